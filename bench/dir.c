@@ -0,0 +1,151 @@
+// This file is part of libkc_system
+// ==================================
+//
+// dir.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Lists a directory of 1M empty files with readdir, with Dir next() and with
+ * the Dir walker on 1, 4 and 8 threads. Pass a different number of entries
+ * as the first argument, and a directory to create them in as the second.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/dir.h"
+#include "../include/file.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_ENTRIES                                                1000000
+#define BENCH_SUBDIRS                                                     64
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static int count_entry(const char* path, const struct DirEntry* entry,
+  void* context)
+{
+  (void)path;
+  (void)entry;
+
+  __atomic_add_fetch((size_t*)context, 1, __ATOMIC_RELAXED);
+
+  return KC_DIR_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void report(const char* name, size_t entries, double seconds)
+{
+  printf("%-16s %10zu %10.3f %12.0f\n", name, entries, seconds * 1e3,
+    entries / seconds);
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  size_t      entries = argc > 1 ? strtoull(argv[1], NULL, 10) : BENCH_ENTRIES;
+  const char* base    = argc > 2 ? argv[2] : ".";
+  char        root[256];
+  char        path[PATH_MAX];
+
+  struct File* file    = new_file();
+  struct Dir*  dir     = new_dir(0);
+  size_t       removed = 0;
+
+  snprintf(root, sizeof(root), "%s/bench_dir", base);
+
+  // the flat directory for the listing, and a tree of the same size to walk
+  snprintf(path, sizeof(path), "%s/flat", root);
+  file->create_path(file, path);
+
+  for (size_t i = 0; i < BENCH_SUBDIRS; ++i)
+  {
+    snprintf(path, sizeof(path), "%s/tree/%zu", root, i);
+    file->create_path(file, path);
+  }
+
+  for (size_t i = 0; i < entries; ++i)
+  {
+    snprintf(path, sizeof(path), "%s/flat/entry_%zu", root, i);
+    close(open(path, O_CREAT | O_WRONLY, 0644));
+
+    snprintf(path, sizeof(path), "%s/tree/%zu/entry_%zu", root,
+      i % BENCH_SUBDIRS, i);
+    close(open(path, O_CREAT | O_WRONLY, 0644));
+  }
+
+  printf("%-16s %10s %10s %12s\n", "method", "entries", "ms", "entries/s");
+
+  snprintf(path, sizeof(path), "%s/flat", root);
+
+  // readdir, checking the type the way a tree walk would
+  double         start = now();
+  DIR*           stream = opendir(path);
+  struct dirent* record = NULL;
+  size_t         count  = 0;
+
+  while ((record = readdir(stream)) != NULL)
+  {
+    count += record->d_type != DT_DIR;
+  }
+
+  closedir(stream);
+  report("readdir", count, now() - start);
+
+  struct DirEntry entry;
+
+  start = now();
+  count = 0;
+  dir->open(dir, path);
+
+  while (dir->next(dir, &entry) == KC_DIR_SUCCESS)
+  {
+    count += entry.type != KC_DIR_DIRECTORY;
+  }
+
+  dir->close(dir);
+  report("dir next", count, now() - start);
+
+  snprintf(path, sizeof(path), "%s/tree", root);
+
+  unsigned threads[] = {1, 4, 8};
+
+  for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i)
+  {
+    char name[32];
+
+    start = now();
+    count = 0;
+    dir->walk(dir, path, threads[i], NULL, count_entry, &count);
+
+    snprintf(name, sizeof(name), "dir walk x%u", threads[i]);
+    report(name, count, now() - start);
+  }
+
+  file->delete_path(file, root, &removed);
+
+  destroy_dir(dir);
+  destroy_file(file);
+
+  return 0;
+}
@@ -0,0 +1,123 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_cache.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Opens a set of 1000 files in random order, once with open and close on
+ * every access, and once through a FileCache large enough to hold them all
+ * and through one that only holds a tenth of them.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file_cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_FILES                                                        1000
+#define BENCH_ROUNDS                                                     500000
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static void run_cache(size_t capacity)
+{
+  struct FileCache* cache = new_file_cache(capacity);
+
+  char     path[64];
+  char     name[32];
+  int      fd   = -1;
+  uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+  double start = now();
+
+  for (int i = 0; i < BENCH_ROUNDS; ++i)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    snprintf(path, sizeof(path), "bench_file_cache/%d",
+      (int)(seed % BENCH_FILES));
+
+    cache->acquire(cache, path, O_RDONLY, &fd);
+    cache->release(cache, fd);
+  }
+
+  double seconds = now() - start;
+
+  snprintf(name, sizeof(name), "cache %zu", capacity);
+  printf("%-12s %10.1f %10zu %10zu %10zu\n", name,
+    seconds * 1e9 / BENCH_ROUNDS, cache->hits, cache->misses,
+    cache->evictions);
+
+  destroy_file_cache(cache);
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  char     path[64];
+  uint64_t seed = 0x9E3779B97F4A7C15ULL;
+
+  mkdir("bench_file_cache", 0777);
+
+  for (int i = 0; i < BENCH_FILES; ++i)
+  {
+    snprintf(path, sizeof(path), "bench_file_cache/%d", i);
+    close(open(path, O_CREAT | O_WRONLY, 0644));
+  }
+
+  printf("%-12s %10s %10s %10s %10s\n", "method", "ns/open", "hits",
+    "misses", "evictions");
+
+  double start = now();
+
+  for (int i = 0; i < BENCH_ROUNDS; ++i)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    snprintf(path, sizeof(path), "bench_file_cache/%d",
+      (int)(seed % BENCH_FILES));
+
+    close(open(path, O_RDONLY | O_CLOEXEC));
+  }
+
+  double seconds = now() - start;
+
+  printf("%-12s %10.1f %10s %10s %10s\n", "open", seconds * 1e9 / BENCH_ROUNDS,
+    "-", "-", "-");
+
+  run_cache(BENCH_FILES);
+  run_cache(BENCH_FILES / 10);
+
+  for (int i = 0; i < BENCH_FILES; ++i)
+  {
+    snprintf(path, sizeof(path), "bench_file_cache/%d", i);
+    unlink(path);
+  }
+
+  rmdir("bench_file_cache");
+
+  return 0;
+}
@@ -0,0 +1,158 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_checksum.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Checksum throughput over a 512 MiB file of random bytes. CRC32C and XXH64
+ * are first run over data already in memory, then over the file: read with
+ * File::read and hashed afterwards, hashed by FileChecksum::compute_file on
+ * one thread and on one per CPU, and read and hashed in one pass with
+ * FileChecksum::read_file. The file is written first, so every method reads
+ * it from the page cache. Pass a directory to create the file there instead
+ * of the working one.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file.h"
+#include "../include/file_checksum.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_FILE_SIZE                                          (512LL << 20)
+#define BENCH_BLOCK_SIZE                                           (1 << 20)
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static void report(const char* name, uint64_t value, double seconds)
+{
+  printf("%-28s  %8.2f  %016llx\n", name, BENCH_FILE_SIZE / seconds / 1e9,
+    (unsigned long long)value);
+}
+
+//---------------------------------------------------------------------------//
+
+static void create_data(const char* path)
+{
+  struct File* file  = new_file();
+  uint64_t*    block = malloc(BENCH_BLOCK_SIZE);
+  uint64_t     seed  = 0x9E3779B97F4A7C15ULL;
+
+  file->open(file, (char*)path, KC_FILE_CREATE_ALWAYS);
+
+  for (long long written = 0; written < BENCH_FILE_SIZE;
+       written += BENCH_BLOCK_SIZE)
+  {
+    for (size_t i = 0; i < BENCH_BLOCK_SIZE / sizeof(uint64_t); ++i)
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+
+      block[i] = seed;
+    }
+
+    file->write_bytes(file, block, BENCH_BLOCK_SIZE);
+  }
+
+  free(block);
+  destroy_file(file);
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  char*    directory = argc > 1 ? argv[1] : ".";
+  unsigned threads   = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+  char     path[512];
+  char     name[64];
+
+  snprintf(path, sizeof(path), "%s/bench_file_checksum", directory);
+
+  create_data(path);
+
+  printf("\n----- BENCH > %lld MiB in %s, %u threads\n\n",
+    BENCH_FILE_SIZE >> 20, directory, threads);
+  printf("%-28s  %8s  %16s\n", "method", "GB/s", "checksum");
+
+  int algorithms[2] = { KC_FILE_CHECKSUM_CRC32C, KC_FILE_CHECKSUM_XXH64 };
+
+  struct File* file   = new_file();
+  char*        buffer = NULL;
+  uint64_t     value  = 0;
+  double       start  = 0;
+
+  file->open(file, path, KC_FILE_READ);
+  file->read(file, &buffer);
+
+  for (int i = 0; i < 2; ++i)
+  {
+    struct FileChecksum* checksum = new_file_checksum(algorithms[i], 0);
+    const char*          label    = i == 0 ? "crc32c" : "xxh64";
+
+    // the hash alone, over data already in memory
+    start = now();
+    checksum->compute(checksum, buffer, BENCH_FILE_SIZE, &value);
+
+    snprintf(name, sizeof(name), "%s memory", label);
+    report(name, value, now() - start);
+
+    // read first, then hashed in a second pass
+    char* data = NULL;
+
+    start = now();
+    file->read(file, &data);
+    checksum->compute(checksum, data, BENCH_FILE_SIZE, &value);
+
+    snprintf(name, sizeof(name), "%s read + compute", label);
+    report(name, value, now() - start);
+
+    free(data);
+
+    start = now();
+    checksum->compute_file(checksum, file, 1, &value);
+
+    snprintf(name, sizeof(name), "%s compute_file", label);
+    report(name, value, now() - start);
+
+    start = now();
+    checksum->compute_file(checksum, file, threads, &value);
+
+    snprintf(name, sizeof(name), "%s compute_file x%u", label, threads);
+    report(name, value, now() - start);
+
+    // read and hashed chunk by chunk
+    start = now();
+    checksum->read_file(checksum, file, threads, &data, NULL, &value);
+
+    snprintf(name, sizeof(name), "%s read_file", label);
+    report(name, value, now() - start);
+
+    free(data);
+    destroy_file_checksum(checksum);
+  }
+
+  free(buffer);
+  file->delete(file);
+  destroy_file(file);
+
+  return 0;
+}
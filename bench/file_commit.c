@@ -0,0 +1,113 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_commit.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Durable commits per second made by a growing number of threads, each one
+ * replacing its own small file with File::atomic_write over and over. Every
+ * commit syncs on its own first, then all threads share a group commit that
+ * waits up to a millisecond for the others. Pass a directory to measure it
+ * instead of the working one.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_COMMITS                                                     50
+#define BENCH_INTERVAL                                                  1000
+#define BENCH_MAX_THREADS                                                 32
+
+struct Worker
+{
+  struct File* file;
+  pthread_t    thread;
+  char         path[512];
+};
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* commit(void* context)
+{
+  struct Worker* worker = (struct Worker*)context;
+
+  char data[256] = "a small record that has to survive a crash";
+
+  for (int i = 0; i < BENCH_COMMITS; ++i)
+  {
+    worker->file->atomic_write(worker->file, worker->path, data,
+      sizeof(data));
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static double run(char* directory, int threads, uint32_t interval)
+{
+  struct File*  file = new_file();
+  struct Worker workers[BENCH_MAX_THREADS];
+
+  file->set_group_commit(file, interval);
+
+  double start = now();
+
+  for (int i = 0; i < threads; ++i)
+  {
+    workers[i].file = file;
+    snprintf(workers[i].path, sizeof(workers[i].path),
+      "%s/bench_file_commit_%d", directory, i);
+
+    pthread_create(&workers[i].thread, NULL, commit, &workers[i]);
+  }
+
+  for (int i = 0; i < threads; ++i)
+  {
+    pthread_join(workers[i].thread, NULL);
+    unlink(workers[i].path);
+  }
+
+  double seconds = now() - start;
+
+  destroy_file(file);
+
+  return threads * BENCH_COMMITS / seconds;
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  char* directory = argc > 1 ? argv[1] : ".";
+
+  printf("\n----- BENCH > File::atomic_write in %s\n\n", directory);
+  printf("%-8s  %14s  %14s\n", "threads", "commits/s", "group commits/s");
+
+  for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2)
+  {
+    printf("%-8d  %14.0f  %14.0f\n", threads, run(directory, threads, 0),
+      run(directory, threads, BENCH_INTERVAL));
+  }
+
+  return 0;
+}
@@ -0,0 +1,157 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_compress.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Compressed files against plain ones, over 256 MiB of log lines. The data is
+ * written once as a plain file and once with KC_FILE_COMPRESSED, then read
+ * back whole with File::read and streamed with File::read_chunk. Throughput
+ * is given for the uncompressed size, next to the size of each file on disk.
+ * Both files stay in the page cache, so the numbers show the cost of the
+ * codec rather than the one of the disk. Pass a directory to create the files
+ * there instead of the working one.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define BENCH_DATA_SIZE                                          (256LL << 20)
+#define BENCH_CHUNK_SIZE                                           (1 << 20)
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static void report(const char* name, const char* path, double seconds)
+{
+  struct stat st;
+  stat(path, &st);
+
+  printf("%-20s  %8.2f  %10.1f  %6.2f\n", name,
+    BENCH_DATA_SIZE / seconds / 1e6, st.st_size / 1048576.0,
+    (double)BENCH_DATA_SIZE / st.st_size);
+}
+
+//---------------------------------------------------------------------------//
+
+static char* create_data()
+{
+  char*    data = malloc(BENCH_DATA_SIZE);
+  uint64_t seed = 0x9E3779B97F4A7C15ULL;
+  size_t   i    = 0;
+
+  const char* levels[4] = { "INFO", "INFO", "WARN", "DEBUG" };
+
+  // lines alike in shape, with ids and timings that keep changing
+  for (size_t n = 0; i < BENCH_DATA_SIZE - 128; ++n)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    i += (size_t)snprintf(data + i, BENCH_DATA_SIZE - i,
+      "2024-05-01T12:%02zu:%02zu.%03zu %-5s worker-%zu request %08llx "
+      "took %llu us\n", n / 60000 % 60, n / 1000 % 60, n % 1000,
+      levels[seed & 3], (size_t)(seed >> 8) % 16,
+      (unsigned long long)(seed >> 16) & 0xFFFFFFFF,
+      (unsigned long long)(seed >> 48) % 5000);
+  }
+
+  for (; i < BENCH_DATA_SIZE; ++i)
+  {
+    data[i] = '\n';
+  }
+
+  return data;
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  char* directory = argc > 1 ? argv[1] : ".";
+  char  paths[2][512];
+
+  snprintf(paths[0], sizeof(paths[0]), "%s/bench_file_plain", directory);
+  snprintf(paths[1], sizeof(paths[1]), "%s/bench_file_compressed",
+    directory);
+
+  printf("\n----- BENCH > %lld MiB of log lines in %s\n\n",
+    BENCH_DATA_SIZE >> 20, directory);
+  printf("%-20s  %8s  %10s  %6s\n", "method", "MB/s", "MiB on disk",
+    "ratio");
+
+  struct File* file   = new_file();
+  char*        data   = create_data();
+  char*        buffer = malloc(BENCH_CHUNK_SIZE);
+  double       start  = 0;
+
+  int modes[2] = { 0, KC_FILE_COMPRESSED };
+
+  for (int i = 0; i < 2; ++i)
+  {
+    const char* label = i == 0 ? "plain" : "compressed";
+    char        name[64];
+
+    start = now();
+    file->open(file, paths[i], KC_FILE_CREATE_ALWAYS | modes[i]);
+    file->write_bytes(file, data, BENCH_DATA_SIZE);
+    file->close(file);
+
+    snprintf(name, sizeof(name), "%s write", label);
+    report(name, paths[i], now() - start);
+
+    // the whole file at once, every block on its own thread
+    char* content = NULL;
+
+    start = now();
+    file->open(file, paths[i], KC_FILE_READ | modes[i]);
+    file->read(file, &content);
+
+    snprintf(name, sizeof(name), "%s read", label);
+    report(name, paths[i], now() - start);
+
+    free(content);
+
+    // block by block, as a stream
+    size_t bytes_read = 0;
+
+    start = now();
+    file->open(file, paths[i], KC_FILE_READ | modes[i]);
+
+    do
+    {
+      file->read_chunk(file, buffer, BENCH_CHUNK_SIZE, &bytes_read);
+    }
+    while (bytes_read > 0);
+
+    snprintf(name, sizeof(name), "%s read_chunk", label);
+    report(name, paths[i], now() - start);
+
+    file->delete(file);
+  }
+
+  free(buffer);
+  free(data);
+  destroy_file(file);
+
+  return 0;
+}
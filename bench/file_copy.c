@@ -0,0 +1,208 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_copy.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Copy throughput of every File::copy strategy, forced one at a time. By
+ * default the copies are made on tmpfs (/dev/shm) and in the working
+ * directory; pass one or more directories to measure those instead, e.g. the
+ * mount point of a loopback disk image formatted with XFS or Btrfs, where
+ * cloning is supported.
+ *
+ * A 1 GiB sparse image, holding 1 MiB of data every 64 MiB, is then copied
+ * with and without KC_FILE_COPY_SPARSE, reporting how much of it ends up
+ * allocated in the copy.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define BENCH_FILE_SIZE                                          (256 << 20)
+#define BENCH_BLOCK_SIZE                                           (1 << 20)
+#define BENCH_ROUNDS                                                      3
+#define BENCH_SPARSE_SIZE                                  (1024LL << 20)
+#define BENCH_SPARSE_STRIDE                                     (64 << 20)
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static void run(char* directory)
+{
+  struct File* file = new_file();
+
+  char from[512];
+  char to[512];
+
+  snprintf(from, sizeof(from), "%s/bench_file_copy_from", directory);
+  snprintf(to, sizeof(to), "%s/bench_file_copy_to", directory);
+
+  static char block[BENCH_BLOCK_SIZE];
+  memset(block, 'x', sizeof(block));
+
+  if (file->open(file, from, KC_FILE_CREATE_ALWAYS) != KC_FILE_SUCCESS)
+  {
+    destroy_file(file);
+    return;
+  }
+
+  for (int i = 0; i < BENCH_FILE_SIZE / BENCH_BLOCK_SIZE; ++i)
+  {
+    file->write_bytes(file, block, sizeof(block));
+  }
+
+  file->close(file);
+
+  int         strategies[] = { KC_FILE_COPY_CLONE, KC_FILE_COPY_RANGE,
+                               KC_FILE_COPY_SENDFILE, KC_FILE_COPY_BUFFER };
+  const char* names[]      = { "clone", "copy_file_range", "sendfile",
+                               "buffer" };
+
+  printf("\n----- BENCH > File::copy %d MiB in %s\n\n", BENCH_FILE_SIZE >> 20,
+    directory);
+
+  for (int i = 0; i < 4; ++i)
+  {
+    double best = 0;
+    int    used = 0;
+
+    // keep the best round, the first one may still be warming up
+    for (int round = 0; round < BENCH_ROUNDS; ++round)
+    {
+      double start = now();
+
+      if (file->copy(file, from, to, strategies[i], &used) != KC_FILE_SUCCESS)
+      {
+        best = 0;
+        break;
+      }
+
+      double seconds = now() - start;
+
+      if (best == 0 || seconds < best)
+      {
+        best = seconds;
+      }
+    }
+
+    if (best == 0)
+    {
+      printf("%-16s  unsupported\n", names[i]);
+    }
+    else
+    {
+      printf("%-16s  %8.2f GB/s\n", names[i], BENCH_FILE_SIZE / best / 1e9);
+    }
+
+    remove(to);
+  }
+
+  remove(from);
+  destroy_file(file);
+}
+
+//---------------------------------------------------------------------------//
+
+static void run_sparse(char* directory)
+{
+  struct File* file = new_file();
+
+  char   from[512];
+  char   to[512];
+  size_t bytes = 0;
+
+  snprintf(from, sizeof(from), "%s/bench_file_copy_sparse", directory);
+  snprintf(to, sizeof(to), "%s/bench_file_copy_to", directory);
+
+  static char block[BENCH_BLOCK_SIZE];
+  memset(block, 'x', sizeof(block));
+
+  if (file->open(file, from, KC_FILE_CREATE_ALWAYS) != KC_FILE_SUCCESS)
+  {
+    destroy_file(file);
+    return;
+  }
+
+  file->truncate(file, BENCH_SPARSE_SIZE);
+
+  for (long long i = 0; i < BENCH_SPARSE_SIZE; i += BENCH_SPARSE_STRIDE)
+  {
+    file->write_at(file, (uint64_t)i, block, sizeof(block), &bytes);
+  }
+
+  file->close(file);
+
+  int         strategies[] = { KC_FILE_COPY_RANGE, KC_FILE_COPY_BUFFER };
+  const char* names[]      = { "copy_file_range", "buffer" };
+
+  printf("\n----- BENCH > File::copy %lld MiB sparse image in %s\n\n",
+    BENCH_SPARSE_SIZE >> 20, directory);
+
+  for (int i = 0; i < 4; ++i)
+  {
+    int         flags = strategies[i / 2] | (i % 2 ? KC_FILE_COPY_SPARSE : 0);
+    int         used  = 0;
+    struct stat st;
+
+    double start   = now();
+    int    ret     = file->copy(file, from, to, flags, &used);
+    double seconds = now() - start;
+
+    if (ret != KC_FILE_SUCCESS || stat(to, &st) != 0)
+    {
+      printf("%-16s %-7s  unsupported\n", names[i / 2], i % 2 ? "sparse" : "");
+      continue;
+    }
+
+    printf("%-16s %-7s  %8.3f s  %6lld MiB allocated\n", names[i / 2],
+      i % 2 ? "sparse" : "", seconds, (long long)st.st_blocks * 512 >> 20);
+
+    remove(to);
+  }
+
+  remove(from);
+  destroy_file(file);
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  if (argc > 1)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      run(argv[i]);
+      run_sparse(argv[i]);
+    }
+
+    return 0;
+  }
+
+  run("/dev/shm");
+  run(".");
+
+  run_sparse("/dev/shm");
+  run_sparse(".");
+
+  return 0;
+}
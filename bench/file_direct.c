@@ -0,0 +1,132 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_direct.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Writes a 512 MiB file in 1 MiB pieces and reads it back whole with
+ * File::read, once through the page cache and once with KC_FILE_DIRECT,
+ * reporting the throughput and the CPU time spent per GB. The buffered file
+ * is dropped from the page cache before it is read, so both reads come from
+ * the device. Pass a directory to measure it instead of the working one.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define BENCH_FILE_SIZE                                          (512 << 20)
+#define BENCH_BLOCK_SIZE                                           (1 << 20)
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static double cpu()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+//---------------------------------------------------------------------------//
+
+static void report(const char* name, double seconds, double cpu_seconds)
+{
+  double gigabytes = BENCH_FILE_SIZE / 1e9;
+
+  printf("%-16s  %8.2f GB/s  %8.3f cpu s/GB\n", name, gigabytes / seconds,
+    cpu_seconds / gigabytes);
+}
+
+//---------------------------------------------------------------------------//
+
+static void run(char* directory, unsigned int direct)
+{
+  struct File* file   = new_file();
+  char*        block  = NULL;
+  char*        buffer = NULL;
+  char         path[512];
+  char         name[32];
+
+  snprintf(path, sizeof(path), "%s/bench_file_direct", directory);
+
+  // the same aligned source buffer for both modes
+  file->alloc_aligned(file, BENCH_BLOCK_SIZE, (void**)&block);
+  memset(block, 'x', BENCH_BLOCK_SIZE);
+
+  if (file->open(file, path, KC_FILE_CREATE_ALWAYS | direct) !=
+      KC_FILE_SUCCESS)
+  {
+    printf("%-16s  unsupported\n", direct ? "direct" : "buffered");
+
+    free(block);
+    destroy_file(file);
+    return;
+  }
+
+  double start     = now();
+  double cpu_start = cpu();
+
+  for (int i = 0; i < BENCH_FILE_SIZE / BENCH_BLOCK_SIZE; ++i)
+  {
+    file->write_bytes(file, block, BENCH_BLOCK_SIZE);
+  }
+
+  // the buffered data only counts once it reached the device
+  file->flush(file);
+  file->advise(file, 0, 0, KC_FILE_ADVISE_DONTNEED);
+
+  snprintf(name, sizeof(name), "%s write", direct ? "direct" : "buffered");
+  report(name, now() - start, cpu() - cpu_start);
+
+  file->open(file, path, KC_FILE_READ | direct);
+
+  start     = now();
+  cpu_start = cpu();
+
+  file->read(file, &buffer);
+
+  snprintf(name, sizeof(name), "%s read", direct ? "direct" : "buffered");
+  report(name, now() - start, cpu() - cpu_start);
+
+  free(buffer);
+  free(block);
+
+  file->delete(file);
+  destroy_file(file);
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  char* directory = argc > 1 ? argv[1] : ".";
+
+  printf("\n----- BENCH > File %d MiB in %s\n\n", BENCH_FILE_SIZE >> 20,
+    directory);
+
+  run(directory, 0);
+  run(directory, KC_FILE_DIRECT);
+
+  return 0;
+}
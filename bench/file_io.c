@@ -0,0 +1,461 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_io.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * The reference numbers of the File I/O paths, meant to be compared between
+ * releases. It times opening and closing a file, creating and deleting files
+ * and nested paths, File::write_bytes and File::read of whole files from
+ * 1 KiB to 4 GiB, growing four times at every step, and write_bytes of small
+ * records. Whole files are read warm, straight after they were written, and
+ * cold, after File::advise dropped them from the page cache; everything else
+ * only runs warm. The largest size is capped to a quarter of the free memory
+ * and half of the free disk space.
+ *
+ * Every operation is timed on its own, small writes in batches, and reported
+ * as throughput and latency percentiles. The same results are written as JSON
+ * to build/bench/file_io.json, or to the path given after the directory. Pass
+ * a directory to create the files there instead of the working one.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MIN_SIZE                                             (1LL << 10)
+#define BENCH_MAX_SIZE                                             (4LL << 30)
+#define BENCH_SIZE_BUDGET                                        (256LL << 20)
+#define BENCH_MIN_SAMPLES                                                    3
+#define BENCH_MAX_SAMPLES                                                 2000
+#define BENCH_META_SAMPLES                                                5000
+#define BENCH_SMALL_WRITES                                           (1 << 20)
+#define BENCH_SMALL_BATCH                                                  256
+
+struct Report
+{
+  struct File* json;
+  bool         first;
+};
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compare_samples(const void* a, const void* b)
+{
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+
+  return (x > y) - (x < y);
+}
+
+//---------------------------------------------------------------------------//
+
+static double percentile(const double* samples, size_t count, double rank)
+{
+  // nearest rank, the samples are already sorted
+  double position = rank * count;
+  size_t index    = (size_t)position;
+
+  index += index < position ? 1 : 0;
+
+  return samples[index > 0 ? index - 1 : 0];
+}
+
+//---------------------------------------------------------------------------//
+
+static void report(struct Report* report, const char* name, const char* cache,
+  long long size, double* samples, size_t count, size_t operations)
+{
+  double total = 0;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    total += samples[i];
+  }
+
+  qsort(samples, count, sizeof(double), compare_samples);
+
+  // a sample covers one operation, or a whole batch of small writes
+  double scale   = 1e6 / (operations / count);
+  double ops     = operations / total;
+  double mbps    = size * ops / 1e6;
+  double p50     = percentile(samples, count, 0.50) * scale;
+  double p90     = percentile(samples, count, 0.90) * scale;
+  double p99     = percentile(samples, count, 0.99) * scale;
+  double p999    = percentile(samples, count, 0.999) * scale;
+  double maximum = samples[count - 1] * scale;
+
+  printf("%-12s  %-4s  %10lld  %7zu  %9.2f  %10.0f  %9.2f  %9.2f  %9.2f  "
+    "%9.2f  %9.2f\n", name, cache, size, operations, mbps, ops, p50, p90,
+    p99, p999, maximum);
+
+  char line[512];
+
+  snprintf(line, sizeof(line), "%s\n    {\"name\": \"%s\", \"cache\": \"%s\", "
+    "\"size\": %lld, \"operations\": %zu, \"mb_per_s\": %.3f, "
+    "\"ops_per_s\": %.1f, \"latency_us\": {\"p50\": %.3f, \"p90\": %.3f, "
+    "\"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f}}",
+    report->first == true ? "" : ",", name, cache, size, operations, mbps,
+    ops, p50, p90, p99, p999, maximum);
+
+  report->json->write(report->json, line);
+  report->first = false;
+}
+
+//---------------------------------------------------------------------------//
+
+static void report_string(struct Report* report, const char* value)
+{
+  char escaped[8];
+
+  // quotes, backslashes and control characters can not appear as they are
+  for (; *value != '\0'; ++value)
+  {
+    unsigned char c = (unsigned char)*value;
+
+    if (c == '"' || c == '\\')
+    {
+      snprintf(escaped, sizeof(escaped), "\\%c", c);
+    }
+    else if (c < 0x20)
+    {
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+    }
+    else
+    {
+      snprintf(escaped, sizeof(escaped), "%c", c);
+    }
+
+    report->json->write(report->json, escaped);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void bench_metadata(struct Report* out, const char* directory)
+{
+  struct File* file    = new_file();
+  double*      created = malloc(sizeof(double) * BENCH_META_SAMPLES);
+  double*      deleted = malloc(sizeof(double) * BENCH_META_SAMPLES);
+  char         path[512];
+  double       start   = 0;
+
+  if (created == NULL || deleted == NULL)
+  {
+    fprintf(stderr, "out of memory, metadata skipped\n");
+
+    free(created);
+    free(deleted);
+    destroy_file(file);
+
+    return;
+  }
+
+  // a single file opened and closed over and over
+  snprintf(path, sizeof(path), "%s/bench_file_io", directory);
+
+  file->open(file, path, KC_FILE_CREATE_ALWAYS);
+  file->write(file, "open and close");
+  file->close(file);
+
+  for (int i = 0; i < BENCH_META_SAMPLES; ++i)
+  {
+    start = now();
+    file->open(file, path, KC_FILE_READ);
+    file->close(file);
+    created[i] = now() - start;
+  }
+
+  report(out, "open_close", "warm", 0, created, BENCH_META_SAMPLES,
+    BENCH_META_SAMPLES);
+
+  file->open(file, path, KC_FILE_READ);
+  file->delete(file);
+
+  // new files, each one removed right after it was made
+  for (int i = 0; i < BENCH_META_SAMPLES; ++i)
+  {
+    snprintf(path, sizeof(path), "%s/bench_file_io_%d", directory, i);
+
+    start = now();
+    file->open(file, path, KC_FILE_CREATE_NEW);
+    file->close(file);
+    created[i] = now() - start;
+
+    file->open(file, path, KC_FILE_READ);
+
+    start = now();
+    file->delete(file);
+    deleted[i] = now() - start;
+  }
+
+  report(out, "create", "warm", 0, created, BENCH_META_SAMPLES,
+    BENCH_META_SAMPLES);
+  report(out, "delete", "warm", 0, deleted, BENCH_META_SAMPLES,
+    BENCH_META_SAMPLES);
+
+  // three new directories below each root, removed with the root
+  for (int i = 0; i < BENCH_META_SAMPLES; ++i)
+  {
+    snprintf(path, sizeof(path), "%s/bench_file_io_%d/a/b/c", directory, i);
+
+    start = now();
+    file->create_path(file, path);
+    created[i] = now() - start;
+
+    snprintf(path, sizeof(path), "%s/bench_file_io_%d", directory, i);
+
+    start = now();
+    file->delete_path(file, path, NULL);
+    deleted[i] = now() - start;
+  }
+
+  report(out, "create_path", "warm", 0, created, BENCH_META_SAMPLES,
+    BENCH_META_SAMPLES);
+  report(out, "delete_path", "warm", 0, deleted, BENCH_META_SAMPLES,
+    BENCH_META_SAMPLES);
+
+  free(created);
+  free(deleted);
+  destroy_file(file);
+}
+
+//---------------------------------------------------------------------------//
+
+static void bench_size(struct Report* out, char* path, const char* data,
+  long long size)
+{
+  struct File* file    = new_file();
+  long long    count   = BENCH_SIZE_BUDGET / size;
+  char*        content = NULL;
+  double       start   = 0;
+
+  count = count < BENCH_MIN_SAMPLES ? BENCH_MIN_SAMPLES : count;
+  count = count > BENCH_MAX_SAMPLES ? BENCH_MAX_SAMPLES : count;
+
+  double* samples = malloc(sizeof(double) * count);
+
+  if (samples == NULL)
+  {
+    fprintf(stderr, "out of memory, %lld bytes skipped\n", size);
+    destroy_file(file);
+
+    return;
+  }
+
+  for (long long i = 0; i < count; ++i)
+  {
+    start = now();
+    file->open(file, path, KC_FILE_CREATE_ALWAYS);
+    file->write_bytes(file, data, (size_t)size);
+    file->close(file);
+    samples[i] = now() - start;
+  }
+
+  report(out, "write", "warm", size, samples, count, count);
+
+  // dirty pages can not be dropped, the last copy is written out
+  file->open(file, path, KC_FILE_CREATE_ALWAYS);
+  file->write_bytes(file, data, (size_t)size);
+  file->sync(file);
+  file->close(file);
+
+  for (long long i = 0; i < count; ++i)
+  {
+    start = now();
+    file->open(file, path, KC_FILE_READ);
+    file->read(file, &content);
+    file->close(file);
+    samples[i] = now() - start;
+
+    free(content);
+  }
+
+  report(out, "read", "warm", size, samples, count, count);
+
+  for (long long i = 0; i < count; ++i)
+  {
+    file->open(file, path, KC_FILE_READ);
+    file->advise(file, 0, 0, KC_FILE_ADVISE_DONTNEED);
+    file->close(file);
+
+    start = now();
+    file->open(file, path, KC_FILE_READ);
+    file->read(file, &content);
+    file->close(file);
+    samples[i] = now() - start;
+
+    free(content);
+  }
+
+  report(out, "read", "cold", size, samples, count, count);
+
+  free(samples);
+  destroy_file(file);
+}
+
+//---------------------------------------------------------------------------//
+
+static void bench_small_writes(struct Report* out, char* path,
+  const char* data, size_t size)
+{
+  struct File* file    = new_file();
+  size_t       count   = BENCH_SMALL_WRITES / BENCH_SMALL_BATCH;
+  double*      samples = malloc(sizeof(double) * count);
+  double       start   = 0;
+
+  if (samples == NULL)
+  {
+    fprintf(stderr, "out of memory, %zu byte records skipped\n", size);
+    destroy_file(file);
+
+    return;
+  }
+
+  file->open(file, path, KC_FILE_CREATE_ALWAYS);
+
+  // a single write is too short to time, a batch of them is timed instead
+  for (size_t i = 0; i < count; ++i)
+  {
+    start = now();
+
+    for (int j = 0; j < BENCH_SMALL_BATCH; ++j)
+    {
+      file->write_bytes(file, data, size);
+    }
+
+    samples[i] = now() - start;
+  }
+
+  file->delete(file);
+
+  report(out, "small_write", "warm", (long long)size, samples, count,
+    BENCH_SMALL_WRITES);
+
+  free(samples);
+  destroy_file(file);
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  char*     directory = argc > 1 ? argv[1] : ".";
+  char*     output    = argc > 2 ? argv[2] : "build/bench/file_io.json";
+  long long maximum   = BENCH_MAX_SIZE;
+  char      path[512];
+
+  snprintf(path, sizeof(path), "%s/bench_file_io", directory);
+
+  // the data is written from memory and read back into memory
+  long long memory = (long long)sysconf(_SC_AVPHYS_PAGES) *
+    sysconf(_SC_PAGESIZE) / 4;
+
+  struct statvfs fs;
+
+  if (statvfs(directory, &fs) == 0)
+  {
+    long long space = (long long)fs.f_bavail * (long long)fs.f_frsize / 2;
+    maximum = space < maximum ? space : maximum;
+  }
+
+  maximum = memory < maximum ? memory : maximum;
+
+  char* data = malloc((size_t)(maximum > 0 ? maximum : 1));
+
+  // the largest size is given up on until its data fits in memory
+  while (data == NULL && maximum > BENCH_MIN_SIZE)
+  {
+    maximum /= 4;
+    data     = malloc((size_t)maximum);
+  }
+
+  if (data == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+
+    return 1;
+  }
+
+  for (long long i = 0; i < maximum; ++i)
+  {
+    data[i] = (char)('a' + i % 26);
+  }
+
+  // the JSON report is written next to the others, its directory may be new
+  struct File*  json   = new_file();
+  struct Report report = { json, true };
+  char          folder[512];
+
+  snprintf(folder, sizeof(folder), "%s", output);
+
+  if (strrchr(folder, '/') != NULL)
+  {
+    *strrchr(folder, '/') = '\0';
+    json->create_path(json, folder);
+  }
+
+  if (json->open(json, output, KC_FILE_CREATE_ALWAYS) != KC_FILE_SUCCESS)
+  {
+    fprintf(stderr, "can not create %s\n", output);
+    destroy_file(json);
+    free(data);
+
+    return 1;
+  }
+
+  json->write(json, "{\n  \"bench\": \"file_io\",\n  \"directory\": \"");
+  report_string(&report, directory);
+  json->write(json, "\",\n  \"results\": [");
+
+  printf("\n----- BENCH > files up to %lld MiB in %s, latency in us\n\n",
+    maximum >> 20, directory);
+  printf("%-12s  %-4s  %10s  %7s  %9s  %10s  %9s  %9s  %9s  %9s  %9s\n",
+    "operation", "run", "size", "ops", "MB/s", "ops/s", "p50", "p90", "p99",
+    "p99.9", "max");
+
+  bench_metadata(&report, directory);
+
+  for (long long size = BENCH_MIN_SIZE; size <= maximum; size *= 4)
+  {
+    bench_size(&report, path, data, size);
+  }
+
+  size_t records[3] = { 16, 128, 1024 };
+
+  for (int i = 0; i < 3; ++i)
+  {
+    bench_small_writes(&report, path, data, records[i]);
+  }
+
+  free(data);
+
+  remove(path);
+
+  json->write(json, "\n  ]\n}\n");
+  destroy_file(json);
+
+  printf("\nresults written to %s\n", output);
+
+  return 0;
+}
@@ -0,0 +1,142 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_journal.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Appends 64 byte records to a FileJournal from a growing number of threads
+ * and reports the appends per second, counting until a final flush() has put
+ * every record on disk. Segments are 64 MiB. Pass a directory to measure it
+ * instead of the working one.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file_journal.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_APPENDS                                                  4000000
+#define BENCH_RECORD_SIZE                                                   64
+#define BENCH_SEGMENT_SIZE                                           (64 << 20)
+#define BENCH_MAX_THREADS                                                    8
+
+struct Worker
+{
+  struct FileJournal* journal;
+  pthread_t           thread;
+  int                 appends;
+};
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* produce(void* context)
+{
+  struct Worker* worker = (struct Worker*)context;
+
+  char record[BENCH_RECORD_SIZE] = "a small record appended to the journal";
+
+  for (int i = 0; i < worker->appends; ++i)
+  {
+    worker->journal->append(worker->journal, record, sizeof(record));
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static void delete_journal(char* path)
+{
+  DIR*           dir   = opendir(path);
+  struct dirent* entry = NULL;
+  char           name[1024];
+
+  while (dir != NULL && (entry = readdir(dir)) != NULL)
+  {
+    if (entry->d_name[0] != '.')
+    {
+      snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+      unlink(name);
+    }
+  }
+
+  if (dir != NULL)
+  {
+    closedir(dir);
+  }
+
+  rmdir(path);
+}
+
+//---------------------------------------------------------------------------//
+
+static void run(char* directory, int threads)
+{
+  char path[512];
+
+  snprintf(path, sizeof(path), "%s/bench_file_journal", directory);
+
+  struct FileJournal* journal = new_file_journal(path, BENCH_SEGMENT_SIZE);
+  struct Worker       workers[BENCH_MAX_THREADS];
+
+  double start = now();
+
+  for (int i = 0; i < threads; ++i)
+  {
+    workers[i].journal = journal;
+    workers[i].appends = BENCH_APPENDS / threads;
+
+    pthread_create(&workers[i].thread, NULL, produce, &workers[i]);
+  }
+
+  for (int i = 0; i < threads; ++i)
+  {
+    pthread_join(workers[i].thread, NULL);
+  }
+
+  journal->flush(journal);
+
+  double seconds = now() - start;
+
+  printf("%-8d  %14.0f  %10.1f\n", threads, BENCH_APPENDS / seconds,
+    BENCH_APPENDS * (BENCH_RECORD_SIZE + 8) / seconds / 1e6);
+
+  destroy_file_journal(journal);
+  delete_journal(path);
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  char* directory = argc > 1 ? argv[1] : ".";
+
+  printf("\n----- BENCH > FileJournal::append %d byte records in %s\n\n",
+    BENCH_RECORD_SIZE, directory);
+  printf("%-8s  %14s  %10s\n", "threads", "appends/s", "MB/s");
+
+  for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2)
+  {
+    run(directory, threads);
+  }
+
+  return 0;
+}
@@ -0,0 +1,167 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_lines.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Lines per second over a 1 GiB text file of random lines, 63 bytes long on
+ * average, read with a getline loop, split with strchr after File::read, and
+ * split by File::for_each_line streaming through its own buffer and over a
+ * mapped view. The file is written first, so every method reads it from the
+ * page cache. Pass a directory to create the file there instead of the
+ * working one.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE_SIZE                                         (1024LL << 20)
+#define BENCH_BLOCK_SIZE                                           (1 << 20)
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static int count_line(const char* line, size_t size, void* context)
+{
+  size_t* bytes = (size_t*)context;
+
+  (*bytes) += size + 1;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void report(const char* name, size_t lines, double seconds)
+{
+  printf("%-20s  %12.0f  %8.2f\n", name, lines / seconds,
+    BENCH_FILE_SIZE / seconds / 1e9);
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t create_lines(const char* path)
+{
+  struct File* file  = new_file();
+  char*        block = malloc(BENCH_BLOCK_SIZE);
+  size_t       lines = 0;
+  uint64_t     seed  = 0x9E3779B97F4A7C15ULL;
+
+  file->open(file, (char*)path, KC_FILE_CREATE_ALWAYS);
+
+  // random line lengths, so the delimiters never line up with the vectors
+  for (long long written = 0; written < BENCH_FILE_SIZE;
+       written += BENCH_BLOCK_SIZE)
+  {
+    for (size_t i = 0; i < BENCH_BLOCK_SIZE; ++i)
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+
+      block[i] = seed % 64 == 0 ? '\n' : (char)('a' + seed % 26);
+      lines   += block[i] == '\n';
+    }
+
+    file->write_bytes(file, block, BENCH_BLOCK_SIZE);
+  }
+
+  free(block);
+  destroy_file(file);
+
+  return lines;
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  char* directory = argc > 1 ? argv[1] : ".";
+  char  path[512];
+
+  snprintf(path, sizeof(path), "%s/bench_file_lines", directory);
+
+  size_t lines = create_lines(path);
+
+  printf("\n----- BENCH > %zu lines in %lld MiB in %s\n\n", lines,
+    BENCH_FILE_SIZE >> 20, directory);
+  printf("%-20s  %12s  %8s\n", "method", "lines/s", "GB/s");
+
+  // getline, one call and one copy per line
+  FILE*   stream = fopen(path, "r");
+  char*   line   = NULL;
+  size_t  size   = 0;
+  size_t  count  = 0;
+  double  start  = now();
+
+  while (getline(&line, &size, stream) != -1)
+  {
+    ++count;
+  }
+
+  report("getline", count, now() - start);
+
+  free(line);
+  fclose(stream);
+
+  // the whole file in one buffer, split with strchr
+  struct File* file   = new_file();
+  char*        buffer = NULL;
+  size_t       bytes  = 0;
+
+  file->open(file, path, KC_FILE_READ);
+
+  count = 0;
+  start = now();
+
+  file->read(file, &buffer);
+
+  for (char* next = buffer; (next = strchr(next, '\n')) != NULL; ++next)
+  {
+    ++count;
+  }
+
+  report("read + strchr", count, now() - start);
+
+  free(buffer);
+
+  // streamed through the default buffer
+  start = now();
+
+  file->for_each_line(file, NULL, 0, '\n', count_line, &bytes);
+
+  report("for_each_line", lines, now() - start);
+
+  // split in place over the mapped file
+  file->open(file, path, KC_FILE_MMAP);
+
+  start = now();
+
+  file->for_each_line(file, NULL, 0, '\n', count_line, &bytes);
+
+  report("for_each_line mmap", lines, now() - start);
+
+  file->unmap(file);
+  file->delete(file);
+  destroy_file(file);
+
+  return 0;
+}
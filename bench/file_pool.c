@@ -0,0 +1,84 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_pool.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Opens and closes the same file over and over, once with a File created and
+ * destroyed around every open, and once with a File taken from a FilePool.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file_pool.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_ROUNDS                                                     200000
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  struct FilePool* pool = new_file_pool(1);
+  struct File*     file = new_file();
+
+  file->open(file, "bench_file_pool", KC_FILE_CREATE_ALWAYS);
+  file->delete(file);
+  file->open(file, "bench_file_pool", KC_FILE_CREATE_ALWAYS);
+  file->close(file);
+
+  printf("%-10s %10s %12s\n", "method", "ns/open", "opens/s");
+
+  double start = now();
+
+  for (int i = 0; i < BENCH_ROUNDS; ++i)
+  {
+    struct File* heap = new_file();
+
+    heap->open(heap, "bench_file_pool", KC_FILE_READ);
+    destroy_file(heap);
+  }
+
+  double seconds = now() - start;
+
+  printf("%-10s %10.1f %12.0f\n", "new_file", seconds * 1e9 / BENCH_ROUNDS,
+    BENCH_ROUNDS / seconds);
+
+  start = now();
+
+  for (int i = 0; i < BENCH_ROUNDS; ++i)
+  {
+    struct File* pooled = NULL;
+
+    pool->acquire(pool, &pooled);
+    pooled->open(pooled, "bench_file_pool", KC_FILE_READ);
+    pool->release(pool, pooled);
+  }
+
+  seconds = now() - start;
+
+  printf("%-10s %10.1f %12.0f\n", "file pool", seconds * 1e9 / BENCH_ROUNDS,
+    BENCH_ROUNDS / seconds);
+
+  file->delete(file);
+
+  destroy_file(file);
+  destroy_file_pool(pool);
+
+  return 0;
+}
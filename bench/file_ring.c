@@ -0,0 +1,151 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_ring.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Random 4 KiB reads through a FileRing, at queue depths 1, 8, 32 and 128,
+ * for every available backend. Pass the path of an existing file to read it
+ * instead of the generated one (e.g. a large file on an NVMe drive).
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FILE_SIZE                                           (64 << 20)
+#define BENCH_BLOCK_SIZE                                           (4 << 10)
+#define BENCH_TOTAL_READS                                             65536
+#define BENCH_MAX_DEPTH                                                 128
+
+//---------------------------------------------------------------------------//
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+
+static void run(struct File* file, uint64_t size, int backend, unsigned depth)
+{
+  struct FileRing* ring = new_file_ring(depth, backend);
+
+  if (ring == NULL)
+  {
+    printf("%-10s %6u  unavailable\n",
+      backend == KC_FILE_RING_IO_URING ? "io_uring" : "threads", depth);
+
+    return;
+  }
+
+  static char           blocks[BENCH_MAX_DEPTH][BENCH_BLOCK_SIZE];
+  struct FileCompletion completions[BENCH_MAX_DEPTH];
+
+  uint64_t seed      = 0x9E3779B97F4A7C15ULL;
+  uint64_t blocks_nr = size / BENCH_BLOCK_SIZE;
+  unsigned submitted = 0;
+  unsigned completed = 0;
+  unsigned count     = 0;
+
+  double start = now();
+
+  // keep the queue full until every read is submitted
+  while (completed < BENCH_TOTAL_READS)
+  {
+    while (ring->pending < depth && submitted < BENCH_TOTAL_READS)
+    {
+      seed ^= seed << 13;
+      seed ^= seed >> 7;
+      seed ^= seed << 17;
+
+      ring->submit_read(ring, file, (seed % blocks_nr) * BENCH_BLOCK_SIZE,
+        blocks[submitted % depth], BENCH_BLOCK_SIZE, NULL);
+
+      ++submitted;
+    }
+
+    ring->poll_completions(ring, completions, depth, 1, &count);
+    completed += count;
+  }
+
+  double seconds = now() - start;
+
+  printf("%-10s %6u  %10.0f IOPS  %8.1f MiB/s\n",
+    ring->backend == KC_FILE_RING_IO_URING ? "io_uring" : "threads", depth,
+    BENCH_TOTAL_READS / seconds,
+    BENCH_TOTAL_READS * (double)BENCH_BLOCK_SIZE / (1 << 20) / seconds);
+
+  destroy_file_ring(ring);
+}
+
+//---------------------------------------------------------------------------//
+
+int main(int argc, char** argv)
+{
+  struct File* file = new_file();
+  char*        name = argc > 1 ? argv[1] : "bench_file_ring";
+  uint64_t     size = BENCH_FILE_SIZE;
+
+  // generate the input file unless one was given
+  if (argc <= 1)
+  {
+    static char block[BENCH_BLOCK_SIZE];
+    memset(block, 'x', sizeof(block));
+
+    file->open(file, name, KC_FILE_CREATE_ALWAYS);
+
+    for (uint64_t i = 0; i < size; i += sizeof(block))
+    {
+      file->write_bytes(file, block, sizeof(block));
+    }
+  }
+
+  if (file->open(file, name, KC_FILE_READ) != KC_FILE_SUCCESS)
+  {
+    destroy_file(file);
+    return 1;
+  }
+
+  if (argc > 1)
+  {
+    fseeko(file->file, 0, SEEK_END);
+    size = (uint64_t)ftello(file->file);
+  }
+
+  printf("\n----- BENCH > FileRing random %d KiB reads\n\n",
+    BENCH_BLOCK_SIZE >> 10);
+  printf("%-10s %6s\n", "backend", "depth");
+
+  unsigned depths[] = { 1, 8, 32, 128 };
+
+  for (int i = 0; i < 4; ++i)
+  {
+    run(file, size, KC_FILE_RING_IO_URING, depths[i]);
+  }
+
+  for (int i = 0; i < 4; ++i)
+  {
+    run(file, size, KC_FILE_RING_THREADS, depths[i]);
+  }
+
+  if (argc <= 1)
+  {
+    file->delete(file);
+  }
+
+  destroy_file(file);
+
+  return 0;
+}
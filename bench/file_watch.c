@@ -0,0 +1,188 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_watch.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * Finds the handful of files changed between two rounds in a tree of 10000
+ * files, once by calling stat on every file and comparing the modification
+ * times, and once through a recursive FileWatch. Each round changes 10 random
+ * files; the CPU time spent noticing them is reported per round.
+ */
+
+#define _GNU_SOURCE
+
+#include "../include/file_watch.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BENCH_DIRS                                                         100
+#define BENCH_FILES                                                        100
+#define BENCH_CHANGES                                                       10
+#define BENCH_ROUNDS                                                        50
+
+//---------------------------------------------------------------------------//
+
+static double cpu()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+//---------------------------------------------------------------------------//
+
+static int count_changes(const struct FileChange* changes, size_t count,
+  void* context)
+{
+  (*(size_t*)context) += count;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void change_files(uint64_t* seed)
+{
+  char path[64];
+
+  for (int i = 0; i < BENCH_CHANGES; ++i)
+  {
+    (*seed) ^= (*seed) << 13;
+    (*seed) ^= (*seed) >> 7;
+    (*seed) ^= (*seed) << 17;
+
+    snprintf(path, sizeof(path), "bench_file_watch/%d/%d",
+      (int)((*seed) % BENCH_DIRS), (int)((*seed) / BENCH_DIRS % BENCH_FILES));
+
+    int fd = open(path, O_WRONLY | O_APPEND);
+
+    write(fd, "x", 1);
+    close(fd);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t rescan(struct timespec* times)
+{
+  char        path[64];
+  size_t      changed = 0;
+  struct stat st;
+
+  // the whole tree, every round, to find the few files that changed
+  for (int d = 0; d < BENCH_DIRS; ++d)
+  {
+    for (int f = 0; f < BENCH_FILES; ++f)
+    {
+      struct timespec* last = &times[d * BENCH_FILES + f];
+
+      snprintf(path, sizeof(path), "bench_file_watch/%d/%d", d, f);
+      stat(path, &st);
+
+      if (st.st_mtim.tv_sec != last->tv_sec ||
+          st.st_mtim.tv_nsec != last->tv_nsec)
+      {
+        (*last) = st.st_mtim;
+        changed += 1;
+      }
+    }
+  }
+
+  return changed;
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  char             path[64];
+  struct timespec* times = calloc(BENCH_DIRS * BENCH_FILES,
+    sizeof(struct timespec));
+
+  mkdir("bench_file_watch", 0777);
+
+  for (int d = 0; d < BENCH_DIRS; ++d)
+  {
+    snprintf(path, sizeof(path), "bench_file_watch/%d", d);
+    mkdir(path, 0777);
+
+    for (int f = 0; f < BENCH_FILES; ++f)
+    {
+      snprintf(path, sizeof(path), "bench_file_watch/%d/%d", d, f);
+      close(open(path, O_CREAT | O_WRONLY, 0644));
+    }
+  }
+
+  printf("\n----- BENCH > %d files, %d changed per round\n\n",
+    BENCH_DIRS * BENCH_FILES, BENCH_CHANGES);
+  printf("%-12s %14s %14s\n", "method", "cpu us/round", "changes/round");
+
+  uint64_t seed    = 0x9E3779B97F4A7C15ULL;
+  size_t   changed = 0;
+  double   spent   = 0;
+
+  // the times every later round is compared with
+  rescan(times);
+
+  for (int i = 0; i < BENCH_ROUNDS; ++i)
+  {
+    change_files(&seed);
+
+    double start = cpu();
+    changed += rescan(times);
+    spent   += cpu() - start;
+  }
+
+  printf("%-12s %14.1f %14.1f\n", "stat rescan", spent * 1e6 / BENCH_ROUNDS,
+    (double)changed / BENCH_ROUNDS);
+
+  // the changes of a round are all in before they are collected
+  struct FileWatch* watch = new_file_watch(0);
+
+  watch->add(watch, "bench_file_watch", KC_FILE_WATCH_RECURSIVE);
+
+  changed = 0;
+  spent   = 0;
+
+  for (int i = 0; i < BENCH_ROUNDS; ++i)
+  {
+    change_files(&seed);
+
+    double start = cpu();
+    watch->dispatch(watch, 0, count_changes, &changed);
+    spent += cpu() - start;
+  }
+
+  printf("%-12s %14.1f %14.1f\n", "file watch", spent * 1e6 / BENCH_ROUNDS,
+    (double)changed / BENCH_ROUNDS);
+
+  destroy_file_watch(watch);
+
+  for (int d = 0; d < BENCH_DIRS; ++d)
+  {
+    for (int f = 0; f < BENCH_FILES; ++f)
+    {
+      snprintf(path, sizeof(path), "bench_file_watch/%d/%d", d, f);
+      unlink(path);
+    }
+
+    snprintf(path, sizeof(path), "bench_file_watch/%d", d);
+    rmdir(path);
+  }
+
+  rmdir("bench_file_watch");
+  free(times);
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+// This file is part of libkc_system
+// ==================================
+//
+// dir.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A structure representing directory enumeration in libkc_system.
+ *
+ * The Dir structure lists the entries of a directory straight from the
+ * kernel, many entries per system call, and reports the type of every entry
+ * without an extra stat. It can also walk a whole tree on several threads,
+ * handing every entry to a visitor callback, optionally behind a filter.
+ *
+ * Both callbacks receive the path of the directory being listed and one of
+ * its entries. When walking on more than one thread, they are called
+ * concurrently and must be thread safe.
+ */
+
+#ifndef DIR_H
+#define DIR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_DIR_UNKNOWN                                               0x00000000
+#define KC_DIR_FILE                                                  0x00000001
+#define KC_DIR_DIRECTORY                                             0x00000002
+#define KC_DIR_LINK                                                  0x00000004
+#define KC_DIR_OTHER                                                 0x00000008
+
+//---------------------------------------------------------------------------//
+
+#define KC_DIR_SUCCESS                                               0x00000000
+#define KC_DIR_END                                                   0x00000001
+#define KC_DIR_CLOSED                                                0x00000002
+#define KC_DIR_INVALID                                              -0x00000001
+
+//---------------------------------------------------------------------------//
+
+struct DirEntry
+{
+  const char* name;
+  uint64_t    inode;
+  int         type;
+};
+
+struct Dir
+{
+  struct ConsoleLog* log;
+
+  int    fd;
+  char*  path;
+  bool   opened;
+
+  char*  buffer;
+  size_t buffer_size;
+  size_t position;
+  size_t length;
+
+  int (*close) (struct Dir* self);
+  int (*next)  (struct Dir* self, struct DirEntry* entry);
+  int (*open)  (struct Dir* self, const char* path);
+  int (*walk)  (struct Dir* self, const char* path, unsigned threads, bool (*filter)(const char* path, const struct DirEntry* entry, void* context), int (*visit)(const char* path, const struct DirEntry* entry, void* context), void* context);
+};
+
+// the constructor should be used to create new directories
+struct Dir* new_dir(size_t buffer_size);
+
+// the destructor should be used to destroy directories
+void destroy_dir(struct Dir* dir);
+
+#endif /* DIR_H */
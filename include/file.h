@@ -12,13 +12,58 @@
  * The File structure encapsulates file interactions, providing methods to 
  * manipulate files, retrieve file metadata, and perform file operations within
  * the libkc_system library.
+ *
+ * Combining KC_FILE_DIRECT with a read or write mode moves the data between
+ * the device and the caller without going through the page cache. The File
+ * keeps a block aligned staging buffer for requests that are not aligned and
+ * for the partial block at the end of the file; buffers from alloc_aligned()
+ * skip it entirely. read_at() and write_at() are passed through unchanged and
+ * need block aligned buffers, offsets and sizes in this mode.
+ *
+ * atomic_write() replaces a file so that after a crash either the old or the
+ * new content is found, never a mix. With set_group_commit(), the syncs that
+ * sync() and atomic_write() wait for are shared by every thread using the same
+ * File; a sync waits up to the interval, in microseconds, for more threads to
+ * join it. Turning it off with an interval of zero waits for the threads that
+ * already joined a batch, while new syncs no longer join one.
+ *
+ * set_buffer() gives the stream of the File a buffer of the given size, so
+ * small writes reach the kernel together; it is handed to the stream by the
+ * next open() and can not be changed while a file is open.
+ *
+ * copy() writes the copy next to the destination and renames it over the
+ * destination once it is complete, so a failed copy leaves the destination as
+ * it was; a file is never copied onto itself or onto a hard link to it.
+ *
+ * for_each_line() splits the file at every delimiter and hands each record to
+ * the callback, without the delimiter, and for '\n' without a carriage return
+ * before it. The records point into the buffer they were read into, or into
+ * the mapped view for KC_FILE_MMAP files, and are only valid until the
+ * callback returns; only a record cut by the end of a chunk is copied.
+ *
+ * Combining KC_FILE_COMPRESSED with a write mode compresses everything written
+ * in independent LZ4 blocks, several at once on as many threads; close()
+ * writes an index of the blocks at the end. Combined with a read mode, the
+ * data is decompressed as it is read, read_at() offsets are offsets into the
+ * decompressed data, found through the index, and read() decompresses every
+ * block at once. flush() and sync() end the current block early. Compressed
+ * files can not be appended to, truncated, mapped or opened for direct I/O.
+ *
+ * In a library built with KC_SYSTEM_STATS, every open, close, read, write,
+ * flush and sync is timed and counted, see system_stats.h; get_stats() returns
+ * the totals of a single File, which are empty otherwise.
  */
 
 #ifndef FILE_H
 #define FILE_H
 
+#include "system_stats.h"
+
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <sys/uio.h>
 
 //---------------------------------------------------------------------------//
 
@@ -32,6 +77,27 @@
 #define KC_FILE_DELETE                                               0x00000040
 #define KC_FILE_CLOSED                                               0x00000080
 #define KC_FILE_DIR_NOT_EMPTY                                        0x00000100
+#define KC_FILE_MMAP                                                 0x00000200
+#define KC_FILE_DIRECT                                               0x00000400
+#define KC_FILE_COMPRESSED                                           0x00000800
+
+//---------------------------------------------------------------------------//
+
+#define KC_FILE_COPY_CLONE                                           0x00000001
+#define KC_FILE_COPY_RANGE                                           0x00000002
+#define KC_FILE_COPY_SENDFILE                                        0x00000004
+#define KC_FILE_COPY_BUFFER                                          0x00000008
+#define KC_FILE_COPY_ANY                                             0x0000000F
+#define KC_FILE_COPY_SPARSE                                          0x00000010
+
+//---------------------------------------------------------------------------//
+
+#define KC_FILE_ADVISE_NORMAL                                        0x00000000
+#define KC_FILE_ADVISE_SEQUENTIAL                                    0x00000001
+#define KC_FILE_ADVISE_RANDOM                                        0x00000002
+#define KC_FILE_ADVISE_WILLNEED                                      0x00000003
+#define KC_FILE_ADVISE_DONTNEED                                      0x00000004
+#define KC_FILE_ADVISE_NOREUSE                                       0x00000005
 
 //---------------------------------------------------------------------------//
 
@@ -48,18 +114,69 @@ struct File
   int   mode;
   bool  opened;
 
-  int (*close)        (struct File* self);
-  int (*create_path)  (struct File* self, char* path);
-  int (*delete)       (struct File* self);
-  int (*delete_path)  (struct File* self, char* path);
-  int (*get_mode)     (struct File* self, int* mode);
-  int (*get_name)     (struct File* self, char** name);
-  int (*get_path)     (struct File* self, char** path);
-  int (*is_open)      (struct File* self, bool* is_open);
-  int (*move)         (struct File* self, char* from, char* to);
-  int (*open)         (struct File* self, char* name, unsigned int mode);
-  int (*read)         (struct File* self, char** buffer);
-  int (*write)        (struct File* self, char* buffer);
+  char*  name_storage;
+  size_t name_size;
+
+  const char* mapped;
+  size_t      mapped_size;
+
+  char*  buffer;
+  size_t buffer_size;
+  bool   path_cache;
+
+  bool     drop_behind;
+  uint64_t drop_offset;
+
+  bool     direct;
+  size_t   block_size;
+  char*    direct_buffer;
+  size_t   direct_size;
+  size_t   direct_fill;
+  uint64_t direct_offset;
+  uint64_t direct_position;
+  bool     direct_writable;
+
+  void* commit;
+  void* compressed;
+  void* stats;
+
+  int (*advise)           (struct File* self, uint64_t offset, uint64_t length, int hint);
+  int (*alloc_aligned)    (struct File* self, size_t size, void** buffer);
+  int (*atomic_write)     (struct File* self, char* path, const void* data, size_t size);
+  int (*close)            (struct File* self);
+  int (*copy)             (struct File* self, char* from, char* to, int flags, int* strategy);
+  int (*create_path)      (struct File* self, char* path);
+  int (*delete)           (struct File* self);
+  int (*delete_path)      (struct File* self, char* path, size_t* removed);
+  int (*flush)            (struct File* self);
+  int (*for_each_chunk)   (struct File* self, void* buffer, size_t size, int (*callback)(const char* chunk, size_t size, void* context), void* context);
+  int (*for_each_line)    (struct File* self, void* buffer, size_t size, int delimiter, int (*callback)(const char* line, size_t size, void* context), void* context);
+  int (*get_block_size)   (struct File* self, size_t* size);
+  int (*get_mode)         (struct File* self, int* mode);
+  int (*get_name)         (struct File* self, char** name);
+  int (*get_path)         (struct File* self, char** path);
+  int (*get_stats)        (struct File* self, struct SystemStats* stats);
+  int (*is_open)          (struct File* self, bool* is_open);
+  int (*map)              (struct File* self, const char** data, size_t* size);
+  int (*move)             (struct File* self, char* from, char* to);
+  int (*open)             (struct File* self, char* name, unsigned int mode);
+  int (*preallocate)      (struct File* self, uint64_t offset, uint64_t length);
+  int (*prefetch)         (struct File* self, uint64_t offset, uint64_t length);
+  int (*punch_hole)       (struct File* self, uint64_t offset, uint64_t length);
+  int (*read)             (struct File* self, char** buffer);
+  int (*read_at)          (struct File* self, uint64_t offset, void* buffer, size_t size, size_t* bytes_read);
+  int (*read_chunk)       (struct File* self, void* buffer, size_t size, size_t* bytes_read);
+  int (*readv)            (struct File* self, const struct iovec* vector, int count, size_t* bytes_read);
+  int (*set_buffer)       (struct File* self, size_t size);
+  int (*set_group_commit) (struct File* self, uint32_t interval);
+  int (*set_path_cache)   (struct File* self, bool enabled);
+  int (*sync)             (struct File* self);
+  int (*truncate)         (struct File* self, uint64_t size);
+  int (*unmap)            (struct File* self);
+  int (*write)            (struct File* self, char* buffer);
+  int (*write_at)         (struct File* self, uint64_t offset, const void* data, size_t size, size_t* bytes_written);
+  int (*write_bytes)      (struct File* self, const void* data, size_t size);
+  int (*writev)           (struct File* self, const struct iovec* vector, int count, size_t* bytes_written);
 };
 
 // the constructor should be used to create new files
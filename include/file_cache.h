@@ -0,0 +1,59 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_cache.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A structure representing a cache of open file descriptors in libkc_system.
+ *
+ * The FileCache structure keeps recently used files open, keyed by their
+ * normalized path and open flags, so opening a hot file again costs no system
+ * call. Every acquired descriptor is reference counted and must be released;
+ * once no one holds it, it stays open until the cache runs out of its
+ * descriptor budget and closes the least recently used ones.
+ *
+ * A descriptor is shared by everyone who acquires the same path and flags, and
+ * with it its file offset, so callers must use pread() and pwrite() rather
+ * than read(), write() or lseek(). Acquires served by a cached descriptor are
+ * counted as hits, all others as misses.
+ *
+ * Paths are normalized lexically, without resolving symbolic links. A file
+ * that is moved or deleted should be evicted by its path.
+ */
+
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include "file.h"
+
+#include <stddef.h>
+
+//---------------------------------------------------------------------------//
+
+struct FileCache
+{
+  struct ConsoleLog* log;
+
+  size_t capacity;
+  size_t count;
+  void*  table;
+
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+
+  int (*acquire) (struct FileCache* self, const char* path, int flags, int* fd);
+  int (*evict)   (struct FileCache* self, const char* path);
+  int (*release) (struct FileCache* self, int fd);
+};
+
+// the constructor should be used to create new caches
+struct FileCache* new_file_cache(size_t capacity);
+
+// the destructor should be used to destroy caches
+void destroy_file_cache(struct FileCache* cache);
+
+#endif /* FILE_CACHE_H */
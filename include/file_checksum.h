@@ -0,0 +1,69 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_checksum.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A structure representing a checksum engine in libkc_system.
+ *
+ * The FileChecksum structure computes CRC32C (Castagnoli), with the SSE4.2
+ * crc32 instruction where the CPU has it and a table driven loop where it
+ * does not, or XXH64. Both start from the seed given to the constructor, 0
+ * for the standard values; a CRC32C seed is the checksum of the data before.
+ * The checksum is returned in the low bits of a 64-bit value.
+ *
+ * Data can be hashed in one call with compute(), or piece by piece with
+ * update() and digest(). compute_file() hashes a whole open file, splitting
+ * a large CRC32C file into ranges hashed on several threads, whose checksums
+ * are then combined into the one of the whole file. XXH64 can not be split
+ * that way and is always computed on one thread. read_file() reads a file
+ * into memory and hashes every chunk right after it is read, while it is
+ * still in the cache, instead of going over the data a second time.
+ *
+ * Files are read at explicit offsets, so their position is never moved;
+ * buffered writes need a flush first. Files opened with KC_FILE_COMPRESSED
+ * are rejected, their data is hashed after File::read() with compute().
+ */
+
+#ifndef FILE_CHECKSUM_H
+#define FILE_CHECKSUM_H
+
+#include "file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_FILE_CHECKSUM_CRC32C                                      0x00000001
+#define KC_FILE_CHECKSUM_XXH64                                       0x00000002
+
+//---------------------------------------------------------------------------//
+
+struct FileChecksum
+{
+  struct ConsoleLog* log;
+
+  int      algorithm;
+  uint64_t seed;
+  uint64_t length;
+  void*    state;
+
+  int (*compute)      (struct FileChecksum* self, const void* data, size_t size, uint64_t* checksum);
+  int (*compute_file) (struct FileChecksum* self, struct File* file, unsigned threads, uint64_t* checksum);
+  int (*digest)       (struct FileChecksum* self, uint64_t* checksum);
+  int (*read_file)    (struct FileChecksum* self, struct File* file, unsigned threads, char** buffer, size_t* size, uint64_t* checksum);
+  int (*reset)        (struct FileChecksum* self);
+  int (*update)       (struct FileChecksum* self, const void* data, size_t size);
+};
+
+// the constructor should be used to create new checksum engines
+struct FileChecksum* new_file_checksum(int algorithm, uint64_t seed);
+
+// the destructor should be used to destroy checksum engines
+void destroy_file_checksum(struct FileChecksum* checksum);
+
+#endif /* FILE_CHECKSUM_H */
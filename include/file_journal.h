@@ -0,0 +1,57 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_journal.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A structure representing an append-only, segmented log in libkc_system.
+ *
+ * The FileJournal structure stores records in a directory of numbered segment
+ * files. Every record is framed by its length and a CRC32C checksum, and a new
+ * segment, with its space reserved up front, is started whenever the next
+ * record does not fit into the current one.
+ *
+ * Any number of threads can append at once. Appends are handed over through
+ * a lock-free queue to a single writer thread, which frames them and writes
+ * whole batches in one system call; flush() waits until everything appended
+ * so far is on disk. Opening an existing journal cuts off a record torn by a
+ * crash at the end of the last segment. A replay with for_each() stops with
+ * KC_FILE_INVALID at an earlier segment that does not end in a whole record.
+ */
+
+#ifndef FILE_JOURNAL_H
+#define FILE_JOURNAL_H
+
+#include "file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+
+struct FileJournal
+{
+  struct ConsoleLog* log;
+
+  char*    directory;
+  uint64_t segment_size;
+  uint64_t segment;
+  uint64_t truncated;
+  void*    engine;
+
+  int (*append)   (struct FileJournal* self, const void* data, size_t size);
+  int (*flush)    (struct FileJournal* self);
+  int (*for_each) (struct FileJournal* self, int (*callback)(const void* record, size_t size, void* context), void* context);
+};
+
+// the constructor should be used to create new journals, or to reopen them
+struct FileJournal* new_file_journal(const char* directory,
+  uint64_t segment_size);
+
+// the destructor should be used to destroy journals, after writing the rest
+void destroy_file_journal(struct FileJournal* journal);
+
+#endif /* FILE_JOURNAL_H */
@@ -0,0 +1,50 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_pool.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A structure representing a pool of reusable files in libkc_system.
+ *
+ * The FilePool structure creates a fixed number of File instances up front,
+ * sharing a single logger and keeping the name of each file inline, and hands
+ * them out to callers that open and close files at a high rate. Acquiring and
+ * releasing a file never allocates and can be done from several threads.
+ *
+ * A file acquired from the pool must be given back with release(), never with
+ * destroy_file(), and must not be used afterwards.
+ */
+
+#ifndef FILE_POOL_H
+#define FILE_POOL_H
+
+#include "file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+
+struct FilePool
+{
+  struct ConsoleLog* log;
+
+  size_t   capacity;
+  size_t   available;
+  uint64_t head;
+  void*    slots;
+
+  int (*acquire) (struct FilePool* self, struct File** file);
+  int (*release) (struct FilePool* self, struct File* file);
+};
+
+// the constructor should be used to create new pools
+struct FilePool* new_file_pool(size_t capacity);
+
+// the destructor should be used to destroy pools
+void destroy_file_pool(struct FilePool* pool);
+
+#endif /* FILE_POOL_H */
@@ -0,0 +1,68 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_ring.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A structure representing asynchronous file I/O in libkc_system.
+ *
+ * The FileRing structure queues reads, writes and syncs against open File
+ * instances without blocking the caller, and reports their results through
+ * completions. It is backed by io_uring when the kernel supports it, and by a
+ * small pool of worker threads otherwise, so a single thread can keep hundreds
+ * of requests in flight.
+ *
+ * Requests go straight to the file descriptor. Every submission flushes the
+ * File first, so data still buffered in its stream or its staged direct block
+ * is visible to the ring; writes made through the File while requests are in
+ * flight are not ordered against them. A kernel too busy to take requests
+ * (EAGAIN or EBUSY) makes polls reap what completed and submit again.
+ */
+
+#ifndef FILE_RING_H
+#define FILE_RING_H
+
+#include "file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_FILE_RING_AUTO                                            0x00000000
+#define KC_FILE_RING_IO_URING                                        0x00000001
+#define KC_FILE_RING_THREADS                                         0x00000002
+
+//---------------------------------------------------------------------------//
+
+struct FileCompletion
+{
+  void*   context;
+  int64_t result;
+};
+
+struct FileRing
+{
+  struct ConsoleLog* log;
+
+  int      backend;
+  unsigned depth;
+  unsigned pending;
+  void*    engine;
+
+  int (*poll_completions) (struct FileRing* self, struct FileCompletion* completions, unsigned max, unsigned min, unsigned* count);
+  int (*submit_fsync)     (struct FileRing* self, struct File* file, void* context);
+  int (*submit_read)      (struct FileRing* self, struct File* file, uint64_t offset, void* buffer, size_t size, void* context);
+  int (*submit_write)     (struct FileRing* self, struct File* file, uint64_t offset, const void* data, size_t size, void* context);
+};
+
+// the constructor should be used to create new rings
+struct FileRing* new_file_ring(unsigned depth, int backend);
+
+// the destructor should be used to destroy rings
+void destroy_file_ring(struct FileRing* ring);
+
+#endif /* FILE_RING_H */
@@ -0,0 +1,84 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_watch.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * A structure representing file change notifications in libkc_system.
+ *
+ * The FileWatch structure watches files and directories with inotify, and
+ * directory trees when they are added with KC_FILE_WATCH_RECURSIVE, including
+ * the directories created in them later on. A burst of events on the same
+ * path is coalesced into a single change, holding every kind of event seen,
+ * which is only reported once the path has been quiet for the delay given to
+ * the constructor.
+ *
+ * A watched file that is replaced by renaming another file over it, as
+ * File::atomic_write() does, is reported as deleted and created, and its
+ * replacement is watched under the same name. This only happens once the old
+ * file is gone for good: while another process keeps it open, the watch stays
+ * on the old file. A file that is deleted and created again later is not
+ * watched anymore.
+ *
+ * dispatch() hands the settled changes to the callback in one batch, waiting
+ * up to a timeout for them. To drive it from an epoll loop instead, watch fd
+ * for input and call dispatch() with a timeout of 0 when it is readable, or
+ * when the timeout reported by get_timeout() runs out. A change carrying
+ * KC_FILE_WATCH_OVERFLOW has no path: the kernel dropped events, and every
+ * watched path has to be checked again.
+ */
+
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+#include "file.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_FILE_WATCH_CREATED                                        0x00000001
+#define KC_FILE_WATCH_MODIFIED                                       0x00000002
+#define KC_FILE_WATCH_DELETED                                        0x00000004
+#define KC_FILE_WATCH_ATTRIBUTES                                     0x00000008
+#define KC_FILE_WATCH_OVERFLOW                                       0x00000010
+
+//---------------------------------------------------------------------------//
+
+#define KC_FILE_WATCH_RECURSIVE                                      0x00000001
+
+//---------------------------------------------------------------------------//
+
+struct FileChange
+{
+  const char* path;
+  uint32_t    events;
+};
+
+struct FileWatch
+{
+  struct ConsoleLog* log;
+
+  int      fd;
+  uint32_t delay;
+  size_t   watches;
+  size_t   pending;
+  void*    engine;
+
+  int (*add)         (struct FileWatch* self, const char* path, int flags);
+  int (*dispatch)    (struct FileWatch* self, int timeout, int (*callback)(const struct FileChange* changes, size_t count, void* context), void* context);
+  int (*get_timeout) (struct FileWatch* self, int* timeout);
+  int (*remove)      (struct FileWatch* self, const char* path);
+};
+
+// the constructor should be used to create new watches
+struct FileWatch* new_file_watch(uint32_t delay);
+
+// the destructor should be used to destroy watches
+void destroy_file_watch(struct FileWatch* watch);
+
+#endif /* FILE_WATCH_H */
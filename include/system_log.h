@@ -0,0 +1,53 @@
+// This file is part of libkc_system
+// ==================================
+//
+// system_log.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * The loggers shared by every structure in libkc_system.
+ *
+ * Instead of creating a logger for every instance, each module asks for its
+ * own process-wide logger, which is created the first time it is needed and
+ * lives until the process exits. Logging can be turned off at runtime, after
+ * which the loggers skip all formatting and output. Building the library with
+ * KC_SYSTEM_LOG_DISABLED defined starts them turned off.
+ *
+ * Only the debug, info, warning and error messages of the module loggers are
+ * muted. Fatal errors are always printed, and so is everything reported
+ * through log_error() where no module logger is at hand: calls made with a
+ * NULL structure or argument, and constructors that fail before their logger
+ * exists.
+ */
+
+#ifndef SYSTEM_LOG_H
+#define SYSTEM_LOG_H
+
+#include <stdbool.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_SYSTEM_LOG_DIR                                          0x00000000
+#define KC_SYSTEM_LOG_FILE                                         0x00000001
+#define KC_SYSTEM_LOG_FILE_CACHE                                   0x00000002
+#define KC_SYSTEM_LOG_FILE_CHECKSUM                                0x00000003
+#define KC_SYSTEM_LOG_FILE_JOURNAL                                 0x00000004
+#define KC_SYSTEM_LOG_FILE_POOL                                    0x00000005
+#define KC_SYSTEM_LOG_FILE_RING                                    0x00000006
+#define KC_SYSTEM_LOG_FILE_WATCH                                   0x00000007
+#define KC_SYSTEM_LOG_MODULES                                      0x00000008
+
+//---------------------------------------------------------------------------//
+
+// returns the logger of a module, creating it on first use
+struct ConsoleLog* get_system_log(int module, const char* file);
+
+// turns the output of every module logger on or off
+void set_system_log(bool enabled);
+
+// reports whether the module loggers currently produce any output
+bool is_system_log_enabled();
+
+#endif /* SYSTEM_LOG_H */
@@ -0,0 +1,85 @@
+// This file is part of libkc_system
+// ==================================
+//
+// system_stats.h
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+/*
+ * The I/O statistics kept by libkc_system, opt-in at build time.
+ *
+ * Building the library with KC_SYSTEM_STATS defined (make build STATS=on)
+ * times every open, close, read, write, flush and sync of a File, and counts
+ * the calls, the bytes moved, the failures and the time spent, along with a
+ * histogram of the latencies. Each bucket of the histogram covers a quarter
+ * of a power of two of nanoseconds, so a percentile read from it is within
+ * 25% of the real one.
+ *
+ * Every thread counts in its own cache line aligned slot, which only that
+ * thread writes, so recording takes no lock and shares no cache line with
+ * another thread. get_system_stats() adds up the slots of every thread, the
+ * ones that already exited included, without stopping them; the counters only
+ * grow, two snapshots are subtracted to look at an interval. Each File also
+ * keeps its own totals, returned by File::get_stats(), with the same relaxed
+ * stores; they are exact for a File used by one thread at a time, while
+ * threads sharing a File may lose some of its counts to each other.
+ *
+ * Without KC_SYSTEM_STATS nothing is timed or counted, the File methods are
+ * not wrapped at all, and every snapshot is empty.
+ */
+
+#ifndef SYSTEM_STATS_H
+#define SYSTEM_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//---------------------------------------------------------------------------//
+
+#define KC_SYSTEM_STATS_CLOSE                                      0x00000000
+#define KC_SYSTEM_STATS_FLUSH                                      0x00000001
+#define KC_SYSTEM_STATS_OPEN                                       0x00000002
+#define KC_SYSTEM_STATS_READ                                       0x00000003
+#define KC_SYSTEM_STATS_SYNC                                       0x00000004
+#define KC_SYSTEM_STATS_WRITE                                      0x00000005
+#define KC_SYSTEM_STATS_OPERATIONS                                 0x00000006
+
+#define KC_SYSTEM_STATS_BUCKETS                                           128
+
+//---------------------------------------------------------------------------//
+
+struct SystemStatsCounter
+{
+  uint64_t calls;
+  uint64_t bytes;
+  uint64_t errors;
+  uint64_t nanoseconds;
+  uint64_t histogram[KC_SYSTEM_STATS_BUCKETS];
+};
+
+struct SystemStats
+{
+  struct SystemStatsCounter operations[KC_SYSTEM_STATS_OPERATIONS];
+};
+
+//---------------------------------------------------------------------------//
+
+// adds up the counters of every thread into a snapshot
+void get_system_stats(struct SystemStats* stats);
+
+// returns the latency, in nanoseconds, below which the given share of calls
+// finished, read from the histogram of a counter
+uint64_t get_system_stats_percentile(const struct SystemStatsCounter* counter, double rank);
+
+// reports whether the library was built to keep statistics
+bool is_system_stats_enabled();
+
+// counts one finished call, in the slot of the calling thread and in the
+// counters of a single File when given; used by the library itself
+void record_system_stats(struct SystemStats* local, int operation, uint64_t start, uint64_t bytes, bool failed);
+
+// returns the time a call started at, to be passed to record_system_stats()
+uint64_t start_system_stats();
+
+#endif /* SYSTEM_STATS_H */
@@ -0,0 +1,617 @@
+// This file is part of libkc_system
+// ==================================
+//
+// dir.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/dir.h"
+#include "../include/system_log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// the entries are fetched from the kernel in batches of this many bytes
+#define KC_DIR_BUFFER_SIZE                                           (1 << 20)
+
+// a tree is never walked by more than this many threads
+#define KC_DIR_MAX_THREADS                                                   64
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+// the record layout returned by getdents64
+struct DirRecord
+{
+  uint64_t       inode;
+  int64_t        offset;
+  unsigned short length;
+  unsigned char  type;
+  char           name[];
+};
+
+struct DirPending
+{
+  struct DirPending* next;
+  char*              path;
+};
+
+struct DirWalk
+{
+  pthread_mutex_t lock;
+  pthread_cond_t  work;
+
+  struct DirPending* queue;
+  size_t             active;
+  size_t             buffer_size;
+  int                result;
+  int                error;
+
+  bool (*filter) (const char* path, const struct DirEntry* entry, void* context);
+  int  (*visit)  (const char* path, const struct DirEntry* entry, void* context);
+  void* context;
+};
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int close_dir  (struct Dir* self);
+static int next_entry (struct Dir* self, struct DirEntry* entry);
+static int open_dir   (struct Dir* self, const char* path);
+static int walk_tree  (struct Dir* self, const char* path, unsigned threads, bool (*filter)(const char* path, const struct DirEntry* entry, void* context), int (*visit)(const char* path, const struct DirEntry* entry, void* context), void* context);
+
+static int   convert_type (unsigned char type);
+static int   read_records (int fd, char* buffer, size_t size, size_t* length);
+static void  walk_fail    (struct DirWalk* walk, int result, int error);
+static void  walk_list    (struct DirWalk* walk, char* path, char* buffer);
+static void* walk_work    (void* context);
+
+//---------------------------------------------------------------------------//
+
+struct Dir* new_dir(size_t buffer_size)
+{
+  // create a dir instance to be returned
+  struct Dir* dir = malloc(sizeof(struct Dir));
+
+  if (dir == NULL)
+  {
+    log_error(err[KC_OUT_OF_MEMORY], log_err[KC_OUT_OF_MEMORY],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  // a buffer too small for a single record is of no use
+  if (buffer_size < sizeof(struct DirRecord) + 256)
+  {
+    buffer_size = KC_DIR_BUFFER_SIZE;
+  }
+
+  struct ConsoleLog* log = get_system_log(KC_SYSTEM_LOG_DIR, __FILE__);
+
+  // assigns the public member fields
+  dir->log         = log;
+  dir->fd          = -1;
+  dir->path        = NULL;
+  dir->opened      = false;
+  dir->buffer      = NULL;
+  dir->buffer_size = buffer_size;
+  dir->position    = 0;
+  dir->length      = 0;
+
+  // assigns the public member methods
+  dir->close = close_dir;
+  dir->next  = next_entry;
+  dir->open  = open_dir;
+  dir->walk  = walk_tree;
+
+  return dir;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_dir(struct Dir* dir)
+{
+  if (dir == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return;
+  }
+
+  // close the directory if still open
+  dir->close(dir);
+
+  free(dir->buffer);
+  free(dir->path);
+  free(dir);
+}
+
+//---------------------------------------------------------------------------//
+
+int close_dir(struct Dir* self)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  if (self->opened == true)
+  {
+    close(self->fd);
+
+    self->fd       = -1;
+    self->position = 0;
+    self->length   = 0;
+    self->opened   = false;
+  }
+
+  return KC_DIR_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int next_entry(struct Dir* self, struct DirEntry* entry)
+{
+  if (self == NULL || entry == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the directory must be open
+  if (self->opened == false)
+  {
+    return KC_DIR_CLOSED;
+  }
+
+  for (;;)
+  {
+    // the batch is used up, fetch the next one
+    if (self->position >= self->length)
+    {
+      self->position = 0;
+
+      if (read_records(self->fd, self->buffer, self->buffer_size,
+            &self->length) != KC_DIR_SUCCESS)
+      {
+        self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+        return KC_DIR_INVALID;
+      }
+
+      if (self->length == 0)
+      {
+        return KC_DIR_END;
+      }
+    }
+
+    struct DirRecord* record =
+      (struct DirRecord*)(self->buffer + self->position);
+
+    self->position += record->length;
+
+    // the entries for the directory itself and its parent are skipped
+    if (record->name[0] == '.' && (record->name[1] == '\0' ||
+        (record->name[1] == '.' && record->name[2] == '\0')))
+    {
+      continue;
+    }
+
+    entry->name  = record->name;
+    entry->inode = record->inode;
+    entry->type  = convert_type(record->type);
+
+    return KC_DIR_SUCCESS;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+int open_dir(struct Dir* self, const char* path)
+{
+  if (self == NULL || path == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the buffer is only allocated once, and reused for every directory
+  if (self->buffer == NULL)
+  {
+    self->buffer = (char*)malloc(self->buffer_size);
+
+    if (self->buffer == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+  }
+
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (fd < 0)
+  {
+    self->log->error(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
+
+    return KC_DIR_INVALID;
+  }
+
+  char* name = (char*)malloc(sizeof(char) * (strlen(path) + 1));
+
+  if (name == NULL)
+  {
+    close(fd);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // if a directory was already opened, close it first
+  close_dir(self);
+
+  strcpy(name, path);
+  free(self->path);
+
+  self->fd     = fd;
+  self->path   = name;
+  self->opened = true;
+
+  return KC_DIR_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int walk_tree(struct Dir* self, const char* path, unsigned threads,
+  bool (*filter)(const char* path, const struct DirEntry* entry, void* context),
+  int (*visit)(const char* path, const struct DirEntry* entry, void* context),
+  void* context)
+{
+  if (self == NULL || path == NULL || visit == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct DirWalk     walk;
+  struct DirPending* root = malloc(sizeof(struct DirPending));
+
+  if (root == NULL || (root->path = strdup(path)) == NULL)
+  {
+    free(root);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  root->next = NULL;
+
+  walk.queue       = root;
+  walk.active      = 0;
+  walk.buffer_size = self->buffer_size;
+  walk.result      = KC_DIR_SUCCESS;
+  walk.error       = 0;
+  walk.filter      = filter;
+  walk.visit       = visit;
+  walk.context     = context;
+
+  pthread_mutex_init(&walk.lock, NULL);
+  pthread_cond_init(&walk.work, NULL);
+
+  if (threads > KC_DIR_MAX_THREADS)
+  {
+    threads = KC_DIR_MAX_THREADS;
+  }
+
+  // the calling thread is one of the workers
+  pthread_t workers[KC_DIR_MAX_THREADS];
+  unsigned  started = 0;
+
+  while (started + 1 < threads)
+  {
+    if (pthread_create(&workers[started], NULL, walk_work, &walk) != 0)
+    {
+      break;
+    }
+
+    ++started;
+  }
+
+  walk_work(&walk);
+
+  for (unsigned i = 0; i < started; ++i)
+  {
+    pthread_join(workers[i], NULL);
+  }
+
+  // the walk may have been stopped with directories still queued
+  while (walk.queue != NULL)
+  {
+    struct DirPending* next = walk.queue->next;
+
+    free(walk.queue->path);
+    free(walk.queue);
+
+    walk.queue = next;
+  }
+
+  pthread_cond_destroy(&walk.work);
+  pthread_mutex_destroy(&walk.lock);
+
+  if (walk.result == KC_DIR_INVALID)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    // report the first failed call to the caller
+    errno = walk.error;
+  }
+
+  return walk.result;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static int convert_type(unsigned char type)
+{
+  switch (type)
+  {
+    case DT_REG:
+      return KC_DIR_FILE;
+
+    case DT_DIR:
+      return KC_DIR_DIRECTORY;
+
+    case DT_LNK:
+      return KC_DIR_LINK;
+
+    case DT_UNKNOWN:
+      return KC_DIR_UNKNOWN;
+
+    default:
+      return KC_DIR_OTHER;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int read_records(int fd, char* buffer, size_t size, size_t* length)
+{
+  for (;;)
+  {
+    // many entries per call, straight into the caller buffer
+    long ret = syscall(SYS_getdents64, fd, buffer, size);
+
+    if (ret >= 0)
+    {
+      (*length) = (size_t)ret;
+
+      return KC_DIR_SUCCESS;
+    }
+
+    if (errno != EINTR)
+    {
+      (*length) = 0;
+
+      return KC_DIR_INVALID;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void walk_fail(struct DirWalk* walk, int result, int error)
+{
+  pthread_mutex_lock(&walk->lock);
+
+  // only the first result that stops the walk is reported
+  if (walk->result == KC_DIR_SUCCESS)
+  {
+    walk->result = result;
+    walk->error  = error;
+  }
+
+  pthread_mutex_unlock(&walk->lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static void walk_list(struct DirWalk* walk, char* path, char* buffer)
+{
+  struct DirPending* subdirs = NULL;
+  size_t             length  = 0;
+
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+  if (fd < 0)
+  {
+    walk_fail(walk, KC_DIR_INVALID, errno);
+
+    return;
+  }
+
+  int listed = KC_DIR_SUCCESS;
+
+  while ((listed = read_records(fd, buffer, walk->buffer_size, &length)) ==
+         KC_DIR_SUCCESS && length > 0)
+  {
+    for (size_t position = 0; position < length; )
+    {
+      struct DirRecord* record = (struct DirRecord*)(buffer + position);
+      struct DirEntry   entry;
+
+      position += record->length;
+
+      if (record->name[0] == '.' && (record->name[1] == '\0' ||
+          (record->name[1] == '.' && record->name[2] == '\0')))
+      {
+        continue;
+      }
+
+      entry.name  = record->name;
+      entry.inode = record->inode;
+      entry.type  = convert_type(record->type);
+
+      // only a few file systems leave the type out, ask for it then
+      if (entry.type == KC_DIR_UNKNOWN)
+      {
+        struct stat st;
+
+        if (fstatat(fd, entry.name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+          entry.type = S_ISREG(st.st_mode) ? KC_DIR_FILE
+            : S_ISDIR(st.st_mode) ? KC_DIR_DIRECTORY
+            : S_ISLNK(st.st_mode) ? KC_DIR_LINK : KC_DIR_OTHER;
+        }
+      }
+
+      // filtered out entries are neither visited nor descended into
+      if (walk->filter != NULL &&
+          walk->filter(path, &entry, walk->context) == false)
+      {
+        continue;
+      }
+
+      int ret = walk->visit(path, &entry, walk->context);
+
+      if (ret != KC_DIR_SUCCESS)
+      {
+        walk_fail(walk, ret, 0);
+        break;
+      }
+
+      if (entry.type != KC_DIR_DIRECTORY)
+      {
+        continue;
+      }
+
+      struct DirPending* child = malloc(sizeof(struct DirPending));
+      size_t             size  = strlen(path) + strlen(entry.name) + 2;
+
+      if (child == NULL || (child->path = malloc(size)) == NULL)
+      {
+        free(child);
+        walk_fail(walk, KC_OUT_OF_MEMORY, ENOMEM);
+
+        break;
+      }
+
+      snprintf(child->path, size, "%s/%s", path, entry.name);
+
+      child->next = subdirs;
+      subdirs     = child;
+    }
+
+    // stop as soon as any worker fails or the visitor asks for it
+    if (__atomic_load_n(&walk->result, __ATOMIC_RELAXED) != KC_DIR_SUCCESS)
+    {
+      break;
+    }
+  }
+
+  // a listing that failed halfway is not the end of the directory
+  if (listed != KC_DIR_SUCCESS)
+  {
+    walk_fail(walk, KC_DIR_INVALID, errno);
+  }
+
+  close(fd);
+
+  if (subdirs == NULL)
+  {
+    return;
+  }
+
+  // hand the subdirectories over to the pool
+  pthread_mutex_lock(&walk->lock);
+
+  while (subdirs != NULL)
+  {
+    struct DirPending* next = subdirs->next;
+
+    subdirs->next = walk->queue;
+    walk->queue   = subdirs;
+    subdirs       = next;
+  }
+
+  pthread_cond_broadcast(&walk->work);
+  pthread_mutex_unlock(&walk->lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static void* walk_work(void* context)
+{
+  struct DirWalk* walk   = (struct DirWalk*)context;
+  char*           buffer = (char*)malloc(walk->buffer_size);
+
+  if (buffer == NULL)
+  {
+    walk_fail(walk, KC_OUT_OF_MEMORY, ENOMEM);
+  }
+
+  pthread_mutex_lock(&walk->lock);
+
+  for (;;)
+  {
+    // wait while the busy workers might still find more directories
+    while (walk->queue == NULL && walk->active > 0)
+    {
+      pthread_cond_wait(&walk->work, &walk->lock);
+    }
+
+    if (walk->queue == NULL || walk->result != KC_DIR_SUCCESS ||
+        buffer == NULL)
+    {
+      break;
+    }
+
+    struct DirPending* pending = walk->queue;
+
+    walk->queue = pending->next;
+    ++walk->active;
+
+    pthread_mutex_unlock(&walk->lock);
+
+    walk_list(walk, pending->path, buffer);
+
+    free(pending->path);
+    free(pending);
+
+    pthread_mutex_lock(&walk->lock);
+
+    --walk->active;
+
+    // the last busy worker wakes up the idle ones so they can exit
+    if (walk->active == 0)
+    {
+      pthread_cond_broadcast(&walk->work);
+    }
+  }
+
+  // let the others stop as well
+  pthread_cond_broadcast(&walk->work);
+  pthread_mutex_unlock(&walk->lock);
+
+  free(buffer);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
@@ -7,27 +7,305 @@
 // SPDX-License-Identifier: MIT License
 
 #define _CRT_SECURE_NO_WARNINGS
+#define _GNU_SOURCE
 
 #include "../deps/libkc/logger/logger.h"
 #include "../include/file.h"
+#include "../include/system_log.h"
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// delimiters are searched for with vector compares where the CPU has them
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+#define KC_FILE_SIMD_X86                                                     1
+#define KC_FILE_TARGET_AVX2                    __attribute__((target("avx2")))
+#define KC_FILE_TARGET_SSE2                    __attribute__((target("sse2")))
+#else
+#define KC_FILE_TARGET_AVX2
+#define KC_FILE_TARGET_SSE2
+#endif
+
+// the last resort copy loop moves data through a buffer of this size
+#define KC_FILE_COPY_BUFFER_SIZE                                     (1 << 20)
+
+// the directory cache is emptied once it remembers this many paths
+#define KC_FILE_PATH_CACHE_LIMIT                                     (1 << 16)
+
+// a scan that drops its pages behind itself does so in windows this large
+#define KC_FILE_DROP_WINDOW                                          (8 << 20)
+
+// unaligned direct I/O is staged through a block aligned buffer this large
+#define KC_FILE_DIRECT_BUFFER_SIZE                                   (1 << 20)
+
+// alignment used for direct I/O buffers when the device does not report one
+#define KC_FILE_DIRECT_ALIGNMENT                                          4096
+
+// directory trees are removed by at most this many threads
+#define KC_FILE_DELETE_WORKERS                                                8
+
+// lines are streamed through a buffer of this size when none is given
+#define KC_FILE_LINE_BUFFER_SIZE                                   (256 << 10)
+
+// compressed files are made of independent blocks of this size, compressed
+// and decompressed by at most this many threads at once
+#define KC_FILE_COMPRESS_BLOCK_SIZE                                (256 << 10)
+#define KC_FILE_COMPRESS_MAX_BLOCK_SIZE                             (64 << 20)
+#define KC_FILE_COMPRESS_WORKERS                                             8
+
+// the largest a block can get when its data does not compress at all
+#define KC_FILE_COMPRESS_BOUND(size)               ((size) + (size) / 255 + 16)
+
+// the match finder hashes 4 bytes into a table of 1 << 14 positions; no
+// match starts in the last 12 bytes of a block, the last 5 are literals
+#define KC_FILE_COMPRESS_HASH_LOG                                           14
+#define KC_FILE_COMPRESS_MATCH_LIMIT                                        12
+#define KC_FILE_COMPRESS_LAST_LITERALS                                       5
+
+// the frame of a block that did not get smaller is flagged, its data follows
+// the frame as it is
+#define KC_FILE_COMPRESS_STORED                                      0x80000000
+
+// the magic at the start of a compressed file, and at the end of its footer
+#define KC_FILE_COMPRESS_MAGIC                                          "KCZ1"
+#define KC_FILE_COMPRESS_INDEX                                      "KCZINDEX"
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+struct CompressFooter
+{
+  uint64_t index;
+  uint64_t count;
+  uint64_t length;
+  char     magic[8];
+};
+
+struct CompressFrame
+{
+  uint32_t size;
+  uint32_t raw_size;
+};
+
+struct CompressHeader
+{
+  char     magic[4];
+  uint32_t block_size;
+};
+
+struct CompressJob
+{
+  struct File* file;
+  char*        target;
+  size_t       first;
+  size_t       count;
+  size_t       next;
+  int          ret;
+  bool         output;
+};
+
+struct CompressStream
+{
+  struct CompressFrame* frames;
+  uint64_t*             offsets;
+  uint64_t*             positions;
+  size_t                count;
+  size_t                capacity;
+
+  bool     writing;
+  unsigned threads;
+  size_t   block_size;
+  size_t   packed_size;
+  char*    raw;
+  size_t   raw_fill;
+  char*    packed;
+  uint64_t offset;
+  uint64_t length;
+  uint64_t position;
+  size_t   current;
+};
+
+struct DeleteNode
+{
+  struct DeleteNode* parent;
+  struct DeleteNode* next;
+
+  // the name is relative to the descriptor of the parent, the root keeps the
+  // path it was given
+  char*  name;
+  int    fd;
+  size_t children;
+  bool   scanned;
+};
+
+struct DeleteTree
+{
+  pthread_mutex_t lock;
+  pthread_cond_t  work;
+
+  struct DeleteNode* queue;
+  size_t             active;
+  size_t             removed;
+  int                error;
+};
+
+struct GroupCommit
+{
+  pthread_mutex_t lock;
+  pthread_cond_t  done;
+  pthread_cond_t  joined;
+  pthread_cond_t  drained;
+
+  uint64_t interval;
+  size_t   last_count;
+  uint64_t generation;
+  uint64_t completed;
+  uint64_t failed;
+  bool     syncing;
+
+  // the threads inside commit_sync(), waited for before the mode is dropped
+  size_t waiters;
+  bool   closing;
+
+  int*   fds;
+  size_t count;
+  size_t capacity;
+  int*   spare;
+  size_t spare_capacity;
+};
+
+struct LineScan
+{
+  int (*callback)(const char* line, size_t size, void* context);
+
+  void* context;
+  int   delimiter;
+  int   ret;
+};
+
+// directories known to exist, shared by every File that enables the cache
+static pthread_rwlock_t path_cache_lock     = PTHREAD_RWLOCK_INITIALIZER;
+static char**           path_cache_slots    = NULL;
+static size_t           path_cache_capacity = 0;
+static size_t           path_cache_count    = 0;
+
+// the fastest delimiter search this CPU supports, picked on first use
+static pthread_once_t line_scan_once = PTHREAD_ONCE_INIT;
+static size_t       (*scan_lines)(struct LineScan* scan, const char* data, size_t start, size_t from, size_t size);
 
 //--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
 
-static int close_file     (struct File* self);
-static int create_path    (struct File* self, char* path);
-static int delete_file    (struct File* self);
-static int delete_path    (struct File* self, char* path);
-static int get_file_mode  (struct File* self, int* mode);
-static int get_file_name  (struct File* self, char** name);
-static int get_file_path  (struct File* self, char** path);
-static int get_opened     (struct File* self, bool* is_open);
-static int open_file      (struct File* self, char* name, unsigned int mode);
-static int read_file      (struct File* self, char** buffer);
-static int write_file     (struct File* self, char* buffer);
+static int advise_file      (struct File* self, uint64_t offset, uint64_t length, int hint);
+static int alloc_aligned    (struct File* self, size_t size, void** buffer);
+static int atomic_write     (struct File* self, char* path, const void* data, size_t size);
+static int close_file       (struct File* self);
+static int copy_file        (struct File* self, char* from, char* to, int flags, int* strategy);
+static int create_path      (struct File* self, char* path);
+static int delete_file      (struct File* self);
+static int delete_path      (struct File* self, char* path, size_t* removed);
+static int flush_file       (struct File* self);
+static int for_each_chunk   (struct File* self, void* buffer, size_t size, int (*callback)(const char* chunk, size_t size, void* context), void* context);
+static int for_each_line    (struct File* self, void* buffer, size_t size, int delimiter, int (*callback)(const char* line, size_t size, void* context), void* context);
+static int get_block_size   (struct File* self, size_t* size);
+static int get_file_mode    (struct File* self, int* mode);
+static int get_file_name    (struct File* self, char** name);
+static int get_file_path    (struct File* self, char** path);
+static int get_file_stats   (struct File* self, struct SystemStats* stats);
+static int get_opened       (struct File* self, bool* is_open);
+static int map_file         (struct File* self, const char** data, size_t* size);
+static int move_file        (struct File* self, char* from, char* to);
+static int open_file        (struct File* self, char* name, unsigned int mode);
+static int preallocate      (struct File* self, uint64_t offset, uint64_t length);
+static int prefetch         (struct File* self, uint64_t offset, uint64_t length);
+static int punch_hole       (struct File* self, uint64_t offset, uint64_t length);
+static int read_file        (struct File* self, char** buffer);
+static int read_at          (struct File* self, uint64_t offset, void* buffer, size_t size, size_t* bytes_read);
+static int read_chunk       (struct File* self, void* buffer, size_t size, size_t* bytes_read);
+static int read_vector      (struct File* self, const struct iovec* vector, int count, size_t* bytes_read);
+static int set_buffer       (struct File* self, size_t size);
+static int set_group_commit (struct File* self, uint32_t interval);
+static int set_path_cache   (struct File* self, bool enabled);
+static int sync_file        (struct File* self);
+static int truncate_file    (struct File* self, uint64_t size);
+static int unmap_file       (struct File* self);
+static int write_file       (struct File* self, char* buffer);
+static int write_at         (struct File* self, uint64_t offset, const void* data, size_t size, size_t* bytes_written);
+static int write_bytes      (struct File* self, const void* data, size_t size);
+static int write_vector     (struct File* self, const struct iovec* vector, int count, size_t* bytes_written);
+
+static int    advise_mapping      (struct File* self, uint64_t offset, uint64_t length, int advice);
+static int    commit_batch        (int* fds, size_t count);
+static int    commit_sync         (struct File* self, int fd);
+static size_t compress_block      (const char* raw, size_t size, char* packed, size_t capacity, uint32_t* table);
+static int    compress_close      (struct File* self);
+static int    compress_fetch      (struct File* self, size_t index, char* target, char* packed);
+static int    compress_flush      (struct File* self);
+static int    compress_open       (struct File* self);
+static int    compress_read       (struct File* self, void* buffer, size_t size, size_t* bytes_read);
+static int    compress_read_all   (struct File* self, char** buffer);
+static int    compress_read_at    (struct File* self, uint64_t offset, void* buffer, size_t size, size_t* bytes_read);
+static void   compress_run        (struct CompressJob* job, unsigned threads);
+static size_t compress_search     (struct CompressStream* stream, uint64_t position);
+static int    compress_seek       (struct File* self, uint64_t position);
+static void*  compress_work       (void* context);
+static int    compress_write      (struct File* self, const void* data, size_t size);
+static int    copy_contents       (int in, int out, uint64_t size, int flags, int* strategy);
+static int    copy_range          (int in, int out, uint64_t offset, uint64_t end, int flags, int* strategy);
+static int    decompress_block    (const char* packed, size_t size, char* raw, size_t raw_size);
+static void   delete_fail         (struct DeleteTree* tree, int error);
+static void   delete_finish       (struct DeleteTree* tree, struct DeleteNode* node);
+static void   delete_scan         (struct DeleteTree* tree, struct DeleteNode* node);
+static void*  delete_work         (void* context);
+static int    direct_flush        (struct File* self);
+static int    direct_open         (struct File* self, const char* name, int mode);
+static int    direct_read         (struct File* self, void* buffer, size_t size, size_t* bytes_read);
+static int    direct_seek         (struct File* self, uint64_t position);
+static int    direct_write        (struct File* self, const void* data, size_t size);
+static int    emit_line           (struct LineScan* scan, const char* line, size_t size);
+static bool   is_readable         (int mode);
+static bool   is_writable         (int mode);
+static int    make_directories    (char* path, bool cached);
+static void   path_cache_clear    ();
+static bool   path_cache_contains (const char* path);
+static void   path_cache_insert   (const char* path);
+static size_t path_hash           (const char* path);
+static size_t query_block_size    (int fd);
+static int    read_mode           (struct File* self);
+static void   release_name        (struct File* self);
+static size_t scan_lines_avx2     (struct LineScan* scan, const char* data, size_t start, size_t from, size_t size);
+static size_t scan_lines_scalar   (struct LineScan* scan, const char* data, size_t start, size_t from, size_t size);
+static size_t scan_lines_sse2     (struct LineScan* scan, const char* data, size_t start, size_t from, size_t size);
+static void   select_line_scan    ();
+#ifdef KC_SYSTEM_STATS
+static int    stats_close         (struct File* self);
+static int    stats_flush         (struct File* self);
+static int    stats_open          (struct File* self, char* name, unsigned int mode);
+static int    stats_read          (struct File* self, char** buffer);
+static int    stats_read_at       (struct File* self, uint64_t offset, void* buffer, size_t size, size_t* bytes_read);
+static int    stats_read_chunk    (struct File* self, void* buffer, size_t size, size_t* bytes_read);
+static int    stats_read_vector   (struct File* self, const struct iovec* vector, int count, size_t* bytes_read);
+static int    stats_sync          (struct File* self);
+static int    stats_write         (struct File* self, char* buffer);
+static int    stats_write_at      (struct File* self, uint64_t offset, const void* data, size_t size, size_t* bytes_written);
+static int    stats_write_bytes   (struct File* self, const void* data, size_t size);
+static int    stats_write_vector  (struct File* self, const struct iovec* vector, int count, size_t* bytes_written);
+#endif
+static int    store_name          (struct File* self, const char* name);
+static int    sync_stream         (struct File* self, off_t* offset);
+static int    transfer_vector     (int fd, const struct iovec* vector, int count, bool output, off_t offset, size_t* bytes);
 
 //---------------------------------------------------------------------------//
 
@@ -44,7 +322,7 @@ struct File* new_file()
     return NULL;
   }
 
-  struct ConsoleLog* log = new_console_log(err, log_err, __FILE__);
+  struct ConsoleLog* log = get_system_log(KC_SYSTEM_LOG_FILE, __FILE__);
 
   // assigns the public member fields
   file->log    = log;
@@ -54,19 +332,89 @@ struct File* new_file()
   file->mode   = KC_FILE_INVALID;
   file->opened = false;
 
+  file->name_storage = NULL;
+  file->name_size    = 0;
+
+  file->mapped      = NULL;
+  file->mapped_size = 0;
+
+  file->buffer      = NULL;
+  file->buffer_size = 0;
+  file->path_cache  = false;
+
+  file->drop_behind = false;
+  file->drop_offset = 0;
+
+  file->direct          = false;
+  file->block_size      = 0;
+  file->direct_buffer   = NULL;
+  file->direct_size     = 0;
+  file->direct_fill     = 0;
+  file->direct_offset   = 0;
+  file->direct_position = 0;
+  file->direct_writable = false;
+
+  file->commit     = NULL;
+  file->compressed = NULL;
+  file->stats      = NULL;
+
   // assigns the public member methods
-  file->close       = close_file;
-  file->create_path = create_path;
-  file->delete      = delete_file;
-  file->delete_path = delete_path;
-  file->get_mode    = get_file_mode;
-  file->get_name    = get_file_name;
-  file->get_path    = get_file_path;
-  file->is_open     = get_opened;
-  file->move        = NULL;
-  file->open        = open_file;
-  file->read        = read_file;
-  file->write       = write_file;
+  file->advise           = advise_file;
+  file->alloc_aligned    = alloc_aligned;
+  file->atomic_write     = atomic_write;
+  file->close            = close_file;
+  file->copy             = copy_file;
+  file->create_path      = create_path;
+  file->delete           = delete_file;
+  file->delete_path      = delete_path;
+  file->flush            = flush_file;
+  file->for_each_chunk   = for_each_chunk;
+  file->for_each_line    = for_each_line;
+  file->get_block_size   = get_block_size;
+  file->get_mode         = get_file_mode;
+  file->get_name         = get_file_name;
+  file->get_path         = get_file_path;
+  file->get_stats        = get_file_stats;
+  file->is_open          = get_opened;
+  file->map              = map_file;
+  file->move             = move_file;
+  file->open             = open_file;
+  file->preallocate      = preallocate;
+  file->prefetch         = prefetch;
+  file->punch_hole       = punch_hole;
+  file->read             = read_file;
+  file->read_at          = read_at;
+  file->read_chunk       = read_chunk;
+  file->readv            = read_vector;
+  file->set_buffer       = set_buffer;
+  file->set_group_commit = set_group_commit;
+  file->set_path_cache   = set_path_cache;
+  file->sync             = sync_file;
+  file->truncate         = truncate_file;
+  file->unmap            = unmap_file;
+  file->write            = write_file;
+  file->write_at         = write_at;
+  file->write_bytes      = write_bytes;
+  file->writev           = write_vector;
+
+#ifdef KC_SYSTEM_STATS
+  // every I/O method is counted through a wrapper, the methods themselves are
+  // left untouched and nothing at all is added when statistics are off
+  file->stats = calloc(1, sizeof(struct SystemStats));
+
+  file->close       = stats_close;
+  file->flush       = stats_flush;
+  file->open        = stats_open;
+  file->read        = stats_read;
+  file->read_at     = stats_read_at;
+  file->read_chunk  = stats_read_chunk;
+  file->readv       = stats_read_vector;
+  file->sync        = stats_sync;
+  file->write       = stats_write;
+  file->write_at    = stats_write_at;
+  file->write_bytes = stats_write_bytes;
+  file->writev      = stats_write_vector;
+#endif
 
   return file;
 }
@@ -83,18 +431,21 @@ void destroy_file(struct File* file)
     return;
   }
 
-  destroy_console_log(file->log);
-
   // close the file if still open
   file->close(file);
 
-  free(file->name);
+  release_name(file);
+  set_group_commit(file, 0);
+
+  free(file->buffer);
+  free(file->path);
+  free(file->stats);
   free(file);
 }
 
 //---------------------------------------------------------------------------//
 
-int close_file(struct File* self)
+int advise_file(struct File* self, uint64_t offset, uint64_t length, int hint)
 {
   if (self == NULL)
   {
@@ -104,58 +455,80 @@ int close_file(struct File* self)
     return KC_NULL_REFERENCE;
   }
 
-  if (self->file != NULL && self->opened == true)
+  // the file must be open
+  if (self->opened == false)
   {
-    fclose(self->file);
-
-    self->file   = NULL;
-    self->mode   = KC_FILE_INVALID;
-    self->opened = false;
+    return KC_FILE_CLOSED;
   }
 
-  return KC_FILE_SUCCESS;
-}
+  static const int fadvice[] =
+  {
+    POSIX_FADV_NORMAL, POSIX_FADV_SEQUENTIAL, POSIX_FADV_RANDOM,
+    POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED, POSIX_FADV_NOREUSE
+  };
 
-//---------------------------------------------------------------------------//
+  // madvise() has no NOREUSE, MADV_SEQUENTIAL is the closest as the kernel
+  // reads ahead and frees the mapped pages soon after they were accessed
+  static const int madvice[] =
+  {
+    MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED, MADV_DONTNEED,
+    MADV_SEQUENTIAL
+  };
 
-int create_path(struct File* self, char* path)
-{
-  if (self == NULL)
+  if (hint < KC_FILE_ADVISE_NORMAL || hint > KC_FILE_ADVISE_NOREUSE ||
+      offset > (uint64_t)INT64_MAX || length > (uint64_t)INT64_MAX)
   {
-    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
-      __FILE__, __LINE__, __func__);
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
 
-    return KC_NULL_REFERENCE;
+    return KC_FILE_INVALID;
   }
 
-  // free the path before creating a new one
-  if (self->path != NULL)
+  int fd = fileno(self->file);
+
+  // dirty pages can not be dropped, write them out first
+  if (hint == KC_FILE_ADVISE_DONTNEED && is_writable(self->mode) == true)
   {
-    free(self->path);
+    if (fflush(self->file) != 0 ||
+        sync_file_range(fd, (off_t)offset, (off_t)length,
+          SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+          SYNC_FILE_RANGE_WAIT_AFTER) != 0)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
   }
 
-  if (mkdir(path, 0777) != 0)
+  // a length of zero reaches to the end of the file
+  int ret = posix_fadvise(fd, (off_t)offset, (off_t)length, fadvice[hint]);
+
+  if (ret == 0 && self->mapped != NULL)
   {
-    return KC_FILE_INVALID;
+    ret = advise_mapping(self, offset, length, madvice[hint]);
   }
 
-  self->path = (char*)malloc(sizeof(char) * (strlen(path) + 1));
-  if (self->path == NULL)
+  if (ret != 0)
   {
-    return KC_OUT_OF_MEMORY;
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
   }
 
-  // Save the path
-  strcpy(self->path, path);
+  // the data is read only once, read_chunk() drops it behind the stream
+  if (hint == KC_FILE_ADVISE_NOREUSE || hint == KC_FILE_ADVISE_NORMAL)
+  {
+    self->drop_behind = hint == KC_FILE_ADVISE_NOREUSE;
+    self->drop_offset = offset;
+  }
 
   return KC_FILE_SUCCESS;
 }
 
 //---------------------------------------------------------------------------//
 
-int delete_file(struct File* self)
+int alloc_aligned(struct File* self, size_t size, void** buffer)
 {
-  if (self == NULL)
+  if (self == NULL || buffer == NULL)
   {
     log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
       __FILE__, __LINE__, __func__);
@@ -163,27 +536,40 @@ int delete_file(struct File* self)
     return KC_NULL_REFERENCE;
   }
 
-  // close the file before deleting it
-  close_file(self);
+  (*buffer) = NULL;
 
-  if (remove(self->name) != 0)
+  // before a direct file is opened the common page size is assumed
+  size_t alignment = self->direct == true ? self->block_size
+                                          : KC_FILE_DIRECT_ALIGNMENT;
+
+  if (size == 0 || size > SIZE_MAX - alignment)
   {
-    self->log->warning(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
 
     return KC_FILE_INVALID;
   }
 
-  free(self->name);
-  self->name = NULL;
+  // the size is rounded up to whole blocks, so the partial block at the end
+  // of a file can be read into the buffer as well; release it with free()
+  size = (size + alignment - 1) & ~(alignment - 1);
+
+  if (posix_memalign(buffer, alignment, size) != 0)
+  {
+    (*buffer) = NULL;
+
+    return KC_OUT_OF_MEMORY;
+  }
 
   return KC_FILE_SUCCESS;
 }
 
 //---------------------------------------------------------------------------//
 
-int delete_path(struct File* self, char* path)
+int atomic_write(struct File* self, char* path, const void* data, size_t size)
 {
-  if (self == NULL)
+  static uint32_t counter = 0;
+
+  if (self == NULL || path == NULL || data == NULL)
   {
     log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
       __FILE__, __LINE__, __func__);
@@ -191,79 +577,126 @@ int delete_path(struct File* self, char* path)
     return KC_NULL_REFERENCE;
   }
 
-  return KC_FILE_SUCCESS;
-}
-
-//---------------------------------------------------------------------------//
+  size_t length    = strlen(path);
+  char*  temporary = (char*)malloc(length + 32);
+  char*  directory = (char*)malloc(length + 2);
 
-int get_file_mode(struct File* self, int* mode)
-{
-  if (self == NULL)
+  if (temporary == NULL || directory == NULL)
   {
-    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
-      __FILE__, __LINE__, __func__);
+    free(temporary);
+    free(directory);
 
-    return KC_NULL_REFERENCE;
+    return KC_OUT_OF_MEMORY;
   }
 
-  // the file must be open
-  if (self->opened == false)
+  // the new content is written next to the target, on the same file system,
+  // under a name no other thread or process writing the same path can pick
+  int fd = -1;
+
+  do
   {
-    return KC_FILE_CLOSED;
+    snprintf(temporary, length + 32, "%s.%d.%u.tmp", path, (int)getpid(),
+      __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+
+    fd = open(temporary, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
   }
+  while (fd < 0 && errno == EEXIST);
 
-  // only if the file is open
-  (*mode) = self->mode;
+  if (fd < 0)
+  {
+    free(temporary);
+    free(directory);
+    self->log->error(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
 
-  return KC_FILE_SUCCESS;
-}
+    return KC_FILE_INVALID;
+  }
 
-//---------------------------------------------------------------------------//
+  const char* source = (const char*)data;
+  size_t      left   = size;
+  int         ret    = KC_FILE_SUCCESS;
+  struct stat st;
 
-int get_file_name(struct File* self, char** name)
-{
-  if (self == NULL)
+  // a replaced file keeps its permissions
+  if (stat(path, &st) == 0 && fchmod(fd, st.st_mode & 07777) != 0)
   {
-    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
-      __FILE__, __LINE__, __func__);
+    ret = KC_FILE_INVALID;
+  }
 
-    return KC_NULL_REFERENCE;
+  while (left > 0 && ret == KC_FILE_SUCCESS)
+  {
+    ssize_t written = write(fd, source, left);
+
+    if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (written <= 0)
+    {
+      ret = KC_FILE_INVALID;
+      break;
+    }
+
+    source += written;
+    left   -= (size_t)written;
   }
 
-  // the file must be open
-  if (self->opened == false)
+  // the data must be durable before the name points at it, otherwise a
+  // crash could leave the target renamed over an empty file
+  if (ret == KC_FILE_SUCCESS)
   {
-    return KC_FILE_CLOSED;
+    ret = commit_sync(self, fd);
   }
 
-  // only if the file is open
-  (*name) = self->name;
+  if (close(fd) != 0 || ret != KC_FILE_SUCCESS ||
+      rename(temporary, path) != 0)
+  {
+    unlink(temporary);
+    free(temporary);
+    free(directory);
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
 
-  return KC_FILE_SUCCESS;
-}
+    return KC_FILE_INVALID;
+  }
 
-//---------------------------------------------------------------------------//
+  // the rename itself is only durable once its directory is synced
+  char* separator = strrchr(strcpy(directory, path), '/');
 
-int get_file_path(struct File* self, char** path)
-{
-  if (self == NULL)
+  if (separator == NULL)
   {
-    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
-      __FILE__, __LINE__, __func__);
+    strcpy(directory, ".");
+  }
+  else
+  {
+    separator[separator == directory ? 1 : 0] = '\0';
+  }
 
-    return KC_NULL_REFERENCE;
+  fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  ret = fd < 0 ? KC_FILE_INVALID : commit_sync(self, fd);
+
+  if (fd >= 0)
+  {
+    close(fd);
   }
 
-  // only if the file is open
-  (*path) = self->path;
+  free(temporary);
+  free(directory);
 
-  return KC_FILE_SUCCESS;
+  if (ret != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+  }
+
+  return ret;
 }
 
 //---------------------------------------------------------------------------//
 
-int get_opened(struct File* self, bool* is_open)
+int close_file(struct File* self)
 {
+  int ret = KC_FILE_SUCCESS;
+
   if (self == NULL)
   {
     log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
@@ -272,16 +705,41 @@ int get_opened(struct File* self, bool* is_open)
     return KC_NULL_REFERENCE;
   }
 
-  (*is_open) = self->opened;
+  if (self->file != NULL && self->opened == true)
+  {
+    // release the mapping before the descriptor goes away
+    unmap_file(self);
 
-  return KC_FILE_SUCCESS;
+    // the partial block still staged for a direct file goes out last, the
+    // index of a compressed file after its last blocks
+    ret = direct_flush(self);
+
+    if (compress_close(self) != KC_FILE_SUCCESS)
+    {
+      ret = KC_FILE_INVALID;
+    }
+
+    fclose(self->file);
+    free(self->direct_buffer);
+
+    self->file          = NULL;
+    self->mode          = KC_FILE_INVALID;
+    self->opened        = false;
+    self->direct        = false;
+    self->direct_buffer = NULL;
+  }
+
+  return ret;
 }
 
 //---------------------------------------------------------------------------//
 
-int open_file(struct File* self, char* name, unsigned int mode)
+int copy_file(struct File* self, char* from, char* to, int flags,
+  int* strategy)
 {
-  if (self == NULL)
+  static uint32_t counter = 0;
+
+  if (self == NULL || from == NULL || to == NULL || strategy == NULL)
   {
     log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
       __FILE__, __LINE__, __func__);
@@ -289,94 +747,102 @@ int open_file(struct File* self, char* name, unsigned int mode)
     return KC_NULL_REFERENCE;
   }
 
-  const char* tmp_mode = NULL;
+  (*strategy) = 0;
 
-  // Create new file, fail if exists
-  if (mode & KC_FILE_CREATE_NEW)
-  {
-    tmp_mode   = "wx";
-    self->mode = KC_FILE_CREATE_NEW;
-  }
-  
-  // Create new file, overwrite if exists
-  if (mode & KC_FILE_CREATE_ALWAYS)
+  // no restriction means any strategy will do
+  if ((flags & KC_FILE_COPY_ANY) == 0)
   {
-    tmp_mode   = "w";
-    self->mode = KC_FILE_CREATE_ALWAYS;
+    flags |= KC_FILE_COPY_ANY;
   }
 
-  // Open existing file, fail if not exists
-  if (mode & KC_FILE_OPEN_EXISTING)
+  struct stat st;
+
+  int in = open(from, O_RDONLY | O_CLOEXEC);
+
+  if (in < 0 || fstat(in, &st) != 0 || S_ISREG(st.st_mode) == false)
   {
-    tmp_mode   = "r";
-    self->mode = KC_FILE_OPEN_EXISTING;
+    if (in >= 0)
+    {
+      close(in);
+    }
+
+    self->log->error(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
   }
 
-  // Open existing file or create new
-  if (mode & KC_FILE_OPEN_ALWAYS)
+  struct stat target;
+
+  // the same file, or a hard link to it, is never copied onto itself
+  if (stat(to, &target) == 0 && target.st_dev == st.st_dev &&
+      target.st_ino == st.st_ino)
   {
-    tmp_mode   = "a+";
-    self->mode = KC_FILE_OPEN_ALWAYS;
+    close(in);
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
   }
 
-  // Open existing file for read ony
-  if (mode & KC_FILE_READ)
+  size_t length    = strlen(to);
+  char*  temporary = (char*)malloc(length + 32);
+
+  if (temporary == NULL)
   {
-    tmp_mode   = "r";
-    self->mode = KC_FILE_READ;
+    close(in);
+
+    return KC_OUT_OF_MEMORY;
   }
 
-  // Open existing file for write only
-  if (mode & KC_FILE_WRITE)
+  // the copy is made next to the destination and only replaces it once it
+  // is complete, a failed copy leaves the destination as it was
+  int out = -1;
+
+  do
   {
-    tmp_mode   = "w";
-    self->mode = KC_FILE_WRITE;
+    snprintf(temporary, length + 32, "%s.%d.%u.tmp", to, (int)getpid(),
+      __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+
+    out = open(temporary, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+      st.st_mode & 07777);
   }
+  while (out < 0 && errno == EEXIST);
 
-  if (self->mode == NULL || tmp_mode == NULL)
+  if (out < 0)
   {
-    // Invalid mode provided
-    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+    close(in);
+    free(temporary);
+    self->log->error(self->log, KC_PERMISSION_DENIED, __LINE__, __func__);
 
     return KC_FILE_INVALID;
   }
 
-  // if a file was already opened, close it first
-  if (self->opened == true)
+  int ret = copy_contents(in, out, (uint64_t)st.st_size, flags, strategy);
+
+  if (close(out) != 0)
   {
-    fclose(self->file);
+    ret = KC_FILE_INVALID;
   }
 
-  self->file = fopen(name, tmp_mode);
+  close(in);
 
-  if (self->file == NULL)
+  if (ret != KC_FILE_SUCCESS || rename(temporary, to) != 0)
   {
-    // File opening failed
-    self->log->error(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
-
-    return KC_FILE_INVALID;
-  }
+    unlink(temporary);
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
 
-  // Save the file name
-  self->name = (char*)malloc(sizeof(char) * (strlen(name) + 1));
-  if (self->name == NULL)
-  {
-    return KC_OUT_OF_MEMORY;
+    ret = KC_FILE_INVALID;
   }
 
-  strcpy(self->name, name);
-  self->opened = true; // file is open
+  free(temporary);
 
-  return KC_FILE_SUCCESS; // Return success status
+  return ret;
 }
 
 //---------------------------------------------------------------------------//
 
-int read_file(struct File* self, char** buffer)
+int create_path(struct File* self, char* path)
 {
-  int ret = KC_FILE_INVALID;
-
-  if (self == NULL)
+  if (self == NULL || path == NULL)
   {
     log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
       __FILE__, __LINE__, __func__);
@@ -384,55 +850,84 @@ int read_file(struct File* self, char** buffer)
     return KC_NULL_REFERENCE;
   }
 
-  // open the file in "read" mode
-  ret = open_file(self, self->name, KC_FILE_READ);
-  if (ret == KC_FILE_INVALID)
+  size_t length = strlen(path);
+  char*  clean  = (char*)malloc(sizeof(char) * (length + 1));
+
+  if (clean == NULL)
   {
-    return ret;
+    return KC_OUT_OF_MEMORY;
   }
 
-  fseek(self->file, 0, SEEK_END);
-  long file_size = ftell(self->file);
+  // collapse repeated separators and drop the trailing one
+  size_t size = 0;
 
-  // Error determining file size
-  if (file_size == -1)
+  for (size_t i = 0; i < length; ++i)
   {
-    return KC_BUFFER_OVERFLOW;
+    if (path[i] != '/' || size == 0 || clean[size - 1] != '/')
+    {
+      clean[size++] = path[i];
+    }
   }
 
-  // Reset file pointer to the beginning
-  fseek(self->file, 0, SEEK_SET);
+  if (size > 1 && clean[size - 1] == '/')
+  {
+    --size;
+  }
 
-  (*buffer) = (char*)malloc(file_size + 1);
+  clean[size] = '\0';
 
-  // Memory allocation failed
-  if (*buffer == NULL)
+  // create every missing component, existing ones are fine
+  int ret = size == 0 ? KC_FILE_INVALID
+    : make_directories(clean, self->path_cache);
+
+  if (ret != KC_FILE_SUCCESS)
   {
-    return KC_OUT_OF_MEMORY;
+    free(clean);
+
+    return ret;
   }
 
-  // Read file content into buffer
-  size_t bytes_read = fread((void*)*buffer, 1, file_size, self->file);
+  // the previous path is only replaced once the new one exists
+  free(self->path);
 
-  // Error reading file content
-  if (bytes_read != (size_t)file_size)
+  // Save the path
+  self->path = clean;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int delete_file(struct File* self)
+{
+  if (self == NULL)
   {
-    free(buffer);
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
 
-    return KC_BUFFER_OVERFLOW;
+    return KC_NULL_REFERENCE;
   }
 
-  // Null-terminate the content
-  (*buffer)[file_size] = '\0';
+  // close the file before deleting it
+  close_file(self);
+
+  if (remove(self->name) != 0)
+  {
+    self->log->warning(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  release_name(self);
 
   return KC_FILE_SUCCESS;
 }
 
 //---------------------------------------------------------------------------//
 
-int write_file(struct File* self, char* buffer)
+int delete_path(struct File* self, char* path, size_t* removed)
 {
-  if (self == NULL || buffer == NULL)
+  if (self == NULL || path == NULL)
   {
     log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
       __FILE__, __LINE__, __func__);
@@ -440,14 +935,4271 @@ int write_file(struct File* self, char* buffer)
     return KC_NULL_REFERENCE;
   }
 
-  size_t bytes_written = fwrite(buffer, 1, strlen(buffer), self->file);
+  struct DeleteTree tree;
+  struct stat       st;
 
-  // Error writing content to file
-  if (bytes_written != strlen(buffer))
+  tree.queue   = NULL;
+  tree.active  = 0;
+  tree.removed = 0;
+  tree.error   = 0;
+
+  if (lstat(path, &st) != 0)
+  {
+    tree.error = errno;
+  }
+  else if (S_ISDIR(st.st_mode) == false)
+  {
+    // a plain file or a link, nothing to walk
+    if (unlink(path) != 0)
+    {
+      tree.error = errno;
+    }
+    else
+    {
+      tree.removed = 1;
+    }
+  }
+  else
+  {
+    struct DeleteNode* root = malloc(sizeof(struct DeleteNode));
+
+    if (root == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+
+    root->parent   = NULL;
+    root->next     = NULL;
+    root->name     = strdup(path);
+    root->fd       = -1;
+    root->children = 0;
+    root->scanned  = false;
+
+    if (root->name == NULL)
+    {
+      free(root);
+      return KC_OUT_OF_MEMORY;
+    }
+
+    tree.queue = root;
+
+    pthread_mutex_init(&tree.lock, NULL);
+    pthread_cond_init(&tree.work, NULL);
+
+    // subdirectories are fanned out to a small pool, a directory keeps its
+    // descriptor until it is emptied, so the descriptor count follows the
+    // depth of the tree rather than its width
+    pthread_t workers[KC_FILE_DELETE_WORKERS - 1];
+    long      cpus    = sysconf(_SC_NPROCESSORS_ONLN);
+    int       threads = 0;
+
+    while (threads < KC_FILE_DELETE_WORKERS - 1 && threads < cpus - 1)
+    {
+      if (pthread_create(&workers[threads], NULL, delete_work, &tree) != 0)
+      {
+        break;
+      }
+
+      ++threads;
+    }
+
+    // the calling thread works as well
+    delete_work(&tree);
+
+    for (int i = 0; i < threads; ++i)
+    {
+      pthread_join(workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&tree.work);
+    pthread_mutex_destroy(&tree.lock);
+  }
+
+  if (removed != NULL)
+  {
+    (*removed) = tree.removed;
+  }
+
+  // the removed directories may still be remembered as existing
+  path_cache_clear();
+
+  // forget the saved path if it was just removed
+  if (self->path != NULL && strcmp(self->path, path) == 0 && tree.error == 0)
+  {
+    free(self->path);
+    self->path = NULL;
+  }
+
+  if (tree.error != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    // report the first failure to the caller
+    errno = tree.error;
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int flush_file(struct File* self)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // hand every buffered byte over to the kernel in a single write, the
+  // blocks staged for a compressed file are cut short
+  if (compress_flush(self) != KC_FILE_SUCCESS || fflush(self->file) != 0 ||
+      direct_flush(self) != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int for_each_chunk(struct File* self, void* buffer, size_t size,
+  int (*callback)(const char* chunk, size_t size, void* context), void* context)
+{
+  int ret = KC_FILE_INVALID;
+
+  if (self == NULL || buffer == NULL || callback == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  if (size == 0)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // write-only streams are reopened for reading, like read() does
+  if (self->opened == false || is_readable(self->mode) == false)
+  {
+    ret = open_file(self, self->name, read_mode(self));
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+  }
+
+  // always stream the whole file, from the first byte
+  if (fseek(self->file, 0, SEEK_SET) != 0 ||
+      direct_seek(self, 0) != KC_FILE_SUCCESS ||
+      compress_seek(self, 0) != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the same caller buffer is reused for every chunk
+  for (;;)
   {
+    size_t bytes_read = 0;
+
+    ret = read_chunk(self, buffer, size, &bytes_read);
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+
+    // end of file
+    if (bytes_read == 0)
+    {
+      break;
+    }
+
+    // the callback can stop the iteration by returning anything else
+    ret = callback((const char*)buffer, bytes_read, context);
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int for_each_line(struct File* self, void* buffer, size_t size, int delimiter,
+  int (*callback)(const char* line, size_t size, void* context), void* context)
+{
+  int ret = KC_FILE_INVALID;
+
+  if (self == NULL || callback == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  if (buffer != NULL && size == 0)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  pthread_once(&line_scan_once, select_line_scan);
+
+  struct LineScan scan = { callback, context, delimiter, KC_FILE_SUCCESS };
+
+  // a mapped file is scanned in place, no line is ever copied
+  if (self->opened == true && self->mode == KC_FILE_MMAP)
+  {
+    const char* data   = NULL;
+    size_t      length = 0;
+
+    ret = map_file(self, &data, &length);
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+
+    size_t start = scan_lines(&scan, data, 0, 0, length);
+
+    // the last line does not need a delimiter
+    if (scan.ret == KC_FILE_SUCCESS && start < length)
+    {
+      emit_line(&scan, data + start, length - start);
+    }
+
+    return scan.ret;
+  }
+
+  // write-only streams are reopened for reading, like read() does
+  if (self->opened == false || is_readable(self->mode) == false)
+  {
+    ret = open_file(self, self->name, read_mode(self));
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+  }
+
+  // always stream the whole file, from the first byte
+  if (fseek(self->file, 0, SEEK_SET) != 0 ||
+      direct_seek(self, 0) != KC_FILE_SUCCESS ||
+      compress_seek(self, 0) != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
     return KC_FILE_INVALID;
   }
 
+  char*  data     = (char*)buffer;
+  char*  owned    = NULL;
+  size_t capacity = buffer != NULL ? size : KC_FILE_LINE_BUFFER_SIZE;
+  size_t fill     = 0;
+
+  if (data == NULL && (data = owned = malloc(capacity)) == NULL)
+  {
+    self->log->error(self->log, KC_OUT_OF_MEMORY, __LINE__, __func__);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // lines are handed out from the buffer they were read into, only the line
+  // cut by the end of a chunk is moved to the front before the next read
+  for (;;)
+  {
+    size_t bytes_read = 0;
+
+    // a single line fills the whole buffer, so it has to grow; a caller
+    // buffer is never resized, the line continues in a copy
+    if (fill == capacity)
+    {
+      char* grown = malloc(capacity * 2);
+
+      if (grown == NULL)
+      {
+        self->log->error(self->log, KC_OUT_OF_MEMORY, __LINE__, __func__);
+
+        scan.ret = KC_OUT_OF_MEMORY;
+        break;
+      }
+
+      memcpy(grown, data, fill);
+      free(owned);
+
+      data      = owned = grown;
+      capacity *= 2;
+    }
+
+    ret = read_chunk(self, data + fill, capacity - fill, &bytes_read);
+    if (ret != KC_FILE_SUCCESS)
+    {
+      scan.ret = ret;
+      break;
+    }
+
+    // end of file, the last line does not need a delimiter
+    if (bytes_read == 0)
+    {
+      if (fill > 0)
+      {
+        emit_line(&scan, data, fill);
+      }
+
+      break;
+    }
+
+    // the part already carried over holds no delimiter, skip it
+    size_t start = scan_lines(&scan, data, 0, fill, fill + bytes_read);
+
+    // the callback can stop the iteration by returning anything else
+    if (scan.ret != KC_FILE_SUCCESS)
+    {
+      break;
+    }
+
+    fill = fill + bytes_read - start;
+    memmove(data, data + start, fill);
+  }
+
+  free(owned);
+
+  return scan.ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int get_block_size(struct File* self, size_t* size)
+{
+  if (self == NULL || size == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // direct I/O buffers, offsets and sizes must be multiples of this size
+  (*size) = self->direct == true ? self->block_size
+                                 : query_block_size(fileno(self->file));
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int get_file_mode(struct File* self, int* mode)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // only if the file is open
+  (*mode) = self->mode;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int get_file_name(struct File* self, char** name)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // only if the file is open
+  (*name) = self->name;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int get_file_path(struct File* self, char** path)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // only if the file is open
+  (*path) = self->path;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int get_file_stats(struct File* self, struct SystemStats* stats)
+{
+  if (self == NULL || stats == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  memset(stats, 0, sizeof(struct SystemStats));
+
+  if (self->stats == NULL)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  const uint64_t* counters = (const uint64_t*)self->stats;
+  uint64_t*       copy     = (uint64_t*)stats;
+
+  // other threads may still be counting into the same File
+  for (size_t i = 0; i < sizeof(struct SystemStats) / sizeof(uint64_t); ++i)
+  {
+    copy[i] = __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int get_opened(struct File* self, bool* is_open)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  (*is_open) = self->opened;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int map_file(struct File* self, const char** data, size_t* size)
+{
+  if (self == NULL || data == NULL || size == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // the view is only available for files opened with KC_FILE_MMAP
+  if (self->mode != KC_FILE_MMAP)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the file is already mapped, hand out the same view
+  if (self->mapped != NULL)
+  {
+    (*data) = self->mapped;
+    (*size) = self->mapped_size;
+
+    return KC_FILE_SUCCESS;
+  }
+
+  struct stat st;
+  int fd = fileno(self->file);
+
+  if (fstat(fd, &st) != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the file is too large to be addressed by this process
+  if ((uint64_t)st.st_size > (uint64_t)SIZE_MAX)
+  {
+    return KC_BUFFER_OVERFLOW;
+  }
+
+  // an empty file can not be mapped, return an empty view instead
+  if (st.st_size == 0)
+  {
+    (*data) = NULL;
+    (*size) = 0;
+
+    return KC_FILE_SUCCESS;
+  }
+
+  // map the file read-only, the pages are faulted in on first access
+  void* view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  if (view == MAP_FAILED)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  self->mapped      = (const char*)view;
+  self->mapped_size = (size_t)st.st_size;
+
+  (*data) = self->mapped;
+  (*size) = self->mapped_size;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int move_file(struct File* self, char* from, char* to)
+{
+  if (self == NULL || from == NULL || to == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // on the same file system this is only a metadata update
+  if (rename(from, to) != 0)
+  {
+    if (errno != EXDEV)
+    {
+      self->log->error(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    // across devices the data is copied, only regular files can be moved
+    struct stat st;
+
+    int in  = open(from, O_RDONLY | O_CLOEXEC);
+    int out = -1;
+    int ret = KC_FILE_INVALID;
+
+    if (in >= 0 && fstat(in, &st) == 0 && S_ISREG(st.st_mode))
+    {
+      out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        st.st_mode & 07777);
+    }
+
+    if (out >= 0)
+    {
+      int strategy = 0;
+
+      // holes in the source stay holes on the other device
+      ret = copy_contents(in, out, (uint64_t)st.st_size,
+        KC_FILE_COPY_ANY | KC_FILE_COPY_SPARSE, &strategy);
+
+      // the source is only removed once the copy is on stable storage
+      if (ret == KC_FILE_SUCCESS && fsync(out) != 0)
+      {
+        ret = KC_FILE_INVALID;
+      }
+
+      if (close(out) != 0)
+      {
+        ret = KC_FILE_INVALID;
+      }
+
+      if (ret != KC_FILE_SUCCESS)
+      {
+        unlink(to);
+      }
+    }
+
+    if (in >= 0)
+    {
+      close(in);
+    }
+
+    if (ret != KC_FILE_SUCCESS || unlink(from) != 0)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+  }
+
+  // a moved directory may still be remembered under its old name
+  path_cache_clear();
+
+  // keep track of the file if it was the one being moved
+  if (self->name != NULL && strcmp(self->name, from) == 0)
+  {
+    return store_name(self, to);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int open_file(struct File* self, char* name, unsigned int mode)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  const char* tmp_mode = NULL;
+
+  // Create new file, fail if exists
+  if (mode & KC_FILE_CREATE_NEW)
+  {
+    tmp_mode   = "wx";
+    self->mode = KC_FILE_CREATE_NEW;
+  }
+  
+  // Create new file, overwrite if exists
+  if (mode & KC_FILE_CREATE_ALWAYS)
+  {
+    tmp_mode   = "w";
+    self->mode = KC_FILE_CREATE_ALWAYS;
+  }
+
+  // Open existing file, fail if not exists
+  if (mode & KC_FILE_OPEN_EXISTING)
+  {
+    tmp_mode   = "r";
+    self->mode = KC_FILE_OPEN_EXISTING;
+  }
+
+  // Open existing file or create new
+  if (mode & KC_FILE_OPEN_ALWAYS)
+  {
+    tmp_mode   = "a+";
+    self->mode = KC_FILE_OPEN_ALWAYS;
+  }
+
+  // Open existing file for read ony
+  if (mode & KC_FILE_READ)
+  {
+    tmp_mode   = "r";
+    self->mode = KC_FILE_READ;
+  }
+
+  // Open existing file for write only
+  if (mode & KC_FILE_WRITE)
+  {
+    tmp_mode   = "w";
+    self->mode = KC_FILE_WRITE;
+  }
+
+  // Open existing file for read only, to be accessed through map()
+  if (mode & KC_FILE_MMAP)
+  {
+    tmp_mode   = "r";
+    self->mode = KC_FILE_MMAP;
+  }
+
+  if (tmp_mode == NULL)
+  {
+    // Invalid mode provided
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // direct I/O moves whole blocks from a known position, which neither an
+  // appending stream nor a mapping can provide
+  if ((mode & KC_FILE_DIRECT) &&
+      (self->mode == KC_FILE_OPEN_ALWAYS || self->mode == KC_FILE_MMAP))
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // a compressed file is either written from the start or read, through its
+  // own blocks rather than mapped or direct ones
+  if ((mode & KC_FILE_COMPRESSED) &&
+      ((mode & KC_FILE_DIRECT) || self->mode == KC_FILE_OPEN_ALWAYS ||
+       self->mode == KC_FILE_MMAP))
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // if a file was already opened, close it first
+  if (self->opened == true)
+  {
+    unmap_file(self);
+    direct_flush(self);
+    compress_close(self);
+    fclose(self->file);
+    free(self->direct_buffer);
+
+    self->opened        = false;
+    self->direct        = false;
+    self->direct_buffer = NULL;
+  }
+
+  // O_DIRECT has no fopen() mode, such files are opened by descriptor
+  if (mode & KC_FILE_DIRECT)
+  {
+    int ret = direct_open(self, name, self->mode);
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+  }
+  else
+  {
+    self->file = fopen(name, tmp_mode);
+  }
+
+  if (self->file == NULL)
+  {
+    // File opening failed
+    self->log->error(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // use the caller sized buffer, small writes are coalesced into it
+  if (self->buffer != NULL)
+  {
+    setvbuf(self->file, self->buffer, _IOFBF, self->buffer_size);
+  }
+
+  // Save the file name
+  if (store_name(self, name) != KC_FILE_SUCCESS)
+  {
+    fclose(self->file);
+    free(self->direct_buffer);
+
+    self->file          = NULL;
+    self->direct        = false;
+    self->direct_buffer = NULL;
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // a writer starts with the header, a reader loads the block index
+  if (mode & KC_FILE_COMPRESSED)
+  {
+    int ret = compress_open(self);
+    if (ret != KC_FILE_SUCCESS)
+    {
+      fclose(self->file);
+
+      self->file = NULL;
+
+      return ret;
+    }
+  }
+
+  // hints given to the previous file do not carry over
+  self->drop_behind = false;
+  self->drop_offset = 0;
+
+  self->opened = true; // file is open
+
+  return KC_FILE_SUCCESS; // Return success status
+}
+
+//---------------------------------------------------------------------------//
+
+int preallocate(struct File* self, uint64_t offset, uint64_t length)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  if (is_writable(self->mode) == false || length == 0 ||
+      offset > (uint64_t)INT64_MAX || length > (uint64_t)INT64_MAX - offset)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // reserve the blocks up front so the writes that follow land in large
+  // contiguous extents; the size is kept, so the stream still appends
+  if (fallocate(fileno(self->file), FALLOC_FL_KEEP_SIZE, (off_t)offset,
+        (off_t)length) != 0)
+  {
+    if (errno == EOPNOTSUPP || errno == ENOSYS)
+    {
+      return KC_UNSUPPORTED_FEATURE;
+    }
+
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int prefetch(struct File* self, uint64_t offset, uint64_t length)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  if (offset > (uint64_t)INT64_MAX || length > (uint64_t)INT64_MAX)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the kernel starts reading the range and returns right away, so a later
+  // read finds the pages in the cache instead of waiting for the device
+  int ret = posix_fadvise(fileno(self->file), (off_t)offset, (off_t)length,
+    POSIX_FADV_WILLNEED);
+
+  // a mapped range is also wired into the page tables ahead of time
+  if (ret == 0 && self->mapped != NULL)
+  {
+    ret = advise_mapping(self, offset, length, MADV_WILLNEED);
+  }
+
+  if (ret != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int punch_hole(struct File* self, uint64_t offset, uint64_t length)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  if (is_writable(self->mode) == false || length == 0 ||
+      offset > (uint64_t)INT64_MAX || length > (uint64_t)INT64_MAX - offset)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // buffered data must not land in the hole after it is punched
+  if (fflush(self->file) != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the range reads back as zeros and its blocks are given back
+  int mode = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+
+  if (fallocate(fileno(self->file), mode, (off_t)offset, (off_t)length) != 0)
+  {
+    if (errno == EOPNOTSUPP || errno == ENOSYS)
+    {
+      return KC_UNSUPPORTED_FEATURE;
+    }
+
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int read_file(struct File* self, char** buffer)
+{
+  int ret = KC_FILE_INVALID;
+
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // a stream that can already read is only rewound, the rest are reopened
+  if (self->opened == true && is_readable(self->mode) == true)
+  {
+    if (fflush(self->file) != 0)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+  }
+  else
+  {
+    // open the file in "read" mode, direct files stay direct
+    ret = open_file(self, self->name, read_mode(self));
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+  }
+
+  // a compressed file is decompressed block by block, all at once
+  if (self->compressed != NULL)
+  {
+    return compress_read_all(self, buffer);
+  }
+
+  struct stat st;
+
+  // Error determining file size
+  if (fstat(fileno(self->file), &st) != 0)
+  {
+    return KC_BUFFER_OVERFLOW;
+  }
+
+  off_t file_size = st.st_size;
+
+  // a direct file lands in an aligned buffer without any copy, the partial
+  // block at the end is read whole and the rest of it is cut off
+  if (self->direct == true)
+  {
+    ret = alloc_aligned(self, (size_t)file_size + 1, (void**)buffer);
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+
+    size_t total = 0;
+
+    while (total < (size_t)file_size)
+    {
+      size_t  length = ((size_t)file_size - total + self->block_size - 1) &
+                       ~(self->block_size - 1);
+      ssize_t done   = pread(fileno(self->file), (*buffer) + total, length,
+                         (off_t)total);
+
+      if (done < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (done <= 0)
+      {
+        break;
+      }
+
+      total += (size_t)done;
+    }
+
+    // Error reading file content
+    if (total != (size_t)file_size)
+    {
+      free(*buffer);
+      (*buffer) = NULL;
+
+      return KC_BUFFER_OVERFLOW;
+    }
+
+    (*buffer)[file_size] = '\0';
+
+    return direct_seek(self, (uint64_t)file_size);
+  }
+
+  // Reset file pointer to the beginning
+  fseeko(self->file, 0, SEEK_SET);
+
+  (*buffer) = (char*)malloc(file_size + 1);
+
+  // Memory allocation failed
+  if (*buffer == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // Read file content into buffer
+  size_t bytes_read = fread((void*)*buffer, 1, file_size, self->file);
+
+  // Error reading file content
+  if (bytes_read != (size_t)file_size)
+  {
+    free(*buffer);
+    (*buffer) = NULL;
+
+    return KC_BUFFER_OVERFLOW;
+  }
+
+  // Null-terminate the content
+  (*buffer)[file_size] = '\0';
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int read_at(struct File* self, uint64_t offset, void* buffer, size_t size,
+  size_t* bytes_read)
+{
+  int ret = KC_FILE_INVALID;
+
+  if (self == NULL || buffer == NULL || bytes_read == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  (*bytes_read) = 0;
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // write-only streams can not be read
+  if (is_readable(self->mode) == false || offset > (uint64_t)INT64_MAX)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // offsets of a compressed file are offsets into its decompressed data
+  if (self->compressed != NULL)
+  {
+    ret = compress_read_at(self, offset, buffer, size, bytes_read);
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+    }
+
+    return ret;
+  }
+
+  struct iovec vector = { buffer, size };
+
+  // the stream and its position are never touched, so any number of threads
+  // can read from the same file at once; buffered writes need a flush first
+  ret = transfer_vector(fileno(self->file), &vector, 1, false, (off_t)offset,
+    bytes_read);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int read_chunk(struct File* self, void* buffer, size_t size, size_t* bytes_read)
+{
+  if (self == NULL || buffer == NULL || bytes_read == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  (*bytes_read) = 0;
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // write-only streams can not be read
+  if (is_readable(self->mode) == false)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // direct files never touch the stream or the page cache
+  if (self->direct == true)
+  {
+    return direct_read(self, buffer, size, bytes_read);
+  }
+
+  // compressed files are decompressed on the fly
+  if (self->compressed != NULL)
+  {
+    return compress_read(self, buffer, size, bytes_read);
+  }
+
+  // read the next chunk from the current position, for requests larger than
+  // the stdio buffer the data lands directly into the caller buffer
+  (*bytes_read) = fread(buffer, 1, size, self->file);
+
+  // Error reading file content
+  if ((*bytes_read) < size && ferror(self->file))
+  {
+    clearerr(self->file);
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // a scan gives back the pages it already went through, so it does not
+  // push hotter data out of the page cache
+  if (self->drop_behind == true)
+  {
+    off_t position = ftello(self->file);
+
+    if (position >= 0 &&
+        (uint64_t)position >= self->drop_offset + KC_FILE_DROP_WINDOW)
+    {
+      posix_fadvise(fileno(self->file), (off_t)self->drop_offset,
+        position - (off_t)self->drop_offset, POSIX_FADV_DONTNEED);
+
+      self->drop_offset = (uint64_t)position;
+    }
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int read_vector(struct File* self, const struct iovec* vector, int count,
+  size_t* bytes_read)
+{
+  int   ret    = KC_FILE_INVALID;
+  off_t offset = 0;
+
+  if (self == NULL || vector == NULL || bytes_read == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  (*bytes_read) = 0;
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // write-only streams can not be read
+  if (is_readable(self->mode) == false || count < 0)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // direct and compressed files fill the buffers one after the other
+  if (self->direct == true || self->compressed != NULL)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      size_t done = 0;
+
+      ret = self->direct == true
+        ? direct_read(self, vector[i].iov_base, vector[i].iov_len, &done)
+        : compress_read(self, vector[i].iov_base, vector[i].iov_len, &done);
+
+      (*bytes_read) += done;
+
+      if (ret != KC_FILE_SUCCESS || done < vector[i].iov_len)
+      {
+        return ret;
+      }
+    }
+
+    return KC_FILE_SUCCESS;
+  }
+
+  // find the logical stream position, past any read-ahead
+  ret = sync_stream(self, &offset);
+  if (ret != KC_FILE_SUCCESS)
+  {
+    return ret;
+  }
+
+  // scatter the data straight into the caller buffers
+  ret = transfer_vector(fileno(self->file), vector, count, false, offset,
+    bytes_read);
+
+  // move the stream past the data that was read
+  fseeko(self->file, offset + (off_t)(*bytes_read), SEEK_SET);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int set_buffer(struct File* self, size_t size)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  if (size == 0)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // setvbuf() is only allowed before the first I/O on a stream, the buffer
+  // is handed to the stream by the next open()
+  if (self->opened == true)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  char* buffer = (char*)malloc(size);
+
+  if (buffer == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // the previous buffer is no longer referenced by any stream
+  free(self->buffer);
+
+  self->buffer      = buffer;
+  self->buffer_size = size;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int set_group_commit(struct File* self, uint32_t interval)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct GroupCommit* group = (struct GroupCommit*)self->commit;
+
+  // an interval of zero goes back to one sync per caller, once the threads
+  // already waiting for a batch are through; new callers sync on their own
+  if (interval == 0)
+  {
+    if (group != NULL)
+    {
+      pthread_mutex_lock(&group->lock);
+
+      group->closing = true;
+
+      // a leader collecting its batch stops waiting for more threads
+      pthread_cond_broadcast(&group->joined);
+
+      while (group->waiters > 0)
+      {
+        pthread_cond_wait(&group->drained, &group->lock);
+      }
+
+      pthread_mutex_unlock(&group->lock);
+
+      pthread_mutex_destroy(&group->lock);
+      pthread_cond_destroy(&group->done);
+      pthread_cond_destroy(&group->joined);
+      pthread_cond_destroy(&group->drained);
+
+      free(group->fds);
+      free(group->spare);
+      free(group);
+    }
+
+    self->commit = NULL;
+
+    return KC_FILE_SUCCESS;
+  }
+
+  if (group == NULL)
+  {
+    group = (struct GroupCommit*)calloc(1, sizeof(struct GroupCommit));
+
+    if (group == NULL)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+
+    pthread_condattr_t attributes;
+
+    // the leader waits for the interval on the monotonic clock
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&group->lock, NULL);
+    pthread_cond_init(&group->done, NULL);
+    pthread_cond_init(&group->joined, &attributes);
+    pthread_cond_init(&group->drained, NULL);
+    pthread_condattr_destroy(&attributes);
+
+    // the batch collected first is generation one, nothing has failed yet
+    group->generation = 1;
+
+    self->commit = group;
+  }
+
+  group->interval = (uint64_t)interval * 1000;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int set_path_cache(struct File* self, bool enabled)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // create_path() remembers the directories it made or found, and skips
+  // every system call for them the next time around
+  self->path_cache = enabled;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int sync_file(struct File* self)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // everything still buffered in user space has to reach the kernel first
+  if (compress_flush(self) != KC_FILE_SUCCESS || fflush(self->file) != 0 ||
+      direct_flush(self) != KC_FILE_SUCCESS ||
+      commit_sync(self, fileno(self->file)) != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int truncate_file(struct File* self, uint64_t size)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // the blocks of a compressed file can not be cut at a raw offset
+  if (is_writable(self->mode) == false || size > (uint64_t)INT64_MAX ||
+      self->compressed != NULL)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // buffered data past the new end would otherwise grow the file again;
+  // growing it leaves a hole, no zeros are written
+  if (fflush(self->file) != 0 || direct_flush(self) != KC_FILE_SUCCESS ||
+      ftruncate(fileno(self->file), (off_t)size) != 0 ||
+      direct_seek(self, self->direct_position) != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int unmap_file(struct File* self)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // nothing to release
+  if (self->mapped == NULL)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  if (munmap((void*)self->mapped, self->mapped_size) != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  self->mapped      = NULL;
+  self->mapped_size = 0;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int write_file(struct File* self, char* buffer)
+{
+  if (self == NULL || buffer == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  return write_bytes(self, buffer, strlen(buffer));
+}
+
+//---------------------------------------------------------------------------//
+
+int write_at(struct File* self, uint64_t offset, const void* data, size_t size,
+  size_t* bytes_written)
+{
+  int ret = KC_FILE_INVALID;
+
+  if (self == NULL || data == NULL || bytes_written == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  (*bytes_written) = 0;
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // read-only streams can not be written, nor can compressed files at an
+  // offset, their blocks only grow at the end
+  if (is_writable(self->mode) == false || offset > (uint64_t)INT64_MAX ||
+      self->compressed != NULL)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  struct iovec vector = { (void*)data, size };
+
+  // like read_at(), the stream position is left alone; files opened with
+  // KC_FILE_OPEN_ALWAYS are in append mode, where the data goes to the end
+  ret = transfer_vector(fileno(self->file), &vector, 1, true, (off_t)offset,
+    bytes_written);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int write_bytes(struct File* self, const void* data, size_t size)
+{
+  if (self == NULL || data == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // direct files are staged in whole blocks, past the stream
+  if (self->direct == true)
+  {
+    if (is_writable(self->mode) == false)
+    {
+      self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    return direct_write(self, data, size);
+  }
+
+  // compressed files are staged in whole blocks, and written once compressed
+  if (self->compressed != NULL)
+  {
+    if (is_writable(self->mode) == false)
+    {
+      self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    return compress_write(self, data, size);
+  }
+
+  // small writes are copied into the stream buffer and reach the kernel in
+  // one write(2) once it fills up, large ones are written out directly
+  size_t bytes_written = fwrite(data, 1, size, self->file);
+
+  // Error writing content to file
+  if (bytes_written != size)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int write_vector(struct File* self, const struct iovec* vector, int count,
+  size_t* bytes_written)
+{
+  int   ret    = KC_FILE_INVALID;
+  off_t offset = 0;
+
+  if (self == NULL || vector == NULL || bytes_written == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  (*bytes_written) = 0;
+
+  // the file must be open
+  if (self->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // read-only streams can not be written
+  if (is_writable(self->mode) == false || count < 0)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // direct and compressed files stage the fragments like any other write
+  if (self->direct == true || self->compressed != NULL)
+  {
+    for (int i = 0; i < count; ++i)
+    {
+      ret = self->direct == true
+        ? direct_write(self, vector[i].iov_base, vector[i].iov_len)
+        : compress_write(self, vector[i].iov_base, vector[i].iov_len);
+
+      if (ret != KC_FILE_SUCCESS)
+      {
+        return ret;
+      }
+
+      (*bytes_written) += vector[i].iov_len;
+    }
+
+    return KC_FILE_SUCCESS;
+  }
+
+  // buffered writes must land before the gathered ones
+  ret = sync_stream(self, &offset);
+  if (ret != KC_FILE_SUCCESS)
+  {
+    return ret;
+  }
+
+  // gather all the fragments into a single system call
+  ret = transfer_vector(fileno(self->file), vector, count, true, offset,
+    bytes_written);
+
+  // appending streams always end up at the end of the file
+  if (self->mode == KC_FILE_OPEN_ALWAYS)
+  {
+    fseeko(self->file, 0, SEEK_END);
+  }
+  else
+  {
+    fseeko(self->file, offset + (off_t)(*bytes_written), SEEK_SET);
+  }
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+  }
+
+  return ret;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static int advise_mapping(struct File* self, uint64_t offset, uint64_t length,
+  int advice)
+{
+  // only the part of the range that is mapped is advised
+  if (offset >= self->mapped_size)
+  {
+    return 0;
+  }
+
+  uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+  uint64_t end  = length == 0 || length > self->mapped_size - offset
+    ? self->mapped_size : offset + length;
+
+  // madvise() works on whole pages, widen the range to cover them
+  offset -= offset % page;
+
+  return madvise((void*)(self->mapped + offset), (size_t)(end - offset),
+    advice);
+}
+
+//---------------------------------------------------------------------------//
+
+static int commit_batch(int* fds, size_t count)
+{
+  int ret = KC_FILE_SUCCESS;
+
+  // a batch for a single file, even from many threads, is one fdatasync()
+  bool single = true;
+
+  for (size_t i = 1; i < count && single == true; ++i)
+  {
+    single = fds[i] == fds[0];
+  }
+
+  if (single == true)
+  {
+    return fdatasync(fds[0]) == 0 ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+  }
+
+  // several files are synced together, each of them once; syncfs() would
+  // write out the dirty pages of every other process on the file system
+  for (size_t i = 0; i < count; ++i)
+  {
+    bool seen = false;
+
+    for (size_t j = 0; j < i && seen == false; ++j)
+    {
+      seen = fds[j] == fds[i];
+    }
+
+    if (seen == false && fdatasync(fds[i]) != 0)
+    {
+      ret = KC_FILE_INVALID;
+    }
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int commit_sync(struct File* self, int fd)
+{
+  struct GroupCommit* group = (struct GroupCommit*)self->commit;
+
+  if (group == NULL)
+  {
+    return fdatasync(fd) == 0 ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+  }
+
+  pthread_mutex_lock(&group->lock);
+
+  // the mode is being turned off, this sync is not part of any batch
+  if (group->closing == true)
+  {
+    pthread_mutex_unlock(&group->lock);
+
+    return fdatasync(fd) == 0 ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+  }
+
+  // join the batch that is being collected
+  if (group->count == group->capacity)
+  {
+    size_t capacity = group->capacity == 0 ? 64 : group->capacity * 2;
+    int*   fds      = (int*)realloc(group->fds, capacity * sizeof(int));
+
+    if (fds == NULL)
+    {
+      pthread_mutex_unlock(&group->lock);
+
+      return fdatasync(fd) == 0 ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+    }
+
+    group->fds      = fds;
+    group->capacity = capacity;
+  }
+
+  group->fds[group->count++] = fd;
+  group->waiters            += 1;
+
+  pthread_cond_signal(&group->joined);
+
+  uint64_t ticket = group->generation;
+
+  while (group->completed < ticket)
+  {
+    // the sync of an earlier batch is running, ours is next
+    if (group->syncing == true)
+    {
+      pthread_cond_wait(&group->done, &group->lock);
+      continue;
+    }
+
+    // nobody syncs, so this thread leads; it gives the other threads up to
+    // an interval to join, but stops as soon as the batch is as large as the
+    // previous one, so a lone caller never waits
+    group->syncing = true;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    deadline.tv_sec  += (time_t)(group->interval / 1000000000);
+    deadline.tv_nsec += (long)(group->interval % 1000000000);
+
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec  += 1;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    while (group->count < group->last_count && group->closing == false)
+    {
+      if (pthread_cond_timedwait(&group->joined, &group->lock,
+            &deadline) == ETIMEDOUT)
+      {
+        break;
+      }
+    }
+
+    // take the batch, the threads arriving from now on form the next one
+    int*     batch      = group->fds;
+    size_t   count      = group->count;
+    size_t   capacity   = group->capacity;
+    uint64_t generation = group->generation++;
+
+    group->fds            = group->spare;
+    group->capacity       = group->spare_capacity;
+    group->count          = 0;
+    group->spare          = batch;
+    group->spare_capacity = capacity;
+    group->last_count     = count;
+
+    pthread_mutex_unlock(&group->lock);
+
+    int ret = commit_batch(batch, count);
+
+    pthread_mutex_lock(&group->lock);
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      group->failed = generation;
+    }
+
+    group->completed = generation;
+    group->syncing   = false;
+
+    pthread_cond_broadcast(&group->done);
+  }
+
+  // a later batch failing as well can only turn a success into a retry
+  int ret = group->failed >= ticket ? KC_FILE_INVALID : KC_FILE_SUCCESS;
+
+  // the last thread out lets the mode be turned off
+  if (--group->waiters == 0 && group->closing == true)
+  {
+    pthread_cond_broadcast(&group->drained);
+  }
+
+  pthread_mutex_unlock(&group->lock);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t compress_block(const char* raw, size_t size, char* packed,
+  size_t capacity, uint32_t* table)
+{
+  size_t anchor = 0;
+  size_t ip     = 0;
+  size_t op     = 0;
+  size_t limit  = size > KC_FILE_COMPRESS_MATCH_LIMIT ?
+                  size - KC_FILE_COMPRESS_MATCH_LIMIT : 0;
+
+  memset(table, 0, sizeof(uint32_t) << KC_FILE_COMPRESS_HASH_LOG);
+
+  // LZ4 block format: a token with the literal and match lengths, the
+  // literals, and a two byte offset back to the match
+  while (ip < limit)
+  {
+    uint32_t sequence  = 0;
+    uint32_t candidate = 0;
+
+    memcpy(&sequence, raw + ip, sizeof(uint32_t));
+
+    uint32_t hash = (sequence * 2654435761U) >>
+                    (32 - KC_FILE_COMPRESS_HASH_LOG);
+
+    candidate   = table[hash];
+    table[hash] = (uint32_t)ip;
+
+    uint32_t found = 0;
+
+    if (candidate < ip)
+    {
+      memcpy(&found, raw + candidate, sizeof(uint32_t));
+    }
+
+    // nothing to refer back to, the step grows with the literals skipped
+    if (candidate >= ip || ip - candidate > 0xFFFF || found != sequence)
+    {
+      ip += 1 + ((ip - anchor) >> 6);
+      continue;
+    }
+
+    // the match may start before the bytes that were hashed
+    while (ip > anchor && candidate > 0 && raw[ip - 1] == raw[candidate - 1])
+    {
+      --ip;
+      --candidate;
+    }
+
+    size_t length = 4;
+
+    // the last literals of a block are never part of a match
+    while (ip + length < size - KC_FILE_COMPRESS_LAST_LITERALS &&
+           raw[ip + length] == raw[candidate + length])
+    {
+      ++length;
+    }
+
+    size_t literals = ip - anchor;
+
+    // the worst case of the sequence has to fit, or the block is stored
+    if (op + literals + literals / 255 + length / 255 + 8 > capacity)
+    {
+      return 0;
+    }
+
+    size_t token = op++;
+
+    packed[token] = (char)((literals < 15 ? literals : 15) << 4);
+
+    if (literals >= 15)
+    {
+      size_t rest = literals - 15;
+
+      for (; rest >= 255; rest -= 255)
+      {
+        packed[op++] = (char)255;
+      }
+
+      packed[op++] = (char)rest;
+    }
+
+    memcpy(packed + op, raw + anchor, literals);
+    op += literals;
+
+    packed[op++] = (char)((ip - candidate) & 0xFF);
+    packed[op++] = (char)((ip - candidate) >> 8);
+
+    packed[token] |= (char)(length - 4 < 15 ? length - 4 : 15);
+
+    if (length - 4 >= 15)
+    {
+      size_t rest = length - 4 - 15;
+
+      for (; rest >= 255; rest -= 255)
+      {
+        packed[op++] = (char)255;
+      }
+
+      packed[op++] = (char)rest;
+    }
+
+    ip    += length;
+    anchor = ip;
+  }
+
+  // the block ends with a sequence of literals only
+  size_t literals = size - anchor;
+
+  if (op + literals + literals / 255 + 2 > capacity)
+  {
+    return 0;
+  }
+
+  packed[op++] = (char)((literals < 15 ? literals : 15) << 4);
+
+  if (literals >= 15)
+  {
+    size_t rest = literals - 15;
+
+    for (; rest >= 255; rest -= 255)
+    {
+      packed[op++] = (char)255;
+    }
+
+    packed[op++] = (char)rest;
+  }
+
+  memcpy(packed + op, raw + anchor, literals);
+
+  return op + literals;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_close(struct File* self)
+{
+  struct CompressStream* stream = (struct CompressStream*)self->compressed;
+
+  if (stream == NULL)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  int ret = KC_FILE_SUCCESS;
+
+  // the index and the footer pointing at it go last, a reader starts there
+  if (stream->writing == true)
+  {
+    ret = compress_flush(self);
+
+    struct CompressFooter footer =
+      { stream->offset, stream->count, stream->length, KC_FILE_COMPRESS_INDEX };
+
+    if (ret == KC_FILE_SUCCESS &&
+        (fwrite(stream->frames, sizeof(struct CompressFrame), stream->count,
+           self->file) != stream->count ||
+         fwrite(&footer, sizeof(footer), 1, self->file) != 1))
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      ret = KC_FILE_INVALID;
+    }
+  }
+
+  free(stream->frames);
+  free(stream->offsets);
+  free(stream->positions);
+  free(stream->raw);
+  free(stream->packed);
+  free(stream);
+
+  self->compressed = NULL;
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_fetch(struct File* self, size_t index, char* target,
+  char* packed)
+{
+  struct CompressStream* stream = (struct CompressStream*)self->compressed;
+  struct CompressFrame   frame  = stream->frames[index];
+
+  size_t size   = frame.size & ~KC_FILE_COMPRESS_STORED;
+  char*  source = (frame.size & KC_FILE_COMPRESS_STORED) ? target : packed;
+  off_t  offset = (off_t)(stream->offsets[index] + sizeof(frame));
+
+  // stored blocks are read straight into place
+  for (size_t done = 0; done < size; )
+  {
+    ssize_t got = pread(fileno(self->file), source + done, size - done,
+                    offset + (off_t)done);
+
+    if (got < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (got <= 0)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    done += (size_t)got;
+  }
+
+  if (source == packed &&
+      decompress_block(packed, size, target, frame.raw_size) !=
+        KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_DATA_CORRUPTION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_flush(struct File* self)
+{
+  struct CompressStream* stream = (struct CompressStream*)self->compressed;
+
+  if (stream == NULL || stream->writing == false || stream->raw_fill == 0)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  size_t blocks = (stream->raw_fill + stream->block_size - 1) /
+                  stream->block_size;
+
+  // the index grows by a whole batch at a time
+  if (stream->count + blocks > stream->capacity)
+  {
+    size_t capacity = stream->capacity * 2 + blocks;
+
+    struct CompressFrame* frames =
+      realloc(stream->frames, capacity * sizeof(struct CompressFrame));
+
+    if (frames != NULL)
+    {
+      stream->frames = frames;
+    }
+
+    uint64_t* offsets =
+      realloc(stream->offsets, capacity * sizeof(uint64_t));
+
+    if (offsets != NULL)
+    {
+      stream->offsets = offsets;
+    }
+
+    uint64_t* positions =
+      realloc(stream->positions, capacity * sizeof(uint64_t));
+
+    if (positions != NULL)
+    {
+      stream->positions = positions;
+    }
+
+    if (frames == NULL || offsets == NULL || positions == NULL)
+    {
+      self->log->error(self->log, KC_OUT_OF_MEMORY, __LINE__, __func__);
+
+      return KC_OUT_OF_MEMORY;
+    }
+
+    stream->capacity = capacity;
+  }
+
+  struct CompressJob job =
+    { self, NULL, stream->count, blocks, 0, KC_FILE_SUCCESS, true };
+
+  for (size_t i = 0; i < blocks; ++i)
+  {
+    size_t start = i * stream->block_size;
+    size_t left  = stream->raw_fill - start;
+
+    stream->frames[stream->count + i].raw_size =
+      (uint32_t)(left < stream->block_size ? left : stream->block_size);
+  }
+
+  // the blocks of a batch are independent, so they compress in parallel
+  compress_run(&job, stream->threads);
+
+  // and are then written out in order
+  for (size_t i = 0; i < blocks; ++i)
+  {
+    size_t               index = stream->count + i;
+    struct CompressFrame frame = stream->frames[index];
+
+    size_t      size = frame.size & ~KC_FILE_COMPRESS_STORED;
+    const char* data = (frame.size & KC_FILE_COMPRESS_STORED) ?
+      stream->raw + i * stream->block_size :
+      stream->packed + i * stream->packed_size;
+
+    if (fwrite(&frame, sizeof(frame), 1, self->file) != 1 ||
+        fwrite(data, 1, size, self->file) != size)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    stream->offsets[index]   = stream->offset;
+    stream->positions[index] = stream->length;
+    stream->offset          += sizeof(frame) + size;
+    stream->length          += frame.raw_size;
+  }
+
+  stream->count   += blocks;
+  stream->raw_fill = 0;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_open(struct File* self)
+{
+  struct CompressStream* stream = calloc(1, sizeof(struct CompressStream));
+
+  if (stream == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  stream->writing    = is_writable(self->mode);
+  stream->threads    = cpus < 1 ? 1 : cpus > KC_FILE_COMPRESS_WORKERS ?
+                       KC_FILE_COMPRESS_WORKERS : (unsigned)cpus;
+  stream->block_size = KC_FILE_COMPRESS_BLOCK_SIZE;
+  stream->current    = SIZE_MAX;
+
+  self->compressed = stream;
+
+  struct CompressHeader header = { KC_FILE_COMPRESS_MAGIC, 0 };
+
+  // a writer stages a whole batch of blocks, one for every thread
+  if (stream->writing == true)
+  {
+    header.block_size    = KC_FILE_COMPRESS_BLOCK_SIZE;
+    stream->offset       = sizeof(header);
+    stream->packed_size  = KC_FILE_COMPRESS_BOUND(stream->block_size);
+    stream->raw          = malloc(stream->block_size * stream->threads);
+    stream->packed       = malloc(stream->packed_size * stream->threads);
+
+    if (stream->raw == NULL || stream->packed == NULL)
+    {
+      compress_close(self);
+
+      return KC_OUT_OF_MEMORY;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, self->file) != 1)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      compress_close(self);
+
+      return KC_FILE_INVALID;
+    }
+
+    return KC_FILE_SUCCESS;
+  }
+
+  struct CompressFooter footer;
+  struct stat           st;
+
+  int fd = fileno(self->file);
+
+  // a reader finds every block through the index at the end of the file
+  if (fstat(fd, &st) != 0 ||
+      (uint64_t)st.st_size < sizeof(header) + sizeof(footer) ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      pread(fd, &footer, sizeof(footer),
+        st.st_size - (off_t)sizeof(footer)) != sizeof(footer) ||
+      memcmp(header.magic, KC_FILE_COMPRESS_MAGIC, sizeof(header.magic)) != 0 ||
+      memcmp(footer.magic, KC_FILE_COMPRESS_INDEX, sizeof(footer.magic)) != 0 ||
+      header.block_size == 0 ||
+      header.block_size > KC_FILE_COMPRESS_MAX_BLOCK_SIZE ||
+      footer.index < sizeof(header) || footer.count > (uint64_t)st.st_size ||
+      footer.index + footer.count * sizeof(struct CompressFrame) +
+        sizeof(footer) != (uint64_t)st.st_size)
+  {
+    self->log->error(self->log, KC_DATA_CORRUPTION, __LINE__, __func__);
+
+    compress_close(self);
+
+    return KC_FILE_INVALID;
+  }
+
+  size_t count = (size_t)footer.count;
+
+  stream->block_size  = header.block_size;
+  stream->packed_size = KC_FILE_COMPRESS_BOUND(stream->block_size);
+  stream->count       = count;
+  stream->capacity    = count;
+  stream->length      = footer.length;
+  stream->frames      = malloc(count * sizeof(struct CompressFrame) + 1);
+  stream->offsets     = malloc(count * sizeof(uint64_t) + 1);
+  stream->positions   = malloc(count * sizeof(uint64_t) + 1);
+  stream->raw         = malloc(stream->block_size);
+  stream->packed      = malloc(stream->packed_size);
+
+  if (stream->frames == NULL || stream->offsets == NULL ||
+      stream->positions == NULL || stream->raw == NULL ||
+      stream->packed == NULL)
+  {
+    compress_close(self);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  size_t  size = count * sizeof(struct CompressFrame);
+  ssize_t got  = 0;
+
+  do
+  {
+    got = pread(fd, stream->frames, size, (off_t)footer.index);
+  }
+  while (got < 0 && errno == EINTR);
+
+  uint64_t offset   = sizeof(header);
+  uint64_t position = 0;
+  bool     valid    = got == (ssize_t)size;
+
+  // the blocks have to fill the file up to the index, and add up to the
+  // length the footer promises
+  for (size_t i = 0; i < count && valid == true; ++i)
+  {
+    struct CompressFrame frame  = stream->frames[i];
+    uint32_t             packed = frame.size & ~KC_FILE_COMPRESS_STORED;
+
+    valid = frame.raw_size <= stream->block_size &&
+            packed <= stream->packed_size &&
+            ((frame.size & KC_FILE_COMPRESS_STORED) == 0 ||
+             packed == frame.raw_size);
+
+    stream->offsets[i]   = offset;
+    stream->positions[i] = position;
+
+    offset   += sizeof(frame) + packed;
+    position += frame.raw_size;
+  }
+
+  if (valid == false || offset != footer.index || position != footer.length)
+  {
+    self->log->error(self->log, KC_DATA_CORRUPTION, __LINE__, __func__);
+
+    compress_close(self);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_read(struct File* self, void* buffer, size_t size,
+  size_t* bytes_read)
+{
+  struct CompressStream* stream = (struct CompressStream*)self->compressed;
+  char*                  target = (char*)buffer;
+
+  while (size > 0 && stream->position < stream->length)
+  {
+    size_t index = stream->current;
+
+    // the block holding the position is decompressed once, then copied out
+    // by as many reads as it takes
+    if (index == SIZE_MAX || stream->position < stream->positions[index] ||
+        stream->position >= stream->positions[index] +
+          stream->frames[index].raw_size)
+    {
+      index = compress_search(stream, stream->position);
+
+      stream->current = SIZE_MAX;
+
+      int ret = compress_fetch(self, index, stream->raw, stream->packed);
+      if (ret != KC_FILE_SUCCESS)
+      {
+        return ret;
+      }
+
+      stream->current = index;
+    }
+
+    size_t start  = (size_t)(stream->position - stream->positions[index]);
+    size_t length = stream->frames[index].raw_size - start;
+
+    length = length < size ? length : size;
+
+    memcpy(target, stream->raw + start, length);
+
+    target           += length;
+    size             -= length;
+    stream->position += length;
+    (*bytes_read)    += length;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_read_all(struct File* self, char** buffer)
+{
+  struct CompressStream* stream = (struct CompressStream*)self->compressed;
+
+  if (stream->length >= SIZE_MAX)
+  {
+    return KC_BUFFER_OVERFLOW;
+  }
+
+  (*buffer) = malloc((size_t)stream->length + 1);
+
+  if (*buffer == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  struct CompressJob job =
+    { self, *buffer, 0, stream->count, 0, KC_FILE_SUCCESS, false };
+
+  // every block lands at its own place in the buffer, so all of them are
+  // decompressed in parallel
+  compress_run(&job, stream->threads);
+
+  if (job.ret != KC_FILE_SUCCESS)
+  {
+    free(*buffer);
+    (*buffer) = NULL;
+
+    return job.ret;
+  }
+
+  (*buffer)[stream->length] = '\0';
+
+  stream->position = stream->length;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_read_at(struct File* self, uint64_t offset, void* buffer,
+  size_t size, size_t* bytes_read)
+{
+  struct CompressStream* stream = (struct CompressStream*)self->compressed;
+  char*                  target = (char*)buffer;
+  char*                  raw    = NULL;
+  char*                  packed = malloc(stream->packed_size);
+  int                    ret    = KC_FILE_SUCCESS;
+
+  if (packed == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // nothing is shared with the stream, so concurrent reads are safe
+  while (size > 0 && offset < stream->length)
+  {
+    size_t index  = compress_search(stream, offset);
+    size_t start  = (size_t)(offset - stream->positions[index]);
+    size_t length = stream->frames[index].raw_size - start;
+
+    length = length < size ? length : size;
+
+    // a whole block is decompressed in place, a part of one through a copy
+    if (start == 0 && length == stream->frames[index].raw_size)
+    {
+      ret = compress_fetch(self, index, target, packed);
+    }
+    else if (raw != NULL || (raw = malloc(stream->block_size)) != NULL)
+    {
+      ret = compress_fetch(self, index, raw, packed);
+
+      if (ret == KC_FILE_SUCCESS)
+      {
+        memcpy(target, raw + start, length);
+      }
+    }
+    else
+    {
+      ret = KC_OUT_OF_MEMORY;
+    }
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      break;
+    }
+
+    target        += length;
+    size          -= length;
+    offset        += length;
+    (*bytes_read) += length;
+  }
+
+  free(raw);
+  free(packed);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static void compress_run(struct CompressJob* job, unsigned threads)
+{
+  pthread_t workers[KC_FILE_COMPRESS_WORKERS];
+  unsigned  started = 0;
+
+  if (threads > job->count)
+  {
+    threads = (unsigned)job->count;
+  }
+
+  // the calling thread is one of the workers
+  while (started + 1 < threads)
+  {
+    if (pthread_create(&workers[started], NULL, compress_work, job) != 0)
+    {
+      break;
+    }
+
+    ++started;
+  }
+
+  compress_work(job);
+
+  for (unsigned i = 0; i < started; ++i)
+  {
+    pthread_join(workers[i], NULL);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t compress_search(struct CompressStream* stream, uint64_t position)
+{
+  size_t low  = 0;
+  size_t high = stream->count;
+
+  // the last block starting at or before the position
+  while (high - low > 1)
+  {
+    size_t middle = low + (high - low) / 2;
+
+    if (stream->positions[middle] <= position)
+    {
+      low = middle;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_seek(struct File* self, uint64_t position)
+{
+  struct CompressStream* stream = (struct CompressStream*)self->compressed;
+
+  if (stream != NULL && stream->writing == false)
+  {
+    stream->position = position;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* compress_work(void* context)
+{
+  struct CompressJob*    job    = (struct CompressJob*)context;
+  struct CompressStream* stream = (struct CompressStream*)job->file->compressed;
+  uint32_t*              table  = NULL;
+  char*                  packed = NULL;
+
+  if (job->output == true)
+  {
+    table = malloc(sizeof(uint32_t) << KC_FILE_COMPRESS_HASH_LOG);
+  }
+  else
+  {
+    packed = malloc(stream->packed_size);
+  }
+
+  if (table == NULL && packed == NULL)
+  {
+    __atomic_store_n(&job->ret, KC_OUT_OF_MEMORY, __ATOMIC_RELAXED);
+
+    return NULL;
+  }
+
+  for (;;)
+  {
+    size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+
+    if (i >= job->count || __atomic_load_n(&job->ret, __ATOMIC_RELAXED) !=
+          KC_FILE_SUCCESS)
+    {
+      break;
+    }
+
+    size_t index = job->first + i;
+
+    if (job->output == true)
+    {
+      struct CompressFrame* frame = &stream->frames[index];
+
+      size_t size = compress_block(stream->raw + i * stream->block_size,
+        frame->raw_size, stream->packed + i * stream->packed_size,
+        frame->raw_size, table);
+
+      // data that does not get smaller is stored as it is
+      frame->size = size == 0 ? frame->raw_size | KC_FILE_COMPRESS_STORED :
+                                (uint32_t)size;
+    }
+    else
+    {
+      int ret = compress_fetch(job->file, index,
+        job->target + stream->positions[index], packed);
+
+      if (ret != KC_FILE_SUCCESS)
+      {
+        __atomic_store_n(&job->ret, ret, __ATOMIC_RELAXED);
+      }
+    }
+  }
+
+  free(table);
+  free(packed);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static int compress_write(struct File* self, const void* data, size_t size)
+{
+  struct CompressStream* stream = (struct CompressStream*)self->compressed;
+  const char*            source = (const char*)data;
+  size_t                 staged = stream->block_size * stream->threads;
+
+  while (size > 0)
+  {
+    size_t length = staged - stream->raw_fill;
+
+    length = length < size ? length : size;
+
+    memcpy(stream->raw + stream->raw_fill, source, length);
+
+    stream->raw_fill += length;
+    source           += length;
+    size             -= length;
+
+    // a full batch is compressed and written in one go
+    if (stream->raw_fill == staged)
+    {
+      int ret = compress_flush(self);
+      if (ret != KC_FILE_SUCCESS)
+      {
+        return ret;
+      }
+    }
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int copy_contents(int in, int out, uint64_t size, int flags,
+  int* strategy)
+{
+  // share the extents of the source, no data is copied at all
+  if ((flags & KC_FILE_COPY_CLONE) && ioctl(out, FICLONE, in) == 0)
+  {
+    (*strategy) = KC_FILE_COPY_CLONE;
+
+    return KC_FILE_SUCCESS;
+  }
+
+  if ((flags & KC_FILE_COPY_SPARSE) == 0)
+  {
+    return copy_range(in, out, 0, size, flags, strategy);
+  }
+
+  // only the data segments are copied, the holes in between stay holes
+  for (off_t offset = 0; (uint64_t)offset < size; )
+  {
+    off_t data = lseek(in, offset, SEEK_DATA);
+
+    // the rest of the file is a hole
+    if (data < 0 && errno == ENXIO)
+    {
+      break;
+    }
+
+    // the file system can not tell, everything left is data
+    off_t hole = data < 0 ? (off_t)size : lseek(in, data, SEEK_HOLE);
+
+    if (data < 0)
+    {
+      data = offset;
+    }
+
+    if (hole < 0 || (uint64_t)hole > size)
+    {
+      hole = (off_t)size;
+    }
+
+    int ret = copy_range(in, out, (uint64_t)data, (uint64_t)hole, flags,
+      strategy);
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+
+    offset = hole;
+  }
+
+  // a trailing hole only exists once the size is set
+  return ftruncate(out, (off_t)size) == 0 ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+}
+
+//---------------------------------------------------------------------------//
+
+static int copy_range(int in, int out, uint64_t offset, uint64_t end,
+  int flags, int* strategy)
+{
+  loff_t  position = (loff_t)offset;
+  ssize_t done     = 0;
+
+  // let the kernel copy the data, possibly offloaded to the file system
+  while ((flags & KC_FILE_COPY_RANGE) && (uint64_t)position < end)
+  {
+    loff_t target = position;
+
+    done = copy_file_range(in, &position, out, &target,
+      (size_t)(end - (uint64_t)position), 0);
+
+    if (done <= 0)
+    {
+      break;
+    }
+
+    (*strategy) = KC_FILE_COPY_RANGE;
+  }
+
+  // fall back to sendfile, still without going through user space
+  while ((flags & KC_FILE_COPY_SENDFILE) && (uint64_t)position < end)
+  {
+    off_t source = (off_t)position;
+
+    if (lseek(out, source, SEEK_SET) < 0)
+    {
+      break;
+    }
+
+    done = sendfile(out, in, &source, (size_t)(end - (uint64_t)position));
+
+    if (done <= 0)
+    {
+      break;
+    }
+
+    position    = source;
+    (*strategy) = KC_FILE_COPY_SENDFILE;
+  }
+
+  if ((uint64_t)position >= end)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  if ((flags & KC_FILE_COPY_BUFFER) == 0)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  // the last resort is a plain read and write loop with a large buffer
+  char* buffer = (char*)malloc(KC_FILE_COPY_BUFFER_SIZE);
+
+  if (buffer == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  (*strategy) = KC_FILE_COPY_BUFFER;
+
+  while ((uint64_t)position < end)
+  {
+    size_t chunk = end - (uint64_t)position < KC_FILE_COPY_BUFFER_SIZE
+      ? (size_t)(end - (uint64_t)position) : KC_FILE_COPY_BUFFER_SIZE;
+
+    done = pread(in, buffer, chunk, position);
+
+    if (done < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    // end of file, the source may have shrunk in the meantime
+    if (done <= 0)
+    {
+      break;
+    }
+
+    struct iovec vector = { buffer, (size_t)done };
+    size_t       bytes  = 0;
+
+    if (transfer_vector(out, &vector, 1, true, position, &bytes) !=
+        KC_FILE_SUCCESS)
+    {
+      done = -1;
+      break;
+    }
+
+    position += done;
+  }
+
+  free(buffer);
+
+  return done < 0 ? KC_FILE_INVALID : KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int decompress_block(const char* packed, size_t size, char* raw,
+  size_t raw_size)
+{
+  const unsigned char* ip  = (const unsigned char*)packed;
+  const unsigned char* end = ip + size;
+  size_t               op  = 0;
+
+  // every length and offset is checked, a corrupt block never writes past
+  // the end of the buffer
+  while (ip < end)
+  {
+    unsigned      token    = *ip++;
+    size_t        literals = token >> 4;
+    unsigned char more     = 255;
+
+    while (literals >= 15 && more == 255)
+    {
+      if (ip == end)
+      {
+        return KC_FILE_INVALID;
+      }
+
+      more      = *ip++;
+      literals += more;
+    }
+
+    if (literals > (size_t)(end - ip) || literals > raw_size - op)
+    {
+      return KC_FILE_INVALID;
+    }
+
+    memcpy(raw + op, ip, literals);
+
+    ip += literals;
+    op += literals;
+
+    // the last sequence has no match
+    if (ip == end)
+    {
+      break;
+    }
+
+    if (end - ip < 2)
+    {
+      return KC_FILE_INVALID;
+    }
+
+    size_t distance = (size_t)ip[0] | (size_t)ip[1] << 8;
+    size_t length   = token & 15;
+
+    ip  += 2;
+    more = 255;
+
+    while (length >= 15 && more == 255)
+    {
+      if (ip == end)
+      {
+        return KC_FILE_INVALID;
+      }
+
+      more    = *ip++;
+      length += more;
+    }
+
+    length += 4;
+
+    if (distance == 0 || distance > op || length > raw_size - op)
+    {
+      return KC_FILE_INVALID;
+    }
+
+    // a match closer than its length repeats the bytes it is copying
+    if (distance >= length)
+    {
+      memcpy(raw + op, raw + op - distance, length);
+    }
+    else
+    {
+      for (size_t i = 0; i < length; ++i)
+      {
+        raw[op + i] = raw[op + i - distance];
+      }
+    }
+
+    op += length;
+  }
+
+  return op == raw_size ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+}
+
+//---------------------------------------------------------------------------//
+
+static void delete_fail(struct DeleteTree* tree, int error)
+{
+  pthread_mutex_lock(&tree->lock);
+
+  // only the first failure is reported
+  if (tree->error == 0)
+  {
+    tree->error = error;
+  }
+
+  pthread_mutex_unlock(&tree->lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static void delete_finish(struct DeleteTree* tree, struct DeleteNode* node)
+{
+  // remove the empty directories bottom-up, as long as a parent has no other
+  // subdirectory left and its own entries are already gone
+  while (node != NULL)
+  {
+    struct DeleteNode* parent = node->parent;
+
+    if (node->fd >= 0)
+    {
+      close(node->fd);
+    }
+
+    // the parent is still open, none of the names above is looked up again
+    int error = unlinkat(parent != NULL ? parent->fd : AT_FDCWD, node->name,
+      AT_REMOVEDIR) != 0 ? errno : 0;
+
+    free(node->name);
+    free(node);
+
+    pthread_mutex_lock(&tree->lock);
+
+    if (error == 0)
+    {
+      ++tree->removed;
+    }
+    else if (tree->error == 0)
+    {
+      tree->error = error;
+    }
+
+    node = NULL;
+
+    if (parent != NULL && --parent->children == 0 && parent->scanned == true)
+    {
+      node = parent;
+    }
+
+    pthread_mutex_unlock(&tree->lock);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void delete_scan(struct DeleteTree* tree, struct DeleteNode* node)
+{
+  struct DeleteNode* subdirs  = NULL;
+  size_t             children = 0;
+  size_t             removed  = 0;
+
+  // a symbolic link swapped in for the directory is never followed
+  int fd = openat(node->parent != NULL ? node->parent->fd : AT_FDCWD,
+    node->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+
+  // the listing gets its own descriptor, the other one stays open for the
+  // subdirectories
+  int  copy = fd < 0 ? -1 : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  DIR* dir  = copy < 0 ? NULL : fdopendir(copy);
+
+  if (dir == NULL)
+  {
+    delete_fail(tree, errno);
+
+    if (copy >= 0)
+    {
+      close(copy);
+    }
+  }
+
+  node->fd = fd;
+
+  struct dirent* entry = NULL;
+
+  while (dir != NULL && (entry = readdir(dir)) != NULL)
+  {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+    {
+      continue;
+    }
+
+    bool is_dir = entry->d_type == DT_DIR;
+
+    // some file systems do not fill in the entry type
+    if (entry->d_type == DT_UNKNOWN)
+    {
+      struct stat st;
+
+      is_dir = fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+        S_ISDIR(st.st_mode);
+    }
+
+    if (is_dir == false)
+    {
+      if (unlinkat(fd, entry->d_name, 0) == 0)
+      {
+        ++removed;
+      }
+      else
+      {
+        delete_fail(tree, errno);
+      }
+
+      continue;
+    }
+
+    // subdirectories are queued, so other workers can pick them up
+    struct DeleteNode* child = malloc(sizeof(struct DeleteNode));
+    char*              name  = strdup(entry->d_name);
+
+    if (child == NULL || name == NULL)
+    {
+      free(child);
+      free(name);
+      delete_fail(tree, ENOMEM);
+
+      continue;
+    }
+
+    child->parent   = node;
+    child->next     = subdirs;
+    child->name     = name;
+    child->fd       = -1;
+    child->children = 0;
+    child->scanned  = false;
+
+    subdirs = child;
+    ++children;
+  }
+
+  if (dir != NULL)
+  {
+    closedir(dir);
+  }
+
+  pthread_mutex_lock(&tree->lock);
+
+  tree->removed += removed;
+
+  // hand the subdirectories over to the pool
+  while (subdirs != NULL)
+  {
+    struct DeleteNode* next = subdirs->next;
+
+    subdirs->next = tree->queue;
+    tree->queue   = subdirs;
+    subdirs       = next;
+  }
+
+  node->children += children;
+  node->scanned   = true;
+
+  bool empty = node->children == 0;
+
+  pthread_cond_broadcast(&tree->work);
+  pthread_mutex_unlock(&tree->lock);
+
+  if (empty == true)
+  {
+    delete_finish(tree, node);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void* delete_work(void* context)
+{
+  struct DeleteTree* tree = (struct DeleteTree*)context;
+
+  pthread_mutex_lock(&tree->lock);
+
+  for (;;)
+  {
+    // wait while the busy workers might still find more directories
+    while (tree->queue == NULL && tree->active > 0)
+    {
+      pthread_cond_wait(&tree->work, &tree->lock);
+    }
+
+    if (tree->queue == NULL)
+    {
+      break;
+    }
+
+    struct DeleteNode* node = tree->queue;
+
+    tree->queue = node->next;
+    ++tree->active;
+
+    pthread_mutex_unlock(&tree->lock);
+
+    delete_scan(tree, node);
+
+    pthread_mutex_lock(&tree->lock);
+
+    --tree->active;
+
+    // the last busy worker wakes up the idle ones so they can exit
+    if (tree->active == 0)
+    {
+      pthread_cond_broadcast(&tree->work);
+    }
+  }
+
+  pthread_mutex_unlock(&tree->lock);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static int direct_flush(struct File* self)
+{
+  // nothing is staged, or only a read window that holds no new data
+  if (self->direct == false || self->direct_fill == 0 ||
+      self->direct_writable == false)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  int      fd    = fileno(self->file);
+  size_t   mask  = self->block_size - 1;
+  size_t   whole = self->direct_fill & ~mask;
+  size_t   size  = (self->direct_fill + mask) & ~mask;
+  uint64_t end   = self->direct_offset + self->direct_fill;
+
+  struct stat st;
+
+  // the file can already reach past the staged data, after truncate()
+  if (fstat(fd, &st) != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the partial block goes out padded with zeros, which are cut off below
+  memset(self->direct_buffer + self->direct_fill, 0, size - self->direct_fill);
+
+  for (size_t done = 0; done < size; )
+  {
+    ssize_t written = pwrite(fd, self->direct_buffer + done, size - done,
+                        (off_t)(self->direct_offset + done));
+
+    if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (written <= 0)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    done += (size_t)written;
+  }
+
+  uint64_t length = (uint64_t)st.st_size > end ? (uint64_t)st.st_size : end;
+
+  if (self->direct_offset + size > length &&
+      ftruncate(fd, (off_t)length) != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the partial block stays staged, the next writes complete it
+  memmove(self->direct_buffer, self->direct_buffer + whole,
+    self->direct_fill - whole);
+
+  self->direct_offset += whole;
+  self->direct_fill   -= whole;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int direct_open(struct File* self, const char* name, int mode)
+{
+  int flags = O_RDONLY;
+
+  // writers read back the partial block they continue, so they read too
+  if (mode == KC_FILE_CREATE_NEW)
+  {
+    flags = O_RDWR | O_CREAT | O_EXCL;
+  }
+  else if (mode == KC_FILE_CREATE_ALWAYS || mode == KC_FILE_WRITE)
+  {
+    flags = O_RDWR | O_CREAT | O_TRUNC;
+  }
+
+  int fd = open(name, flags | O_DIRECT | O_CLOEXEC, 0666);
+
+  if (fd < 0)
+  {
+    // the file system can not bypass the page cache
+    if (errno == EINVAL)
+    {
+      self->log->error(self->log, KC_UNSUPPORTED_FEATURE, __LINE__, __func__);
+
+      return KC_UNSUPPORTED_FEATURE;
+    }
+
+    // File opening failed
+    self->log->error(self->log, KC_FILE_NOT_FOUND, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  size_t block = query_block_size(fd);
+  size_t size  = block > KC_FILE_DIRECT_BUFFER_SIZE ? block
+                                                    : KC_FILE_DIRECT_BUFFER_SIZE;
+  void*  buffer = NULL;
+
+  if (posix_memalign(&buffer, block, size) != 0)
+  {
+    close(fd);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // the stream only owns the descriptor, stdio never moves any data
+  self->file = fdopen(fd, flags == O_RDONLY ? "r" : "w");
+
+  if (self->file == NULL)
+  {
+    free(buffer);
+    close(fd);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  self->direct          = true;
+  self->block_size      = block;
+  self->direct_buffer   = (char*)buffer;
+  self->direct_size     = size;
+  self->direct_fill     = 0;
+  self->direct_offset   = 0;
+  self->direct_position = 0;
+
+  // the access mode is kept, so flushes do not have to ask for it
+  self->direct_writable = flags != O_RDONLY;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int direct_read(struct File* self, void* buffer, size_t size,
+  size_t* bytes_read)
+{
+  int    fd     = fileno(self->file);
+  char*  target = (char*)buffer;
+  size_t mask   = self->block_size - 1;
+
+  while (size > 0)
+  {
+    uint64_t position = self->direct_position;
+    uint64_t end      = self->direct_offset + self->direct_fill;
+    ssize_t  done     = 0;
+
+    // the rest of the last window read is copied out first
+    if (position >= self->direct_offset && position < end)
+    {
+      size_t length = end - position < size ? (size_t)(end - position) : size;
+
+      memcpy(target, self->direct_buffer + (position - self->direct_offset),
+        length);
+
+      done = (ssize_t)length;
+    }
+    // aligned requests of whole blocks land straight in the caller buffer
+    else if ((position & mask) == 0 && ((uintptr_t)target & mask) == 0 &&
+             size > mask)
+    {
+      done = pread(fd, target, size & ~mask, (off_t)position);
+    }
+    // anything else reads the blocks around the position into the window
+    else
+    {
+      self->direct_offset = position & ~mask;
+      self->direct_fill   = 0;
+
+      done = pread(fd, self->direct_buffer, self->direct_size,
+        (off_t)self->direct_offset);
+
+      if (done > 0)
+      {
+        self->direct_fill = (size_t)done;
+
+        // the window ends before the position, the end of the file is near
+        if (self->direct_offset + (uint64_t)done > position)
+        {
+          continue;
+        }
+      }
+
+      done = done < 0 ? done : 0;
+    }
+
+    if (done < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (done < 0)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    // end of file
+    if (done == 0)
+    {
+      break;
+    }
+
+    target                += done;
+    size                  -= (size_t)done;
+    self->direct_position += (uint64_t)done;
+    (*bytes_read)         += (size_t)done;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int direct_seek(struct File* self, uint64_t position)
+{
+  if (self->direct == false)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  self->direct_offset   = position & ~(uint64_t)(self->block_size - 1);
+  self->direct_fill     = 0;
+  self->direct_position = position;
+
+  // a writer continues inside the block at the position, read its start back
+  if (is_writable(self->mode) == true && position > self->direct_offset)
+  {
+    ssize_t done = 0;
+
+    do
+    {
+      done = pread(fileno(self->file), self->direct_buffer, self->block_size,
+        (off_t)self->direct_offset);
+    }
+    while (done < 0 && errno == EINTR);
+
+    if (done < 0)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    memset(self->direct_buffer + done, 0, self->block_size - (size_t)done);
+
+    self->direct_fill = (size_t)(position - self->direct_offset);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int direct_write(struct File* self, const void* data, size_t size)
+{
+  int         ret    = KC_FILE_SUCCESS;
+  const char* source = (const char*)data;
+  size_t      mask   = self->block_size - 1;
+
+  while (size > 0)
+  {
+    size_t length = 0;
+
+    // while nothing is staged, aligned whole blocks are written in place
+    if (self->direct_fill == 0 && ((uintptr_t)source & mask) == 0 &&
+        size > mask)
+    {
+      ssize_t written = pwrite(fileno(self->file), source, size & ~mask,
+                          (off_t)self->direct_offset);
+
+      if (written < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (written <= 0 || ((size_t)written & mask) != 0)
+      {
+        self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+        return KC_FILE_INVALID;
+      }
+
+      length               = (size_t)written;
+      self->direct_offset += length;
+    }
+    else
+    {
+      length = self->direct_size - self->direct_fill;
+      length = length < size ? length : size;
+
+      memcpy(self->direct_buffer + self->direct_fill, source, length);
+
+      self->direct_fill += length;
+    }
+
+    source                += length;
+    size                  -= length;
+    self->direct_position += length;
+
+    // a full staging buffer goes out in a single write
+    if (self->direct_fill == self->direct_size)
+    {
+      ret = direct_flush(self);
+      if (ret != KC_FILE_SUCCESS)
+      {
+        return ret;
+      }
+    }
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int emit_line(struct LineScan* scan, const char* line, size_t size)
+{
+  // lines ending in CRLF are handed out without the carriage return
+  if (scan->delimiter == '\n' && size > 0 && line[size - 1] == '\r')
+  {
+    --size;
+  }
+
+  scan->ret = scan->callback(line, size, scan->context);
+
+  return scan->ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool is_readable(int mode)
+{
+  return mode == KC_FILE_OPEN_EXISTING || mode == KC_FILE_OPEN_ALWAYS ||
+         mode == KC_FILE_READ          || mode == KC_FILE_MMAP;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool is_writable(int mode)
+{
+  return mode == KC_FILE_CREATE_NEW || mode == KC_FILE_CREATE_ALWAYS ||
+         mode == KC_FILE_OPEN_ALWAYS || mode == KC_FILE_WRITE;
+}
+
+//---------------------------------------------------------------------------//
+
+static int make_directories(char* path, bool cached)
+{
+  // hot prefixes are known to exist, no system call needed
+  if (cached == true && path_cache_contains(path) == true)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  int error = mkdir(path, 0777) == 0 ? 0 : errno;
+
+  // a parent is missing, create it first and then try again
+  if (error == ENOENT)
+  {
+    char* separator = strrchr(path, '/');
+
+    if (separator == NULL || separator == path)
+    {
+      return KC_FILE_INVALID;
+    }
+
+    (*separator) = '\0';
+    int ret = make_directories(path, cached);
+    (*separator) = '/';
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+
+    error = mkdir(path, 0777) == 0 ? 0 : errno;
+  }
+
+  // the directory exists already or a concurrent creator won the race,
+  // both are fine as long as it really is a directory
+  if (error == EEXIST)
+  {
+    struct stat st;
+
+    error = stat(path, &st) == 0 && S_ISDIR(st.st_mode) ? 0 : ENOTDIR;
+  }
+
+  if (error != 0)
+  {
+    errno = error;
+
+    return KC_FILE_INVALID;
+  }
+
+  if (cached == true)
+  {
+    path_cache_insert(path);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void path_cache_clear()
+{
+  pthread_rwlock_wrlock(&path_cache_lock);
+
+  for (size_t i = 0; i < path_cache_capacity; ++i)
+  {
+    free(path_cache_slots[i]);
+    path_cache_slots[i] = NULL;
+  }
+
+  path_cache_count = 0;
+
+  pthread_rwlock_unlock(&path_cache_lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static bool path_cache_contains(const char* path)
+{
+  bool found = false;
+
+  pthread_rwlock_rdlock(&path_cache_lock);
+
+  if (path_cache_count > 0)
+  {
+    size_t mask  = path_cache_capacity - 1;
+    size_t index = path_hash(path) & mask;
+
+    // open addressing, an empty slot ends the probe
+    while (path_cache_slots[index] != NULL)
+    {
+      if (strcmp(path_cache_slots[index], path) == 0)
+      {
+        found = true;
+        break;
+      }
+
+      index = (index + 1) & mask;
+    }
+  }
+
+  pthread_rwlock_unlock(&path_cache_lock);
+
+  return found;
+}
+
+//---------------------------------------------------------------------------//
+
+static void path_cache_insert(const char* path)
+{
+  pthread_rwlock_wrlock(&path_cache_lock);
+
+  // keep the cache bounded, it is refilled by the next calls
+  if (path_cache_count >= KC_FILE_PATH_CACHE_LIMIT)
+  {
+    for (size_t i = 0; i < path_cache_capacity; ++i)
+    {
+      free(path_cache_slots[i]);
+      path_cache_slots[i] = NULL;
+    }
+
+    path_cache_count = 0;
+  }
+
+  // grow the table while keeping it at most half full
+  if ((path_cache_count + 1) * 2 > path_cache_capacity)
+  {
+    size_t capacity = path_cache_capacity == 0 ? 64 : path_cache_capacity * 2;
+    char** slots    = (char**)calloc(capacity, sizeof(char*));
+
+    if (slots == NULL)
+    {
+      pthread_rwlock_unlock(&path_cache_lock);
+      return;
+    }
+
+    for (size_t i = 0; i < path_cache_capacity; ++i)
+    {
+      if (path_cache_slots[i] == NULL)
+      {
+        continue;
+      }
+
+      size_t index = path_hash(path_cache_slots[i]) & (capacity - 1);
+
+      while (slots[index] != NULL)
+      {
+        index = (index + 1) & (capacity - 1);
+      }
+
+      slots[index] = path_cache_slots[i];
+    }
+
+    free(path_cache_slots);
+
+    path_cache_slots    = slots;
+    path_cache_capacity = capacity;
+  }
+
+  size_t mask  = path_cache_capacity - 1;
+  size_t index = path_hash(path) & mask;
+
+  while (path_cache_slots[index] != NULL)
+  {
+    // another thread got here first
+    if (strcmp(path_cache_slots[index], path) == 0)
+    {
+      pthread_rwlock_unlock(&path_cache_lock);
+      return;
+    }
+
+    index = (index + 1) & mask;
+  }
+
+  path_cache_slots[index] = strdup(path);
+
+  if (path_cache_slots[index] != NULL)
+  {
+    ++path_cache_count;
+  }
+
+  pthread_rwlock_unlock(&path_cache_lock);
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t path_hash(const char* path)
+{
+  // FNV-1a
+  uint64_t hash = 0xCBF29CE484222325ULL;
+
+  while (*path != '\0')
+  {
+    hash ^= (unsigned char)*path++;
+    hash *= 0x100000001B3ULL;
+  }
+
+  return (size_t)hash;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t query_block_size(int fd)
+{
+  struct stat st;
+  int         sector = 0;
+
+  if (fstat(fd, &st) != 0)
+  {
+    return KC_FILE_DIRECT_ALIGNMENT;
+  }
+
+  // a block device reports its logical sector size itself
+  if (S_ISBLK(st.st_mode) && ioctl(fd, BLKSSZGET, &sector) == 0 && sector > 0)
+  {
+    return (size_t)sector;
+  }
+
+#ifdef STATX_DIOALIGN
+  struct statx stx;
+
+  // newer kernels know the alignment the file system needs for direct I/O
+  if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 &&
+      (stx.stx_mask & STATX_DIOALIGN) && stx.stx_dio_offset_align > 0)
+  {
+    return stx.stx_dio_offset_align > stx.stx_dio_mem_align ?
+      stx.stx_dio_offset_align : stx.stx_dio_mem_align;
+  }
+#endif
+
+  // the file system block size is always a multiple of the sector size
+  if (st.st_blksize > 0 && (st.st_blksize & (st.st_blksize - 1)) == 0)
+  {
+    return (size_t)st.st_blksize;
+  }
+
+  return KC_FILE_DIRECT_ALIGNMENT;
+}
+
+//---------------------------------------------------------------------------//
+
+static int read_mode(struct File* self)
+{
+  int mode = KC_FILE_READ;
+
+  // a stream reopened for reading keeps the way its data is stored
+  if (self->direct == true)
+  {
+    mode |= KC_FILE_DIRECT;
+  }
+
+  if (self->compressed != NULL)
+  {
+    mode |= KC_FILE_COMPRESSED;
+  }
+
+  return mode;
+}
+
+//---------------------------------------------------------------------------//
+
+static void release_name(struct File* self)
+{
+  // the inline storage belongs to the pool the file came from
+  if (self->name != self->name_storage)
+  {
+    free(self->name);
+  }
+
+  self->name = NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+KC_FILE_TARGET_AVX2
+static size_t scan_lines_avx2(struct LineScan* scan, const char* data,
+  size_t start, size_t from, size_t size)
+{
+#ifdef KC_FILE_SIMD_X86
+  const __m256i pattern = _mm256_set1_epi8((char)scan->delimiter);
+
+  // one compare finds every delimiter in 32 bytes, short lines cost no more
+  // than a bit scan each
+  for (; from + 32 <= size; from += 32)
+  {
+    __m256i  block = _mm256_loadu_si256((const __m256i*)(data + from));
+    uint32_t mask  =
+      (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, pattern));
+
+    while (mask != 0)
+    {
+      size_t end = from + (size_t)__builtin_ctz(mask);
+
+      if (emit_line(scan, data + start, end - start) != KC_FILE_SUCCESS)
+      {
+        return end + 1;
+      }
+
+      start  = end + 1;
+      mask  &= mask - 1;
+    }
+  }
+
+  return scan_lines_sse2(scan, data, start, from, size);
+#else
+  return scan_lines_scalar(scan, data, start, from, size);
+#endif
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t scan_lines_scalar(struct LineScan* scan, const char* data,
+  size_t start, size_t from, size_t size)
+{
+  while (from < size)
+  {
+    const char* found = memchr(data + from, scan->delimiter, size - from);
+
+    if (found == NULL)
+    {
+      break;
+    }
+
+    size_t end = (size_t)(found - data);
+
+    if (emit_line(scan, data + start, end - start) != KC_FILE_SUCCESS)
+    {
+      return end + 1;
+    }
+
+    start = from = end + 1;
+  }
+
+  return start;
+}
+
+//---------------------------------------------------------------------------//
+
+KC_FILE_TARGET_SSE2
+static size_t scan_lines_sse2(struct LineScan* scan, const char* data,
+  size_t start, size_t from, size_t size)
+{
+#ifdef KC_FILE_SIMD_X86
+  const __m128i pattern = _mm_set1_epi8((char)scan->delimiter);
+
+  for (; from + 16 <= size; from += 16)
+  {
+    __m128i  block = _mm_loadu_si128((const __m128i*)(data + from));
+    uint32_t mask  =
+      (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+
+    while (mask != 0)
+    {
+      size_t end = from + (size_t)__builtin_ctz(mask);
+
+      if (emit_line(scan, data + start, end - start) != KC_FILE_SUCCESS)
+      {
+        return end + 1;
+      }
+
+      start  = end + 1;
+      mask  &= mask - 1;
+    }
+  }
+#endif
+
+  // the last few bytes, or the whole buffer without vector support
+  return scan_lines_scalar(scan, data, start, from, size);
+}
+
+//---------------------------------------------------------------------------//
+
+static void select_line_scan()
+{
+  scan_lines = scan_lines_scalar;
+
+#ifdef KC_FILE_SIMD_X86
+  if (__builtin_cpu_supports("avx2"))
+  {
+    scan_lines = scan_lines_avx2;
+  }
+  else if (__builtin_cpu_supports("sse2"))
+  {
+    scan_lines = scan_lines_sse2;
+  }
+#endif
+}
+
+//---------------------------------------------------------------------------//
+
+#ifdef KC_SYSTEM_STATS
+
+static int stats_close(struct File* self)
+{
+  // closing a closed file is not counted, destroy_file() always does it
+  bool     opened = self != NULL && self->opened == true;
+  uint64_t start  = start_system_stats();
+  int      ret    = close_file(self);
+
+  if (opened == true)
+  {
+    record_system_stats(self->stats, KC_SYSTEM_STATS_CLOSE, start, 0,
+      ret != KC_FILE_SUCCESS);
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_flush(struct File* self)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = flush_file(self);
+
+  // a flush only hands the buffer to the kernel, it is kept apart from syncs
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_FLUSH,
+    start, 0, ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_open(struct File* self, char* name, unsigned int mode)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = open_file(self, name, mode);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_OPEN,
+    start, 0, ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_read(struct File* self, char** buffer)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = read_file(self, buffer);
+  uint64_t bytes = 0;
+
+  // the whole file was read, the stream stopped at its end
+  if (ret == KC_FILE_SUCCESS)
+  {
+    bytes = self->compressed != NULL ?
+      ((struct CompressStream*)self->compressed)->length :
+      self->direct == true ? self->direct_position :
+      (uint64_t)ftello(self->file);
+  }
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_READ,
+    start, bytes, ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_read_at(struct File* self, uint64_t offset, void* buffer,
+  size_t size, size_t* bytes_read)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = read_at(self, offset, buffer, size, bytes_read);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_READ,
+    start, bytes_read != NULL ? (*bytes_read) : 0, ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_read_chunk(struct File* self, void* buffer, size_t size,
+  size_t* bytes_read)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = read_chunk(self, buffer, size, bytes_read);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_READ,
+    start, bytes_read != NULL ? (*bytes_read) : 0, ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_read_vector(struct File* self, const struct iovec* vector,
+  int count, size_t* bytes_read)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = read_vector(self, vector, count, bytes_read);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_READ,
+    start, bytes_read != NULL ? (*bytes_read) : 0, ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_sync(struct File* self)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = sync_file(self);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_SYNC,
+    start, 0, ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_write(struct File* self, char* buffer)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = write_file(self, buffer);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_WRITE,
+    start, ret == KC_FILE_SUCCESS ? strlen(buffer) : 0,
+    ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_write_at(struct File* self, uint64_t offset,
+  const void* data, size_t size, size_t* bytes_written)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = write_at(self, offset, data, size, bytes_written);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_WRITE,
+    start, bytes_written != NULL ? (*bytes_written) : 0,
+    ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_write_bytes(struct File* self, const void* data, size_t size)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = write_bytes(self, data, size);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_WRITE,
+    start, ret == KC_FILE_SUCCESS ? size : 0, ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stats_write_vector(struct File* self, const struct iovec* vector,
+  int count, size_t* bytes_written)
+{
+  uint64_t start = start_system_stats();
+  int      ret   = write_vector(self, vector, count, bytes_written);
+
+  record_system_stats(self != NULL ? self->stats : NULL, KC_SYSTEM_STATS_WRITE,
+    start, bytes_written != NULL ? (*bytes_written) : 0,
+    ret != KC_FILE_SUCCESS);
+
+  return ret;
+}
+
+#endif /* KC_SYSTEM_STATS */
+
+//---------------------------------------------------------------------------//
+
+static int store_name(struct File* self, const char* name)
+{
+  // reopening under the current name, nothing to copy
+  if (name == self->name)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  size_t size = strlen(name) + 1;
+
+  // short names go into the inline storage, if the file has any
+  if (self->name_storage != NULL && size <= self->name_size)
+  {
+    memmove(self->name_storage, name, size);
+
+    // the old name may still be on the heap if it did not fit before
+    if (self->name != self->name_storage)
+    {
+      free(self->name);
+    }
+
+    self->name = self->name_storage;
+
+    return KC_FILE_SUCCESS;
+  }
+
+  char* copy = (char*)malloc(sizeof(char) * size);
+
+  if (copy == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  memcpy(copy, name, size);
+  release_name(self);
+
+  self->name = copy;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int sync_stream(struct File* self, off_t* offset)
+{
+  // write out pending data and report the logical stream position, the
+  // descriptor offset itself is left alone so the stream stays consistent
+  if (fflush(self->file) != 0)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  (*offset) = ftello(self->file);
+
+  if ((*offset) < 0)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int transfer_vector(int fd, const struct iovec* vector, int count,
+  bool output, off_t offset, size_t* bytes)
+{
+  int index = 0;
+
+  while (index < count)
+  {
+    int     batch = (count - index) < IOV_MAX ? (count - index) : IOV_MAX;
+    ssize_t done  = output ? pwritev(fd, vector + index, batch, offset)
+                           : preadv(fd, vector + index, batch, offset);
+
+    if (done < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      return KC_FILE_INVALID;
+    }
+
+    // end of file, the remaining buffers stay untouched
+    if (done == 0 && output == false)
+    {
+      return KC_FILE_SUCCESS;
+    }
+
+    (*bytes) += (size_t)done;
+    offset   += (off_t)done;
+
+    // skip the buffers that were transferred completely
+    while (index < count && (size_t)done >= vector[index].iov_len)
+    {
+      done -= (ssize_t)vector[index].iov_len;
+      ++index;
+    }
+
+    if (done == 0)
+    {
+      continue;
+    }
+
+    // a short transfer stopped inside a buffer, finish that one by hand
+    char*  base = (char*)vector[index].iov_base + done;
+    size_t left = vector[index].iov_len - (size_t)done;
+
+    while (left > 0)
+    {
+      done = output ? pwrite(fd, base, left, offset)
+                    : pread(fd, base, left, offset);
+
+      if (done < 0 && errno == EINTR)
+      {
+        continue;
+      }
+
+      if (done < 0)
+      {
+        return KC_FILE_INVALID;
+      }
+
+      if (done == 0)
+      {
+        return KC_FILE_SUCCESS;
+      }
+
+      (*bytes) += (size_t)done;
+      offset   += (off_t)done;
+
+      base += done;
+      left -= (size_t)done;
+    }
+
+    ++index;
+  }
+
   return KC_FILE_SUCCESS;
 }
 
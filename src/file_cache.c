@@ -0,0 +1,621 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_cache.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/file_cache.h"
+#include "../include/system_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+struct FileCacheEntry
+{
+  struct FileCacheEntry* path_next;
+  struct FileCacheEntry* fd_next;
+  struct FileCacheEntry* lru_prev;
+  struct FileCacheEntry* lru_next;
+
+  char*  path;
+  size_t hash;
+  int    flags;
+  int    fd;
+  size_t refs;
+  bool   stale;
+};
+
+struct FileCacheTable
+{
+  pthread_mutex_t lock;
+
+  struct FileCacheEntry*  entries;
+  struct FileCacheEntry*  unused;
+  struct FileCacheEntry** paths;
+  struct FileCacheEntry** fds;
+  size_t                  buckets;
+
+  // idle descriptors, the most recently released one first
+  struct FileCacheEntry idle;
+};
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int acquire_handle (struct FileCache* self, const char* path, int flags, int* fd);
+static int evict_path     (struct FileCache* self, const char* path);
+static int release_handle (struct FileCache* self, int fd);
+
+static void                   close_entry    (struct FileCacheTable* table, struct FileCacheEntry* entry);
+static struct FileCacheEntry* find_entry     (struct FileCacheTable* table, const char* path, size_t hash, int flags);
+static size_t                 hash_key       (const char* path, int flags);
+static void                   idle_push      (struct FileCacheTable* table, struct FileCacheEntry* entry);
+static void                   idle_remove    (struct FileCacheEntry* entry);
+static bool                   normalize_path (const char* path, char* clean);
+static void                   unlink_path    (struct FileCacheTable* table, struct FileCacheEntry* entry);
+
+//---------------------------------------------------------------------------//
+
+struct FileCache* new_file_cache(size_t capacity)
+{
+  if (capacity == 0)
+  {
+    log_error(err[KC_INVALID_ARGUMENT], log_err[KC_INVALID_ARGUMENT],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  // twice as many buckets as entries keeps the chains short
+  size_t buckets = 1;
+
+  while (buckets < capacity * 2)
+  {
+    buckets <<= 1;
+  }
+
+  // create a cache instance to be returned
+  struct FileCache*      cache = malloc(sizeof(struct FileCache));
+  struct FileCacheTable* table = malloc(sizeof(struct FileCacheTable));
+
+  struct FileCacheEntry*  entries =
+    calloc(capacity, sizeof(struct FileCacheEntry));
+  struct FileCacheEntry** paths   =
+    calloc(buckets, sizeof(struct FileCacheEntry*));
+  struct FileCacheEntry** fds     =
+    calloc(buckets, sizeof(struct FileCacheEntry*));
+
+  if (cache == NULL || table == NULL || entries == NULL || paths == NULL ||
+      fds == NULL)
+  {
+    log_error(err[KC_OUT_OF_MEMORY], log_err[KC_OUT_OF_MEMORY],
+      __FILE__, __LINE__, __func__);
+
+    free(fds);
+    free(paths);
+    free(entries);
+    free(table);
+    free(cache);
+
+    return NULL;
+  }
+
+  pthread_mutex_init(&table->lock, NULL);
+
+  table->entries = entries;
+  table->unused  = NULL;
+  table->paths   = paths;
+  table->fds     = fds;
+  table->buckets = buckets;
+
+  table->idle.lru_prev = &table->idle;
+  table->idle.lru_next = &table->idle;
+
+  // every entry starts on the list of unused ones
+  for (size_t i = capacity; i > 0; --i)
+  {
+    entries[i - 1].fd        = -1;
+    entries[i - 1].path_next = table->unused;
+    table->unused            = &entries[i - 1];
+  }
+
+  // assigns the public member fields
+  cache->log       = get_system_log(KC_SYSTEM_LOG_FILE_CACHE, __FILE__);
+  cache->capacity  = capacity;
+  cache->count     = 0;
+  cache->table     = table;
+  cache->hits      = 0;
+  cache->misses    = 0;
+  cache->evictions = 0;
+
+  // assigns the public member methods
+  cache->acquire = acquire_handle;
+  cache->evict   = evict_path;
+  cache->release = release_handle;
+
+  return cache;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_file_cache(struct FileCache* cache)
+{
+  if (cache == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return;
+  }
+
+  struct FileCacheTable* table = (struct FileCacheTable*)cache->table;
+
+  // descriptors still held by someone are closed as well
+  for (size_t i = 0; i < cache->capacity; ++i)
+  {
+    if (table->entries[i].fd >= 0)
+    {
+      close(table->entries[i].fd);
+    }
+
+    free(table->entries[i].path);
+  }
+
+  pthread_mutex_destroy(&table->lock);
+
+  free(table->fds);
+  free(table->paths);
+  free(table->entries);
+  free(table);
+  free(cache);
+}
+
+//---------------------------------------------------------------------------//
+
+int acquire_handle(struct FileCache* self, const char* path, int flags,
+  int* fd)
+{
+  if (self == NULL || path == NULL || fd == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct FileCacheTable* table = (struct FileCacheTable*)self->table;
+  char                   clean[PATH_MAX];
+
+  (*fd) = -1;
+
+  // a shared descriptor can only open what already exists, as it is
+  if ((flags & (O_CREAT | O_EXCL | O_TRUNC)) != 0 ||
+      normalize_path(path, clean) == false)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  flags |= O_CLOEXEC;
+
+  size_t hash   = hash_key(clean, flags);
+  size_t bucket = hash & (table->buckets - 1);
+
+  pthread_mutex_lock(&table->lock);
+
+  struct FileCacheEntry* entry = find_entry(table, clean, hash, flags);
+
+  // a hot file, handed out without any system call
+  if (entry != NULL)
+  {
+    if (entry->refs++ == 0)
+    {
+      idle_remove(entry);
+    }
+
+    ++self->hits;
+    (*fd) = entry->fd;
+
+    pthread_mutex_unlock(&table->lock);
+
+    return KC_FILE_SUCCESS;
+  }
+
+  ++self->misses;
+
+  // every descriptor is in use, nothing could be evicted to make room
+  bool full = table->unused == NULL && table->idle.lru_prev == &table->idle;
+
+  pthread_mutex_unlock(&table->lock);
+
+  if (full == true)
+  {
+    return KC_RESOURCE_UNAVAILABLE;
+  }
+
+  // the file is opened without the lock, other paths are served meanwhile
+  char* copy = strdup(clean);
+  int   file = copy == NULL ? -1 : open(clean, flags);
+
+  if (file < 0)
+  {
+    int error = copy == NULL ? KC_OUT_OF_MEMORY
+      : errno == ENOENT ? KC_FILE_NOT_FOUND : KC_IO_ERROR;
+
+    free(copy);
+
+    if (error == KC_OUT_OF_MEMORY)
+    {
+      return KC_OUT_OF_MEMORY;
+    }
+
+    self->log->error(self->log, error, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  pthread_mutex_lock(&table->lock);
+
+  // another thread opened the same file first, its descriptor is shared and
+  // the acquire is served from the cache after all
+  if ((entry = find_entry(table, clean, hash, flags)) != NULL)
+  {
+    if (entry->refs++ == 0)
+    {
+      idle_remove(entry);
+    }
+
+    --self->misses;
+    ++self->hits;
+    (*fd) = entry->fd;
+
+    pthread_mutex_unlock(&table->lock);
+
+    close(file);
+    free(copy);
+
+    return KC_FILE_SUCCESS;
+  }
+
+  if ((entry = table->unused) != NULL)
+  {
+    table->unused = entry->path_next;
+  }
+  else
+  {
+    // out of budget, the coldest idle descriptor makes room
+    entry = table->idle.lru_prev;
+
+    if (entry == &table->idle)
+    {
+      pthread_mutex_unlock(&table->lock);
+
+      close(file);
+      free(copy);
+
+      return KC_RESOURCE_UNAVAILABLE;
+    }
+
+    close_entry(table, entry);
+
+    ++self->evictions;
+    --self->count;
+  }
+
+  entry->path  = copy;
+  entry->hash  = hash;
+  entry->flags = flags;
+  entry->fd    = file;
+  entry->refs  = 1;
+  entry->stale = false;
+
+  entry->path_next     = table->paths[bucket];
+  table->paths[bucket] = entry;
+
+  size_t slot = (size_t)file & (table->buckets - 1);
+
+  entry->fd_next   = table->fds[slot];
+  table->fds[slot] = entry;
+
+  ++self->count;
+  (*fd) = file;
+
+  pthread_mutex_unlock(&table->lock);
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int evict_path(struct FileCache* self, const char* path)
+{
+  if (self == NULL || path == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct FileCacheTable* table = (struct FileCacheTable*)self->table;
+  char                   clean[PATH_MAX];
+
+  if (normalize_path(path, clean) == false)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  pthread_mutex_lock(&table->lock);
+
+  // the path may be cached once for every set of flags
+  for (size_t i = 0; i < self->capacity; ++i)
+  {
+    struct FileCacheEntry* entry = &table->entries[i];
+
+    if (entry->fd < 0 || entry->stale == true ||
+        strcmp(entry->path, clean) != 0)
+    {
+      continue;
+    }
+
+    ++self->evictions;
+
+    // a descriptor still in use is closed when it is released
+    if (entry->refs > 0)
+    {
+      unlink_path(table, entry);
+      entry->stale = true;
+
+      continue;
+    }
+
+    close_entry(table, entry);
+
+    entry->path_next = table->unused;
+    table->unused    = entry;
+
+    --self->count;
+  }
+
+  pthread_mutex_unlock(&table->lock);
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int release_handle(struct FileCache* self, int fd)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct FileCacheTable* table = (struct FileCacheTable*)self->table;
+  struct FileCacheEntry* entry = NULL;
+
+  pthread_mutex_lock(&table->lock);
+
+  if (fd >= 0)
+  {
+    entry = table->fds[(size_t)fd & (table->buckets - 1)];
+  }
+
+  while (entry != NULL && (entry->fd != fd || entry->refs == 0))
+  {
+    entry = entry->fd_next;
+  }
+
+  // only descriptors handed out by the cache can be released
+  if (entry == NULL)
+  {
+    pthread_mutex_unlock(&table->lock);
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  if (--entry->refs == 0)
+  {
+    if (entry->stale == true)
+    {
+      close_entry(table, entry);
+
+      entry->path_next = table->unused;
+      table->unused    = entry;
+
+      --self->count;
+    }
+    else
+    {
+      idle_push(table, entry);
+    }
+  }
+
+  pthread_mutex_unlock(&table->lock);
+
+  return KC_FILE_SUCCESS;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static void close_entry(struct FileCacheTable* table,
+  struct FileCacheEntry* entry)
+{
+  if (entry->stale == false)
+  {
+    unlink_path(table, entry);
+  }
+
+  if (entry->refs == 0 && entry->lru_next != NULL)
+  {
+    idle_remove(entry);
+  }
+
+  struct FileCacheEntry** link =
+    &table->fds[(size_t)entry->fd & (table->buckets - 1)];
+
+  while ((*link) != entry)
+  {
+    link = &(*link)->fd_next;
+  }
+
+  (*link) = entry->fd_next;
+
+  close(entry->fd);
+  free(entry->path);
+
+  entry->path    = NULL;
+  entry->fd      = -1;
+  entry->fd_next = NULL;
+  entry->stale   = false;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct FileCacheEntry* find_entry(struct FileCacheTable* table,
+  const char* path, size_t hash, int flags)
+{
+  for (struct FileCacheEntry* entry =
+         table->paths[hash & (table->buckets - 1)];
+       entry != NULL; entry = entry->path_next)
+  {
+    if (entry->hash == hash && entry->flags == flags &&
+        strcmp(entry->path, path) == 0)
+    {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t hash_key(const char* path, int flags)
+{
+  uint64_t hash = 0xCBF29CE484222325ULL;
+
+  for (const char* c = path; *c != '\0'; ++c)
+  {
+    hash ^= (unsigned char)*c;
+    hash *= 0x100000001B3ULL;
+  }
+
+  hash ^= (uint64_t)(unsigned)flags;
+  hash *= 0x100000001B3ULL;
+
+  return (size_t)hash;
+}
+
+//---------------------------------------------------------------------------//
+
+static void idle_push(struct FileCacheTable* table,
+  struct FileCacheEntry* entry)
+{
+  entry->lru_prev = &table->idle;
+  entry->lru_next = table->idle.lru_next;
+
+  table->idle.lru_next->lru_prev = entry;
+  table->idle.lru_next           = entry;
+}
+
+//---------------------------------------------------------------------------//
+
+static void idle_remove(struct FileCacheEntry* entry)
+{
+  entry->lru_prev->lru_next = entry->lru_next;
+  entry->lru_next->lru_prev = entry->lru_prev;
+
+  entry->lru_prev = NULL;
+  entry->lru_next = NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool normalize_path(const char* path, char* clean)
+{
+  size_t size = 0;
+
+  // collapse repeated separators and drop the "." components
+  for (const char* c = path; *c != '\0'; )
+  {
+    // a separator left over from a dropped component is dropped as well
+    if (c[0] == '/' && (size > 0 ? clean[size - 1] == '/' : c != path))
+    {
+      ++c;
+    }
+    else if (c[0] == '.' && (c[1] == '/' || c[1] == '\0') &&
+             (size == 0 || clean[size - 1] == '/'))
+    {
+      c += c[1] == '/' ? 2 : 1;
+    }
+    else if (size + 1 < PATH_MAX)
+    {
+      clean[size++] = *c++;
+    }
+    else
+    {
+      return false;
+    }
+  }
+
+  if (size > 1 && clean[size - 1] == '/')
+  {
+    --size;
+  }
+
+  // what is left of "." or "./" is the current directory
+  if (size == 0)
+  {
+    if (path[0] == '\0')
+    {
+      return false;
+    }
+
+    clean[size++] = '.';
+  }
+
+  clean[size] = '\0';
+
+  return true;
+}
+
+//---------------------------------------------------------------------------//
+
+static void unlink_path(struct FileCacheTable* table,
+  struct FileCacheEntry* entry)
+{
+  struct FileCacheEntry** link =
+    &table->paths[entry->hash & (table->buckets - 1)];
+
+  while ((*link) != entry)
+  {
+    link = &(*link)->path_next;
+  }
+
+  (*link) = entry->path_next;
+
+  entry->path_next = NULL;
+}
+
+//---------------------------------------------------------------------------//
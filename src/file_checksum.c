@@ -0,0 +1,1031 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_checksum.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/file_checksum.h"
+#include "../include/system_log.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// the crc32 instruction is used where the CPU has it, 64 bits at a time
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+#define KC_FILE_CHECKSUM_SSE42                                               1
+#define KC_FILE_CHECKSUM_TARGET_SSE42        __attribute__((target("sse4.2")))
+#else
+#define KC_FILE_CHECKSUM_TARGET_SSE42
+#endif
+
+// files are read in chunks this large, small enough to still be in the cache
+// when they are hashed, at offsets and sizes aligned for direct files
+#define KC_FILE_CHECKSUM_CHUNK_SIZE                                   (1 << 18)
+#define KC_FILE_CHECKSUM_ALIGNMENT                                         4096
+
+// a file is only split for another thread once it has this many bytes more
+#define KC_FILE_CHECKSUM_RANGE_SIZE                                   (16 << 20)
+#define KC_FILE_CHECKSUM_MAX_THREADS                                         64
+
+// the three interleaved crc32 streams run over blocks of these sizes
+#define KC_FILE_CHECKSUM_CRC_LONG                                          8192
+#define KC_FILE_CHECKSUM_CRC_SHORT                                          256
+
+// the reflected CRC32C (Castagnoli) polynomial
+#define KC_FILE_CHECKSUM_CRC_POLY                                    0x82F63B78
+
+// the XXH64 primes
+#define KC_FILE_CHECKSUM_XXH_PRIME1                     0x9E3779B185EBCA87ULL
+#define KC_FILE_CHECKSUM_XXH_PRIME2                     0xC2B2AE3D27D4EB4FULL
+#define KC_FILE_CHECKSUM_XXH_PRIME3                     0x165667B19E3779F9ULL
+#define KC_FILE_CHECKSUM_XXH_PRIME4                     0x85EBCA77C2B2AE63ULL
+#define KC_FILE_CHECKSUM_XXH_PRIME5                     0x27D4EB2F165667C5ULL
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+struct XxhState
+{
+  uint64_t      lanes[4];
+  uint64_t      total;
+  uint64_t      seed;
+  unsigned char stripe[32];
+  size_t        fill;
+};
+
+struct ChecksumState
+{
+  uint32_t        crc;
+  struct XxhState xxh;
+};
+
+struct ChecksumRange
+{
+  struct FileChecksum* checksum;
+  struct File*         file;
+  uint64_t             offset;
+  uint64_t             length;
+  char*                target;
+  uint64_t             value;
+  int                  ret;
+};
+
+// the CRC32C tables, built once for every engine: eight for the byte loop,
+// and two that shift a crc past a long or a short block of zeros
+static uint32_t       crc_table[8][256];
+static uint32_t       crc_long[4][256];
+static uint32_t       crc_short[4][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+// the fastest CRC32C loop this CPU can run, chosen once
+static uint32_t (*crc_update)(uint32_t crc, const void* data, size_t size);
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int compute      (struct FileChecksum* self, const void* data, size_t size, uint64_t* checksum);
+static int compute_file (struct FileChecksum* self, struct File* file, unsigned threads, uint64_t* checksum);
+static int digest       (struct FileChecksum* self, uint64_t* checksum);
+static int read_file    (struct FileChecksum* self, struct File* file, unsigned threads, char** buffer, size_t* size, uint64_t* checksum);
+static int reset        (struct FileChecksum* self);
+static int update       (struct FileChecksum* self, const void* data, size_t size);
+
+static uint32_t crc_combine       (uint32_t first, uint32_t second, uint64_t length);
+static uint32_t crc_hardware      (uint32_t crc, const void* data, size_t size);
+static void     crc_init          ();
+static void     crc_matrix_square (uint32_t* square, const uint32_t* matrix);
+static uint32_t crc_matrix_times  (const uint32_t* matrix, uint32_t vector);
+static void     crc_operator      (uint32_t* matrix, uint64_t length);
+static uint32_t crc_shift         (uint32_t table[4][256], uint32_t crc);
+static uint32_t crc_software      (uint32_t crc, const void* data, size_t size);
+static void     crc_zeros         (uint32_t table[4][256], uint64_t length);
+static int      hash_file         (struct FileChecksum* self, struct File* file, unsigned threads, char* target, uint64_t size, uint64_t* checksum);
+static void*    hash_range        (void* context);
+static uint64_t xxh_digest        (const struct XxhState* state);
+static uint64_t xxh_read          (const unsigned char* data, size_t size);
+static void     xxh_reset         (struct XxhState* state, uint64_t seed);
+static uint64_t xxh_round         (uint64_t lane, uint64_t input);
+static void     xxh_update        (struct XxhState* state, const void* data, size_t size);
+
+//---------------------------------------------------------------------------//
+
+struct FileChecksum* new_file_checksum(int algorithm, uint64_t seed)
+{
+  if (algorithm != KC_FILE_CHECKSUM_CRC32C &&
+      algorithm != KC_FILE_CHECKSUM_XXH64)
+  {
+    log_error(err[KC_INVALID_ARGUMENT], log_err[KC_INVALID_ARGUMENT],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  // a CRC32C seed is a 32-bit checksum
+  if (algorithm == KC_FILE_CHECKSUM_CRC32C && seed > UINT32_MAX)
+  {
+    log_error(err[KC_INVALID_ARGUMENT], log_err[KC_INVALID_ARGUMENT],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  pthread_once(&crc_once, crc_init);
+
+  // create a checksum instance to be returned
+  struct FileChecksum*  checksum = malloc(sizeof(struct FileChecksum));
+  struct ChecksumState* state    = malloc(sizeof(struct ChecksumState));
+
+  if (checksum == NULL || state == NULL)
+  {
+    log_error(err[KC_OUT_OF_MEMORY], log_err[KC_OUT_OF_MEMORY],
+      __FILE__, __LINE__, __func__);
+
+    free(checksum);
+    free(state);
+
+    return NULL;
+  }
+
+  // assigns the public member fields
+  checksum->log       = get_system_log(KC_SYSTEM_LOG_FILE_CHECKSUM, __FILE__);
+  checksum->algorithm = algorithm;
+  checksum->seed      = seed;
+  checksum->length    = 0;
+  checksum->state     = state;
+
+  // assigns the public member methods
+  checksum->compute      = compute;
+  checksum->compute_file = compute_file;
+  checksum->digest       = digest;
+  checksum->read_file    = read_file;
+  checksum->reset        = reset;
+  checksum->update       = update;
+
+  reset(checksum);
+
+  return checksum;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_file_checksum(struct FileChecksum* checksum)
+{
+  if (checksum == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return;
+  }
+
+  free(checksum->state);
+  free(checksum);
+}
+
+//---------------------------------------------------------------------------//
+
+int compute(struct FileChecksum* self, const void* data, size_t size,
+  uint64_t* checksum)
+{
+  if (self == NULL || (data == NULL && size > 0) || checksum == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the running checksum of update() is left alone
+  if (self->algorithm == KC_FILE_CHECKSUM_CRC32C)
+  {
+    (*checksum) = crc_update((uint32_t)self->seed, data, size);
+  }
+  else
+  {
+    struct XxhState state;
+
+    xxh_reset(&state, self->seed);
+    xxh_update(&state, data, size);
+
+    (*checksum) = xxh_digest(&state);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int compute_file(struct FileChecksum* self, struct File* file,
+  unsigned threads, uint64_t* checksum)
+{
+  if (self == NULL || file == NULL || checksum == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (file->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // the size on disk of a compressed file is not the size of its data
+  if (file->compressed != NULL)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  struct stat st;
+
+  if (fstat(fileno(file->file), &st) != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return hash_file(self, file, threads, NULL, (uint64_t)st.st_size, checksum);
+}
+
+//---------------------------------------------------------------------------//
+
+int digest(struct FileChecksum* self, uint64_t* checksum)
+{
+  if (self == NULL || checksum == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct ChecksumState* state = (struct ChecksumState*)self->state;
+
+  // more data can still be added after a digest
+  if (self->algorithm == KC_FILE_CHECKSUM_CRC32C)
+  {
+    (*checksum) = state->crc;
+  }
+  else
+  {
+    (*checksum) = xxh_digest(&state->xxh);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int read_file(struct FileChecksum* self, struct File* file, unsigned threads,
+  char** buffer, size_t* size, uint64_t* checksum)
+{
+  if (self == NULL || file == NULL || buffer == NULL || checksum == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (file->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // the size on disk of a compressed file is not the size of its data
+  if (file->compressed != NULL)
+  {
+    self->log->error(self->log, KC_INVALID_OPERATION, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  struct stat st;
+
+  if (fstat(fileno(file->file), &st) != 0)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  uint64_t file_size = (uint64_t)st.st_size;
+  size_t   capacity  = ((size_t)file_size + KC_FILE_CHECKSUM_ALIGNMENT) &
+                       ~((size_t)KC_FILE_CHECKSUM_ALIGNMENT - 1);
+  char*    data      = NULL;
+
+  // aligned and rounded up to whole blocks, so direct files are read into it
+  // without a copy, with room for the terminating zero
+  if (file_size >= SIZE_MAX - KC_FILE_CHECKSUM_ALIGNMENT ||
+      posix_memalign((void**)&data, KC_FILE_CHECKSUM_ALIGNMENT, capacity) != 0)
+  {
+    self->log->error(self->log, KC_OUT_OF_MEMORY, __LINE__, __func__);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  int ret = hash_file(self, file, threads, data, file_size, checksum);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    free(data);
+
+    return ret;
+  }
+
+  data[file_size] = '\0';
+
+  (*buffer) = data;
+
+  if (size != NULL)
+  {
+    (*size) = (size_t)file_size;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int reset(struct FileChecksum* self)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct ChecksumState* state = (struct ChecksumState*)self->state;
+
+  state->crc = (uint32_t)self->seed;
+  xxh_reset(&state->xxh, self->seed);
+
+  self->length = 0;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int update(struct FileChecksum* self, const void* data, size_t size)
+{
+  if (self == NULL || (data == NULL && size > 0))
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct ChecksumState* state = (struct ChecksumState*)self->state;
+
+  if (self->algorithm == KC_FILE_CHECKSUM_CRC32C)
+  {
+    state->crc = crc_update(state->crc, data, size);
+  }
+  else
+  {
+    xxh_update(&state->xxh, data, size);
+  }
+
+  self->length += size;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint32_t crc_combine(uint32_t first, uint32_t second, uint64_t length)
+{
+  uint32_t matrix[32];
+
+  // the crc of the first part, carried on over as many zeros as the second
+  // part has bytes, differs from the crc of both by the crc of the second
+  crc_operator(matrix, length);
+
+  return crc_matrix_times(matrix, first) ^ second;
+}
+
+//---------------------------------------------------------------------------//
+
+KC_FILE_CHECKSUM_TARGET_SSE42
+static uint32_t crc_hardware(uint32_t crc, const void* data, size_t size)
+{
+#ifdef KC_FILE_CHECKSUM_SSE42
+  const unsigned char* next  = (const unsigned char*)data;
+  uint64_t             crc0  = crc ^ 0xFFFFFFFF;
+  uint64_t             word0 = 0;
+  uint64_t             word1 = 0;
+  uint64_t             word2 = 0;
+
+  while (size > 0 && ((uintptr_t)next & 7) != 0)
+  {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *next++);
+    --size;
+  }
+
+  // a crc32 takes three cycles but a new one starts every cycle, so three
+  // streams run over adjacent blocks, and the first two are then carried on
+  // past the blocks after them and folded in
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    size_t   block        = pass == 0 ? KC_FILE_CHECKSUM_CRC_LONG :
+                                          KC_FILE_CHECKSUM_CRC_SHORT;
+    uint32_t (*zeros)[256] = pass == 0 ? crc_long : crc_short;
+
+    while (size >= block * 3)
+    {
+      const unsigned char* end  = next + block;
+      uint64_t             crc1 = 0;
+      uint64_t             crc2 = 0;
+
+      do
+      {
+        memcpy(&word0, next, sizeof(uint64_t));
+        memcpy(&word1, next + block, sizeof(uint64_t));
+        memcpy(&word2, next + block * 2, sizeof(uint64_t));
+
+        crc0 = _mm_crc32_u64(crc0, word0);
+        crc1 = _mm_crc32_u64(crc1, word1);
+        crc2 = _mm_crc32_u64(crc2, word2);
+
+        next += sizeof(uint64_t);
+      }
+      while (next < end);
+
+      crc0  = crc_shift(zeros, (uint32_t)crc0) ^ crc1;
+      crc0  = crc_shift(zeros, (uint32_t)crc0) ^ crc2;
+      next += block * 2;
+      size -= block * 3;
+    }
+  }
+
+  while (size >= sizeof(uint64_t))
+  {
+    memcpy(&word0, next, sizeof(uint64_t));
+
+    crc0  = _mm_crc32_u64(crc0, word0);
+    next += sizeof(uint64_t);
+    size -= sizeof(uint64_t);
+  }
+
+  while (size > 0)
+  {
+    crc0 = _mm_crc32_u8((uint32_t)crc0, *next++);
+    --size;
+  }
+
+  return (uint32_t)crc0 ^ 0xFFFFFFFF;
+#else
+  return crc_software(crc, data, size);
+#endif
+}
+
+//---------------------------------------------------------------------------//
+
+static void crc_init()
+{
+  // the crc of every byte value, then of every byte value followed by one
+  // to seven zero bytes
+  for (uint32_t i = 0; i < 256; ++i)
+  {
+    uint32_t crc = i;
+
+    for (int bit = 0; bit < 8; ++bit)
+    {
+      crc = (crc >> 1) ^ (KC_FILE_CHECKSUM_CRC_POLY & (0 - (crc & 1)));
+    }
+
+    crc_table[0][i] = crc;
+  }
+
+  for (uint32_t i = 0; i < 256; ++i)
+  {
+    for (int k = 1; k < 8; ++k)
+    {
+      crc_table[k][i] = (crc_table[k - 1][i] >> 8) ^
+                        crc_table[0][crc_table[k - 1][i] & 0xFF];
+    }
+  }
+
+  crc_zeros(crc_long, KC_FILE_CHECKSUM_CRC_LONG);
+  crc_zeros(crc_short, KC_FILE_CHECKSUM_CRC_SHORT);
+
+  crc_update = crc_software;
+
+#ifdef KC_FILE_CHECKSUM_SSE42
+  if (__builtin_cpu_supports("sse4.2"))
+  {
+    crc_update = crc_hardware;
+  }
+#endif
+}
+
+//---------------------------------------------------------------------------//
+
+static void crc_matrix_square(uint32_t* square, const uint32_t* matrix)
+{
+  for (int n = 0; n < 32; ++n)
+  {
+    square[n] = crc_matrix_times(matrix, matrix[n]);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static uint32_t crc_matrix_times(const uint32_t* matrix, uint32_t vector)
+{
+  uint32_t sum = 0;
+
+  for (; vector != 0; vector >>= 1, ++matrix)
+  {
+    if (vector & 1)
+    {
+      sum ^= (*matrix);
+    }
+  }
+
+  return sum;
+}
+
+//---------------------------------------------------------------------------//
+
+static void crc_operator(uint32_t* matrix, uint64_t length)
+{
+  uint32_t power[32];
+  uint32_t next[32];
+
+  // what a single zero bit does to every bit of a crc
+  power[0] = KC_FILE_CHECKSUM_CRC_POLY;
+
+  for (int n = 1; n < 32; ++n)
+  {
+    power[n] = (uint32_t)1 << (n - 1);
+  }
+
+  // squared three times it does the same for a zero byte
+  for (int i = 0; i < 3; ++i)
+  {
+    crc_matrix_square(next, power);
+    memcpy(power, next, sizeof(next));
+  }
+
+  for (int n = 0; n < 32; ++n)
+  {
+    matrix[n] = (uint32_t)1 << n;
+  }
+
+  // the powers of two that add up to the length are chained together
+  while (length != 0)
+  {
+    if (length & 1)
+    {
+      for (int n = 0; n < 32; ++n)
+      {
+        next[n] = crc_matrix_times(power, matrix[n]);
+      }
+
+      memcpy(matrix, next, sizeof(next));
+    }
+
+    length >>= 1;
+
+    if (length != 0)
+    {
+      crc_matrix_square(next, power);
+      memcpy(power, next, sizeof(next));
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static uint32_t crc_shift(uint32_t table[4][256], uint32_t crc)
+{
+  return table[0][crc & 0xFF] ^ table[1][(crc >> 8) & 0xFF] ^
+         table[2][(crc >> 16) & 0xFF] ^ table[3][crc >> 24];
+}
+
+//---------------------------------------------------------------------------//
+
+static uint32_t crc_software(uint32_t crc, const void* data, size_t size)
+{
+  const unsigned char* next = (const unsigned char*)data;
+
+  crc ^= 0xFFFFFFFF;
+
+  // eight bytes per step, each looked up in its own table
+  while (size >= 8)
+  {
+    crc ^= (uint32_t)next[0] | (uint32_t)next[1] << 8 |
+           (uint32_t)next[2] << 16 | (uint32_t)next[3] << 24;
+
+    crc = crc_table[7][crc & 0xFF] ^ crc_table[6][(crc >> 8) & 0xFF] ^
+          crc_table[5][(crc >> 16) & 0xFF] ^ crc_table[4][crc >> 24] ^
+          crc_table[3][next[4]] ^ crc_table[2][next[5]] ^
+          crc_table[1][next[6]] ^ crc_table[0][next[7]];
+
+    next += 8;
+    size -= 8;
+  }
+
+  while (size > 0)
+  {
+    crc = crc_table[0][(crc ^ *next++) & 0xFF] ^ (crc >> 8);
+    --size;
+  }
+
+  return crc ^ 0xFFFFFFFF;
+}
+
+//---------------------------------------------------------------------------//
+
+static void crc_zeros(uint32_t table[4][256], uint64_t length)
+{
+  uint32_t matrix[32];
+
+  // the operator split by byte, so a crc is carried past the zeros with four
+  // lookups instead of a matrix product
+  crc_operator(matrix, length);
+
+  for (uint32_t n = 0; n < 256; ++n)
+  {
+    table[0][n] = crc_matrix_times(matrix, n);
+    table[1][n] = crc_matrix_times(matrix, n << 8);
+    table[2][n] = crc_matrix_times(matrix, n << 16);
+    table[3][n] = crc_matrix_times(matrix, n << 24);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int hash_file(struct FileChecksum* self, struct File* file,
+  unsigned threads, char* target, uint64_t size, uint64_t* checksum)
+{
+  struct ChecksumRange ranges[KC_FILE_CHECKSUM_MAX_THREADS];
+  pthread_t            workers[KC_FILE_CHECKSUM_MAX_THREADS];
+
+  uint64_t parts = size / KC_FILE_CHECKSUM_RANGE_SIZE;
+
+  // only CRC32C ranges can be combined, XXH64 goes through in one piece
+  if (parts > threads)
+  {
+    parts = threads;
+  }
+
+  if (parts > KC_FILE_CHECKSUM_MAX_THREADS)
+  {
+    parts = KC_FILE_CHECKSUM_MAX_THREADS;
+  }
+
+  if (parts == 0 || self->algorithm != KC_FILE_CHECKSUM_CRC32C)
+  {
+    parts = 1;
+  }
+
+  // every range but the last is made of whole chunks
+  uint64_t stride = (size + parts - 1) / parts;
+
+  stride = (stride + KC_FILE_CHECKSUM_CHUNK_SIZE - 1) &
+           ~((uint64_t)KC_FILE_CHECKSUM_CHUNK_SIZE - 1);
+
+  if (stride > 0)
+  {
+    parts = (size + stride - 1) / stride;
+  }
+
+  if (parts == 0)
+  {
+    parts = 1;
+  }
+
+  for (uint64_t i = 0; i < parts; ++i)
+  {
+    ranges[i].checksum = self;
+    ranges[i].file     = file;
+    ranges[i].offset   = i * stride;
+    ranges[i].length   = i + 1 < parts ? stride : size - i * stride;
+    ranges[i].target   = target;
+    ranges[i].value    = i == 0 ? self->seed : 0;
+    ranges[i].ret      = KC_FILE_SUCCESS;
+  }
+
+  // the calling thread hashes the first range, a range without a worker is
+  // hashed after it
+  uint64_t started = 1;
+
+  while (started < parts)
+  {
+    if (pthread_create(&workers[started], NULL, hash_range,
+          &ranges[started]) != 0)
+    {
+      break;
+    }
+
+    ++started;
+  }
+
+  hash_range(&ranges[0]);
+
+  for (uint64_t i = started; i < parts; ++i)
+  {
+    hash_range(&ranges[i]);
+  }
+
+  for (uint64_t i = 1; i < started; ++i)
+  {
+    pthread_join(workers[i], NULL);
+  }
+
+  uint64_t value = ranges[0].value;
+
+  for (uint64_t i = 0; i < parts; ++i)
+  {
+    if (ranges[i].ret != KC_FILE_SUCCESS)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return ranges[i].ret;
+    }
+
+    if (i > 0)
+    {
+      value = crc_combine((uint32_t)value, (uint32_t)ranges[i].value,
+        ranges[i].length);
+    }
+  }
+
+  (*checksum) = value;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* hash_range(void* context)
+{
+  struct ChecksumRange* range = (struct ChecksumRange*)context;
+  struct FileChecksum*  self  = range->checksum;
+  char*                 chunk = NULL;
+  uint64_t              done  = 0;
+  uint32_t              crc   = (uint32_t)range->value;
+
+  struct XxhState xxh;
+
+  xxh_reset(&xxh, range->value);
+
+  // without a target the data only passes through one chunk
+  if (range->target == NULL && range->length > 0 &&
+      posix_memalign((void**)&chunk, KC_FILE_CHECKSUM_ALIGNMENT,
+        KC_FILE_CHECKSUM_CHUNK_SIZE) != 0)
+  {
+    range->ret = KC_OUT_OF_MEMORY;
+
+    return NULL;
+  }
+
+  while (done < range->length)
+  {
+    uint64_t left = range->length - done;
+    size_t   want = KC_FILE_CHECKSUM_CHUNK_SIZE;
+    char*    into = chunk;
+    size_t   got  = 0;
+
+    if (into == NULL)
+    {
+      into = range->target + range->offset + done;
+    }
+
+    if (left < want)
+    {
+      want = (size_t)left;
+    }
+
+    // the tail is read as a whole block, for direct files
+    want = (want + KC_FILE_CHECKSUM_ALIGNMENT - 1) &
+           ~((size_t)KC_FILE_CHECKSUM_ALIGNMENT - 1);
+
+    range->ret = range->file->read_at(range->file, range->offset + done, into,
+      want, &got);
+
+    if (range->ret != KC_FILE_SUCCESS)
+    {
+      break;
+    }
+
+    // the file was cut short while it was read
+    if (got == 0)
+    {
+      range->ret = KC_FILE_INVALID;
+
+      break;
+    }
+
+    if (got > left)
+    {
+      got = (size_t)left;
+    }
+
+    // hashed right away, while the chunk is still in the cache
+    if (self->algorithm == KC_FILE_CHECKSUM_CRC32C)
+    {
+      crc = crc_update(crc, into, got);
+    }
+    else
+    {
+      xxh_update(&xxh, into, got);
+    }
+
+    done += got;
+  }
+
+  range->value = self->algorithm == KC_FILE_CHECKSUM_CRC32C ? crc :
+                                                              xxh_digest(&xxh);
+
+  free(chunk);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t xxh_digest(const struct XxhState* state)
+{
+  const unsigned char* next = state->stripe;
+  size_t               left = state->fill;
+  uint64_t             hash = 0;
+
+  if (state->total >= 32)
+  {
+    hash = (state->lanes[0] << 1 | state->lanes[0] >> 63) +
+           (state->lanes[1] << 7 | state->lanes[1] >> 57) +
+           (state->lanes[2] << 12 | state->lanes[2] >> 52) +
+           (state->lanes[3] << 18 | state->lanes[3] >> 46);
+
+    for (int i = 0; i < 4; ++i)
+    {
+      hash ^= xxh_round(0, state->lanes[i]);
+      hash  = hash * KC_FILE_CHECKSUM_XXH_PRIME1 + KC_FILE_CHECKSUM_XXH_PRIME4;
+    }
+  }
+  else
+  {
+    hash = state->seed + KC_FILE_CHECKSUM_XXH_PRIME5;
+  }
+
+  hash += state->total;
+
+  for (; left >= 8; next += 8, left -= 8)
+  {
+    hash ^= xxh_round(0, xxh_read(next, 8));
+    hash  = (hash << 27 | hash >> 37) * KC_FILE_CHECKSUM_XXH_PRIME1 +
+            KC_FILE_CHECKSUM_XXH_PRIME4;
+  }
+
+  if (left >= 4)
+  {
+    hash ^= xxh_read(next, 4) * KC_FILE_CHECKSUM_XXH_PRIME1;
+    hash  = (hash << 23 | hash >> 41) * KC_FILE_CHECKSUM_XXH_PRIME2 +
+            KC_FILE_CHECKSUM_XXH_PRIME3;
+
+    next += 4;
+    left -= 4;
+  }
+
+  for (; left > 0; ++next, --left)
+  {
+    hash ^= (*next) * KC_FILE_CHECKSUM_XXH_PRIME5;
+    hash  = (hash << 11 | hash >> 53) * KC_FILE_CHECKSUM_XXH_PRIME1;
+  }
+
+  // the final avalanche
+  hash ^= hash >> 33;
+  hash *= KC_FILE_CHECKSUM_XXH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= KC_FILE_CHECKSUM_XXH_PRIME3;
+  hash ^= hash >> 32;
+
+  return hash;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t xxh_read(const unsigned char* data, size_t size)
+{
+  uint64_t value = 0;
+
+  // XXH64 reads its input little-endian
+  memcpy(&value, data, size);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value) >> (64 - 8 * size);
+#endif
+
+  return value;
+}
+
+//---------------------------------------------------------------------------//
+
+static void xxh_reset(struct XxhState* state, uint64_t seed)
+{
+  state->lanes[0] = seed + KC_FILE_CHECKSUM_XXH_PRIME1 +
+                    KC_FILE_CHECKSUM_XXH_PRIME2;
+  state->lanes[1] = seed + KC_FILE_CHECKSUM_XXH_PRIME2;
+  state->lanes[2] = seed;
+  state->lanes[3] = seed - KC_FILE_CHECKSUM_XXH_PRIME1;
+  state->total    = 0;
+  state->seed     = seed;
+  state->fill     = 0;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t xxh_round(uint64_t lane, uint64_t input)
+{
+  lane += input * KC_FILE_CHECKSUM_XXH_PRIME2;
+  lane  = lane << 31 | lane >> 33;
+
+  return lane * KC_FILE_CHECKSUM_XXH_PRIME1;
+}
+
+//---------------------------------------------------------------------------//
+
+static void xxh_update(struct XxhState* state, const void* data, size_t size)
+{
+  const unsigned char* next = (const unsigned char*)data;
+
+  if (size == 0)
+  {
+    return;
+  }
+
+  state->total += size;
+
+  // not enough for a stripe yet
+  if (state->fill + size < 32)
+  {
+    memcpy(state->stripe + state->fill, next, size);
+    state->fill += size;
+
+    return;
+  }
+
+  // the stripe started by the last update is completed first
+  if (state->fill > 0)
+  {
+    size_t missing = 32 - state->fill;
+
+    memcpy(state->stripe + state->fill, next, missing);
+
+    for (int i = 0; i < 4; ++i)
+    {
+      state->lanes[i] = xxh_round(state->lanes[i],
+        xxh_read(state->stripe + i * 8, 8));
+    }
+
+    next += missing;
+    size -= missing;
+
+    state->fill = 0;
+  }
+
+  // four independent lanes, one stripe of 32 bytes at a time
+  uint64_t lane0 = state->lanes[0];
+  uint64_t lane1 = state->lanes[1];
+  uint64_t lane2 = state->lanes[2];
+  uint64_t lane3 = state->lanes[3];
+
+  for (; size >= 32; next += 32, size -= 32)
+  {
+    lane0 = xxh_round(lane0, xxh_read(next, 8));
+    lane1 = xxh_round(lane1, xxh_read(next + 8, 8));
+    lane2 = xxh_round(lane2, xxh_read(next + 16, 8));
+    lane3 = xxh_round(lane3, xxh_read(next + 24, 8));
+  }
+
+  state->lanes[0] = lane0;
+  state->lanes[1] = lane1;
+  state->lanes[2] = lane2;
+  state->lanes[3] = lane3;
+
+  memcpy(state->stripe, next, size);
+  state->fill = size;
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,965 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_journal.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/file_journal.h"
+#include "../include/system_log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// the writer collects records into a buffer this large before writing them
+#define KC_FILE_JOURNAL_BATCH_SIZE                                    (1 << 20)
+
+// segment files are named after their index, zero padded to this many digits
+#define KC_FILE_JOURNAL_NAME_DIGITS                                           20
+
+// after a batch the writer waits this long (ns) for the next one to collect,
+// unless this many records are already queued
+#define KC_FILE_JOURNAL_LINGER                                         1000000
+#define KC_FILE_JOURNAL_BACKLOG                                           4096
+
+// what the writer is doing, producers only wake it from the last two
+#define KC_FILE_JOURNAL_BUSY                                                 0
+#define KC_FILE_JOURNAL_GATHERING                                            1
+#define KC_FILE_JOURNAL_IDLE                                                 2
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+struct JournalFrame
+{
+  uint32_t size;
+  uint32_t checksum;
+};
+
+struct JournalNode
+{
+  struct JournalNode* next;
+  size_t              size;
+  char                frame[];
+};
+
+struct JournalEngine
+{
+  pthread_mutex_t lock;
+  pthread_cond_t  work;
+  pthread_cond_t  flushed;
+  pthread_t       writer;
+
+  struct JournalNode* head;
+  struct JournalNode* tail;
+
+  uint64_t appended;
+  uint64_t written;
+  uint64_t requested;
+  uint64_t synced;
+  int      state;
+  bool     stopping;
+  int      error;
+
+  int      fd;
+  uint64_t offset;
+  char*    batch;
+  size_t   batch_fill;
+};
+
+// CRC32C (Castagnoli) lookup table, built once for every journal
+static uint32_t       crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int append   (struct FileJournal* self, const void* data, size_t size);
+static int flush    (struct FileJournal* self);
+static int for_each (struct FileJournal* self, int (*callback)(const void* record, size_t size, void* context), void* context);
+
+static uint32_t            crc_compute     (uint32_t size, const void* data);
+static void                crc_init        ();
+static int                 journal_output  (struct FileJournal* self, const char* data, size_t size);
+static struct JournalNode* journal_pop     (struct JournalEngine* engine);
+static int                 journal_recover (struct FileJournal* self);
+static int                 journal_roll    (struct FileJournal* self);
+static void*               journal_work    (void* context);
+static int                 journal_write   (struct FileJournal* self, const char* frame, size_t size);
+static int                 list_segments   (const char* directory, uint64_t** indices, size_t* count);
+static int                 segment_open    (struct FileJournal* self, uint64_t index);
+static size_t              segment_scan    (const char* data, size_t size, int (*callback)(const void* record, size_t size, void* context), void* context, int* ret);
+static int                 sync_directory  (const char* directory);
+
+//---------------------------------------------------------------------------//
+
+struct FileJournal* new_file_journal(const char* directory,
+  uint64_t segment_size)
+{
+  if (directory == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  // a segment must at least hold the frame of an empty record
+  if (segment_size <= sizeof(struct JournalFrame))
+  {
+    log_error(err[KC_INVALID_ARGUMENT], log_err[KC_INVALID_ARGUMENT],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  pthread_once(&crc_once, crc_init);
+
+  // create a journal instance to be returned
+  struct FileJournal*   journal = malloc(sizeof(struct FileJournal));
+  struct JournalEngine* engine  = calloc(1, sizeof(struct JournalEngine));
+  struct JournalNode*   stub    = calloc(1, sizeof(struct JournalNode));
+  char*                 batch   = malloc(KC_FILE_JOURNAL_BATCH_SIZE);
+  char*                 path    = strdup(directory);
+
+  if (journal == NULL || engine == NULL || stub == NULL || batch == NULL ||
+      path == NULL)
+  {
+    log_error(err[KC_OUT_OF_MEMORY], log_err[KC_OUT_OF_MEMORY],
+      __FILE__, __LINE__, __func__);
+
+    free(journal);
+    free(engine);
+    free(stub);
+    free(batch);
+    free(path);
+
+    return NULL;
+  }
+
+  // assigns the public member fields
+  journal->log          = get_system_log(KC_SYSTEM_LOG_FILE_JOURNAL, __FILE__);
+  journal->directory    = path;
+  journal->segment_size = segment_size;
+  journal->segment      = 0;
+  journal->truncated    = 0;
+  journal->engine       = engine;
+
+  // assigns the public member methods
+  journal->append   = append;
+  journal->flush    = flush;
+  journal->for_each = for_each;
+
+  // the queue starts out with a consumed node, producers link after it
+  engine->head  = stub;
+  engine->tail  = stub;
+  engine->fd    = -1;
+  engine->batch = batch;
+
+  // pick up where the last writer stopped, cutting off its torn tail
+  if ((mkdir(directory, 0777) != 0 && errno != EEXIST) ||
+      journal_recover(journal) != KC_FILE_SUCCESS)
+  {
+    journal->log->error(journal->log, KC_IO_ERROR, __LINE__, __func__);
+
+    if (engine->fd >= 0)
+    {
+      close(engine->fd);
+    }
+
+    free(journal);
+    free(engine);
+    free(stub);
+    free(batch);
+    free(path);
+
+    return NULL;
+  }
+
+  pthread_condattr_t attributes;
+
+  // the writer lingers after a batch on the monotonic clock
+  pthread_condattr_init(&attributes);
+  pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+
+  pthread_mutex_init(&engine->lock, NULL);
+  pthread_cond_init(&engine->work, &attributes);
+  pthread_cond_init(&engine->flushed, NULL);
+  pthread_condattr_destroy(&attributes);
+
+  if (pthread_create(&engine->writer, NULL, journal_work, journal) != 0)
+  {
+    journal->log->error(journal->log, KC_RESOURCE_UNAVAILABLE, __LINE__,
+      __func__);
+
+    pthread_mutex_destroy(&engine->lock);
+    pthread_cond_destroy(&engine->work);
+    pthread_cond_destroy(&engine->flushed);
+    close(engine->fd);
+
+    free(journal);
+    free(engine);
+    free(stub);
+    free(batch);
+    free(path);
+
+    return NULL;
+  }
+
+  return journal;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_file_journal(struct FileJournal* journal)
+{
+  if (journal == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return;
+  }
+
+  struct JournalEngine* engine = (struct JournalEngine*)journal->engine;
+
+  // the writer drains the queue and syncs the segment before it exits
+  pthread_mutex_lock(&engine->lock);
+
+  engine->stopping = true;
+  pthread_cond_signal(&engine->work);
+
+  pthread_mutex_unlock(&engine->lock);
+
+  pthread_join(engine->writer, NULL);
+
+  pthread_mutex_destroy(&engine->lock);
+  pthread_cond_destroy(&engine->work);
+  pthread_cond_destroy(&engine->flushed);
+
+  close(engine->fd);
+
+  // only the last consumed node is left
+  free(engine->head);
+  free(engine->batch);
+  free(engine);
+
+  free(journal->directory);
+  free(journal);
+}
+
+//---------------------------------------------------------------------------//
+
+int append(struct FileJournal* self, const void* data, size_t size)
+{
+  if (self == NULL || data == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct JournalEngine* engine = (struct JournalEngine*)self->engine;
+
+  // a record never spans two segments
+  if (size > self->segment_size - sizeof(struct JournalFrame) ||
+      size > UINT32_MAX)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the writer failed before, nothing more reaches the disk
+  if (__atomic_load_n(&engine->error, __ATOMIC_ACQUIRE) != 0)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  struct JournalNode* node =
+    malloc(sizeof(struct JournalNode) + sizeof(struct JournalFrame) + size);
+
+  if (node == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // the record is framed and checksummed by the producer, off the writer
+  struct JournalFrame frame =
+    { (uint32_t)size, crc_compute((uint32_t)size, data) };
+
+  memcpy(node->frame, &frame, sizeof(frame));
+  memcpy(node->frame + sizeof(frame), data, size);
+
+  node->next = NULL;
+  node->size = sizeof(frame) + size;
+
+  // the record is counted before it is queued: a flush() that sees the
+  // count waits until as many records were written, and those written ahead
+  // of this one were all counted before it, so this one is among them
+  uint64_t appended =
+    __atomic_add_fetch(&engine->appended, 1, __ATOMIC_SEQ_CST);
+
+  // producers only ever swap the tail, the writer alone walks from the head
+  struct JournalNode* previous =
+    __atomic_exchange_n(&engine->tail, node, __ATOMIC_ACQ_REL);
+
+  __atomic_store_n(&previous->next, node, __ATOMIC_SEQ_CST);
+
+  int state = __atomic_load_n(&engine->state, __ATOMIC_SEQ_CST);
+
+  // a busy writer picks the record up by itself, an idle one is woken right
+  // away and a gathering one once the backlog is large; only the producer
+  // that changes the state makes the system call
+  if ((state == KC_FILE_JOURNAL_IDLE ||
+       (state == KC_FILE_JOURNAL_GATHERING &&
+        appended - __atomic_load_n(&engine->written, __ATOMIC_ACQUIRE) >=
+          KC_FILE_JOURNAL_BACKLOG)) &&
+      __atomic_compare_exchange_n(&engine->state, &state,
+        KC_FILE_JOURNAL_BUSY, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+  {
+    pthread_mutex_lock(&engine->lock);
+    pthread_cond_signal(&engine->work);
+    pthread_mutex_unlock(&engine->lock);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int flush(struct FileJournal* self)
+{
+  if (self == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct JournalEngine* engine = (struct JournalEngine*)self->engine;
+
+  // every record of the caller was counted before this, and is written before
+  // the count of written records reaches it; records counted by other threads
+  // but not queued yet are on their way, so the writer still gets to them
+  uint64_t target = __atomic_load_n(&engine->appended, __ATOMIC_ACQUIRE);
+
+  pthread_mutex_lock(&engine->lock);
+
+  if (engine->requested < target)
+  {
+    engine->requested = target;
+    pthread_cond_signal(&engine->work);
+  }
+
+  while (engine->synced < target)
+  {
+    pthread_cond_wait(&engine->flushed, &engine->lock);
+  }
+
+  int ret = engine->error == 0 ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+
+  pthread_mutex_unlock(&engine->lock);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int for_each(struct FileJournal* self,
+  int (*callback)(const void* record, size_t size, void* context),
+  void* context)
+{
+  if (self == NULL || callback == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  uint64_t* indices = NULL;
+  size_t    count   = 0;
+
+  // everything appended so far is replayed
+  int ret = flush(self);
+
+  if (ret == KC_FILE_SUCCESS)
+  {
+    ret = list_segments(self->directory, &indices, &count);
+  }
+
+  // segments are replayed oldest first, records in the order they were written
+  for (size_t i = 0; i < count && ret == KC_FILE_SUCCESS; ++i)
+  {
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%0*llu.log", self->directory,
+      KC_FILE_JOURNAL_NAME_DIGITS, (unsigned long long)indices[i]);
+
+    int         fd   = open(path, O_RDONLY | O_CLOEXEC);
+    char*       data = NULL;
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0 ||
+        (data = malloc((size_t)st.st_size + 1)) == NULL ||
+        pread(fd, data, (size_t)st.st_size, 0) != st.st_size)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      ret = KC_FILE_INVALID;
+    }
+    else
+    {
+      size_t valid =
+        segment_scan(data, (size_t)st.st_size, callback, context, &ret);
+
+      // only the last segment may end in a torn record, the ones before it
+      // were sealed whole, so a shorter scan there means they are corrupt
+      if (ret == KC_FILE_SUCCESS && i + 1 < count &&
+          valid < (size_t)st.st_size)
+      {
+        self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+        ret = KC_FILE_INVALID;
+      }
+    }
+
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+
+    free(data);
+  }
+
+  free(indices);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint32_t crc_compute(uint32_t size, const void* data)
+{
+  const unsigned char* length = (const unsigned char*)&size;
+  const unsigned char* bytes  = (const unsigned char*)data;
+
+  uint32_t crc = 0xFFFFFFFF;
+
+  // the length is covered as well, so a torn header is caught too
+  for (size_t i = 0; i < sizeof(size); ++i)
+  {
+    crc = crc_table[(crc ^ length[i]) & 0xFF] ^ (crc >> 8);
+  }
+
+  for (uint32_t i = 0; i < size; ++i)
+  {
+    crc = crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+
+  return crc ^ 0xFFFFFFFF;
+}
+
+//---------------------------------------------------------------------------//
+
+static void crc_init()
+{
+  for (uint32_t i = 0; i < 256; ++i)
+  {
+    uint32_t crc = i;
+
+    for (int bit = 0; bit < 8; ++bit)
+    {
+      crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+    }
+
+    crc_table[i] = crc;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int list_segments(const char* directory, uint64_t** indices,
+  size_t* count)
+{
+  DIR* dir = opendir(directory);
+
+  (*indices) = NULL;
+  (*count)   = 0;
+
+  if (dir == NULL)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  size_t         capacity = 0;
+  struct dirent* entry    = NULL;
+
+  while ((entry = readdir(dir)) != NULL)
+  {
+    char* end = NULL;
+
+    // only the segment files count, anything else in the directory is kept
+    if (strlen(entry->d_name) != KC_FILE_JOURNAL_NAME_DIGITS + 4 ||
+        strcmp(entry->d_name + KC_FILE_JOURNAL_NAME_DIGITS, ".log") != 0)
+    {
+      continue;
+    }
+
+    uint64_t index = strtoull(entry->d_name, &end, 10);
+
+    if (end != entry->d_name + KC_FILE_JOURNAL_NAME_DIGITS)
+    {
+      continue;
+    }
+
+    if ((*count) == capacity)
+    {
+      capacity = capacity == 0 ? 16 : capacity * 2;
+
+      uint64_t* grown = realloc(*indices, capacity * sizeof(uint64_t));
+
+      if (grown == NULL)
+      {
+        closedir(dir);
+        free(*indices);
+
+        (*indices) = NULL;
+        (*count)   = 0;
+
+        return KC_OUT_OF_MEMORY;
+      }
+
+      (*indices) = grown;
+    }
+
+    // insertion sort, a journal rarely has more than a few hundred segments
+    size_t position = (*count)++;
+
+    while (position > 0 && (*indices)[position - 1] > index)
+    {
+      (*indices)[position] = (*indices)[position - 1];
+      --position;
+    }
+
+    (*indices)[position] = index;
+  }
+
+  closedir(dir);
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int journal_output(struct FileJournal* self, const char* data,
+  size_t size)
+{
+  struct JournalEngine* engine = (struct JournalEngine*)self->engine;
+
+  while (size > 0)
+  {
+    ssize_t written = pwrite(engine->fd, data, size, (off_t)engine->offset);
+
+    if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    if (written <= 0)
+    {
+      return KC_FILE_INVALID;
+    }
+
+    data           += written;
+    size           -= (size_t)written;
+    engine->offset += (uint64_t)written;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct JournalNode* journal_pop(struct JournalEngine* engine)
+{
+  struct JournalNode* head = engine->head;
+  struct JournalNode* next = __atomic_load_n(&head->next, __ATOMIC_ACQUIRE);
+
+  // empty, or a producer swapped the tail but has not linked its node yet
+  if (next == NULL)
+  {
+    return NULL;
+  }
+
+  // the old head was consumed on the previous call, the returned node stays
+  // alive as the new head until the next one
+  engine->head = next;
+  free(head);
+
+  return next;
+}
+
+//---------------------------------------------------------------------------//
+
+static int journal_recover(struct FileJournal* self)
+{
+  struct JournalEngine* engine  = (struct JournalEngine*)self->engine;
+  uint64_t*             indices = NULL;
+  size_t                count   = 0;
+
+  int ret = list_segments(self->directory, &indices, &count);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    return ret;
+  }
+
+  // a new journal starts with an empty first segment
+  if (count == 0)
+  {
+    free(indices);
+
+    return segment_open(self, 0);
+  }
+
+  uint64_t last = indices[count - 1];
+
+  free(indices);
+
+  ret = segment_open(self, last);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    return ret;
+  }
+
+  // older segments were synced before the next one was started, only the
+  // last one can end in a torn record
+  char* data = malloc(engine->offset + 1);
+
+  if (data == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  if (pread(engine->fd, data, engine->offset, 0) != (ssize_t)engine->offset)
+  {
+    free(data);
+
+    return KC_FILE_INVALID;
+  }
+
+  size_t valid = segment_scan(data, engine->offset, NULL, NULL, &ret);
+
+  free(data);
+
+  if (valid < engine->offset)
+  {
+    if (ftruncate(engine->fd, (off_t)valid) != 0 || fdatasync(engine->fd) != 0)
+    {
+      return KC_FILE_INVALID;
+    }
+
+    self->truncated = engine->offset - valid;
+    engine->offset  = valid;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int journal_roll(struct FileJournal* self)
+{
+  struct JournalEngine* engine = (struct JournalEngine*)self->engine;
+
+  // the full segment is made durable before the next one exists, so recovery
+  // never has to look past the last segment
+  if (fdatasync(engine->fd) != 0)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  close(engine->fd);
+
+  engine->fd = -1;
+
+  return segment_open(self, self->segment + 1);
+}
+
+//---------------------------------------------------------------------------//
+
+static void* journal_work(void* context)
+{
+  struct FileJournal*   self   = (struct FileJournal*)context;
+  struct JournalEngine* engine = (struct JournalEngine*)self->engine;
+
+  for (;;)
+  {
+    struct JournalNode* node  = NULL;
+    uint64_t        count = 0;
+    int             ret   = KC_FILE_SUCCESS;
+
+    // take everything queued so far, the batch goes out whenever it fills
+    while ((node = journal_pop(engine)) != NULL)
+    {
+      if (ret == KC_FILE_SUCCESS && engine->error == 0)
+      {
+        ret = journal_write(self, node->frame, node->size);
+      }
+
+      ++count;
+    }
+
+    if (ret == KC_FILE_SUCCESS && engine->batch_fill > 0)
+    {
+      ret = journal_output(self, engine->batch, engine->batch_fill);
+    }
+
+    engine->batch_fill = 0;
+
+    __atomic_store_n(&engine->written, engine->written + count,
+      __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&engine->lock);
+
+    // records are dropped after a failure, every flush() reports it
+    if (ret != KC_FILE_SUCCESS && engine->error == 0)
+    {
+      __atomic_store_n(&engine->error, KC_IO_ERROR, __ATOMIC_RELEASE);
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+    }
+
+    uint64_t written = engine->written;
+
+    // someone waits in flush() and there is something new to sync
+    if (engine->requested > engine->synced && written > engine->synced)
+    {
+      pthread_mutex_unlock(&engine->lock);
+
+      ret = fdatasync(engine->fd) == 0 ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+
+      pthread_mutex_lock(&engine->lock);
+
+      if (ret != KC_FILE_SUCCESS)
+      {
+        __atomic_store_n(&engine->error, KC_IO_ERROR, __ATOMIC_RELEASE);
+      }
+
+      engine->synced = written;
+      pthread_cond_broadcast(&engine->flushed);
+      pthread_mutex_unlock(&engine->lock);
+
+      continue;
+    }
+
+    // nothing arrived since the last wait, sleep until the next record;
+    // producers look at the state after linking theirs, so none is missed
+    int state = count == 0 ? KC_FILE_JOURNAL_IDLE : KC_FILE_JOURNAL_GATHERING;
+
+    __atomic_store_n(&engine->state, state, __ATOMIC_SEQ_CST);
+
+    bool empty =
+      __atomic_load_n(&engine->head->next, __ATOMIC_SEQ_CST) == NULL;
+
+    if (empty == true && engine->stopping == true)
+    {
+      pthread_mutex_unlock(&engine->lock);
+      break;
+    }
+
+    // a flush() or a destructor waits, write what is queued right away
+    if (empty == false &&
+        (engine->requested > engine->synced || engine->stopping == true))
+    {
+      state = KC_FILE_JOURNAL_BUSY;
+    }
+
+    if (state == KC_FILE_JOURNAL_IDLE && empty == true)
+    {
+      pthread_cond_wait(&engine->work, &engine->lock);
+    }
+    else if (state == KC_FILE_JOURNAL_GATHERING)
+    {
+      // give the producers time to queue a whole batch, instead of waking
+      // up for every few records
+      struct timespec deadline;
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+      deadline.tv_nsec += KC_FILE_JOURNAL_LINGER;
+
+      if (deadline.tv_nsec >= 1000000000)
+      {
+        deadline.tv_sec  += 1;
+        deadline.tv_nsec -= 1000000000;
+      }
+
+      pthread_cond_timedwait(&engine->work, &engine->lock, &deadline);
+    }
+
+    __atomic_store_n(&engine->state, KC_FILE_JOURNAL_BUSY, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_unlock(&engine->lock);
+  }
+
+  // a clean shutdown leaves every record on disk
+  fdatasync(engine->fd);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static int journal_write(struct FileJournal* self, const char* frame,
+  size_t size)
+{
+  struct JournalEngine* engine = (struct JournalEngine*)self->engine;
+  int                   ret    = KC_FILE_SUCCESS;
+
+  // the record does not fit in this segment, write what is batched and move
+  // on to the next one
+  if (engine->offset + engine->batch_fill + size > self->segment_size)
+  {
+    ret = journal_output(self, engine->batch, engine->batch_fill);
+
+    engine->batch_fill = 0;
+
+    if (ret != KC_FILE_SUCCESS || journal_roll(self) != KC_FILE_SUCCESS)
+    {
+      return KC_FILE_INVALID;
+    }
+  }
+
+  if (engine->batch_fill + size > KC_FILE_JOURNAL_BATCH_SIZE)
+  {
+    ret = journal_output(self, engine->batch, engine->batch_fill);
+
+    engine->batch_fill = 0;
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+  }
+
+  // records larger than the whole batch are written on their own
+  if (size > KC_FILE_JOURNAL_BATCH_SIZE)
+  {
+    return journal_output(self, frame, size);
+  }
+
+  memcpy(engine->batch + engine->batch_fill, frame, size);
+  engine->batch_fill += size;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int segment_open(struct FileJournal* self, uint64_t index)
+{
+  struct JournalEngine* engine = (struct JournalEngine*)self->engine;
+  char                  path[PATH_MAX];
+  struct stat           st;
+
+  snprintf(path, sizeof(path), "%s/%0*llu.log", self->directory,
+    KC_FILE_JOURNAL_NAME_DIGITS, (unsigned long long)index);
+
+  bool existed = stat(path, &st) == 0;
+
+  engine->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+
+  if (engine->fd < 0 || fstat(engine->fd, &st) != 0)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  // the whole segment is reserved at once, appends never wait for the file
+  // system to find blocks; not every file system can do it
+  fallocate(engine->fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)self->segment_size);
+
+  engine->offset = (uint64_t)st.st_size;
+
+  __atomic_store_n(&self->segment, index, __ATOMIC_RELEASE);
+
+  // a new segment must survive a crash along with the records written to it
+  if (existed == false)
+  {
+    return sync_directory(self->directory);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t segment_scan(const char* data, size_t size,
+  int (*callback)(const void* record, size_t size, void* context),
+  void* context, int* ret)
+{
+  size_t offset = 0;
+
+  // walk the records up to the first one that is cut short or corrupt
+  while (size - offset >= sizeof(struct JournalFrame))
+  {
+    struct JournalFrame frame;
+
+    memcpy(&frame, data + offset, sizeof(frame));
+
+    if (frame.size > size - offset - sizeof(frame) ||
+        crc_compute(frame.size, data + offset + sizeof(frame)) !=
+          frame.checksum)
+    {
+      break;
+    }
+
+    if (callback != NULL && (*ret) == KC_FILE_SUCCESS)
+    {
+      (*ret) = callback(data + offset + sizeof(frame), frame.size, context);
+    }
+
+    offset += sizeof(frame) + frame.size;
+  }
+
+  return offset;
+}
+
+//---------------------------------------------------------------------------//
+
+static int sync_directory(const char* directory)
+{
+  int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+  if (fd < 0)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  int ret = fsync(fd) == 0 ? KC_FILE_SUCCESS : KC_FILE_INVALID;
+
+  close(fd);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
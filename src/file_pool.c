@@ -0,0 +1,279 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_pool.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/file_pool.h"
+#include "../include/system_log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// names up to this size are kept inside the pool, longer ones on the heap
+#define KC_FILE_POOL_NAME_SIZE                                              256
+
+// the free list is empty when its head points at this index
+#define KC_FILE_POOL_EMPTY                                           0xFFFFFFFF
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+struct FilePoolSlot
+{
+  struct File file;
+  uint32_t    next;
+  char        name[KC_FILE_POOL_NAME_SIZE];
+};
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int acquire_file (struct FilePool* self, struct File** file);
+static int release_file (struct FilePool* self, struct File* file);
+
+static void push_slot (struct FilePool* self, uint32_t index);
+
+//---------------------------------------------------------------------------//
+
+struct FilePool* new_file_pool(size_t capacity)
+{
+  if (capacity == 0 || capacity >= KC_FILE_POOL_EMPTY)
+  {
+    log_error(err[KC_INVALID_ARGUMENT], log_err[KC_INVALID_ARGUMENT],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  // create a pool instance to be returned
+  struct FilePool*     pool  = malloc(sizeof(struct FilePool));
+  struct FilePoolSlot* slots = calloc(capacity, sizeof(struct FilePoolSlot));
+
+  // every pooled file starts as a copy of a regular one
+  struct File* file = new_file();
+
+  if (pool == NULL || slots == NULL || file == NULL)
+  {
+    log_error(err[KC_OUT_OF_MEMORY], log_err[KC_OUT_OF_MEMORY],
+      __FILE__, __LINE__, __func__);
+
+    if (file != NULL)
+    {
+      destroy_file(file);
+    }
+
+    free(slots);
+    free(pool);
+
+    return NULL;
+  }
+
+  struct ConsoleLog* log = get_system_log(KC_SYSTEM_LOG_FILE_POOL, __FILE__);
+
+  // assigns the public member fields
+  pool->log       = log;
+  pool->capacity  = capacity;
+  pool->available = 0;
+  pool->head      = KC_FILE_POOL_EMPTY;
+  pool->slots     = slots;
+
+  // assigns the public member methods
+  pool->acquire = acquire_file;
+  pool->release = release_file;
+
+  for (size_t i = capacity; i > 0; --i)
+  {
+    struct FilePoolSlot* slot = &slots[i - 1];
+
+    slot->file              = (*file);
+    slot->file.name_storage = slot->name;
+    slot->file.name_size    = KC_FILE_POOL_NAME_SIZE;
+
+    // the counters of the template go with it, every slot keeps its own
+    if (file->stats != NULL &&
+        (slot->file.stats = calloc(1, sizeof(struct SystemStats))) == NULL)
+    {
+      log_error(err[KC_OUT_OF_MEMORY], log_err[KC_OUT_OF_MEMORY],
+        __FILE__, __LINE__, __func__);
+
+      // slots not reached yet are still zeroed, their counters are NULL
+      for (size_t j = 0; j < capacity; ++j)
+      {
+        free(slots[j].file.stats);
+      }
+
+      destroy_file(file);
+      free(slots);
+      free(pool);
+
+      return NULL;
+    }
+
+    push_slot(pool, (uint32_t)(i - 1));
+  }
+
+  destroy_file(file);
+
+  return pool;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_file_pool(struct FilePool* pool)
+{
+  if (pool == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return;
+  }
+
+  struct FilePoolSlot* slots = (struct FilePoolSlot*)pool->slots;
+
+  // files that were never released are closed along with the pool
+  for (size_t i = 0; i < pool->capacity; ++i)
+  {
+    struct File* file = &slots[i].file;
+
+    file->close(file);
+    file->set_group_commit(file, 0);
+
+    if (file->name != file->name_storage)
+    {
+      free(file->name);
+    }
+
+    free(file->buffer);
+    free(file->path);
+    free(file->stats);
+  }
+
+  free(pool->slots);
+  free(pool);
+}
+
+//---------------------------------------------------------------------------//
+
+int acquire_file(struct FilePool* self, struct File** file)
+{
+  if (self == NULL || file == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct FilePoolSlot* slots = (struct FilePoolSlot*)self->slots;
+  uint64_t             head  = __atomic_load_n(&self->head, __ATOMIC_ACQUIRE);
+  uint64_t             next  = 0;
+
+  // pop the top of the free list, the upper half of the head is a counter
+  // bumped on every change so a slot reused in between is never mistaken
+  do
+  {
+    uint32_t index = (uint32_t)head;
+
+    if (index == KC_FILE_POOL_EMPTY)
+    {
+      (*file) = NULL;
+
+      return KC_RESOURCE_UNAVAILABLE;
+    }
+
+    next = (((head >> 32) + 1) << 32) |
+      __atomic_load_n(&slots[index].next, __ATOMIC_RELAXED);
+  }
+  while (!__atomic_compare_exchange_n(&self->head, &head, next, true,
+           __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+  __atomic_sub_fetch(&self->available, 1, __ATOMIC_RELAXED);
+
+  (*file) = &slots[(uint32_t)head].file;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int release_file(struct FilePool* self, struct File* file)
+{
+  if (self == NULL || file == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct FilePoolSlot* slots = (struct FilePoolSlot*)self->slots;
+  struct FilePoolSlot* slot  = (struct FilePoolSlot*)file;
+
+  // only files handed out by this pool can be given back to it
+  if (slot < slots || slot >= slots + self->capacity ||
+      (size_t)((char*)slot - (char*)slots) % sizeof(struct FilePoolSlot) != 0)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  file->close(file);
+
+  // group commit is switched off again, the next caller starts with plain syncs
+  file->set_group_commit(file, 0);
+
+  // a name too long for the inline storage was put on the heap
+  if (file->name != file->name_storage)
+  {
+    free(file->name);
+  }
+
+  // anything the caller configured is dropped, the next one starts clean
+  free(file->buffer);
+  free(file->path);
+
+  file->name        = NULL;
+  file->path        = NULL;
+  file->buffer      = NULL;
+  file->buffer_size = 0;
+  file->path_cache  = false;
+
+  // the counters start over for the next caller
+  if (file->stats != NULL)
+  {
+    memset(file->stats, 0, sizeof(struct SystemStats));
+  }
+
+  push_slot(self, (uint32_t)(slot - slots));
+
+  return KC_FILE_SUCCESS;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static void push_slot(struct FilePool* self, uint32_t index)
+{
+  struct FilePoolSlot* slots = (struct FilePoolSlot*)self->slots;
+  uint64_t             head  = __atomic_load_n(&self->head, __ATOMIC_RELAXED);
+  uint64_t             next  = 0;
+
+  // counted before the slot can be taken, so the count never drops below zero
+  __atomic_add_fetch(&self->available, 1, __ATOMIC_RELAXED);
+
+  do
+  {
+    __atomic_store_n(&slots[index].next, (uint32_t)head, __ATOMIC_RELAXED);
+
+    next = (((head >> 32) + 1) << 32) | index;
+  }
+  while (!__atomic_compare_exchange_n(&self->head, &head, next, true,
+           __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+//---------------------------------------------------------------------------//
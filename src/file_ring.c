@@ -0,0 +1,851 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_ring.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/file_ring.h"
+#include "../include/system_log.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// the thread pool never grows past this many workers, whatever the depth
+#define KC_FILE_RING_MAX_WORKERS                                             16
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+enum FILE_RING_OPCODES
+{
+  KC_FILE_RING_OP_READ,
+  KC_FILE_RING_OP_WRITE,
+  KC_FILE_RING_OP_FSYNC
+};
+
+struct FileRequest
+{
+  int      opcode;
+  int      fd;
+  uint64_t offset;
+  void*    buffer;
+  size_t   size;
+  void*    context;
+};
+
+struct UringEngine
+{
+  int      fd;
+  unsigned queued;
+
+  void*  sq_ring;
+  size_t sq_ring_size;
+  void*  cq_ring;
+  size_t cq_ring_size;
+
+  struct io_uring_sqe* sqes;
+  size_t               sqes_size;
+
+  unsigned* sq_head;
+  unsigned* sq_tail;
+  unsigned* sq_mask;
+  unsigned* sq_array;
+
+  unsigned*            cq_head;
+  unsigned*            cq_tail;
+  unsigned*            cq_mask;
+  struct io_uring_cqe* cqes;
+};
+
+struct ThreadEngine
+{
+  pthread_mutex_t lock;
+  pthread_cond_t  work;
+  pthread_cond_t  done;
+
+  struct FileRequest*    requests;
+  unsigned               requests_head;
+  unsigned               requests_count;
+  struct FileCompletion* completions;
+  unsigned               completions_head;
+  unsigned               completions_count;
+  unsigned               capacity;
+
+  pthread_t* workers;
+  unsigned   workers_count;
+  bool       stopping;
+};
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int poll_completions  (struct FileRing* self, struct FileCompletion* completions, unsigned max, unsigned min, unsigned* count);
+static int submit_fsync      (struct FileRing* self, struct File* file, void* context);
+static int submit_read       (struct FileRing* self, struct File* file, uint64_t offset, void* buffer, size_t size, void* context);
+static int submit_write      (struct FileRing* self, struct File* file, uint64_t offset, const void* data, size_t size, void* context);
+
+static int   submit_request  (struct FileRing* self, struct File* file, struct FileRequest* request);
+
+static int   uring_enter     (struct UringEngine* engine, unsigned submit, unsigned min);
+static void  uring_destroy   (struct UringEngine* engine);
+static int   uring_init      (struct UringEngine* engine, unsigned depth);
+static int   uring_poll      (struct FileRing* self, struct FileCompletion* completions, unsigned max, unsigned min, unsigned* count);
+static int   uring_submit    (struct FileRing* self, struct FileRequest* request);
+
+static void  threads_destroy (struct ThreadEngine* engine);
+static int   threads_init    (struct ThreadEngine* engine, unsigned depth);
+static int   threads_poll    (struct FileRing* self, struct FileCompletion* completions, unsigned max, unsigned min, unsigned* count);
+static int   threads_submit  (struct FileRing* self, struct FileRequest* request);
+static void* threads_work    (void* context);
+
+//---------------------------------------------------------------------------//
+
+struct FileRing* new_file_ring(unsigned depth, int backend)
+{
+  if (depth == 0 || backend < KC_FILE_RING_AUTO ||
+      backend > KC_FILE_RING_THREADS)
+  {
+    log_error(err[KC_INVALID_ARGUMENT], log_err[KC_INVALID_ARGUMENT],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  // create a ring instance to be returned
+  struct FileRing* ring = malloc(sizeof(struct FileRing));
+
+  if (ring == NULL)
+  {
+    log_error(err[KC_OUT_OF_MEMORY], log_err[KC_OUT_OF_MEMORY],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  ring->engine = NULL;
+
+  // prefer io_uring, fall back to the thread pool if the kernel lacks it
+  if (backend != KC_FILE_RING_THREADS)
+  {
+    struct UringEngine* engine = malloc(sizeof(struct UringEngine));
+
+    if (engine != NULL && uring_init(engine, depth) == KC_FILE_SUCCESS)
+    {
+      ring->engine  = engine;
+      ring->backend = KC_FILE_RING_IO_URING;
+    }
+    else
+    {
+      free(engine);
+    }
+  }
+
+  if (ring->engine == NULL && backend != KC_FILE_RING_IO_URING)
+  {
+    struct ThreadEngine* engine = malloc(sizeof(struct ThreadEngine));
+
+    if (engine != NULL && threads_init(engine, depth) == KC_FILE_SUCCESS)
+    {
+      ring->engine  = engine;
+      ring->backend = KC_FILE_RING_THREADS;
+    }
+    else
+    {
+      free(engine);
+    }
+  }
+
+  if (ring->engine == NULL)
+  {
+    log_error(err[KC_UNSUPPORTED_FEATURE], log_err[KC_UNSUPPORTED_FEATURE],
+      __FILE__, __LINE__, __func__);
+
+    free(ring);
+    return NULL;
+  }
+
+  // assigns the public member fields
+  ring->log     = get_system_log(KC_SYSTEM_LOG_FILE_RING, __FILE__);
+  ring->depth   = depth;
+  ring->pending = 0;
+
+  // assigns the public member methods
+  ring->poll_completions = poll_completions;
+  ring->submit_fsync     = submit_fsync;
+  ring->submit_read      = submit_read;
+  ring->submit_write     = submit_write;
+
+  return ring;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_file_ring(struct FileRing* ring)
+{
+  if (ring == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return;
+  }
+
+  // the caller buffers must outlive every request, so wait for all of them
+  struct FileCompletion completions[64];
+
+  while (ring->pending > 0)
+  {
+    unsigned count = 0;
+
+    if (ring->poll_completions(ring, completions, 64, 1, &count) !=
+        KC_FILE_SUCCESS)
+    {
+      break;
+    }
+  }
+
+  if (ring->backend == KC_FILE_RING_IO_URING)
+  {
+    uring_destroy((struct UringEngine*)ring->engine);
+  }
+  else
+  {
+    threads_destroy((struct ThreadEngine*)ring->engine);
+  }
+
+  free(ring->engine);
+  free(ring);
+}
+
+//---------------------------------------------------------------------------//
+
+int poll_completions(struct FileRing* self, struct FileCompletion* completions,
+  unsigned max, unsigned min, unsigned* count)
+{
+  if (self == NULL || completions == NULL || count == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  (*count) = 0;
+
+  // never wait for more than what is in flight or what fits in the output
+  if (min > self->pending)
+  {
+    min = self->pending;
+  }
+
+  if (min > max)
+  {
+    min = max;
+  }
+
+  int ret = self->backend == KC_FILE_RING_IO_URING
+    ? uring_poll(self, completions, max, min, count)
+    : threads_poll(self, completions, max, min, count);
+
+  self->pending -= (*count);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int submit_fsync(struct FileRing* self, struct File* file, void* context)
+{
+  struct FileRequest request =
+  {
+    KC_FILE_RING_OP_FSYNC, -1, 0, NULL, 0, context
+  };
+
+  return submit_request(self, file, &request);
+}
+
+//---------------------------------------------------------------------------//
+
+int submit_read(struct FileRing* self, struct File* file, uint64_t offset,
+  void* buffer, size_t size, void* context)
+{
+  if (buffer == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct FileRequest request =
+  {
+    KC_FILE_RING_OP_READ, -1, offset, buffer, size, context
+  };
+
+  return submit_request(self, file, &request);
+}
+
+//---------------------------------------------------------------------------//
+
+int submit_write(struct FileRing* self, struct File* file, uint64_t offset,
+  const void* data, size_t size, void* context)
+{
+  if (data == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct FileRequest request =
+  {
+    KC_FILE_RING_OP_WRITE, -1, offset, (void*)data, size, context
+  };
+
+  return submit_request(self, file, &request);
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static int submit_request(struct FileRing* self, struct File* file,
+  struct FileRequest* request)
+{
+  if (self == NULL || file == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  // the file must be open
+  if (file->opened == false)
+  {
+    return KC_FILE_CLOSED;
+  }
+
+  // every completion must have room, reap some before submitting more
+  if (self->pending >= self->depth)
+  {
+    return KC_RESOURCE_UNAVAILABLE;
+  }
+
+  // a single request moves at most 4 GiB, like one io_uring entry
+  if (request->size > UINT32_MAX)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the ring goes straight to the descriptor, so whatever the File still
+  // holds in its stream or its staged direct block is written out first
+  if (file->flush(file) != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  request->fd = fileno(file->file);
+
+  int ret = self->backend == KC_FILE_RING_IO_URING
+    ? uring_submit(self, request)
+    : threads_submit(self, request);
+
+  // a busy kernel is no failure, the caller reaps completions and retries
+  if (ret == KC_RESOURCE_UNAVAILABLE)
+  {
+    return ret;
+  }
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+    return ret;
+  }
+
+  ++self->pending;
+
+  return KC_FILE_SUCCESS;
+}
+
+//--- MARK: IO_URING BACKEND ------------------------------------------------//
+
+static int uring_enter(struct UringEngine* engine, unsigned submit,
+  unsigned min)
+{
+  unsigned flags = min > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+  for (;;)
+  {
+    long ret = syscall(__NR_io_uring_enter, engine->fd, submit, min, flags,
+      NULL, 0);
+
+    if (ret >= 0)
+    {
+      // the kernel may take fewer entries than offered
+      engine->queued -= (unsigned)ret;
+
+      return KC_FILE_SUCCESS;
+    }
+
+    // the kernel is short on memory or its completion queue overflowed,
+    // reaping completions makes room again
+    if (errno == EAGAIN || errno == EBUSY)
+    {
+      return KC_RESOURCE_UNAVAILABLE;
+    }
+
+    if (errno != EINTR)
+    {
+      return KC_FILE_INVALID;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void uring_destroy(struct UringEngine* engine)
+{
+  munmap(engine->sqes, engine->sqes_size);
+
+  if (engine->cq_ring != engine->sq_ring)
+  {
+    munmap(engine->cq_ring, engine->cq_ring_size);
+  }
+
+  munmap(engine->sq_ring, engine->sq_ring_size);
+  close(engine->fd);
+}
+
+//---------------------------------------------------------------------------//
+
+static int uring_init(struct UringEngine* engine, unsigned depth)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  long fd = syscall(__NR_io_uring_setup, depth, &params);
+
+  if (fd < 0)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  // plain read and write opcodes arrived together with this feature
+  if ((params.features & IORING_FEAT_RW_CUR_POS) == 0 ||
+      params.cq_entries < depth)
+  {
+    close((int)fd);
+    return KC_FILE_INVALID;
+  }
+
+  engine->fd     = (int)fd;
+  engine->queued = 0;
+
+  engine->sq_ring_size = params.sq_off.array +
+    params.sq_entries * sizeof(unsigned);
+  engine->cq_ring_size = params.cq_off.cqes +
+    params.cq_entries * sizeof(struct io_uring_cqe);
+
+  // newer kernels share one mapping between both rings
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    if (engine->cq_ring_size > engine->sq_ring_size)
+    {
+      engine->sq_ring_size = engine->cq_ring_size;
+    }
+
+    engine->cq_ring_size = engine->sq_ring_size;
+  }
+
+  engine->sq_ring = mmap(NULL, engine->sq_ring_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, engine->fd, IORING_OFF_SQ_RING);
+
+  if (engine->sq_ring == MAP_FAILED)
+  {
+    close(engine->fd);
+    return KC_FILE_INVALID;
+  }
+
+  engine->cq_ring = engine->sq_ring;
+
+  if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0)
+  {
+    engine->cq_ring = mmap(NULL, engine->cq_ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, engine->fd, IORING_OFF_CQ_RING);
+
+    if (engine->cq_ring == MAP_FAILED)
+    {
+      munmap(engine->sq_ring, engine->sq_ring_size);
+      close(engine->fd);
+      return KC_FILE_INVALID;
+    }
+  }
+
+  engine->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  engine->sqes      = mmap(NULL, engine->sqes_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, engine->fd, IORING_OFF_SQES);
+
+  if (engine->sqes == MAP_FAILED)
+  {
+    if (engine->cq_ring != engine->sq_ring)
+    {
+      munmap(engine->cq_ring, engine->cq_ring_size);
+    }
+
+    munmap(engine->sq_ring, engine->sq_ring_size);
+    close(engine->fd);
+    return KC_FILE_INVALID;
+  }
+
+  char* sq = (char*)engine->sq_ring;
+  char* cq = (char*)engine->cq_ring;
+
+  engine->sq_head  = (unsigned*)(sq + params.sq_off.head);
+  engine->sq_tail  = (unsigned*)(sq + params.sq_off.tail);
+  engine->sq_mask  = (unsigned*)(sq + params.sq_off.ring_mask);
+  engine->sq_array = (unsigned*)(sq + params.sq_off.array);
+
+  engine->cq_head = (unsigned*)(cq + params.cq_off.head);
+  engine->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+  engine->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+  engine->cqes    = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int uring_poll(struct FileRing* self, struct FileCompletion* completions,
+  unsigned max, unsigned min, unsigned* count)
+{
+  struct UringEngine* engine = (struct UringEngine*)self->engine;
+  unsigned            submit = engine->queued;
+
+  for (;;)
+  {
+    unsigned wanted = min > (*count) ? min - (*count) : 0;
+    unsigned before = (*count);
+    int      ret    = KC_FILE_SUCCESS;
+
+    // hand the queued requests to the kernel and wait in the same call
+    if (submit > 0 || wanted > 0)
+    {
+      ret = uring_enter(engine, submit, wanted);
+    }
+
+    if (ret == KC_FILE_INVALID)
+    {
+      return KC_FILE_INVALID;
+    }
+
+    unsigned head = *engine->cq_head;
+    unsigned tail = __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail && (*count) < max)
+    {
+      struct io_uring_cqe* cqe = &engine->cqes[head & *engine->cq_mask];
+
+      completions[*count].context = (void*)(uintptr_t)cqe->user_data;
+      completions[*count].result  = cqe->res;
+
+      ++(*count);
+      ++head;
+    }
+
+    // give the consumed entries back to the kernel
+    __atomic_store_n(engine->cq_head, head, __ATOMIC_RELEASE);
+
+    if (ret == KC_FILE_SUCCESS || (*count) == max)
+    {
+      return KC_FILE_SUCCESS;
+    }
+
+    // the kernel was busy, the requests stay queued for the next poll unless
+    // this one waits; then it submits again once completions were reaped, or
+    // waits for a request in flight to finish and make room
+    if (wanted == 0 && (*count) == before)
+    {
+      return KC_FILE_SUCCESS;
+    }
+
+    bool waiting = (*count) == before &&
+      self->pending - (*count) > engine->queued;
+
+    submit = waiting == true ? 0 : engine->queued;
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static int uring_submit(struct FileRing* self, struct FileRequest* request)
+{
+  struct UringEngine* engine = (struct UringEngine*)self->engine;
+
+  unsigned tail = *engine->sq_tail;
+  unsigned head = __atomic_load_n(engine->sq_head, __ATOMIC_ACQUIRE);
+
+  // the submission queue is full, push it to the kernel first
+  if (tail - head > *engine->sq_mask)
+  {
+    int ret = uring_enter(engine, engine->queued, 0);
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+  }
+
+  unsigned index = tail & *engine->sq_mask;
+
+  struct io_uring_sqe* sqe = &engine->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+  switch (request->opcode)
+  {
+    case KC_FILE_RING_OP_READ:
+      sqe->opcode = IORING_OP_READ;
+      break;
+
+    case KC_FILE_RING_OP_WRITE:
+      sqe->opcode = IORING_OP_WRITE;
+      break;
+
+    default:
+      sqe->opcode = IORING_OP_FSYNC;
+      break;
+  }
+
+  sqe->fd        = request->fd;
+  sqe->off       = request->offset;
+  sqe->addr      = (uint64_t)(uintptr_t)request->buffer;
+  sqe->len       = (uint32_t)request->size;
+  sqe->user_data = (uint64_t)(uintptr_t)request->context;
+
+  engine->sq_array[index] = index;
+
+  // publish the entry, it is picked up by the next io_uring_enter
+  __atomic_store_n(engine->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++engine->queued;
+
+  return KC_FILE_SUCCESS;
+}
+
+//--- MARK: THREAD POOL BACKEND ---------------------------------------------//
+
+static void threads_destroy(struct ThreadEngine* engine)
+{
+  pthread_mutex_lock(&engine->lock);
+  engine->stopping = true;
+  pthread_cond_broadcast(&engine->work);
+  pthread_mutex_unlock(&engine->lock);
+
+  for (unsigned i = 0; i < engine->workers_count; ++i)
+  {
+    pthread_join(engine->workers[i], NULL);
+  }
+
+  pthread_cond_destroy(&engine->done);
+  pthread_cond_destroy(&engine->work);
+  pthread_mutex_destroy(&engine->lock);
+
+  free(engine->workers);
+  free(engine->completions);
+  free(engine->requests);
+}
+
+//---------------------------------------------------------------------------//
+
+static int threads_init(struct ThreadEngine* engine, unsigned depth)
+{
+  engine->requests_head     = 0;
+  engine->requests_count    = 0;
+  engine->completions_head  = 0;
+  engine->completions_count = 0;
+  engine->capacity          = depth;
+  engine->workers_count     = 0;
+  engine->stopping          = false;
+
+  engine->requests    = malloc(depth * sizeof(struct FileRequest));
+  engine->completions = malloc(depth * sizeof(struct FileCompletion));
+  engine->workers     = malloc(KC_FILE_RING_MAX_WORKERS * sizeof(pthread_t));
+
+  if (engine->requests == NULL || engine->completions == NULL ||
+      engine->workers == NULL)
+  {
+    free(engine->workers);
+    free(engine->completions);
+    free(engine->requests);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  pthread_mutex_init(&engine->lock, NULL);
+  pthread_cond_init(&engine->work, NULL);
+  pthread_cond_init(&engine->done, NULL);
+
+  // a fixed pool serves every file, no matter how many requests are queued
+  unsigned workers = depth < KC_FILE_RING_MAX_WORKERS
+    ? depth : KC_FILE_RING_MAX_WORKERS;
+
+  for (unsigned i = 0; i < workers; ++i)
+  {
+    if (pthread_create(&engine->workers[i], NULL, threads_work, engine) != 0)
+    {
+      break;
+    }
+
+    ++engine->workers_count;
+  }
+
+  if (engine->workers_count == 0)
+  {
+    threads_destroy(engine);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int threads_poll(struct FileRing* self,
+  struct FileCompletion* completions, unsigned max, unsigned min,
+  unsigned* count)
+{
+  struct ThreadEngine* engine = (struct ThreadEngine*)self->engine;
+
+  pthread_mutex_lock(&engine->lock);
+
+  while (engine->completions_count < min)
+  {
+    pthread_cond_wait(&engine->done, &engine->lock);
+  }
+
+  while (engine->completions_count > 0 && (*count) < max)
+  {
+    completions[*count] = engine->completions[engine->completions_head];
+
+    engine->completions_head = (engine->completions_head + 1) %
+      engine->capacity;
+
+    --engine->completions_count;
+    ++(*count);
+  }
+
+  pthread_mutex_unlock(&engine->lock);
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int threads_submit(struct FileRing* self, struct FileRequest* request)
+{
+  struct ThreadEngine* engine = (struct ThreadEngine*)self->engine;
+
+  pthread_mutex_lock(&engine->lock);
+
+  unsigned tail = (engine->requests_head + engine->requests_count) %
+    engine->capacity;
+
+  engine->requests[tail] = *request;
+  ++engine->requests_count;
+
+  pthread_cond_signal(&engine->work);
+  pthread_mutex_unlock(&engine->lock);
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* threads_work(void* context)
+{
+  struct ThreadEngine* engine = (struct ThreadEngine*)context;
+
+  pthread_mutex_lock(&engine->lock);
+
+  for (;;)
+  {
+    while (engine->requests_count == 0 && engine->stopping == false)
+    {
+      pthread_cond_wait(&engine->work, &engine->lock);
+    }
+
+    if (engine->requests_count == 0)
+    {
+      break;
+    }
+
+    struct FileRequest request = engine->requests[engine->requests_head];
+
+    engine->requests_head = (engine->requests_head + 1) % engine->capacity;
+    --engine->requests_count;
+
+    pthread_mutex_unlock(&engine->lock);
+
+    // run the blocking call outside of the lock
+    ssize_t result = 0;
+
+    switch (request.opcode)
+    {
+      case KC_FILE_RING_OP_READ:
+        result = pread(request.fd, request.buffer, request.size,
+          (off_t)request.offset);
+        break;
+
+      case KC_FILE_RING_OP_WRITE:
+        result = pwrite(request.fd, request.buffer, request.size,
+          (off_t)request.offset);
+        break;
+
+      default:
+        result = fsync(request.fd);
+        break;
+    }
+
+    // report errors the same way io_uring does
+    if (result < 0)
+    {
+      result = -errno;
+    }
+
+    pthread_mutex_lock(&engine->lock);
+
+    unsigned tail = (engine->completions_head + engine->completions_count) %
+      engine->capacity;
+
+    engine->completions[tail].context = request.context;
+    engine->completions[tail].result  = result;
+
+    ++engine->completions_count;
+
+    pthread_cond_signal(&engine->done);
+  }
+
+  pthread_mutex_unlock(&engine->lock);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,1050 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_watch.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/file_watch.h"
+#include "../include/system_log.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// every watch reports the same kinds of events, they are told apart later
+#define KC_FILE_WATCH_MASK   (IN_CREATE | IN_DELETE | IN_MODIFY |             \
+                              IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |  \
+                              IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+// events are read from the kernel in blocks of this size
+#define KC_FILE_WATCH_BUFFER_SIZE                                     (64 << 10)
+
+// both tables start out with this many buckets and double when full
+#define KC_FILE_WATCH_BUCKETS                                                64
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+struct WatchEntry
+{
+  struct WatchEntry* next;
+
+  char* path;
+  int   wd;
+  bool  recursive;
+  bool  renamed;
+};
+
+struct PendingChange
+{
+  struct PendingChange* next;
+  struct PendingChange* after;
+
+  char*    path;
+  size_t   hash;
+  uint32_t events;
+  uint64_t last;
+};
+
+struct WatchEngine
+{
+  struct WatchEntry** watches;
+  size_t              watch_buckets;
+
+  struct PendingChange** changes;
+  size_t                 change_buckets;
+
+  // pending changes in the order their first event arrived
+  struct PendingChange* first;
+  struct PendingChange* last;
+
+  struct FileChange* batch;
+  size_t             batch_capacity;
+
+  // the directory last moved away, until it shows up again under a new name
+  char*    moved;
+  uint32_t cookie;
+
+  char* buffer;
+};
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int add         (struct FileWatch* self, const char* path, int flags);
+static int dispatch    (struct FileWatch* self, int timeout, int (*callback)(const struct FileChange* changes, size_t count, void* context), void* context);
+static int get_timeout (struct FileWatch* self, int* timeout);
+static int remove_path (struct FileWatch* self, const char* path);
+
+static int                change_record  (struct FileWatch* self, const char* path, uint32_t events);
+static uint64_t           change_settle  (struct FileWatch* self);
+static size_t             hash_path      (const char* path);
+static void               normalize_path (const char* path, char* clean);
+static uint64_t           now            ();
+static int                read_events    (struct FileWatch* self);
+static void               watch_drop     (struct FileWatch* self, struct WatchEntry* entry);
+static struct WatchEntry* watch_find     (struct FileWatch* self, int wd);
+static int                watch_insert   (struct FileWatch* self, int wd, const char* path, bool recursive);
+static size_t             watch_rename   (struct FileWatch* self, const char* from, const char* to);
+static int                watch_tree     (struct FileWatch* self, const char* path, bool recursive, bool report);
+static void               watch_untree   (struct FileWatch* self, const char* path, size_t* removed);
+
+//---------------------------------------------------------------------------//
+
+struct FileWatch* new_file_watch(uint32_t delay)
+{
+  // create a watch instance to be returned
+  struct FileWatch*   watch  = malloc(sizeof(struct FileWatch));
+  struct WatchEngine* engine = calloc(1, sizeof(struct WatchEngine));
+  char*               buffer = malloc(KC_FILE_WATCH_BUFFER_SIZE);
+
+  struct WatchEntry**    watches =
+    calloc(KC_FILE_WATCH_BUCKETS, sizeof(struct WatchEntry*));
+  struct PendingChange** changes =
+    calloc(KC_FILE_WATCH_BUCKETS, sizeof(struct PendingChange*));
+
+  if (watch == NULL || engine == NULL || buffer == NULL || watches == NULL ||
+      changes == NULL)
+  {
+    log_error(err[KC_OUT_OF_MEMORY], log_err[KC_OUT_OF_MEMORY],
+      __FILE__, __LINE__, __func__);
+
+    free(changes);
+    free(watches);
+    free(buffer);
+    free(engine);
+    free(watch);
+
+    return NULL;
+  }
+
+  // the descriptor never blocks, dispatch() polls it with its own timeout
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (fd < 0)
+  {
+    log_error(err[KC_RESOURCE_UNAVAILABLE], log_err[KC_RESOURCE_UNAVAILABLE],
+      __FILE__, __LINE__, __func__);
+
+    free(changes);
+    free(watches);
+    free(buffer);
+    free(engine);
+    free(watch);
+
+    return NULL;
+  }
+
+  engine->watches        = watches;
+  engine->watch_buckets  = KC_FILE_WATCH_BUCKETS;
+  engine->changes        = changes;
+  engine->change_buckets = KC_FILE_WATCH_BUCKETS;
+  engine->buffer         = buffer;
+
+  // assigns the public member fields
+  watch->log     = get_system_log(KC_SYSTEM_LOG_FILE_WATCH, __FILE__);
+  watch->fd      = fd;
+  watch->delay   = delay;
+  watch->watches = 0;
+  watch->pending = 0;
+  watch->engine  = engine;
+
+  // assigns the public member methods
+  watch->add         = add;
+  watch->dispatch    = dispatch;
+  watch->get_timeout = get_timeout;
+  watch->remove      = remove_path;
+
+  return watch;
+}
+
+//---------------------------------------------------------------------------//
+
+void destroy_file_watch(struct FileWatch* watch)
+{
+  if (watch == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return;
+  }
+
+  struct WatchEngine* engine = (struct WatchEngine*)watch->engine;
+
+  // closing the descriptor removes every watch in the kernel at once
+  close(watch->fd);
+
+  for (size_t i = 0; i < engine->watch_buckets; ++i)
+  {
+    while (engine->watches[i] != NULL)
+    {
+      struct WatchEntry* entry = engine->watches[i];
+
+      engine->watches[i] = entry->next;
+
+      free(entry->path);
+      free(entry);
+    }
+  }
+
+  while (engine->first != NULL)
+  {
+    struct PendingChange* change = engine->first;
+
+    engine->first = change->after;
+
+    free(change->path);
+    free(change);
+  }
+
+  free(engine->watches);
+  free(engine->changes);
+  free(engine->batch);
+  free(engine->moved);
+  free(engine->buffer);
+  free(engine);
+  free(watch);
+}
+
+//---------------------------------------------------------------------------//
+
+int add(struct FileWatch* self, const char* path, int flags)
+{
+  if (self == NULL || path == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  char clean[PATH_MAX];
+
+  if (strlen(path) >= sizeof(clean) ||
+      (flags & ~KC_FILE_WATCH_RECURSIVE) != 0)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  // the same directory is known by a single name, without a trailing slash
+  normalize_path(path, clean);
+
+  int ret = watch_tree(self, clean, (flags & KC_FILE_WATCH_RECURSIVE) != 0,
+    false);
+
+  if (ret != KC_FILE_SUCCESS)
+  {
+    // the kernel limits how many watches a user can have
+    self->log->error(self->log,
+      errno == ENOENT ? KC_FILE_NOT_FOUND :
+      errno == ENOSPC ? KC_RESOURCE_UNAVAILABLE : KC_IO_ERROR,
+      __LINE__, __func__);
+  }
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+int dispatch(struct FileWatch* self, int timeout,
+  int (*callback)(const struct FileChange* changes, size_t count,
+    void* context),
+  void* context)
+{
+  if (self == NULL || callback == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+
+  uint64_t deadline = timeout < 0 ? UINT64_MAX
+                                  : now() + (uint64_t)timeout * 1000000;
+
+  for (;;)
+  {
+    int ret = read_events(self);
+
+    if (ret != KC_FILE_SUCCESS)
+    {
+      return ret;
+    }
+
+    uint64_t current = now();
+    uint64_t delay   = (uint64_t)self->delay * 1000000;
+    uint64_t settle  = UINT64_MAX;
+    size_t   count   = 0;
+
+    struct PendingChange*  settled = NULL;
+    struct PendingChange** link    = &engine->first;
+
+    engine->last = NULL;
+
+    // take every path that has been quiet long enough, keep the others in
+    // the order they arrived
+    while ((*link) != NULL)
+    {
+      struct PendingChange* change = *link;
+
+      if (current - change->last < delay)
+      {
+        settle = change->last + delay < settle ? change->last + delay
+                                               : settle;
+
+        engine->last = change;
+        link         = &change->after;
+
+        continue;
+      }
+
+      (*link) = change->after;
+
+      // unlink it from its hash chain too
+      struct PendingChange** chain =
+        &engine->changes[change->hash & (engine->change_buckets - 1)];
+
+      while ((*chain) != change)
+      {
+        chain = &(*chain)->next;
+      }
+
+      (*chain) = change->next;
+
+      change->after = settled;
+      settled       = change;
+      count        += 1;
+    }
+
+    self->pending -= count;
+
+    if (count > 0)
+    {
+      if (count > engine->batch_capacity)
+      {
+        struct FileChange* batch =
+          realloc(engine->batch, count * sizeof(struct FileChange));
+
+        if (batch == NULL)
+        {
+          self->log->error(self->log, KC_OUT_OF_MEMORY, __LINE__, __func__);
+
+          ret = KC_OUT_OF_MEMORY;
+        }
+        else
+        {
+          engine->batch          = batch;
+          engine->batch_capacity = count;
+        }
+      }
+
+      // the settled list is in reverse, the batch is filled from the back
+      size_t index = count;
+
+      for (struct PendingChange* change = settled; change != NULL;
+           change = change->after)
+      {
+        if (ret == KC_FILE_SUCCESS)
+        {
+          index -= 1;
+
+          // a queue overflow is reported without a path
+          engine->batch[index].path   =
+            change->path[0] == '\0' ? NULL : change->path;
+          engine->batch[index].events = change->events;
+        }
+      }
+
+      if (ret == KC_FILE_SUCCESS)
+      {
+        ret = callback(engine->batch, count, context);
+      }
+
+      // the paths were only lent to the callback
+      while (settled != NULL)
+      {
+        struct PendingChange* change = settled;
+
+        settled = change->after;
+
+        free(change->path);
+        free(change);
+      }
+
+      return ret;
+    }
+
+    if (current >= deadline)
+    {
+      return KC_FILE_SUCCESS;
+    }
+
+    // sleep until new events arrive, a path settles or the timeout is over
+    uint64_t wake = settle < deadline ? settle : deadline;
+    int      wait = wake == UINT64_MAX
+                  ? -1 : (int)((wake - current + 999999) / 1000000);
+
+    struct pollfd pfd = { self->fd, POLLIN, 0 };
+
+    if (poll(&pfd, 1, wait) < 0 && errno != EINTR)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+int get_timeout(struct FileWatch* self, int* timeout)
+{
+  if (self == NULL || timeout == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  uint64_t settle  = change_settle(self);
+  uint64_t current = now();
+
+  // nothing is pending, only new events matter
+  if (settle == UINT64_MAX)
+  {
+    (*timeout) = -1;
+  }
+  else
+  {
+    (*timeout) = settle <= current
+               ? 0 : (int)((settle - current + 999999) / 1000000);
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int remove_path(struct FileWatch* self, const char* path)
+{
+  if (self == NULL || path == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return KC_NULL_REFERENCE;
+  }
+
+  char   clean[PATH_MAX];
+  size_t removed = 0;
+
+  if (strlen(path) >= sizeof(clean))
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  normalize_path(path, clean);
+
+  // the path and, if it was added recursively, everything below it
+  watch_untree(self, clean, &removed);
+
+  if (removed == 0)
+  {
+    self->log->error(self->log, KC_INVALID_ARGUMENT, __LINE__, __func__);
+
+    return KC_FILE_INVALID;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int change_record(struct FileWatch* self, const char* path,
+  uint32_t events)
+{
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+
+  size_t hash = hash_path(path);
+
+  // a path that already has a pending change only collects the new events
+  // and waits for the burst to end
+  for (struct PendingChange* change =
+         engine->changes[hash & (engine->change_buckets - 1)];
+       change != NULL; change = change->next)
+  {
+    if (change->hash == hash && strcmp(change->path, path) == 0)
+    {
+      change->events |= events;
+      change->last    = now();
+
+      return KC_FILE_SUCCESS;
+    }
+  }
+
+  // the table is full, rehash into twice as many buckets
+  if (self->pending >= engine->change_buckets)
+  {
+    size_t                 buckets = engine->change_buckets * 2;
+    struct PendingChange** changes =
+      calloc(buckets, sizeof(struct PendingChange*));
+
+    if (changes != NULL)
+    {
+      for (struct PendingChange* change = engine->first; change != NULL;
+           change = change->after)
+      {
+        size_t slot = change->hash & (buckets - 1);
+
+        change->next  = changes[slot];
+        changes[slot] = change;
+      }
+
+      free(engine->changes);
+
+      engine->changes        = changes;
+      engine->change_buckets = buckets;
+    }
+  }
+
+  struct PendingChange* change = malloc(sizeof(struct PendingChange));
+  char*                 copy   = strdup(path);
+
+  if (change == NULL || copy == NULL)
+  {
+    free(change);
+    free(copy);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  size_t bucket = hash & (engine->change_buckets - 1);
+
+  change->next   = engine->changes[bucket];
+  change->after  = NULL;
+  change->path   = copy;
+  change->hash   = hash;
+  change->events = events;
+  change->last   = now();
+
+  engine->changes[bucket] = change;
+
+  if (engine->last != NULL)
+  {
+    engine->last->after = change;
+  }
+  else
+  {
+    engine->first = change;
+  }
+
+  engine->last   = change;
+  self->pending += 1;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t change_settle(struct FileWatch* self)
+{
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+
+  uint64_t delay  = (uint64_t)self->delay * 1000000;
+  uint64_t settle = UINT64_MAX;
+
+  // the next time a pending path has been quiet for the whole delay
+  for (struct PendingChange* change = engine->first; change != NULL;
+       change = change->after)
+  {
+    if (change->last + delay < settle)
+    {
+      settle = change->last + delay;
+    }
+  }
+
+  return settle;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t hash_path(const char* path)
+{
+  uint64_t hash = 0xCBF29CE484222325ULL;
+
+  for (const char* c = path; *c != '\0'; ++c)
+  {
+    hash ^= (unsigned char)*c;
+    hash *= 0x100000001B3ULL;
+  }
+
+  return (size_t)hash;
+}
+
+//---------------------------------------------------------------------------//
+
+static void normalize_path(const char* path, char* clean)
+{
+  size_t size = strlen(path);
+
+  // the root keeps its only slash
+  while (size > 1 && path[size - 1] == '/')
+  {
+    --size;
+  }
+
+  memcpy(clean, path, size);
+  clean[size] = '\0';
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+//---------------------------------------------------------------------------//
+
+static int read_events(struct FileWatch* self)
+{
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+  char                path[PATH_MAX];
+
+  for (;;)
+  {
+    ssize_t size = read(self->fd, engine->buffer, KC_FILE_WATCH_BUFFER_SIZE);
+
+    if (size < 0 && errno == EINTR)
+    {
+      continue;
+    }
+
+    // everything the kernel had queued was read
+    if (size < 0 && errno == EAGAIN)
+    {
+      return KC_FILE_SUCCESS;
+    }
+
+    if (size <= 0)
+    {
+      self->log->error(self->log, KC_IO_ERROR, __LINE__, __func__);
+
+      return KC_FILE_INVALID;
+    }
+
+    for (char* next = engine->buffer; next < engine->buffer + size;)
+    {
+      struct inotify_event event;
+
+      memcpy(&event, next, sizeof(event));
+
+      const char* name = next + sizeof(event);
+
+      next += sizeof(event) + event.len;
+
+      // the kernel dropped events, everything has to be checked again
+      if (event.mask & IN_Q_OVERFLOW)
+      {
+        change_record(self, "", KC_FILE_WATCH_OVERFLOW);
+        continue;
+      }
+
+      struct WatchEntry* entry = watch_find(self, event.wd);
+
+      // events still queued for a watch that was removed
+      if (entry == NULL)
+      {
+        continue;
+      }
+
+      // the watch is gone, its path was deleted or its file system unmounted
+      if (event.mask & IN_IGNORED)
+      {
+        struct stat st;
+
+        snprintf(path, sizeof(path), "%s", entry->path);
+        watch_drop(self, entry);
+
+        // a file replaced by a rename over it, as atomic_write() does, is
+        // found under its name again and watched from now on
+        if (lstat(path, &st) == 0 && S_ISREG(st.st_mode) &&
+            watch_tree(self, path, false, false) == KC_FILE_SUCCESS &&
+            change_record(self, path, KC_FILE_WATCH_CREATED) !=
+              KC_FILE_SUCCESS)
+        {
+          self->log->error(self->log, KC_OUT_OF_MEMORY, __LINE__, __func__);
+
+          return KC_OUT_OF_MEMORY;
+        }
+
+        continue;
+      }
+
+      // the directory was renamed inside a watched tree, its watches already
+      // carry the new name
+      if ((event.mask & IN_MOVE_SELF) && (event.len == 0) &&
+          entry->renamed == true)
+      {
+        entry->renamed = false;
+        continue;
+      }
+
+      // events on the watched path itself come without a name
+      if (event.len > 0 && name[0] != '\0')
+      {
+        snprintf(path, sizeof(path), "%s/%s", entry->path, name);
+      }
+      else
+      {
+        snprintf(path, sizeof(path), "%s", entry->path);
+      }
+
+      uint32_t events = 0;
+
+      if (event.mask & (IN_CREATE | IN_MOVED_TO))
+      {
+        events |= KC_FILE_WATCH_CREATED;
+      }
+
+      if (event.mask & (IN_MODIFY | IN_CLOSE_WRITE))
+      {
+        events |= KC_FILE_WATCH_MODIFIED;
+      }
+
+      if (event.mask & (IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF |
+                        IN_MOVE_SELF))
+      {
+        events |= KC_FILE_WATCH_DELETED;
+      }
+
+      if (event.mask & IN_ATTRIB)
+      {
+        events |= KC_FILE_WATCH_ATTRIBUTES;
+      }
+
+      if (change_record(self, path, events) != KC_FILE_SUCCESS)
+      {
+        self->log->error(self->log, KC_OUT_OF_MEMORY, __LINE__, __func__);
+
+        return KC_OUT_OF_MEMORY;
+      }
+
+      // the other half of the move tells where the directory went
+      if ((event.mask & IN_ISDIR) && (event.mask & IN_MOVED_FROM))
+      {
+        free(engine->moved);
+
+        engine->moved  = strdup(path);
+        engine->cookie = event.cookie;
+      }
+
+      // a directory renamed inside a watched tree keeps its watches, they are
+      // moved over to the new name
+      if ((event.mask & IN_ISDIR) && (event.mask & IN_MOVED_TO) &&
+          entry->recursive == true && engine->moved != NULL &&
+          engine->cookie == event.cookie &&
+          watch_rename(self, engine->moved, path) > 0)
+      {
+        free(engine->moved);
+        engine->moved = NULL;
+      }
+      // a new directory in a watched tree is watched as well, and what was
+      // created in it before the watch was in place is reported as created
+      else if ((event.mask & IN_ISDIR) &&
+               (event.mask & (IN_CREATE | IN_MOVED_TO)) &&
+               entry->recursive == true)
+      {
+        watch_tree(self, path, true, true);
+      }
+
+      // a directory moved away keeps its watch under a name that is no longer
+      // right, it is dropped along with everything watched below it
+      if ((event.mask & IN_MOVE_SELF) && (event.len == 0))
+      {
+        watch_untree(self, path, NULL);
+      }
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+static void watch_drop(struct FileWatch* self, struct WatchEntry* entry)
+{
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+
+  struct WatchEntry** link =
+    &engine->watches[(size_t)entry->wd & (engine->watch_buckets - 1)];
+
+  while ((*link) != entry)
+  {
+    link = &(*link)->next;
+  }
+
+  (*link) = entry->next;
+
+  free(entry->path);
+  free(entry);
+
+  self->watches -= 1;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct WatchEntry* watch_find(struct FileWatch* self, int wd)
+{
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+
+  for (struct WatchEntry* entry =
+         engine->watches[(size_t)wd & (engine->watch_buckets - 1)];
+       entry != NULL; entry = entry->next)
+  {
+    if (entry->wd == wd)
+    {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static int watch_insert(struct FileWatch* self, int wd, const char* path,
+  bool recursive)
+{
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+  struct WatchEntry*  entry  = watch_find(self, wd);
+  char*               copy   = strdup(path);
+
+  if (copy == NULL)
+  {
+    return KC_OUT_OF_MEMORY;
+  }
+
+  // the kernel hands out the same descriptor when a path is added twice
+  if (entry != NULL)
+  {
+    free(entry->path);
+
+    entry->path       = copy;
+    entry->recursive |= recursive;
+
+    return KC_FILE_SUCCESS;
+  }
+
+  // the table is full, rehash into twice as many buckets
+  if (self->watches >= engine->watch_buckets)
+  {
+    size_t              buckets = engine->watch_buckets * 2;
+    struct WatchEntry** watches = calloc(buckets, sizeof(struct WatchEntry*));
+
+    if (watches != NULL)
+    {
+      for (size_t i = 0; i < engine->watch_buckets; ++i)
+      {
+        while (engine->watches[i] != NULL)
+        {
+          struct WatchEntry* moved = engine->watches[i];
+          size_t             slot  = (size_t)moved->wd & (buckets - 1);
+
+          engine->watches[i] = moved->next;
+          moved->next        = watches[slot];
+          watches[slot]      = moved;
+        }
+      }
+
+      free(engine->watches);
+
+      engine->watches       = watches;
+      engine->watch_buckets = buckets;
+    }
+  }
+
+  if ((entry = malloc(sizeof(struct WatchEntry))) == NULL)
+  {
+    free(copy);
+
+    return KC_OUT_OF_MEMORY;
+  }
+
+  size_t slot = (size_t)wd & (engine->watch_buckets - 1);
+
+  entry->next      = engine->watches[slot];
+  entry->path      = copy;
+  entry->wd        = wd;
+  entry->recursive = recursive;
+  entry->renamed   = false;
+
+  engine->watches[slot] = entry;
+  self->watches        += 1;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t watch_rename(struct FileWatch* self, const char* from,
+  const char* to)
+{
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+
+  size_t size    = strlen(from);
+  size_t renamed = 0;
+  char   path[PATH_MAX];
+
+  for (size_t i = 0; i < engine->watch_buckets; ++i)
+  {
+    for (struct WatchEntry* entry = engine->watches[i]; entry != NULL;
+         entry = entry->next)
+    {
+      // the directory itself and every path below it
+      if (strncmp(entry->path, from, size) != 0 ||
+          (entry->path[size] != '\0' && entry->path[size] != '/'))
+      {
+        continue;
+      }
+
+      snprintf(path, sizeof(path), "%s%s", to, entry->path + size);
+
+      char* copy = strdup(path);
+
+      if (copy == NULL)
+      {
+        continue;
+      }
+
+      free(entry->path);
+      entry->path = copy;
+
+      // the kernel still reports the move to the directory itself
+      entry->renamed = entry->path[strlen(to)] == '\0';
+      renamed       += 1;
+    }
+  }
+
+  return renamed;
+}
+
+//---------------------------------------------------------------------------//
+
+static int watch_tree(struct FileWatch* self, const char* path,
+  bool recursive, bool report)
+{
+  int wd = inotify_add_watch(self->fd, path, KC_FILE_WATCH_MASK);
+
+  if (wd < 0 || watch_insert(self, wd, path, recursive) != KC_FILE_SUCCESS)
+  {
+    return KC_FILE_INVALID;
+  }
+
+  DIR* dir = recursive == true ? opendir(path) : NULL;
+
+  // a file, or a directory that is watched on its own
+  if (dir == NULL)
+  {
+    return KC_FILE_SUCCESS;
+  }
+
+  struct dirent* entry = NULL;
+  char           child[PATH_MAX];
+  int            ret   = KC_FILE_SUCCESS;
+
+  while (ret == KC_FILE_SUCCESS && (entry = readdir(dir)) != NULL)
+  {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+    {
+      continue;
+    }
+
+    snprintf(child, sizeof(child), "%s%s%s", path,
+      strcmp(path, "/") == 0 ? "" : "/", entry->d_name);
+
+    if (report == true)
+    {
+      change_record(self, child, KC_FILE_WATCH_CREATED);
+    }
+
+    struct stat st;
+
+    // symbolic links are never followed, a tree is only watched once
+    bool directory = entry->d_type == DT_DIR ||
+      (entry->d_type == DT_UNKNOWN && lstat(child, &st) == 0 &&
+       S_ISDIR(st.st_mode));
+
+    // a directory removed in the meantime is not an error, running out of
+    // watches is
+    if (directory == true &&
+        watch_tree(self, child, true, report) != KC_FILE_SUCCESS &&
+        errno != ENOENT)
+    {
+      ret = KC_FILE_INVALID;
+    }
+  }
+
+  closedir(dir);
+
+  return ret;
+}
+
+//---------------------------------------------------------------------------//
+
+static void watch_untree(struct FileWatch* self, const char* path,
+  size_t* removed)
+{
+  struct WatchEngine* engine = (struct WatchEngine*)self->engine;
+
+  size_t size = strlen(path);
+
+  for (size_t i = 0; i < engine->watch_buckets; ++i)
+  {
+    struct WatchEntry* entry = engine->watches[i];
+
+    while (entry != NULL)
+    {
+      struct WatchEntry* next = entry->next;
+
+      // the path itself and every path below it
+      if (strncmp(entry->path, path, size) == 0 &&
+          (entry->path[size] == '\0' || entry->path[size] == '/' ||
+           (size == 1 && path[0] == '/')))
+      {
+        inotify_rm_watch(self->fd, entry->wd);
+        watch_drop(self, entry);
+
+        if (removed != NULL)
+        {
+          (*removed) += 1;
+        }
+      }
+
+      entry = next;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
@@ -0,0 +1,137 @@
+// This file is part of libkc_system
+// ==================================
+//
+// system_log.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/system_log.h"
+
+#include <stddef.h>
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+// one logger per module, created lazily and never destroyed
+static struct ConsoleLog* system_logs[KC_SYSTEM_LOG_MODULES] = {NULL};
+
+#ifdef KC_SYSTEM_LOG_DISABLED
+static bool system_log_enabled = false;
+#else
+static bool system_log_enabled = true;
+#endif
+
+// the methods of an enabled logger, saved while the loggers are muted
+static struct ConsoleLog system_log_methods;
+static bool              system_log_saved = false;
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static void apply_state (struct ConsoleLog* log, bool enabled);
+static void mute_log    (struct ConsoleLog* self, const int index, const int line, const char* func);
+
+//---------------------------------------------------------------------------//
+
+struct ConsoleLog* get_system_log(int module, const char* file)
+{
+  if (module < 0 || module >= KC_SYSTEM_LOG_MODULES)
+  {
+    log_error(err[KC_INVALID_ARGUMENT], log_err[KC_INVALID_ARGUMENT],
+      __FILE__, __LINE__, __func__);
+
+    return NULL;
+  }
+
+  struct ConsoleLog* log =
+    __atomic_load_n(&system_logs[module], __ATOMIC_ACQUIRE);
+
+  if (log != NULL)
+  {
+    return log;
+  }
+
+  struct ConsoleLog* created = new_console_log(err, log_err, file);
+
+  if (created == NULL)
+  {
+    return NULL;
+  }
+
+  apply_state(created, __atomic_load_n(&system_log_enabled, __ATOMIC_ACQUIRE));
+
+  // another thread may have created the same logger in the meantime
+  if (!__atomic_compare_exchange_n(&system_logs[module], &log, created, false,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    destroy_console_log(created);
+
+    return log;
+  }
+
+  return created;
+}
+
+//---------------------------------------------------------------------------//
+
+void set_system_log(bool enabled)
+{
+  __atomic_store_n(&system_log_enabled, enabled, __ATOMIC_RELEASE);
+
+  for (int i = 0; i < KC_SYSTEM_LOG_MODULES; ++i)
+  {
+    struct ConsoleLog* log =
+      __atomic_load_n(&system_logs[i], __ATOMIC_ACQUIRE);
+
+    if (log != NULL)
+    {
+      apply_state(log, enabled);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+bool is_system_log_enabled()
+{
+  return __atomic_load_n(&system_log_enabled, __ATOMIC_ACQUIRE);
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static void apply_state(struct ConsoleLog* log, bool enabled)
+{
+  // every logger shares the same methods, remember them once
+  if (__atomic_load_n(&system_log_saved, __ATOMIC_ACQUIRE) == false &&
+      log->error != mute_log)
+  {
+    system_log_methods = (*log);
+    __atomic_store_n(&system_log_saved, true, __ATOMIC_RELEASE);
+  }
+
+  // a muted logger returns right away, before formatting anything; fatal
+  // errors are always reported, they still abort the process
+  __atomic_store_n(&log->debug,
+    enabled ? system_log_methods.debug : mute_log, __ATOMIC_RELEASE);
+  __atomic_store_n(&log->error,
+    enabled ? system_log_methods.error : mute_log, __ATOMIC_RELEASE);
+  __atomic_store_n(&log->info,
+    enabled ? system_log_methods.info : mute_log, __ATOMIC_RELEASE);
+  __atomic_store_n(&log->warning,
+    enabled ? system_log_methods.warning : mute_log, __ATOMIC_RELEASE);
+}
+
+//---------------------------------------------------------------------------//
+
+static void mute_log(struct ConsoleLog* self, const int index, const int line,
+  const char* func)
+{
+  (void)self;
+  (void)index;
+  (void)line;
+  (void)func;
+}
+
+//---------------------------------------------------------------------------//
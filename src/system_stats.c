@@ -0,0 +1,293 @@
+// This file is part of libkc_system
+// ==================================
+//
+// system_stats.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../include/system_stats.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// the slots of two threads never share a cache line
+#define KC_SYSTEM_STATS_CACHE_LINE                                         64
+
+//--- MARK: PRIVATE STRUCTURES ----------------------------------------------//
+
+struct StatsSlot
+{
+  struct SystemStats stats;
+  struct StatsSlot*  next;
+  bool               owned;
+} __attribute__((aligned(KC_SYSTEM_STATS_CACHE_LINE)));
+
+// every slot ever made, a slot is handed to a new thread once its owner exits
+static struct StatsSlot* stats_slots = NULL;
+
+static __thread struct StatsSlot* stats_slot = NULL;
+
+static pthread_key_t  stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+
+//--- MARK: PRIVATE FUNCTION PROTOTYPES -------------------------------------//
+
+static int               stats_bucket     (uint64_t nanoseconds);
+static struct StatsSlot* stats_claim      ();
+static void              stats_count      (uint64_t* value, uint64_t amount);
+static void              stats_key_create ();
+static void              stats_release    (void* slot);
+static uint64_t          stats_upper      (int bucket);
+
+//---------------------------------------------------------------------------//
+
+void get_system_stats(struct SystemStats* stats)
+{
+  if (stats == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return;
+  }
+
+  memset(stats, 0, sizeof(struct SystemStats));
+
+  uint64_t* total = (uint64_t*)stats;
+  size_t    words = sizeof(struct SystemStats) / sizeof(uint64_t);
+
+  struct StatsSlot* slot = __atomic_load_n(&stats_slots, __ATOMIC_ACQUIRE);
+
+  // the owners keep counting while their slots are added up
+  for (; slot != NULL; slot = slot->next)
+  {
+    const uint64_t* counters = (const uint64_t*)&slot->stats;
+
+    for (size_t i = 0; i < words; ++i)
+    {
+      total[i] += __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+uint64_t get_system_stats_percentile(const struct SystemStatsCounter* counter,
+  double rank)
+{
+  if (counter == NULL)
+  {
+    log_error(err[KC_NULL_REFERENCE], log_err[KC_NULL_REFERENCE],
+      __FILE__, __LINE__, __func__);
+
+    return 0;
+  }
+
+  uint64_t total = 0;
+
+  for (int i = 0; i < KC_SYSTEM_STATS_BUCKETS; ++i)
+  {
+    total += counter->histogram[i];
+  }
+
+  if (total == 0)
+  {
+    return 0;
+  }
+
+  rank = rank < 0 ? 0 : rank > 1 ? 1 : rank;
+
+  // the bucket holding the call at that rank, counted from the fastest
+  double   position = rank * total;
+  uint64_t target   = (uint64_t)position;
+
+  target += target < position || target == 0 ? 1 : 0;
+
+  uint64_t seen = 0;
+
+  for (int i = 0; i < KC_SYSTEM_STATS_BUCKETS; ++i)
+  {
+    seen += counter->histogram[i];
+
+    if (seen >= target)
+    {
+      return stats_upper(i);
+    }
+  }
+
+  return stats_upper(KC_SYSTEM_STATS_BUCKETS - 1);
+}
+
+//---------------------------------------------------------------------------//
+
+bool is_system_stats_enabled()
+{
+#ifdef KC_SYSTEM_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+//---------------------------------------------------------------------------//
+
+void record_system_stats(struct SystemStats* local, int operation,
+  uint64_t start, uint64_t bytes, bool failed)
+{
+  if (operation < 0 || operation >= KC_SYSTEM_STATS_OPERATIONS)
+  {
+    return;
+  }
+
+  uint64_t elapsed = start_system_stats() - start;
+  int      bucket  = stats_bucket(elapsed);
+
+  struct StatsSlot* slot = stats_slot != NULL ? stats_slot : stats_claim();
+
+  if (slot != NULL)
+  {
+    struct SystemStatsCounter* counter = &slot->stats.operations[operation];
+
+    stats_count(&counter->calls, 1);
+    stats_count(&counter->bytes, bytes);
+    stats_count(&counter->errors, failed == true ? 1 : 0);
+    stats_count(&counter->nanoseconds, elapsed);
+    stats_count(&counter->histogram[bucket], 1);
+  }
+
+  // the counters of a File belong to the thread using it, like a slot; they
+  // are stored without a locked add, threads sharing a File may lose counts
+  if (local != NULL)
+  {
+    struct SystemStatsCounter* counter = &local->operations[operation];
+
+    stats_count(&counter->calls, 1);
+    stats_count(&counter->bytes, bytes);
+    stats_count(&counter->errors, failed == true ? 1 : 0);
+    stats_count(&counter->nanoseconds, elapsed);
+    stats_count(&counter->histogram[bucket], 1);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+uint64_t start_system_stats()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+//--- MARK: PRIVATE FUNCTIONS -----------------------------------------------//
+
+static int stats_bucket(uint64_t nanoseconds)
+{
+  // the first four buckets hold a single value each
+  if (nanoseconds < 4)
+  {
+    return (int)nanoseconds;
+  }
+
+  // four buckets for every power of two, split by the two bits after the top
+  int top    = 63 - __builtin_clzll(nanoseconds);
+  int bucket = (top - 1) * 4 + (int)((nanoseconds >> (top - 2)) & 3);
+
+  return bucket < KC_SYSTEM_STATS_BUCKETS ? bucket
+    : KC_SYSTEM_STATS_BUCKETS - 1;
+}
+
+//---------------------------------------------------------------------------//
+
+static struct StatsSlot* stats_claim()
+{
+  pthread_once(&stats_once, stats_key_create);
+
+  struct StatsSlot* slot = __atomic_load_n(&stats_slots, __ATOMIC_ACQUIRE);
+
+  // the slot of a thread that exited carries on with its counters
+  for (; slot != NULL; slot = slot->next)
+  {
+    bool owned = false;
+
+    if (__atomic_compare_exchange_n(&slot->owned, &owned, true, false,
+          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    {
+      break;
+    }
+  }
+
+  if (slot == NULL)
+  {
+    if (posix_memalign((void**)&slot, KC_SYSTEM_STATS_CACHE_LINE,
+          sizeof(struct StatsSlot)) != 0)
+    {
+      return NULL;
+    }
+
+    memset(slot, 0, sizeof(struct StatsSlot));
+    slot->owned = true;
+    slot->next  = __atomic_load_n(&stats_slots, __ATOMIC_RELAXED);
+
+    while (!__atomic_compare_exchange_n(&stats_slots, &slot->next, slot,
+             false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    {
+      // another thread added its slot first, slot->next was reloaded
+    }
+  }
+
+  // the slot is given back when the thread exits
+  pthread_setspecific(stats_key, slot);
+  stats_slot = slot;
+
+  return slot;
+}
+
+//---------------------------------------------------------------------------//
+
+static void stats_count(uint64_t* value, uint64_t amount)
+{
+  // only the owner writes its slot, a relaxed store keeps readers from ever
+  // seeing half of a value without the cost of a locked add
+  __atomic_store_n(value, __atomic_load_n(value, __ATOMIC_RELAXED) + amount,
+    __ATOMIC_RELAXED);
+}
+
+//---------------------------------------------------------------------------//
+
+static void stats_key_create()
+{
+  pthread_key_create(&stats_key, stats_release);
+}
+
+//---------------------------------------------------------------------------//
+
+static void stats_release(void* slot)
+{
+  // a later call on this thread, from another destructor, claims a new slot
+  stats_slot = NULL;
+
+  __atomic_store_n(&((struct StatsSlot*)slot)->owned, false, __ATOMIC_RELEASE);
+}
+
+//---------------------------------------------------------------------------//
+
+static uint64_t stats_upper(int bucket)
+{
+  if (bucket < 4)
+  {
+    return (uint64_t)bucket;
+  }
+
+  // the last value before the next bucket starts
+  int top = bucket / 4 + 1;
+  int sub = bucket % 4;
+
+  return ((uint64_t)(5 + sub) << (top - 2)) - 1;
+}
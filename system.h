@@ -15,6 +15,15 @@
 #ifndef SYSTEM_H
 #define SYSTEM_H
 
+#include "include/dir.h"
 #include "include/file.h"
+#include "include/file_cache.h"
+#include "include/file_checksum.h"
+#include "include/file_journal.h"
+#include "include/file_pool.h"
+#include "include/file_ring.h"
+#include "include/file_watch.h"
+#include "include/system_log.h"
+#include "include/system_stats.h"
 
 #endif /* SYSTEM_H */
@@ -0,0 +1,234 @@
+// This file is part of libkc_system
+// ==================================
+//
+// dir.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/dir.h"
+#include "../include/file.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TREE_WIDTH                                                            4
+#define TREE_FILES                                                           16
+
+//---------------------------------------------------------------------------//
+
+struct WalkCount
+{
+  size_t files;
+  size_t directories;
+  size_t links;
+  size_t stop;
+};
+
+//---------------------------------------------------------------------------//
+
+static void create_tree(struct File* file)
+{
+  char path[64];
+
+  // four subdirectories of sixteen files each, plus a file and a link on top
+  for (int i = 0; i < TREE_WIDTH; ++i)
+  {
+    snprintf(path, sizeof(path), "test_dir/sub_%d", i);
+    file->create_path(file, path);
+
+    for (int j = 0; j < TREE_FILES; ++j)
+    {
+      snprintf(path, sizeof(path), "test_dir/sub_%d/file_%d", i, j);
+
+      file->open(file, path, KC_FILE_CREATE_ALWAYS);
+      file->close(file);
+    }
+  }
+
+  file->open(file, "test_dir/top", KC_FILE_CREATE_ALWAYS);
+  file->close(file);
+
+  symlink("sub_0", "test_dir/link");
+}
+
+//---------------------------------------------------------------------------//
+
+static bool skip_first(const char* path, const struct DirEntry* entry,
+  void* context)
+{
+  (void)path;
+  (void)context;
+
+  return strcmp(entry->name, "sub_0") != 0;
+}
+
+//---------------------------------------------------------------------------//
+
+static int count_entry(const char* path, const struct DirEntry* entry,
+  void* context)
+{
+  struct WalkCount* count = (struct WalkCount*)context;
+
+  (void)path;
+
+  // the visitor may be called from several threads at once
+  if (entry->type == KC_DIR_FILE)
+  {
+    __atomic_add_fetch(&count->files, 1, __ATOMIC_RELAXED);
+  }
+  else if (entry->type == KC_DIR_DIRECTORY)
+  {
+    __atomic_add_fetch(&count->directories, 1, __ATOMIC_RELAXED);
+  }
+  else if (entry->type == KC_DIR_LINK)
+  {
+    __atomic_add_fetch(&count->links, 1, __ATOMIC_RELAXED);
+  }
+
+  if (count->stop > 0 &&
+      count->files + count->directories + count->links >= count->stop)
+  {
+    return KC_INVALID_OPERATION;
+  }
+
+  return KC_DIR_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("Dir")
+  {
+    subtest("Creation and Destruction")
+    {
+      struct Dir* dir = new_dir(0);
+
+      ok(dir != NULL);
+      ok(dir->log != NULL);
+      ok(dir->fd == -1);
+      ok(dir->path == NULL);
+      ok(dir->opened == false);
+      ok(dir->buffer == NULL);
+      ok(dir->buffer_size > 0);
+
+      destroy_dir(dir);
+    }
+
+    subtest("Next")
+    {
+      struct File* file = new_file();
+      struct Dir*  dir  = new_dir(0);
+
+      struct DirEntry entry;
+      size_t          removed = 0;
+
+      create_tree(file);
+
+      int ret = dir->next(dir, &entry);
+
+      ok(ret == KC_DIR_CLOSED);
+
+      ret = dir->open(dir, "test_dir");
+
+      ok(ret == KC_DIR_SUCCESS);
+      ok(dir->opened == true);
+      ok(strcmp(dir->path, "test_dir") == 0);
+
+      size_t files       = 0;
+      size_t directories = 0;
+      size_t links       = 0;
+
+      while ((ret = dir->next(dir, &entry)) == KC_DIR_SUCCESS)
+      {
+        files       += entry.type == KC_DIR_FILE;
+        directories += entry.type == KC_DIR_DIRECTORY;
+        links       += entry.type == KC_DIR_LINK;
+      }
+
+      ok(ret == KC_DIR_END);
+      ok(files == 1);
+      ok(directories == TREE_WIDTH);
+      ok(links == 1);
+
+      // the directory can be reopened to list it again
+      ret = dir->open(dir, "test_dir/sub_1");
+
+      for (files = 0; dir->next(dir, &entry) == KC_DIR_SUCCESS; ++files);
+
+      ok(ret == KC_DIR_SUCCESS);
+      ok(files == TREE_FILES);
+
+      ret = dir->open(dir, "test_dir/top");
+
+      ok(ret == KC_DIR_INVALID);
+
+      dir->close(dir);
+
+      ok(dir->opened == false);
+
+      file->delete_path(file, "test_dir", &removed);
+
+      destroy_dir(dir);
+      destroy_file(file);
+    }
+
+    subtest("Walk")
+    {
+      struct File* file = new_file();
+      struct Dir*  dir  = new_dir(0);
+
+      struct WalkCount count   = {0};
+      size_t           removed = 0;
+
+      create_tree(file);
+
+      int ret = dir->walk(dir, "test_dir", 1, NULL, count_entry, &count);
+
+      ok(ret == KC_DIR_SUCCESS);
+      ok(count.files == TREE_WIDTH * TREE_FILES + 1);
+      ok(count.directories == TREE_WIDTH);
+      ok(count.links == 1);
+
+      // the filtered out directory is neither visited nor descended into
+      memset(&count, 0, sizeof(count));
+      ret = dir->walk(dir, "test_dir", 4, skip_first, count_entry, &count);
+
+      ok(ret == KC_DIR_SUCCESS);
+      ok(count.files == (TREE_WIDTH - 1) * TREE_FILES + 1);
+      ok(count.directories == TREE_WIDTH - 1);
+      ok(count.links == 1);
+
+      // the visitor stops the walk, its result is returned
+      memset(&count, 0, sizeof(count));
+      count.stop = 10;
+      ret = dir->walk(dir, "test_dir", 4, NULL, count_entry, &count);
+
+      ok(ret == KC_INVALID_OPERATION);
+      ok(count.files + count.directories + count.links <
+         TREE_WIDTH * TREE_FILES + TREE_WIDTH + 2);
+
+      ret = dir->walk(dir, "test_dir_missing", 2, NULL, count_entry, &count);
+
+      // the failed call is reported through errno
+      ok(ret == KC_DIR_INVALID);
+      ok(errno == ENOENT);
+
+      file->delete_path(file, "test_dir", &removed);
+
+      destroy_dir(dir);
+      destroy_file(file);
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}
@@ -6,10 +6,226 @@
 // Copyright (c) 2023 Daniel Tanase
 // SPDX-License-Identifier: MIT License
 
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
 #include "../deps/libkc/testing/testing.h"
 #include "../include/file.h"
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define READ_AT_FILE_SIZE                                         (16 << 20)
+#define READ_AT_BLOCK_SIZE                                          (4 << 10)
+#define READ_AT_TOTAL_READS                                           65536
+
+#define ADVISE_FILE_SIZE                                          (32 << 20)
+
+#define ATOMIC_WRITE_THREADS                                              8
+#define ATOMIC_WRITE_ROUNDS                                              20
+
+#define DIRECT_FILE_SIZE                                    ((3 << 20) + 123)
+
+#define COMPRESSED_FILE_SIZE                                 ((3 << 20) + 77)
+
+struct AtomicWriteWorker
+{
+  struct File* file;
+  pthread_t    thread;
+  int          index;
+  bool         same;
+};
+
+struct CreatePathWorker
+{
+  pthread_t thread;
+  int       ret;
+};
+
+struct LineCheck
+{
+  size_t count;
+  bool   same;
+};
+
+struct ReadAtWorker
+{
+  struct File* file;
+  pthread_t    thread;
+  uint64_t     seed;
+  int          reads;
+  bool         same;
+};
+
+static int count_chunk(const char* chunk, size_t size, void* context)
+{
+  size_t* total = (size_t*)context;
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    // every byte must follow the written pattern
+    if (chunk[i] != (char)('a' + (*total + i) % 26))
+    {
+      return KC_FILE_INVALID;
+    }
+  }
+
+  (*total) += size;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int count_line(const char* line, size_t size, void* context)
+{
+  (void)line;
+  (void)size;
+
+  (*(size_t*)context) += 1;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int check_line(const char* line, size_t size, void* context)
+{
+  struct LineCheck* check = (struct LineCheck*)context;
+
+  // line n holds n % 97 copies of the same letter, without its delimiter
+  if (size != check->count % 97)
+  {
+    check->same = false;
+  }
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    if (line[i] != (char)('a' + check->count % 26))
+    {
+      check->same = false;
+    }
+  }
+
+  check->count += 1;
+
+  // the iteration stops when asked to by the callback
+  return check->count == 1000 ? KC_FILE_INVALID : KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t count_resident(const char* path, size_t size)
+{
+  size_t         page     = (size_t)sysconf(_SC_PAGESIZE);
+  size_t         resident = 0;
+  unsigned char* pages    = malloc(size / page + 1);
+
+  FILE* stream = fopen(path, "r");
+  void* view   = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(stream), 0);
+
+  // ask which pages of the file are in the page cache, without reading them
+  if (view != MAP_FAILED && mincore(view, size, pages) == 0)
+  {
+    for (size_t i = 0; i < (size + page - 1) / page; ++i)
+    {
+      resident += pages[i] & 1;
+    }
+  }
+
+  if (view != MAP_FAILED)
+  {
+    munmap(view, size);
+  }
+
+  fclose(stream);
+  free(pages);
+
+  return resident * page;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* atomic_replace(void* context)
+{
+  struct AtomicWriteWorker* worker = (struct AtomicWriteWorker*)context;
+
+  char path[64];
+  char data[64];
+
+  snprintf(path, sizeof(path), "test_atomic_write_%d", worker->index);
+
+  worker->same = true;
+
+  // every thread shares the File, and with it the group commit
+  for (int i = 0; i < ATOMIC_WRITE_ROUNDS; ++i)
+  {
+    int size = snprintf(data, sizeof(data), "round %d", i);
+
+    worker->same = worker->same &&
+      worker->file->atomic_write(worker->file, path, data, size) ==
+        KC_FILE_SUCCESS;
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* create_shared_path(void* context)
+{
+  struct CreatePathWorker* worker = (struct CreatePathWorker*)context;
+  struct File*             file   = new_file();
+
+  // every thread races on the very same missing components
+  worker->ret = file->create_path(file, "test_create_race/a/b/c/d/e/f");
+
+  destroy_file(file);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* random_read_at(void* context)
+{
+  struct ReadAtWorker* worker = (struct ReadAtWorker*)context;
+
+  char block[READ_AT_BLOCK_SIZE];
+  int  blocks = READ_AT_FILE_SIZE / READ_AT_BLOCK_SIZE;
+
+  worker->same = true;
+
+  for (int i = 0; i < worker->reads; ++i)
+  {
+    size_t bytes_read = 0;
+
+    // xorshift, every thread walks its own random sequence
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 7;
+    worker->seed ^= worker->seed << 17;
+
+    uint64_t offset = (worker->seed % blocks) * READ_AT_BLOCK_SIZE;
+
+    worker->file->read_at(worker->file, offset, block, sizeof(block),
+      &bytes_read);
+
+    // every block starts with its own offset
+    worker->same = worker->same && bytes_read == sizeof(block) &&
+      memcmp(block, &offset, sizeof(offset)) == 0;
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
 
 int main()
 {
@@ -19,215 +235,1560 @@ int main()
     {
       struct File* file = new_file();
 
-      ok(file != NULL);
-      ok(file->log != NULL);
-      ok(file->file == NULL);
-      ok(file->name == NULL);
-      ok(file->mode == KC_FILE_INVALID);
-      ok(file->opened == false);
+      ok(file != NULL);
+      ok(file->log != NULL);
+      ok(file->file == NULL);
+      ok(file->name == NULL);
+      ok(file->mode == KC_FILE_INVALID);
+      ok(file->opened == false);
+
+      destroy_file(file);
+    }
+
+    subtest("Copy")
+    {
+      struct File* file = new_file();
+
+      int   ret      = KC_FILE_INVALID;
+      int   strategy = 0;
+      char* buffer   = NULL;
+
+      file->open(file, "test_copy", KC_FILE_CREATE_NEW);
+      file->write(file, "This is just a copy test");
+      file->close(file);
+
+      ret = file->copy(file, "test_copy", "test_copied", KC_FILE_COPY_ANY,
+        &strategy);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(strategy & KC_FILE_COPY_ANY);
+
+      // every fallback produces the same copy
+      int strategies[] =
+      {
+        KC_FILE_COPY_RANGE, KC_FILE_COPY_SENDFILE, KC_FILE_COPY_BUFFER
+      };
+
+      for (int i = 0; i < 3; ++i)
+      {
+        ret = file->copy(file, "test_copy", "test_copied", strategies[i],
+          &strategy);
+
+        ok(ret == KC_FILE_SUCCESS);
+        ok(strategy == strategies[i]);
+
+        file->open(file, "test_copied", KC_FILE_READ);
+        file->read(file, &buffer);
+
+        ok(strcmp(buffer, "This is just a copy test") == 0);
+
+        free(buffer);
+        file->delete(file);
+      }
+
+      ret = file->copy(file, "test_missing", "test_copied", KC_FILE_COPY_ANY,
+        &strategy);
+
+      ok(ret == KC_FILE_INVALID);
+      ok(strategy == 0);
+
+      // a file is never copied onto itself, nor onto a hard link to it
+      link("test_copy", "test_copy_link");
+
+      ok(file->copy(file, "test_copy", "test_copy", KC_FILE_COPY_ANY,
+        &strategy) == KC_FILE_INVALID);
+      ok(file->copy(file, "test_copy", "test_copy_link", KC_FILE_COPY_ANY,
+        &strategy) == KC_FILE_INVALID);
+
+      file->open(file, "test_copy", KC_FILE_READ);
+      file->read(file, &buffer);
+
+      ok(strcmp(buffer, "This is just a copy test") == 0);
+
+      free(buffer);
+      unlink("test_copy_link");
+
+      // a failed copy leaves the destination untouched
+      file->open(file, "test_copied", KC_FILE_CREATE_ALWAYS);
+      file->write(file, "kept");
+      file->close(file);
+
+      ok(file->copy(file, "test_missing", "test_copied", KC_FILE_COPY_ANY,
+        &strategy) == KC_FILE_INVALID);
+      ok(file->copy(file, "test_copy", "test_missing/test_copied",
+        KC_FILE_COPY_ANY, &strategy) == KC_FILE_INVALID);
+
+      file->open(file, "test_copied", KC_FILE_READ);
+      file->read(file, &buffer);
+
+      ok(strcmp(buffer, "kept") == 0);
+
+      free(buffer);
+      file->delete(file);
+
+      file->open(file, "test_copy", KC_FILE_OPEN_EXISTING);
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Copy Sparse")
+    {
+      struct File* file = new_file();
+
+      int         ret      = KC_FILE_INVALID;
+      int         strategy = 0;
+      size_t      bytes    = 0;
+      char        data[8]  = {0};
+      struct stat st;
+
+      // two small islands of data in an 8 MiB file
+      file->open(file, "test_sparse", KC_FILE_CREATE_ALWAYS);
+      file->write_at(file, 0, "head", 4, &bytes);
+      file->truncate(file, 8 << 20);
+      file->write_at(file, 4 << 20, "middle", 6, &bytes);
+      file->close(file);
+
+      ret = file->copy(file, "test_sparse", "test_sparse_copy",
+        KC_FILE_COPY_RANGE | KC_FILE_COPY_BUFFER | KC_FILE_COPY_SPARSE,
+        &strategy);
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      stat("test_sparse_copy", &st);
+
+      // the holes are not materialized in the copy
+      ok(st.st_size == 8 << 20);
+      ok(st.st_blocks * 512 < 1 << 20);
+
+      file->open(file, "test_sparse_copy", KC_FILE_READ);
+      file->read_at(file, 4 << 20, data, 6, &bytes);
+
+      ok(strcmp(data, "middle") == 0);
+
+      file->read_at(file, 2 << 20, data, 6, &bytes);
+
+      ok(bytes == 6 && data[0] == '\0' && data[5] == '\0');
+
+      file->delete(file);
+      unlink("test_sparse");
+      destroy_file(file);
+    }
+
+    subtest("Create Path")
+    {
+      struct File* file = new_file();
+      int ret = KC_FILE_INVALID;
+
+      ret = file->create_path(file, "test_files");
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      file->delete_path(file, "test_files", NULL);
+      destroy_file(file);
+    }
+
+    subtest("Create Path Recursively")
+    {
+      struct File* file = new_file();
+
+      int         ret = KC_FILE_INVALID;
+      struct stat st;
+
+      ret = file->create_path(file, "test_create/2024/10/17/09/shard//");
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(strcmp(file->path, "test_create/2024/10/17/09/shard") == 0);
+      ok(stat("test_create/2024/10/17/09/shard", &st) == 0);
+
+      // creating it again is not an error
+      ret = file->create_path(file, "test_create/2024/10/17/09/shard");
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      // a file in the way is, and the previous path is kept
+      file->open(file, "test_create/2024/blocker", KC_FILE_CREATE_NEW);
+      file->close(file);
+
+      ret = file->create_path(file, "test_create/2024/blocker/shard");
+
+      ok(ret == KC_FILE_INVALID);
+      ok(strcmp(file->path, "test_create/2024/10/17/09/shard") == 0);
+
+      note("Path Cache")
+      file->set_path_cache(file, true);
+      ret = file->create_path(file, "test_create/2024/10/17/10/shard");
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      // a cached directory is trusted without asking the file system
+      rmdir("test_create/2024/10/17/10/shard");
+      ret = file->create_path(file, "test_create/2024/10/17/10/shard");
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(stat("test_create/2024/10/17/10/shard", &st) != 0);
+
+      // removing a path forgets about it
+      file->delete_path(file, "test_create", NULL);
+      ret = file->create_path(file, "test_create/2024/10/17/10/shard");
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(stat("test_create/2024/10/17/10/shard", &st) == 0);
+
+      file->delete_path(file, "test_create", NULL);
+      destroy_file(file);
+    }
+
+    subtest("Create Path Concurrently")
+    {
+      struct File*            file = new_file();
+      struct CreatePathWorker workers[8];
+      bool                    same = true;
+
+      for (int i = 0; i < 8; ++i)
+      {
+        pthread_create(&workers[i].thread, NULL, create_shared_path, &workers[i]);
+      }
+
+      for (int i = 0; i < 8; ++i)
+      {
+        pthread_join(workers[i].thread, NULL);
+        same = same && workers[i].ret == KC_FILE_SUCCESS;
+      }
+
+      ok(same == true);
+
+      file->delete_path(file, "test_create_race", NULL);
+      destroy_file(file);
+    }
+
+    subtest("Advise")
+    {
+      struct File* file = new_file();
+
+      int         ret        = KC_FILE_INVALID;
+      size_t      bytes_read = 0;
+      const char* data       = NULL;
+      size_t      size       = 0;
+      bool        same       = true;
+
+      static char block[1 << 20];
+      memset(block, 'x', sizeof(block));
+
+      ret = file->advise(file, 0, 0, KC_FILE_ADVISE_RANDOM);
+
+      ok(ret == KC_FILE_CLOSED);
+
+      file->open(file, "test_advise", KC_FILE_CREATE_ALWAYS);
+
+      for (int i = 0; i < ADVISE_FILE_SIZE / (int)sizeof(block); ++i)
+      {
+        file->write_bytes(file, block, sizeof(block));
+      }
+
+      // the written pages are synced and dropped from the page cache
+      ret = file->advise(file, 0, 0, KC_FILE_ADVISE_DONTNEED);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(count_resident("test_advise", ADVISE_FILE_SIZE) <
+         ADVISE_FILE_SIZE / 2);
+
+      note("Hints")
+      file->open(file, "test_advise", KC_FILE_READ);
+
+      for (int hint = KC_FILE_ADVISE_NORMAL; hint <= KC_FILE_ADVISE_NOREUSE;
+           ++hint)
+      {
+        same = same && file->advise(file, 0, 0, hint) == KC_FILE_SUCCESS;
+      }
+
+      ok(same == true);
+
+      ret = file->advise(file, 0, 0, KC_FILE_ADVISE_NOREUSE + 1);
+
+      ok(ret == KC_FILE_INVALID);
+
+      note("Drop Behind")
+      file->advise(file, 0, 0, KC_FILE_ADVISE_NOREUSE);
+
+      ok(file->drop_behind == true);
+
+      // a full scan leaves almost nothing behind in the page cache
+      do
+      {
+        file->read_chunk(file, block, sizeof(block), &bytes_read);
+      }
+      while (bytes_read > 0);
+
+      ok(count_resident("test_advise", ADVISE_FILE_SIZE) <
+         ADVISE_FILE_SIZE / 2);
+
+      note("Prefetch")
+      file->advise(file, 0, 0, KC_FILE_ADVISE_DONTNEED);
+      ret = file->prefetch(file, 0, ADVISE_FILE_SIZE);
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      // the pages are read in the background, give the device some time
+      for (int i = 0; i < 100; ++i)
+      {
+        if (count_resident("test_advise", ADVISE_FILE_SIZE) ==
+            ADVISE_FILE_SIZE)
+        {
+          break;
+        }
+
+        usleep(10000);
+      }
+
+      ok(count_resident("test_advise", ADVISE_FILE_SIZE) > 0);
+
+      note("Mapped")
+      file->open(file, "test_advise", KC_FILE_MMAP);
+      file->map(file, &data, &size);
+
+      ret = file->advise(file, 4096, 8192, KC_FILE_ADVISE_RANDOM);
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      ret = file->prefetch(file, 100, size);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(data[size - 1] == 'x');
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Atomic Write")
+    {
+      struct File* file = new_file();
+
+      int         ret     = KC_FILE_INVALID;
+      char*       content = NULL;
+      bool        same    = true;
+      char        path[64];
+      struct stat st;
+
+      ret = file->atomic_write(file, "test_atomic_write", "first", 5);
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      chmod("test_atomic_write", 0600);
+
+      // the content is replaced as a whole, the permissions are kept
+      ret = file->atomic_write(file, "test_atomic_write", "second", 6);
+
+      file->open(file, "test_atomic_write", KC_FILE_READ);
+      file->read(file, &content);
+      stat("test_atomic_write", &st);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(strcmp(content, "second") == 0);
+      ok((st.st_mode & 0777) == 0600);
+
+      free(content);
+
+      ret = file->atomic_write(file, "test_atomic_missing/file", "x", 1);
+
+      ok(ret == KC_FILE_INVALID);
+
+      note("Group Commit")
+      struct AtomicWriteWorker workers[ATOMIC_WRITE_THREADS];
+
+      ret = file->set_group_commit(file, 1000);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->commit != NULL);
+
+      for (int i = 0; i < ATOMIC_WRITE_THREADS; ++i)
+      {
+        workers[i].file  = file;
+        workers[i].index = i;
+
+        pthread_create(&workers[i].thread, NULL, atomic_replace, &workers[i]);
+      }
+
+      for (int i = 0; i < ATOMIC_WRITE_THREADS; ++i)
+      {
+        pthread_join(workers[i].thread, NULL);
+
+        snprintf(path, sizeof(path), "test_atomic_write_%d", i);
+        file->open(file, path, KC_FILE_READ);
+        file->read(file, &content);
+
+        same = same && workers[i].same &&
+          strcmp(content, "round 19") == 0;
+
+        free(content);
+        unlink(path);
+      }
+
+      ok(same == true);
+
+      file->set_group_commit(file, 0);
+
+      ok(file->commit == NULL);
+
+      // no temporary file is left behind
+      DIR*           dir   = opendir(".");
+      struct dirent* entry = NULL;
+
+      same = true;
+
+      while ((entry = readdir(dir)) != NULL)
+      {
+        same = same && strstr(entry->d_name, ".tmp") == NULL;
+      }
+
+      closedir(dir);
+
+      ok(same == true);
+
+      unlink("test_atomic_write");
+      destroy_file(file);
+    }
+
+    subtest("Close")
+    {
+      struct File* file = new_file();
+      int ret = KC_FILE_INVALID;
+
+      file->open(file, "test_close", KC_FILE_CREATE_NEW);
+
+      ok(file->file != NULL);
+      ok(file->mode & KC_FILE_CREATE_NEW);
+
+      ret = file->close(file);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->opened == false);
+      ok(file->file == NULL);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Compressed")
+    {
+      struct File* file = new_file();
+      int ret = KC_FILE_INVALID;
+
+      size_t bytes_read = 0;
+      size_t lines      = 0;
+      char*  content    = NULL;
+      char   chunk[1000];
+      bool   same       = true;
+
+      static char data[COMPRESSED_FILE_SIZE];
+      static char noise[300000];
+
+      // log lines repeat a lot, random bytes not at all
+      for (size_t i = 0, n = 0; i < sizeof(data); ++n)
+      {
+        i += (size_t)snprintf(data + i, sizeof(data) - i,
+          "2024-05-01 12:%02zu:%02zu worker %zu handled request %zu\n",
+          n / 60 % 60, n % 60, n % 7, n);
+      }
+
+      data[sizeof(data) - 1] = '\n';
+
+      for (size_t i = 0; i < sizeof(noise); ++i)
+      {
+        noise[i] = (char)((i * 2654435761U) >> 13);
+      }
+
+      ret = file->open(file, "test_compressed",
+        KC_FILE_CREATE_ALWAYS | KC_FILE_COMPRESSED);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->compressed != NULL);
+
+      // a flush ends the block early, the rest is written by close()
+      file->write_bytes(file, data, 1000);
+      ok(file->flush(file) == KC_FILE_SUCCESS);
+      file->write_bytes(file, data + 1000, sizeof(data) - 1000);
+
+      ok(file->write_at(file, 0, data, 1, &bytes_read) == KC_FILE_INVALID);
+      ok(file->truncate(file, 0) == KC_FILE_INVALID);
+
+      ret = file->close(file);
+
+      struct stat st;
+      stat("test_compressed", &st);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->compressed == NULL);
+      ok(st.st_size > 0 && st.st_size < (off_t)sizeof(data) / 4);
+
+      note("Read")
+      file->open(file, "test_compressed", KC_FILE_READ | KC_FILE_COMPRESSED);
+      ret = file->read(file, &content);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(content != NULL && memcmp(content, data, sizeof(data)) == 0);
+      ok(content != NULL && content[sizeof(data)] == '\0');
+
+      free(content);
+
+      note("Read Chunk")
+      file->open(file, "test_compressed", KC_FILE_READ | KC_FILE_COMPRESSED);
+
+      for (size_t offset = 0; same == true; offset += bytes_read)
+      {
+        file->read_chunk(file, chunk, sizeof(chunk), &bytes_read);
+
+        if (bytes_read == 0)
+        {
+          same = offset == sizeof(data);
+          break;
+        }
+
+        same = memcmp(chunk, data + offset, bytes_read) == 0;
+      }
+
+      ok(same == true);
+
+      note("Read At")
+      // a range across the end of a block, and one past the end of the data
+      ret = file->read_at(file, (256 << 10) - 10, chunk, sizeof(chunk),
+        &bytes_read);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(bytes_read == sizeof(chunk));
+      ok(memcmp(chunk, data + (256 << 10) - 10, sizeof(chunk)) == 0);
+
+      file->read_at(file, sizeof(data) - 10, chunk, sizeof(chunk),
+        &bytes_read);
+
+      ok(bytes_read == 10);
+      ok(memcmp(chunk, data + sizeof(data) - 10, 10) == 0);
+
+      note("For Each Line")
+      ret = file->for_each_line(file, NULL, 0, '\n', count_line, &lines);
+
+      size_t expected = 0;
+
+      for (const char* c = data; (c = memchr(c, '\n', data + sizeof(data) - c));
+           ++c)
+      {
+        ++expected;
+      }
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(lines == expected);
+
+      note("Incompressible")
+      // blocks that do not get smaller are stored as they are
+      file->open(file, "test_compressed",
+        KC_FILE_CREATE_ALWAYS | KC_FILE_COMPRESSED);
+      file->write_bytes(file, noise, sizeof(noise));
+      file->close(file);
+
+      file->open(file, "test_compressed", KC_FILE_READ | KC_FILE_COMPRESSED);
+      ret = file->read(file, &content);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(content != NULL && memcmp(content, noise, sizeof(noise)) == 0);
+
+      free(content);
+
+      note("Invalid")
+      ok(file->open(file, "test_compressed",
+        KC_FILE_OPEN_ALWAYS | KC_FILE_COMPRESSED) == KC_FILE_INVALID);
+      ok(file->open(file, "test_compressed",
+        KC_FILE_MMAP | KC_FILE_COMPRESSED) == KC_FILE_INVALID);
+
+      // plain files have no block index
+      file->open(file, "test_compressed", KC_FILE_CREATE_ALWAYS);
+      file->write(file, "plain text, not compressed at all");
+      file->close(file);
+
+      ok(file->open(file, "test_compressed",
+        KC_FILE_READ | KC_FILE_COMPRESSED) == KC_FILE_INVALID);
+      ok(file->opened == false);
+
+      remove("test_compressed");
+      destroy_file(file);
+    }
+
+    subtest("Delete")
+    {
+      struct File* file = new_file();
+      int ret = KC_FILE_INVALID;
+
+      file->open(file, "test_delete", KC_FILE_CREATE_NEW);
+
+      ret = file->delete(file);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->file == NULL);
+
+      destroy_file(file);
+    }
+
+    subtest("Delete Path")
+    {
+      struct File* file = new_file();
+
+      int    ret     = KC_FILE_INVALID;
+      size_t removed = 0;
+      char   name[64];
+
+      mkdir("test_delete_path", 0777);
+      mkdir("test_delete_keep", 0777);
+
+      for (int i = 0; i < 50; ++i)
+      {
+        snprintf(name, sizeof(name), "test_delete_path/f%d", i);
+        file->open(file, name, KC_FILE_CREATE_NEW);
+      }
+
+      for (int i = 0; i < 4; ++i)
+      {
+        snprintf(name, sizeof(name), "test_delete_path/d%d", i);
+        mkdir(name, 0777);
+
+        for (int j = 0; j < 3; ++j)
+        {
+          snprintf(name, sizeof(name), "test_delete_path/d%d/s%d", i, j);
+          mkdir(name, 0777);
+
+          for (int k = 0; k < 20; ++k)
+          {
+            snprintf(name, sizeof(name), "test_delete_path/d%d/s%d/f%d", i, j, k);
+            file->open(file, name, KC_FILE_CREATE_NEW);
+          }
+        }
+      }
+
+      // links are removed, never followed
+      ret = symlink("../test_delete_keep", "test_delete_path/d0/link");
+      file->close(file);
+
+      ret = file->delete_path(file, "test_delete_path", &removed);
+
+      struct stat st;
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(removed == 17 + 290 + 1);
+      ok(stat("test_delete_path", &st) != 0);
+      ok(stat("test_delete_keep", &st) == 0);
+
+      ret = file->delete_path(file, "test_delete_path", &removed);
+
+      ok(ret == KC_FILE_INVALID);
+      ok(removed == 0);
+
+      // a tree deeper than PATH_MAX, only reachable one level at a time
+      int fd = open(".", O_RDONLY | O_DIRECTORY);
+
+      mkdir("test_delete_path", 0777);
+
+      for (int i = 0, next = -1; i < 200 && fd >= 0; ++i)
+      {
+        snprintf(name, sizeof(name), "%s",
+          i == 0 ? "test_delete_path" : "a_rather_long_directory_name");
+
+        mkdirat(fd, name, 0777);
+        next = openat(fd, name, O_RDONLY | O_DIRECTORY);
+        close(fd);
+        fd = next;
+      }
+
+      close(fd);
+
+      ret = file->delete_path(file, "test_delete_path", &removed);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(removed == 200);
+      ok(stat("test_delete_path", &st) != 0);
+
+      file->delete_path(file, "test_delete_keep", NULL);
+      destroy_file(file);
+    }
+
+    subtest("Direct")
+    {
+      struct File* file = new_file();
+
+      int    ret        = KC_FILE_INVALID;
+      size_t block      = 0;
+      size_t bytes_read = 0;
+      char*  content    = NULL;
+      char*  aligned    = NULL;
+      bool   same       = true;
+
+      static char data[DIRECT_FILE_SIZE];
+
+      for (size_t i = 0; i < sizeof(data); ++i)
+      {
+        data[i] = (char)('a' + i % 26);
+      }
+
+      ret = file->alloc_aligned(file, 100, (void**)&aligned);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok((uintptr_t)aligned % 4096 == 0);
+
+      free(aligned);
+
+      ret = file->open(file, "test_direct",
+        KC_FILE_CREATE_ALWAYS | KC_FILE_DIRECT);
+
+      // not every file system can bypass the page cache
+      skip(ret == KC_UNSUPPORTED_FEATURE);
+      ok(ret == KC_FILE_SUCCESS);
+
+      file->get_block_size(file, &block);
+
+      ok(block >= 512 && (block & (block - 1)) == 0);
+
+      // unaligned pieces, a large aligned write and an unaligned tail
+      file->write_bytes(file, data, 100);
+      file->write_bytes(file, data + 100, block - 100);
+      file->alloc_aligned(file, 2 << 20, (void**)&aligned);
+      memcpy(aligned, data + block, 2 << 20);
+      file->write_bytes(file, aligned, 2 << 20);
+      ret = file->write_bytes(file, data + block + (2 << 20),
+        sizeof(data) - block - (2 << 20));
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      ret = file->close(file);
+
+      struct stat st;
+      stat("test_direct", &st);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(st.st_size == sizeof(data));
+      ok(count_resident("test_direct", sizeof(data)) == 0);
+
+      note("Read")
+      file->open(file, "test_direct", KC_FILE_READ | KC_FILE_DIRECT);
+      ret = file->read(file, &content);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(memcmp(content, data, sizeof(data)) == 0);
+      ok(content[sizeof(data)] == '\0');
+
+      free(content);
+
+      note("Read Chunk")
+      file->open(file, "test_direct", KC_FILE_READ | KC_FILE_DIRECT);
+
+      // an unaligned chunk, then aligned whole blocks, then the tail
+      file->read_chunk(file, aligned, 100, &bytes_read);
+      same = bytes_read == 100 && memcmp(aligned, data, 100) == 0;
+
+      file->read_chunk(file, aligned, block - 100, &bytes_read);
+      same = same && memcmp(aligned, data + 100, block - 100) == 0;
+
+      file->read_chunk(file, aligned, 2 << 20, &bytes_read);
+      same = same && memcmp(aligned, data + block, 2 << 20) == 0;
+
+      file->read_chunk(file, aligned, 2 << 20, &bytes_read);
+      same = same && bytes_read == sizeof(data) - block - (2 << 20) &&
+        memcmp(aligned, data + block + (2 << 20), bytes_read) == 0;
+
+      ok(same == true);
+
+      ret = file->read_chunk(file, aligned, 2 << 20, &bytes_read);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(bytes_read == 0);
+      ok(count_resident("test_direct", sizeof(data)) == 0);
+
+      note("Flush and Truncate")
+      file->open(file, "test_direct", KC_FILE_WRITE | KC_FILE_DIRECT);
+      file->write_bytes(file, "direct", 6);
+      ret = file->flush(file);
+      stat("test_direct", &st);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(st.st_size == 6);
+
+      // the partial block is read back, the position stays where it was
+      file->truncate(file, 4);
+      file->write_bytes(file, "ory", 3);
+      file->close(file);
+
+      file->open(file, "test_direct", KC_FILE_READ);
+      file->read(file, &content);
+
+      ok(memcmp(content, "dire\0\0ory", 10) == 0);
+
+      free(content);
+
+      note("Invalid Modes")
+      ret = file->open(file, "test_direct", KC_FILE_OPEN_ALWAYS | KC_FILE_DIRECT);
+
+      ok(ret == KC_FILE_INVALID);
+
+      ret = file->open(file, "test_direct", KC_FILE_MMAP | KC_FILE_DIRECT);
+
+      ok(ret == KC_FILE_INVALID);
+
+      free(aligned);
+      unlink("test_direct");
+      destroy_file(file);
+    }
+
+    subtest("Get Mode")
+    {
+      struct File* file = new_file();
+
+      int ret  = KC_FILE_INVALID;
+      int mode = KC_FILE_INVALID;
+
+      file->open(file, "test_get_mode", KC_FILE_CREATE_NEW);
+
+      ret = file->get_mode(file, &mode);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(mode == KC_FILE_CREATE_NEW);
+
+      file->open(file, "test_get_mode", KC_FILE_CREATE_ALWAYS);
+
+      ret = file->get_mode(file, &mode);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(mode == KC_FILE_CREATE_ALWAYS);
+
+      file->open(file, "test_get_mode", KC_FILE_OPEN_EXISTING);
+
+      ret = file->get_mode(file, &mode);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(mode & KC_FILE_OPEN_EXISTING);
+
+      file->open(file, "test_get_mode", KC_FILE_OPEN_ALWAYS);
+
+      ret = file->get_mode(file, &mode);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(mode == KC_FILE_OPEN_ALWAYS);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Get Name")
+    {
+      struct File* file = new_file();
+
+      int   ret = KC_FILE_INVALID;
+      char* name;
+
+      file->open(file, "test_get_name", KC_FILE_CREATE_NEW);
+      ret = file->get_name(file, &name);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(strcmp(name, "test_get_name") == 0);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Get Path")
+    {
+      struct File* file = new_file();
+
+      int   ret = KC_FILE_INVALID;
+      char* path;
+
+      file->create_path(file, "test");
+      file->create_path(file, "test/get");
+      file->create_path(file, "test/get/path");
+
+      ret = file->get_path(file, &path);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(strcmp(path, "test/get/path") == 0);
+
+      file->delete_path(file, "test", NULL);
+      destroy_file(file);
+    }
+
+    subtest("Is Open")
+    {
+      struct File* file = new_file();
+
+      int  ret     = KC_FILE_INVALID;
+      bool is_open = false;
+
+      ret = file->is_open(file, &is_open);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(is_open == false);
+
+      file->open(file, "test_close", KC_FILE_CREATE_NEW);
+      ret = file->is_open(file, &is_open);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(is_open == true);
+
+      file->close(file);
+
+      ret = file->is_open(file, &is_open);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(is_open == false);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Map")
+    {
+      struct File* file = new_file();
+
+      int         ret  = KC_FILE_INVALID;
+      const char* data = NULL;
+      size_t      size = 0;
+
+      file->open(file, "test_map", KC_FILE_CREATE_NEW);
+      file->write(file, "This is just a map test");
+      file->close(file);
+
+      ret = file->map(file, &data, &size);
+
+      ok(ret == KC_FILE_CLOSED);
+
+      file->open(file, "test_map", KC_FILE_MMAP);
+      ret = file->map(file, &data, &size);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->mode == KC_FILE_MMAP);
+      ok(size == strlen("This is just a map test"));
+      ok(memcmp(data, "This is just a map test", size) == 0);
+
+      ret = file->unmap(file);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->mapped == NULL);
+
+      file->map(file, &data, &size);
+      file->close(file);
+
+      ok(file->mapped == NULL);
+      ok(file->mapped_size == 0);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Move")
+    {
+      struct File* file = new_file();
+
+      int   ret    = KC_FILE_INVALID;
+      char* buffer = NULL;
+      char  other[64];
+
+      file->open(file, "test_move", KC_FILE_CREATE_NEW);
+      file->write(file, "This is just a move test");
+      file->close(file);
+
+      note("Same Device")
+      ret = file->move(file, "test_move", "test_moved");
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(strcmp(file->name, "test_moved") == 0);
+
+      file->read(file, &buffer);
+
+      ok(strcmp(buffer, "This is just a move test") == 0);
+
+      free(buffer);
+      file->close(file);
+
+      ret = file->move(file, "test_move", "test_moved");
+
+      ok(ret == KC_FILE_INVALID);
+
+      note("Across Devices")
+      struct stat st;
+      snprintf(other, sizeof(other), "/dev/shm/test_move_%d", (int)getpid());
+
+      // tmpfs is usually a different device than the working directory
+      skip(stat("/dev/shm", &st) != 0);
+      ret = file->move(file, "test_moved", other);
+      ok(ret == KC_FILE_SUCCESS);
+
+      file->read(file, &buffer);
+
+      ok(strcmp(file->name, other) == 0);
+      ok(strcmp(buffer, "This is just a move test") == 0);
+      ok(stat("test_moved", &st) != 0);
+
+      free(buffer);
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Open")
+    {
+      struct File* file = new_file();
+      int ret = KC_FILE_INVALID;
+
+      note("Create New")
+      ret = file->open(file, "test_open", KC_FILE_CREATE_NEW);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->mode & KC_FILE_CREATE_NEW);
+
+      note("Create Always")
+      ret = file->open(file, "test_open", KC_FILE_CREATE_ALWAYS);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->mode & KC_FILE_CREATE_ALWAYS);
+
+      note("Open Existing")
+      ret = file->open(file, "test_open", KC_FILE_OPEN_EXISTING);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->mode & KC_FILE_OPEN_EXISTING);
+
+      note("Open Always")
+      ret = file->open(file, "test_open", KC_FILE_OPEN_ALWAYS);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->mode & KC_FILE_OPEN_ALWAYS);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Preallocate")
+    {
+      struct File* file = new_file();
+
+      int         ret = KC_FILE_INVALID;
+      struct stat st;
+
+      ret = file->preallocate(file, 0, 4 << 20);
+
+      ok(ret == KC_FILE_CLOSED);
+
+      file->open(file, "test_preallocate", KC_FILE_CREATE_ALWAYS);
+      ret = file->preallocate(file, 0, 4 << 20);
+
+      // not every file system can reserve blocks
+      skip(ret == KC_UNSUPPORTED_FEATURE);
+      ok(ret == KC_FILE_SUCCESS);
+
+      stat("test_preallocate", &st);
 
+      // the blocks are reserved, the size is left alone
+      ok(st.st_size == 0);
+      ok(st.st_blocks * 512 >= 4 << 20);
+
+      file->open(file, "test_preallocate", KC_FILE_READ);
+      ret = file->preallocate(file, 0, 4 << 20);
+
+      ok(ret == KC_FILE_INVALID);
+
+      file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Create Path")
+    subtest("Punch Hole")
     {
       struct File* file = new_file();
-      int ret = KC_FILE_INVALID;
 
-      ret = file->create_path(file, "test_files");
+      int         ret   = KC_FILE_INVALID;
+      size_t      bytes = 0;
+      char        data[4];
+      struct stat before;
+      struct stat after;
+
+      static char block[1 << 20];
+      memset(block, 'x', sizeof(block));
 
+      file->open(file, "test_punch_hole", KC_FILE_CREATE_ALWAYS);
+      file->write_bytes(file, block, sizeof(block));
+      file->flush(file);
+      fsync(fileno(file->file));
+
+      stat("test_punch_hole", &before);
+
+      ret = file->punch_hole(file, 0, 512 << 10);
+
+      skip(ret == KC_UNSUPPORTED_FEATURE);
       ok(ret == KC_FILE_SUCCESS);
 
+      stat("test_punch_hole", &after);
+
+      ok(after.st_size == before.st_size);
+      ok(after.st_blocks < before.st_blocks);
+
+      // the hole reads back as zeros, the rest is untouched
+      file->open(file, "test_punch_hole", KC_FILE_READ);
+      file->read_at(file, 0, data, 4, &bytes);
+
+      ok(bytes == 4 && data[0] == '\0' && data[3] == '\0');
+
+      file->read_at(file, 512 << 10, data, 4, &bytes);
+
+      ok(bytes == 4 && data[0] == 'x' && data[3] == 'x');
+
+      file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Close")
+    subtest("Read")
     {
       struct File* file = new_file();
-      int ret = KC_FILE_INVALID;
 
-      file->open(file, "test_close", KC_FILE_CREATE_NEW);
+      int   ret = KC_FILE_INVALID;
+      char* buffer;
 
-      ok(file->file != NULL);
-      ok(file->mode & KC_FILE_CREATE_NEW);
+      file->open(file, "test_read", KC_FILE_CREATE_NEW);
+      file->write(file, "This is just a read test");
 
-      ret = file->close(file);
+      ret = file->read(file, &buffer);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(file->opened == false);
-      ok(file->file == NULL);
+      ok(strcmp(buffer, "This is just a read test") == 0);
+
+      free(buffer);
+
+      // a stream that can already read is reused, not reopened
+      file->open(file, "test_read", KC_FILE_READ);
+
+      FILE* stream = file->file;
+
+      file->read(file, &buffer);
+      free(buffer);
+
+      ret = file->read(file, &buffer);
 
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->file == stream);
+      ok(strcmp(buffer, "This is just a read test") == 0);
+
+      free(buffer);
       file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Delete")
+    subtest("Read At")
     {
       struct File* file = new_file();
-      int ret = KC_FILE_INVALID;
 
-      file->open(file, "test_delete", KC_FILE_CREATE_NEW);
+      int    ret        = KC_FILE_INVALID;
+      char   buffer[8]  = {0};
+      size_t bytes_read = 0;
 
-      ret = file->delete(file);
+      file->open(file, "test_read_at", KC_FILE_CREATE_NEW);
+      file->write(file, "0123456789");
+      file->open(file, "test_read_at", KC_FILE_READ);
+
+      ret = file->read_at(file, 6, buffer, 3, &bytes_read);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(file->file == NULL);
+      ok(bytes_read == 3);
+      ok(memcmp(buffer, "678", 3) == 0);
+
+      // the shared stream position is left alone
+      file->read_chunk(file, buffer, 2, &bytes_read);
+
+      ok(memcmp(buffer, "01", 2) == 0);
+
+      // short read at the end of the file
+      ret = file->read_at(file, 8, buffer, sizeof(buffer), &bytes_read);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(bytes_read == 2);
+
+      ret = file->read_at(file, 100, buffer, sizeof(buffer), &bytes_read);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(bytes_read == 0);
 
+      file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Get Mode")
+    subtest("Read At Concurrently")
     {
       struct File* file = new_file();
 
-      int ret  = KC_FILE_INVALID;
-      int mode = KC_FILE_INVALID;
+      static char block[READ_AT_BLOCK_SIZE];
+      size_t      bytes_written = 0;
 
-      file->open(file, "test_get_mode", KC_FILE_CREATE_NEW);
+      file->set_buffer(file, 1 << 20);
+      file->open(file, "test_read_at_threads", KC_FILE_CREATE_NEW);
 
-      ret = file->get_mode(file, &mode);
+      for (uint64_t offset = 0; offset < READ_AT_FILE_SIZE; offset += sizeof(block))
+      {
+        memcpy(block, &offset, sizeof(offset));
+        file->write_bytes(file, block, sizeof(block));
+      }
 
-      ok(ret == KC_FILE_SUCCESS);
-      ok(mode == KC_FILE_CREATE_NEW);
+      file->open(file, "test_read_at_threads", KC_FILE_READ);
 
-      file->open(file, "test_get_mode", KC_FILE_CREATE_ALWAYS);
+      // the same amount of random reads is split between more threads
+      for (int threads = 1; threads <= 8; threads *= 2)
+      {
+        struct ReadAtWorker workers[8];
+        struct timespec     start;
+        struct timespec     end;
+        bool                same = true;
 
-      ret = file->get_mode(file, &mode);
+        clock_gettime(CLOCK_MONOTONIC, &start);
 
-      ok(ret == KC_FILE_SUCCESS);
-      ok(mode == KC_FILE_CREATE_ALWAYS);
+        for (int i = 0; i < threads; ++i)
+        {
+          workers[i].file  = file;
+          workers[i].seed  = 0x9E3779B97F4A7C15ULL * (i + 1);
+          workers[i].reads = READ_AT_TOTAL_READS / threads;
 
-      file->open(file, "test_get_mode", KC_FILE_OPEN_EXISTING);
+          pthread_create(&workers[i].thread, NULL, random_read_at, &workers[i]);
+        }
 
-      ret = file->get_mode(file, &mode);
+        for (int i = 0; i < threads; ++i)
+        {
+          pthread_join(workers[i].thread, NULL);
+          same = same && workers[i].same;
+        }
 
-      ok(ret == KC_FILE_SUCCESS);
-      ok(mode & KC_FILE_OPEN_EXISTING);
+        clock_gettime(CLOCK_MONOTONIC, &end);
 
-      file->open(file, "test_get_mode", KC_FILE_OPEN_ALWAYS);
+        double seconds = (end.tv_sec - start.tv_sec) +
+          (end.tv_nsec - start.tv_nsec) / 1e9;
 
-      ret = file->get_mode(file, &mode);
+        char message[128];
+        snprintf(message, sizeof(message), "%d thread(s): %.0f MiB/s",
+          threads, READ_AT_TOTAL_READS * (double)READ_AT_BLOCK_SIZE /
+          (1 << 20) / seconds);
+
+        note(message);
+        ok(same == true);
+      }
+
+      // write_at() leaves the stream position alone as well
+      file->open(file, "test_read_at_threads", KC_FILE_CREATE_ALWAYS);
+      file->write(file, "0123456789");
+      file->flush(file);
+
+      int ret = file->write_at(file, 2, "ab", 2, &bytes_written);
+
+      file->write(file, "!");
+      file->flush(file);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(mode == KC_FILE_OPEN_ALWAYS);
+      ok(bytes_written == 2);
+
+      char   buffer[16] = {0};
+      size_t bytes_read = 0;
+
+      file->open(file, "test_read_at_threads", KC_FILE_READ);
+      file->read_at(file, 0, buffer, sizeof(buffer), &bytes_read);
+
+      ok(bytes_read == 11);
+      ok(memcmp(buffer, "01ab456789!", 11) == 0);
 
       file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Get Name")
+    subtest("Read Chunk")
     {
       struct File* file = new_file();
 
-      int   ret = KC_FILE_INVALID;
-      char* name;
+      int    ret        = KC_FILE_INVALID;
+      char   buffer[64];
+      char   content[1000];
+      size_t bytes_read = 0;
+      size_t total      = 0;
+      bool   same       = true;
 
-      file->open(file, "test_get_name", KC_FILE_CREATE_NEW);
-      ret = file->get_name(file, &name);
+      for (size_t i = 0; i < sizeof(content) - 1; ++i)
+      {
+        content[i] = (char)('a' + i % 26);
+      }
+      content[sizeof(content) - 1] = '\0';
+
+      file->open(file, "test_read_chunk", KC_FILE_CREATE_NEW);
+      file->write(file, content);
+
+      ret = file->read_chunk(file, buffer, sizeof(buffer), &bytes_read);
+
+      ok(ret == KC_FILE_INVALID);
+      ok(bytes_read == 0);
+
+      file->open(file, "test_read_chunk", KC_FILE_READ);
+
+      do
+      {
+        ret  = file->read_chunk(file, buffer, sizeof(buffer), &bytes_read);
+        same = same && memcmp(buffer, content + total, bytes_read) == 0;
+
+        total += bytes_read;
+      }
+      while (ret == KC_FILE_SUCCESS && bytes_read != 0);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(strcmp(name, "test_get_name") == 0);
+      ok(same == true);
+      ok(total == sizeof(content) - 1);
 
       file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Get Path")
+    subtest("Flush")
+    {
+      struct File* file   = new_file();
+      struct File* reader = new_file();
+
+      int    ret        = KC_FILE_INVALID;
+      char   buffer[16] = {0};
+      size_t bytes_read = 0;
+
+      ret = file->flush(file);
+
+      ok(ret == KC_FILE_CLOSED);
+
+      file->set_buffer(file, 1 << 16);
+      file->open(file, "test_flush", KC_FILE_CREATE_NEW);
+      file->write(file, "buffered");
+
+      // nothing reached the file yet, everything sits in the buffer
+      reader->open(reader, "test_flush", KC_FILE_READ);
+      reader->read_chunk(reader, buffer, sizeof(buffer), &bytes_read);
+
+      ok(bytes_read == 0);
+
+      ret = file->flush(file);
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      reader->open(reader, "test_flush", KC_FILE_READ);
+      reader->read_chunk(reader, buffer, sizeof(buffer), &bytes_read);
+
+      ok(bytes_read == strlen("buffered"));
+      ok(memcmp(buffer, "buffered", bytes_read) == 0);
+
+      file->delete(file);
+      destroy_file(reader);
+      destroy_file(file);
+    }
+
+    subtest("For Each Chunk")
     {
       struct File* file = new_file();
 
-      int   ret = KC_FILE_INVALID;
-      char* path;
+      int    ret   = KC_FILE_INVALID;
+      char   buffer[100];
+      char   content[4097];
+      size_t total = 0;
 
-      file->create_path(file, "test");
-      file->create_path(file, "test/get");
-      file->create_path(file, "test/get/path");
+      for (size_t i = 0; i < sizeof(content) - 1; ++i)
+      {
+        content[i] = (char)('a' + i % 26);
+      }
+      content[sizeof(content) - 1] = '\0';
 
-      ret = file->get_path(file, &path);
+      file->open(file, "test_for_each_chunk", KC_FILE_CREATE_NEW);
+      file->write(file, content);
+
+      ret = file->for_each_chunk(file, buffer, sizeof(buffer), count_chunk, &total);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(strcmp(path, "test/get/path") == 0);
+      ok(total == sizeof(content) - 1);
 
       file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Is Open")
+    subtest("For Each Line")
     {
       struct File* file = new_file();
 
-      int  ret     = KC_FILE_INVALID;
-      bool is_open = false;
+      int              ret   = KC_FILE_INVALID;
+      char             buffer[16];
+      char             line[128];
+      struct LineCheck check = { 0, true };
 
-      ret = file->is_open(file, &is_open);
+      // lines of every length up to 96, crossing any chunk and vector
+      // boundary, every other one ending in CRLF and the last one in nothing
+      file->open(file, "test_for_each_line", KC_FILE_CREATE_NEW);
+
+      for (size_t i = 0; i < 300; ++i)
+      {
+        memset(line, 'a' + i % 26, i % 97);
+        strcpy(line + i % 97, i % 2 == 0 ? "\n" : "\r\n");
+
+        file->write(file, i == 299 ? "" : line);
+      }
+
+      memset(line, 'a' + 299 % 26, 299 % 97);
+      file->write_bytes(file, line, 299 % 97);
+      file->close(file);
+
+      // a buffer smaller than most lines has to grow
+      file->open(file, "test_for_each_line", KC_FILE_READ);
+
+      ret = file->for_each_line(file, buffer, sizeof(buffer), '\n',
+        check_line, &check);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(is_open == false);
+      ok(check.count == 300);
+      ok(check.same == true);
 
-      file->open(file, "test_close", KC_FILE_CREATE_NEW);
-      ret = file->is_open(file, &is_open);
+      check = (struct LineCheck){ 0, true };
+      ret   = file->for_each_line(file, NULL, 0, '\n', check_line, &check);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(is_open == true);
+      ok(check.count == 300);
+      ok(check.same == true);
 
-      file->close(file);
+      // a mapped file is split in place
+      file->open(file, "test_for_each_line", KC_FILE_MMAP);
 
-      ret = file->is_open(file, &is_open);
+      check = (struct LineCheck){ 0, true };
+      ret   = file->for_each_line(file, NULL, 0, '\n', check_line, &check);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(is_open == false);
+      ok(check.count == 300);
+      ok(check.same == true);
+
+      file->unmap(file);
+
+      // any byte can separate the records
+      file->open(file, "test_for_each_line", KC_FILE_CREATE_ALWAYS);
+
+      for (size_t i = 0; i < 1200; ++i)
+      {
+        memset(line, 'a' + i % 26, i % 97);
+        file->write_bytes(file, line, i % 97);
+        file->write_bytes(file, ";", 1);
+      }
+
+      check = (struct LineCheck){ 0, true };
+      ret   = file->for_each_line(file, NULL, 0, ';', check_line, &check);
+
+      ok(ret == KC_FILE_INVALID);
+      ok(check.count == 1000);
+      ok(check.same == true);
+
+      ret = file->for_each_line(file, buffer, 0, ';', check_line, &check);
+      ok(ret == KC_FILE_INVALID);
+
+      ret = file->for_each_line(file, NULL, 0, ';', NULL, &check);
+      ok(ret == KC_NULL_REFERENCE);
 
       file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Open")
+    subtest("Read Vector")
     {
       struct File* file = new_file();
-      int ret = KC_FILE_INVALID;
 
-      note("Create New")
-      ret = file->open(file, "test_open", KC_FILE_CREATE_NEW);
+      int    ret        = KC_FILE_INVALID;
+      char   header[4]  = {0};
+      char   payload[8] = {0};
+      char   trailer[8] = {0};
+      size_t bytes_read = 0;
 
-      ok(ret == KC_FILE_SUCCESS);
-      ok(file->mode & KC_FILE_CREATE_NEW);
+      struct iovec vector[3] =
+      {
+        { header,  sizeof(header)  },
+        { payload, sizeof(payload) },
+        { trailer, sizeof(trailer) }
+      };
 
-      note("Create Always")
-      ret = file->open(file, "test_open", KC_FILE_CREATE_ALWAYS);
+      file->open(file, "test_read_vector", KC_FILE_CREATE_NEW);
+      file->write(file, "HEADpayload!END");
+
+      ret = file->readv(file, vector, 3, &bytes_read);
+
+      ok(ret == KC_FILE_INVALID);
+
+      file->open(file, "test_read_vector", KC_FILE_READ);
+
+      // the stream position is honored and advanced
+      file->read_chunk(file, header, 1, &bytes_read);
+      ret = file->readv(file, vector, 3, &bytes_read);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(file->mode & KC_FILE_CREATE_ALWAYS);
+      ok(bytes_read == 14);
+      ok(memcmp(header, "EADp", 4) == 0);
+      ok(memcmp(payload, "ayload!E", 8) == 0);
+      ok(memcmp(trailer, "ND", 2) == 0);
 
-      note("Open Existing")
-      ret = file->open(file, "test_open", KC_FILE_OPEN_EXISTING);
+      file->read_chunk(file, header, sizeof(header), &bytes_read);
+
+      ok(bytes_read == 0);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Sync")
+    {
+      struct File* file = new_file();
+
+      int ret = file->sync(file);
+
+      ok(ret == KC_FILE_CLOSED);
+
+      file->open(file, "test_sync", KC_FILE_CREATE_ALWAYS);
+      file->write(file, "This is just a sync test");
+
+      ret = file->sync(file);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(file->mode & KC_FILE_OPEN_EXISTING);
 
-      note("Open Always")
-      ret = file->open(file, "test_open", KC_FILE_OPEN_ALWAYS);
+      // a lone caller is not held back by the interval
+      file->set_group_commit(file, 1000000);
+
+      ret = file->sync(file);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(file->mode & KC_FILE_OPEN_ALWAYS);
 
       file->delete(file);
       destroy_file(file);
     }
 
-    subtest("Read")
+    subtest("Truncate")
     {
       struct File* file = new_file();
 
-      int   ret = KC_FILE_INVALID;
-      char* buffer;
+      int         ret    = KC_FILE_INVALID;
+      char*       buffer = NULL;
+      struct stat st;
 
-      file->open(file, "test_read", KC_FILE_CREATE_NEW);
-      file->write(file, "This is just a read test");
+      file->open(file, "test_truncate", KC_FILE_CREATE_ALWAYS);
+      file->write(file, "This is just a truncate test");
 
-      ret = file->read(file, &buffer);
+      // the buffered text is written first and then cut
+      ret = file->truncate(file, 4);
 
       ok(ret == KC_FILE_SUCCESS);
-      ok(strcmp(buffer, "This is just a read test") == 0);
+
+      file->read(file, &buffer);
+
+      ok(strcmp(buffer, "This") == 0);
+
+      free(buffer);
+
+      // growing the file leaves a hole behind
+      file->open(file, "test_truncate", KC_FILE_WRITE);
+      ret = file->truncate(file, 1 << 20);
+
+      stat("test_truncate", &st);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(st.st_size == 1 << 20);
+      ok(st.st_blocks * 512 < 1 << 20);
+
+      file->open(file, "test_truncate", KC_FILE_READ);
+      ret = file->truncate(file, 0);
+
+      ok(ret == KC_FILE_INVALID);
 
       file->delete(file);
       destroy_file(file);
@@ -253,6 +1814,104 @@ int main()
       destroy_file(file);
     }
 
+    subtest("Write Bytes")
+    {
+      struct File* file = new_file();
+
+      int    ret        = KC_FILE_INVALID;
+      char   record[8]  = { 'r', 'e', 'c', '\0', 'o', 'r', 'd', '\0' };
+      char   buffer[sizeof(record) * 1000];
+      size_t bytes_read = 0;
+      bool   same       = true;
+
+      ret = file->write_bytes(file, record, sizeof(record));
+
+      ok(ret == KC_FILE_CLOSED);
+
+      ret = file->set_buffer(file, 0);
+
+      ok(ret == KC_FILE_INVALID);
+
+      ret = file->set_buffer(file, 1 << 12);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->buffer_size == 1 << 12);
+
+      file->open(file, "test_write_bytes", KC_FILE_CREATE_NEW);
+
+      for (int i = 0; i < 1000; ++i)
+      {
+        ret = file->write_bytes(file, record, sizeof(record));
+        same = same && ret == KC_FILE_SUCCESS;
+      }
+
+      ok(same == true);
+
+      // the stream already did I/O, its buffer only changes once it is closed
+      ret = file->set_buffer(file, 1 << 16);
+
+      ok(ret == KC_FILE_INVALID);
+      ok(file->buffer_size == 1 << 12);
+
+      file->close(file);
+      ret = file->set_buffer(file, 1 << 16);
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      file->open(file, "test_write_bytes", KC_FILE_READ);
+      file->read_chunk(file, buffer, sizeof(buffer), &bytes_read);
+
+      ok(bytes_read == sizeof(buffer));
+
+      for (int i = 0; i < 1000; ++i)
+      {
+        same = same && memcmp(buffer + i * sizeof(record), record, sizeof(record)) == 0;
+      }
+
+      ok(same == true);
+
+      file->delete(file);
+      destroy_file(file);
+    }
+
+    subtest("Write Vector")
+    {
+      struct File* file = new_file();
+
+      int    ret           = KC_FILE_INVALID;
+      char*  buffer        = NULL;
+      size_t bytes_written = 0;
+
+      struct iovec vector[3] =
+      {
+        { "HEAD",    4 },
+        { "payload", 7 },
+        { "END",     3 }
+      };
+
+      file->open(file, "test_write_vector", KC_FILE_CREATE_NEW);
+
+      // buffered data must come out before the gathered fragments
+      file->write(file, "<");
+      ret = file->writev(file, vector, 3, &bytes_written);
+      file->write(file, ">");
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(bytes_written == 14);
+
+      file->read(file, &buffer);
+
+      ok(strcmp(buffer, "<HEADpayloadEND>") == 0);
+
+      ret = file->writev(file, vector, 3, &bytes_written);
+
+      ok(ret == KC_FILE_INVALID);
+
+      free(buffer);
+      file->delete(file);
+      destroy_file(file);
+    }
+
     done_testing();
   }
 
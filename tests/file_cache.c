@@ -0,0 +1,255 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_cache.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/file.h"
+#include "../include/file_cache.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CACHE_SIZE                                                            2
+#define CACHE_THREADS                                                         8
+#define CACHE_ROUNDS                                                       2000
+
+//---------------------------------------------------------------------------//
+
+static void create_files(struct File* file)
+{
+  file->open(file, "test_file_cache_a", KC_FILE_CREATE_ALWAYS);
+  file->write(file, "first");
+  file->open(file, "test_file_cache_b", KC_FILE_CREATE_ALWAYS);
+  file->write(file, "second");
+  file->open(file, "test_file_cache_c", KC_FILE_CREATE_ALWAYS);
+  file->write(file, "third");
+  file->close(file);
+}
+
+//---------------------------------------------------------------------------//
+
+static void delete_files()
+{
+  unlink("test_file_cache_a");
+  unlink("test_file_cache_b");
+  unlink("test_file_cache_c");
+}
+
+//---------------------------------------------------------------------------//
+
+static void* acquire_files(void* context)
+{
+  struct FileCache* cache = (struct FileCache*)context;
+  const char*       paths[3] =
+  {
+    "test_file_cache_a", "test_file_cache_b", "test_file_cache_c"
+  };
+
+  for (int i = 0; i < CACHE_ROUNDS; ++i)
+  {
+    int fd = -1;
+
+    if (cache->acquire(cache, paths[i % 3], O_RDONLY, &fd) == KC_FILE_SUCCESS)
+    {
+      cache->release(cache, fd);
+    }
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("FileCache")
+  {
+    subtest("Creation and Destruction")
+    {
+      struct FileCache* cache = new_file_cache(CACHE_SIZE);
+
+      ok(cache != NULL);
+      ok(cache->log != NULL);
+      ok(cache->table != NULL);
+      ok(cache->capacity == CACHE_SIZE);
+      ok(cache->count == 0);
+      ok(cache->hits == 0);
+      ok(cache->misses == 0);
+      ok(cache->evictions == 0);
+
+      destroy_file_cache(cache);
+
+      cache = new_file_cache(0);
+
+      ok(cache == NULL);
+    }
+
+    subtest("Acquire and Release")
+    {
+      struct FileCache* cache = new_file_cache(CACHE_SIZE);
+      struct File*      file  = new_file();
+
+      int  first  = -1;
+      int  second = -1;
+      char data[8] = {0};
+
+      create_files(file);
+
+      int ret = cache->acquire(cache, "test_file_cache_a", O_RDONLY, &first);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(first >= 0);
+      ok(cache->misses == 1);
+      ok(cache->count == 1);
+
+      // the same file under another spelling is the same descriptor
+      ret = cache->acquire(cache, ".//test_file_cache_a", O_RDONLY, &second);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(second == first);
+      ok(cache->hits == 1);
+
+      ok(pread(first, data, 5, 0) == 5 && strcmp(data, "first") == 0);
+
+      cache->release(cache, first);
+      cache->release(cache, second);
+
+      // once released it stays open for the next caller
+      ret = cache->acquire(cache, "test_file_cache_a", O_RDONLY, &second);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(second == first);
+      ok(cache->hits == 2);
+      ok(cache->misses == 1);
+
+      ret = cache->release(cache, second);
+
+      ok(ret == KC_FILE_SUCCESS);
+
+      ret = cache->release(cache, second);
+
+      ok(ret == KC_FILE_INVALID);
+
+      ret = cache->acquire(cache, "test_file_cache_missing", O_RDONLY,
+        &second);
+
+      ok(ret == KC_FILE_INVALID);
+      ok(second == -1);
+      ok(cache->count == 1);
+
+      ret = cache->acquire(cache, "test_file_cache_a", O_RDWR | O_CREAT,
+        &second);
+
+      ok(ret == KC_FILE_INVALID);
+
+      delete_files();
+      destroy_file(file);
+      destroy_file_cache(cache);
+    }
+
+    subtest("Eviction")
+    {
+      struct FileCache* cache = new_file_cache(CACHE_SIZE);
+      struct File*      file  = new_file();
+
+      int a = -1;
+      int b = -1;
+      int c = -1;
+
+      create_files(file);
+
+      cache->acquire(cache, "test_file_cache_a", O_RDONLY, &a);
+      cache->acquire(cache, "test_file_cache_b", O_RDONLY, &b);
+
+      // every descriptor is held, the budget cannot be exceeded
+      int ret = cache->acquire(cache, "test_file_cache_c", O_RDONLY, &c);
+
+      ok(ret == KC_RESOURCE_UNAVAILABLE);
+      ok(cache->count == CACHE_SIZE);
+
+      // "a" was released first, it is the coldest and is closed
+      cache->release(cache, a);
+      cache->release(cache, b);
+
+      ret = cache->acquire(cache, "test_file_cache_c", O_RDONLY, &c);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(cache->evictions == 1);
+      ok(cache->count == CACHE_SIZE);
+
+      cache->acquire(cache, "test_file_cache_b", O_RDONLY, &b);
+
+      ok(cache->hits == 1);
+
+      cache->release(cache, b);
+      cache->acquire(cache, "test_file_cache_a", O_RDONLY, &a);
+
+      ok(cache->evictions == 2);
+      ok(cache->misses == 5);
+
+      cache->release(cache, a);
+
+      // an evicted path is opened again on the next acquire
+      ret = cache->evict(cache, "test_file_cache_a");
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(cache->evictions == 3);
+      ok(cache->count == 1);
+
+      // a path still in use is closed once its holder releases it
+      cache->evict(cache, "test_file_cache_c");
+
+      ok(cache->count == 1);
+
+      cache->release(cache, c);
+
+      ok(cache->count == 0);
+
+      delete_files();
+      destroy_file(file);
+      destroy_file_cache(cache);
+    }
+
+    subtest("Threads")
+    {
+      struct FileCache* cache = new_file_cache(CACHE_SIZE * 4);
+      struct File*      file  = new_file();
+      pthread_t         threads[CACHE_THREADS];
+
+      create_files(file);
+
+      for (int i = 0; i < CACHE_THREADS; ++i)
+      {
+        pthread_create(&threads[i], NULL, acquire_files, cache);
+      }
+
+      for (int i = 0; i < CACHE_THREADS; ++i)
+      {
+        pthread_join(threads[i], NULL);
+      }
+
+      // files opened by two threads at once are still cached only once
+      ok(cache->count == 3);
+      ok(cache->evictions == 0);
+      ok(cache->hits + cache->misses == CACHE_THREADS * CACHE_ROUNDS);
+
+      delete_files();
+      destroy_file(file);
+      destroy_file_cache(cache);
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}
@@ -0,0 +1,279 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_checksum.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/file.h"
+#include "../include/file_checksum.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// large enough to be split into ranges for several threads
+#define CHECKSUM_FILE_SIZE                                 ((40 << 20) + 12345)
+#define CHECKSUM_THREADS                                                      4
+
+//---------------------------------------------------------------------------//
+
+static char* create_data(const char* path, size_t size)
+{
+  struct File* file = new_file();
+  char*        data = malloc(size);
+  uint64_t     seed = 0x9E3779B97F4A7C15ULL;
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+
+    data[i] = (char)seed;
+  }
+
+  file->open(file, (char*)path, KC_FILE_CREATE_ALWAYS);
+  file->write_bytes(file, data, size);
+
+  destroy_file(file);
+
+  return data;
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("FileChecksum")
+  {
+    subtest("Creation and Destruction")
+    {
+      struct FileChecksum* checksum =
+        new_file_checksum(KC_FILE_CHECKSUM_CRC32C, 0);
+
+      ok(checksum != NULL);
+      ok(checksum->log != NULL);
+      ok(checksum->algorithm == KC_FILE_CHECKSUM_CRC32C);
+      ok(checksum->seed == 0);
+      ok(checksum->length == 0);
+      ok(checksum->state != NULL);
+
+      destroy_file_checksum(checksum);
+
+      ok(new_file_checksum(0x80, 0) == NULL);
+      ok(new_file_checksum(KC_FILE_CHECKSUM_CRC32C, 1ULL << 32) == NULL);
+    }
+
+    subtest("Known Values")
+    {
+      struct FileChecksum* crc = new_file_checksum(KC_FILE_CHECKSUM_CRC32C, 0);
+      struct FileChecksum* xxh = new_file_checksum(KC_FILE_CHECKSUM_XXH64, 0);
+
+      char     zeros[32] = {0};
+      uint64_t value     = 0;
+
+      ok(crc->compute(crc, "123456789", 9, &value) == KC_FILE_SUCCESS);
+      ok(value == 0xE3069283);
+      ok(crc->compute(crc, zeros, sizeof(zeros), &value) == KC_FILE_SUCCESS);
+      ok(value == 0x8A9136AA);
+      ok(crc->compute(crc, NULL, 0, &value) == KC_FILE_SUCCESS);
+      ok(value == 0);
+
+      ok(xxh->compute(xxh, NULL, 0, &value) == KC_FILE_SUCCESS);
+      ok(value == 0xEF46DB3751D8E999ULL);
+      ok(xxh->compute(xxh, "a", 1, &value) == KC_FILE_SUCCESS);
+      ok(value == 0xD24EC4F1A98C6E5BULL);
+      ok(xxh->compute(xxh, "abc", 3, &value) == KC_FILE_SUCCESS);
+      ok(value == 0x44BC2CF5AD770999ULL);
+
+      // long enough for the four lanes
+      ok(xxh->compute(xxh, "Nobody inspects the spammish repetition", 39,
+        &value) == KC_FILE_SUCCESS);
+      ok(value == 0xFBCEA83C8A378BF1ULL);
+
+      ok(crc->compute(crc, NULL, 1, &value) == KC_NULL_REFERENCE);
+      ok(crc->compute(crc, zeros, 1, NULL) == KC_NULL_REFERENCE);
+
+      destroy_file_checksum(crc);
+      destroy_file_checksum(xxh);
+    }
+
+    subtest("Update and Digest")
+    {
+      struct FileChecksum* crc = new_file_checksum(KC_FILE_CHECKSUM_CRC32C, 0);
+      struct FileChecksum* xxh = new_file_checksum(KC_FILE_CHECKSUM_XXH64, 0);
+
+      char*    data     = create_data("test_file_checksum", 100000);
+      uint64_t expected = 0;
+      uint64_t value    = 0;
+
+      // pieces of every size add up to the checksum of the whole
+      xxh->compute(xxh, data, 100000, &expected);
+
+      for (size_t done = 0, step = 1; done < 100000; done += step, step += 7)
+      {
+        xxh->update(xxh, data + done, step < 100000 - done ? step :
+          100000 - done);
+      }
+
+      ok(xxh->length == 100000);
+      ok(xxh->digest(xxh, &value) == KC_FILE_SUCCESS);
+      ok(value == expected);
+
+      crc->compute(crc, data, 100000, &expected);
+
+      for (size_t done = 0, step = 1; done < 100000; done += step, step += 7)
+      {
+        crc->update(crc, data + done, step < 100000 - done ? step :
+          100000 - done);
+      }
+
+      ok(crc->digest(crc, &value) == KC_FILE_SUCCESS);
+      ok(value == expected);
+
+      ok(crc->reset(crc) == KC_FILE_SUCCESS);
+      ok(crc->length == 0);
+      crc->digest(crc, &value);
+      ok(value == 0);
+
+      // a CRC32C seed carries on from the data before
+      struct FileChecksum* tail = NULL;
+
+      crc->compute(crc, "12345", 5, &value);
+      tail = new_file_checksum(KC_FILE_CHECKSUM_CRC32C, value);
+
+      ok(tail->compute(tail, "6789", 4, &value) == KC_FILE_SUCCESS);
+      ok(value == 0xE3069283);
+
+      ok(crc->update(crc, NULL, 1) == KC_NULL_REFERENCE);
+      ok(crc->digest(crc, NULL) == KC_NULL_REFERENCE);
+
+      free(data);
+      remove("test_file_checksum");
+
+      destroy_file_checksum(tail);
+      destroy_file_checksum(crc);
+      destroy_file_checksum(xxh);
+    }
+
+    subtest("Compute File")
+    {
+      struct FileChecksum* crc  = new_file_checksum(KC_FILE_CHECKSUM_CRC32C, 7);
+      struct FileChecksum* xxh  = new_file_checksum(KC_FILE_CHECKSUM_XXH64, 7);
+      struct File*         file = new_file();
+
+      char*    data     = create_data("test_file_checksum", CHECKSUM_FILE_SIZE);
+      uint64_t expected = 0;
+      uint64_t value    = 0;
+
+      ok(crc->compute_file(crc, file, 1, &value) == KC_FILE_CLOSED);
+
+      file->open(file, "test_file_checksum", KC_FILE_READ);
+
+      // the ranges hashed on their own threads combine to the same checksum
+      crc->compute(crc, data, CHECKSUM_FILE_SIZE, &expected);
+
+      ok(crc->compute_file(crc, file, 1, &value) == KC_FILE_SUCCESS);
+      ok(value == expected);
+      ok(crc->compute_file(crc, file, CHECKSUM_THREADS, &value) ==
+        KC_FILE_SUCCESS);
+      ok(value == expected);
+
+      xxh->compute(xxh, data, CHECKSUM_FILE_SIZE, &expected);
+
+      ok(xxh->compute_file(xxh, file, CHECKSUM_THREADS, &value) ==
+        KC_FILE_SUCCESS);
+      ok(value == expected);
+
+      ok(crc->compute_file(crc, NULL, 1, &value) == KC_NULL_REFERENCE);
+      ok(crc->compute_file(crc, file, 1, NULL) == KC_NULL_REFERENCE);
+
+      free(data);
+      file->delete(file);
+
+      destroy_file(file);
+      destroy_file_checksum(crc);
+      destroy_file_checksum(xxh);
+    }
+
+    subtest("Read File")
+    {
+      struct FileChecksum* crc  = new_file_checksum(KC_FILE_CHECKSUM_CRC32C, 0);
+      struct File*         file = new_file();
+
+      char*    data     = create_data("test_file_checksum", CHECKSUM_FILE_SIZE);
+      char*    buffer   = NULL;
+      size_t   size     = 0;
+      uint64_t expected = 0;
+      uint64_t value    = 0;
+
+      crc->compute(crc, data, CHECKSUM_FILE_SIZE, &expected);
+
+      // the data is read and hashed in one pass
+      file->open(file, "test_file_checksum", KC_FILE_READ);
+
+      ok(crc->read_file(crc, file, CHECKSUM_THREADS, &buffer, &size,
+        &value) == KC_FILE_SUCCESS);
+      ok(size == CHECKSUM_FILE_SIZE);
+      ok(value == expected);
+      ok(buffer != NULL && memcmp(buffer, data, size) == 0);
+      ok(buffer != NULL && buffer[size] == '\0');
+
+      free(buffer);
+      buffer = NULL;
+
+      // direct files land in the same aligned buffer
+      file->open(file, "test_file_checksum", KC_FILE_READ | KC_FILE_DIRECT);
+
+      ok(crc->read_file(crc, file, 1, &buffer, NULL, &value) ==
+        KC_FILE_SUCCESS);
+      ok(value == expected);
+      ok(buffer != NULL && memcmp(buffer, data, CHECKSUM_FILE_SIZE) == 0);
+
+      free(buffer);
+
+      ok(crc->read_file(crc, file, 1, NULL, NULL, &value) ==
+        KC_NULL_REFERENCE);
+
+      // compressed files are hashed after they were read, the size on disk
+      // is not the size of their data
+      buffer = NULL;
+
+      file->open(file, "test_file_checksum",
+        KC_FILE_CREATE_ALWAYS | KC_FILE_COMPRESSED);
+      file->write_bytes(file, data, 1 << 20);
+      file->close(file);
+
+      file->open(file, "test_file_checksum",
+        KC_FILE_READ | KC_FILE_COMPRESSED);
+
+      ok(crc->compute_file(crc, file, 1, &value) == KC_FILE_INVALID);
+      ok(crc->read_file(crc, file, 1, &buffer, &size, &value) ==
+        KC_FILE_INVALID);
+      ok(buffer == NULL);
+
+      crc->compute(crc, data, 1 << 20, &expected);
+      file->read(file, &buffer);
+      crc->compute(crc, buffer, 1 << 20, &value);
+
+      ok(value == expected);
+
+      free(buffer);
+      free(data);
+      file->delete(file);
+
+      destroy_file(file);
+      destroy_file_checksum(crc);
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}
@@ -0,0 +1,455 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_journal.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/file.h"
+#include "../include/file_journal.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define JOURNAL_DIRECTORY                                  "test_file_journal"
+#define JOURNAL_SEGMENT_SIZE                                                256
+#define JOURNAL_THREADS                                                       8
+#define JOURNAL_RECORDS                                                    1000
+
+struct Replay
+{
+  size_t count;
+  size_t bytes;
+  bool   ordered;
+};
+
+//---------------------------------------------------------------------------//
+
+static int count_record(const void* record, size_t size, void* context)
+{
+  struct Replay* replay = (struct Replay*)context;
+  char           expected[32];
+
+  // the records of the single threaded tests are numbered in order
+  snprintf(expected, sizeof(expected), "record %zu", replay->count);
+
+  if (size != strlen(expected) || memcmp(record, expected, size) != 0)
+  {
+    replay->ordered = false;
+  }
+
+  replay->count += 1;
+  replay->bytes += size;
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static int stop_replay(const void* record, size_t size, void* context)
+{
+  (*(size_t*)context) += 1;
+
+  return KC_INVALID_OPERATION;
+}
+
+//---------------------------------------------------------------------------//
+
+static size_t count_segments()
+{
+  DIR*           dir   = opendir(JOURNAL_DIRECTORY);
+  struct dirent* entry = NULL;
+  size_t         count = 0;
+
+  while (dir != NULL && (entry = readdir(dir)) != NULL)
+  {
+    count += strstr(entry->d_name, ".log") != NULL;
+  }
+
+  if (dir != NULL)
+  {
+    closedir(dir);
+  }
+
+  return count;
+}
+
+//---------------------------------------------------------------------------//
+
+static void delete_journal()
+{
+  DIR*           dir   = opendir(JOURNAL_DIRECTORY);
+  struct dirent* entry = NULL;
+  char           path[512];
+
+  while (dir != NULL && (entry = readdir(dir)) != NULL)
+  {
+    if (entry->d_name[0] != '.')
+    {
+      snprintf(path, sizeof(path), "%s/%s", JOURNAL_DIRECTORY, entry->d_name);
+      unlink(path);
+    }
+  }
+
+  if (dir != NULL)
+  {
+    closedir(dir);
+  }
+
+  rmdir(JOURNAL_DIRECTORY);
+}
+
+//---------------------------------------------------------------------------//
+
+static void* append_records(void* context)
+{
+  struct FileJournal* journal = (struct FileJournal*)context;
+
+  char record[16] = "threaded record";
+
+  for (int i = 0; i < JOURNAL_RECORDS; ++i)
+  {
+    journal->append(journal, record, sizeof(record));
+  }
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool find_record(const char* record, size_t size)
+{
+  DIR*           dir   = opendir(JOURNAL_DIRECTORY);
+  struct dirent* entry = NULL;
+  bool           found = false;
+  char           path[512];
+  char           data[1 << 16];
+
+  // the segments are read straight from the disk, not through the journal
+  while (dir != NULL && found == false && (entry = readdir(dir)) != NULL)
+  {
+    if (strstr(entry->d_name, ".log") == NULL)
+    {
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", JOURNAL_DIRECTORY, entry->d_name);
+
+    int     fd    = open(path, O_RDONLY);
+    ssize_t bytes = fd < 0 ? 0 : pread(fd, data, sizeof(data), 0);
+
+    found = bytes > 0 && memmem(data, (size_t)bytes, record, size) != NULL;
+
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+  }
+
+  if (dir != NULL)
+  {
+    closedir(dir);
+  }
+
+  return found;
+}
+
+//---------------------------------------------------------------------------//
+
+static void* flush_records(void* context)
+{
+  struct FileJournal* journal = (struct FileJournal*)context;
+  size_t              missing = 0;
+  char                record[32];
+
+  // once flush() returns, the record of the caller must be in its segment
+  for (int i = 0; i < JOURNAL_RECORDS / 50; ++i)
+  {
+    snprintf(record, sizeof(record), "flushed %p %d", (void*)&missing, i);
+
+    journal->append(journal, record, strlen(record));
+
+    if (journal->flush(journal) != KC_FILE_SUCCESS ||
+        find_record(record, strlen(record)) == false)
+    {
+      ++missing;
+    }
+  }
+
+  return (void*)missing;
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("FileJournal")
+  {
+    subtest("Creation and Destruction")
+    {
+      struct FileJournal* journal =
+        new_file_journal(JOURNAL_DIRECTORY, JOURNAL_SEGMENT_SIZE);
+
+      ok(journal != NULL);
+      ok(journal->log != NULL);
+      ok(strcmp(journal->directory, JOURNAL_DIRECTORY) == 0);
+      ok(journal->segment_size == JOURNAL_SEGMENT_SIZE);
+      ok(journal->segment == 0);
+      ok(journal->truncated == 0);
+      ok(journal->engine != NULL);
+      ok(count_segments() == 1);
+
+      destroy_file_journal(journal);
+
+      ok(new_file_journal(NULL, JOURNAL_SEGMENT_SIZE) == NULL);
+      ok(new_file_journal(JOURNAL_DIRECTORY, 8) == NULL);
+
+      delete_journal();
+    }
+
+    subtest("Append and Flush")
+    {
+      struct FileJournal* journal =
+        new_file_journal(JOURNAL_DIRECTORY, JOURNAL_SEGMENT_SIZE);
+
+      struct Replay replay = { 0, 0, true };
+      char          record[32];
+      char          large[JOURNAL_SEGMENT_SIZE] = {0};
+
+      for (size_t i = 0; i < 5; ++i)
+      {
+        snprintf(record, sizeof(record), "record %zu", i);
+        ok(journal->append(journal, record, strlen(record)) ==
+          KC_FILE_SUCCESS);
+      }
+
+      // a record never spans two segments
+      ok(journal->append(journal, large, sizeof(large)) == KC_FILE_INVALID);
+      ok(journal->append(journal, NULL, 1) == KC_NULL_REFERENCE);
+
+      ok(journal->flush(journal) == KC_FILE_SUCCESS);
+      ok(journal->flush(journal) == KC_FILE_SUCCESS);
+
+      // every record is framed by its size and checksum
+      struct stat st;
+      stat(JOURNAL_DIRECTORY "/00000000000000000000.log", &st);
+
+      ok(st.st_size == 5 * (8 + 8));
+
+      ok(journal->for_each(journal, count_record, &replay) ==
+        KC_FILE_SUCCESS);
+      ok(replay.count == 5);
+      ok(replay.bytes == 5 * 8);
+      ok(replay.ordered == true);
+
+      // the callback stops the replay
+      size_t visited = 0;
+
+      ok(journal->for_each(journal, stop_replay, &visited) ==
+        KC_INVALID_OPERATION);
+      ok(visited == 1);
+
+      ok(journal->for_each(journal, NULL, NULL) == KC_NULL_REFERENCE);
+      ok(journal->flush(NULL) == KC_NULL_REFERENCE);
+
+      destroy_file_journal(journal);
+      delete_journal();
+    }
+
+    subtest("Rollover")
+    {
+      struct FileJournal* journal =
+        new_file_journal(JOURNAL_DIRECTORY, JOURNAL_SEGMENT_SIZE);
+
+      struct Replay replay = { 0, 0, true };
+      char          record[32];
+
+      // 16 records of 16 bytes fill a segment, 100 of them need seven
+      for (size_t i = 0; i < 100; ++i)
+      {
+        snprintf(record, sizeof(record), "record %zu", i);
+        journal->append(journal, record, strlen(record));
+      }
+
+      ok(journal->flush(journal) == KC_FILE_SUCCESS);
+      ok(journal->segment > 0);
+      ok(count_segments() == journal->segment + 1);
+
+      ok(journal->for_each(journal, count_record, &replay) ==
+        KC_FILE_SUCCESS);
+      ok(replay.count == 100);
+      ok(replay.ordered == true);
+
+      uint64_t segment = journal->segment;
+
+      destroy_file_journal(journal);
+
+      // reopening continues in the last segment
+      journal = new_file_journal(JOURNAL_DIRECTORY, JOURNAL_SEGMENT_SIZE);
+
+      ok(journal->segment == segment);
+      ok(journal->truncated == 0);
+
+      snprintf(record, sizeof(record), "record %d", 100);
+      journal->append(journal, record, strlen(record));
+
+      replay = (struct Replay){ 0, 0, true };
+
+      ok(journal->for_each(journal, count_record, &replay) ==
+        KC_FILE_SUCCESS);
+      ok(replay.count == 101);
+      ok(replay.ordered == true);
+
+      destroy_file_journal(journal);
+      delete_journal();
+    }
+
+    subtest("Concurrent Append")
+    {
+      struct FileJournal* journal =
+        new_file_journal(JOURNAL_DIRECTORY, 1 << 16);
+
+      pthread_t threads[JOURNAL_THREADS];
+
+      for (int i = 0; i < JOURNAL_THREADS; ++i)
+      {
+        pthread_create(&threads[i], NULL, append_records, journal);
+      }
+
+      for (int i = 0; i < JOURNAL_THREADS; ++i)
+      {
+        pthread_join(threads[i], NULL);
+      }
+
+      struct Replay replay = { 0, 0, true };
+
+      ok(journal->for_each(journal, count_record, &replay) ==
+        KC_FILE_SUCCESS);
+      ok(replay.count == JOURNAL_THREADS * JOURNAL_RECORDS);
+      ok(replay.bytes == JOURNAL_THREADS * JOURNAL_RECORDS * 16);
+
+      destroy_file_journal(journal);
+      delete_journal();
+    }
+
+    subtest("Concurrent Flush")
+    {
+      struct FileJournal* journal =
+        new_file_journal(JOURNAL_DIRECTORY, 1 << 16);
+
+      pthread_t threads[JOURNAL_THREADS];
+      size_t    missing = 0;
+
+      for (int i = 0; i < JOURNAL_THREADS; ++i)
+      {
+        pthread_create(&threads[i], NULL, flush_records, journal);
+      }
+
+      for (int i = 0; i < JOURNAL_THREADS; ++i)
+      {
+        void* result = NULL;
+
+        pthread_join(threads[i], &result);
+        missing += (size_t)result;
+      }
+
+      ok(missing == 0);
+
+      destroy_file_journal(journal);
+      delete_journal();
+    }
+
+    subtest("Torn Tail")
+    {
+      struct FileJournal* journal =
+        new_file_journal(JOURNAL_DIRECTORY, JOURNAL_SEGMENT_SIZE);
+
+      char record[32];
+
+      for (size_t i = 0; i < 3; ++i)
+      {
+        snprintf(record, sizeof(record), "record %zu", i);
+        journal->append(journal, record, strlen(record));
+      }
+
+      destroy_file_journal(journal);
+
+      // a crash in the middle of a write leaves half a record behind
+      int fd = open(JOURNAL_DIRECTORY "/00000000000000000000.log",
+        O_WRONLY | O_APPEND);
+
+      ok(write(fd, "\x08\x00\x00\x00\x01\x02\x03\x04rec", 11) == 11);
+      close(fd);
+
+      journal = new_file_journal(JOURNAL_DIRECTORY, JOURNAL_SEGMENT_SIZE);
+
+      ok(journal != NULL);
+      ok(journal->truncated == 11);
+
+      struct stat st;
+      stat(JOURNAL_DIRECTORY "/00000000000000000000.log", &st);
+
+      ok(st.st_size == 3 * (8 + 8));
+
+      // new records follow the last whole one
+      snprintf(record, sizeof(record), "record %d", 3);
+      journal->append(journal, record, strlen(record));
+
+      struct Replay replay = { 0, 0, true };
+
+      ok(journal->for_each(journal, count_record, &replay) ==
+        KC_FILE_SUCCESS);
+      ok(replay.count == 4);
+      ok(replay.ordered == true);
+
+      destroy_file_journal(journal);
+      delete_journal();
+    }
+
+    subtest("Corrupt Segment")
+    {
+      struct FileJournal* journal =
+        new_file_journal(JOURNAL_DIRECTORY, JOURNAL_SEGMENT_SIZE);
+
+      char record[32];
+
+      for (size_t i = 0; i < 20; ++i)
+      {
+        snprintf(record, sizeof(record), "record %zu", i);
+        journal->append(journal, record, strlen(record));
+      }
+
+      ok(journal->flush(journal) == KC_FILE_SUCCESS);
+      ok(journal->segment > 0);
+
+      // a flipped byte in a sealed segment cuts its replay short
+      int fd = open(JOURNAL_DIRECTORY "/00000000000000000000.log", O_WRONLY);
+
+      ok(pwrite(fd, "X", 1, 8 + 8 + 8) == 1);
+      close(fd);
+
+      struct Replay replay = { 0, 0, true };
+
+      ok(journal->for_each(journal, count_record, &replay) ==
+        KC_FILE_INVALID);
+      ok(replay.count == 1);
+
+      destroy_file_journal(journal);
+      delete_journal();
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}
@@ -0,0 +1,206 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_pool.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/file_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define POOL_SIZE                                                             4
+#define POOL_THREADS                                                          8
+#define POOL_ROUNDS                                                       10000
+
+//---------------------------------------------------------------------------//
+
+static void* PoolWorker(void* context)
+{
+  struct FilePool* pool   = (struct FilePool*)context;
+  struct File*     file   = NULL;
+  size_t           failed = 0;
+
+  // keep taking and giving back files, no two threads may get the same one
+  for (int i = 0; i < POOL_ROUNDS; ++i)
+  {
+    if (pool->acquire(pool, &file) != KC_FILE_SUCCESS)
+    {
+      continue;
+    }
+
+    // the flag is only ever raised by the thread holding the file
+    if (__atomic_exchange_n(&file->opened, true, __ATOMIC_ACQ_REL) == true)
+    {
+      ++failed;
+    }
+
+    __atomic_store_n(&file->opened, false, __ATOMIC_RELEASE);
+
+    pool->release(pool, file);
+  }
+
+  return (void*)failed;
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("FilePool")
+  {
+    subtest("Creation and Destruction")
+    {
+      struct FilePool* pool = new_file_pool(POOL_SIZE);
+
+      ok(pool != NULL);
+      ok(pool->log != NULL);
+      ok(pool->slots != NULL);
+      ok(pool->capacity == POOL_SIZE);
+      ok(pool->available == POOL_SIZE);
+
+      destroy_file_pool(pool);
+
+      pool = new_file_pool(0);
+
+      ok(pool == NULL);
+    }
+
+    subtest("Acquire and Release")
+    {
+      struct FilePool* pool = new_file_pool(POOL_SIZE);
+      struct File*     files[POOL_SIZE];
+      struct File*     file = NULL;
+
+      bool same = true;
+      int  ret  = KC_FILE_INVALID;
+
+      for (int i = 0; i < POOL_SIZE; ++i)
+      {
+        ret  = pool->acquire(pool, &files[i]);
+        same = same && ret == KC_FILE_SUCCESS && files[i] != NULL &&
+          files[i]->log != NULL && files[i]->opened == false;
+      }
+
+      ok(same == true);
+      ok(pool->available == 0);
+      ok(files[0] != files[POOL_SIZE - 1]);
+
+      // every file is out, the pool is exhausted
+      ret = pool->acquire(pool, &file);
+
+      ok(ret == KC_RESOURCE_UNAVAILABLE);
+      ok(file == NULL);
+
+      ret = files[0]->open(files[0], "test_file_pool", KC_FILE_CREATE_ALWAYS);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(files[0]->name == files[0]->name_storage);
+      ok(strcmp(files[0]->name, "test_file_pool") == 0);
+
+      files[0]->write(files[0], "pooled");
+      files[0]->set_group_commit(files[0], 100);
+      files[0]->close(files[0]);
+
+      // the next file to be handed out is the last one given back
+      ret = pool->release(pool, files[0]);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(pool->available == 1);
+
+      pool->acquire(pool, &file);
+
+      ok(file == files[0]);
+      ok(file->name == NULL);
+      ok(file->commit == NULL);
+
+      // every slot counts on its own, and starts over once given back
+      struct SystemStats stats;
+
+      file->get_stats(file, &stats);
+
+      ok(file->stats == NULL || file->stats != files[1]->stats);
+      ok(stats.operations[KC_SYSTEM_STATS_OPEN].calls == 0);
+
+      char* buffer = NULL;
+
+      file->open(file, "test_file_pool", KC_FILE_READ);
+      file->read(file, &buffer);
+
+      ok(buffer != NULL && strcmp(buffer, "pooled") == 0);
+
+      free(buffer);
+      file->delete(file);
+
+      // names longer than the inline storage still work
+      char name[512] = {0};
+
+      for (int i = 0; i < 150; ++i)
+      {
+        strcat(name, "./");
+      }
+
+      strcat(name, "test_file_pool");
+
+      ret = file->open(file, name, KC_FILE_CREATE_ALWAYS);
+
+      ok(ret == KC_FILE_SUCCESS);
+      ok(file->name != file->name_storage);
+      ok(strcmp(file->name, name) == 0);
+
+      file->delete(file);
+
+      struct File* other = new_file();
+
+      ret = pool->release(pool, other);
+
+      ok(ret == KC_FILE_INVALID);
+
+      for (int i = 0; i < POOL_SIZE; ++i)
+      {
+        pool->release(pool, files[i]);
+      }
+
+      ok(pool->available == POOL_SIZE);
+
+      destroy_file(other);
+      destroy_file_pool(pool);
+    }
+
+    subtest("Acquire Concurrently")
+    {
+      struct FilePool* pool = new_file_pool(POOL_SIZE);
+      pthread_t        threads[POOL_THREADS];
+      size_t           failed = 0;
+
+      for (int i = 0; i < POOL_THREADS; ++i)
+      {
+        pthread_create(&threads[i], NULL, PoolWorker, pool);
+      }
+
+      for (int i = 0; i < POOL_THREADS; ++i)
+      {
+        void* result = NULL;
+
+        pthread_join(threads[i], &result);
+        failed += (size_t)result;
+      }
+
+      ok(failed == 0);
+      ok(pool->available == POOL_SIZE);
+
+      destroy_file_pool(pool);
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}
@@ -0,0 +1,206 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_ring.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/file_ring.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define RING_DEPTH                                                           32
+#define RING_BLOCK_SIZE                                                     512
+
+//---------------------------------------------------------------------------//
+
+static void run_ring(int backend)
+{
+  struct FileRing* ring = new_file_ring(RING_DEPTH, backend);
+  struct File*     file = new_file();
+
+  struct FileCompletion completions[RING_DEPTH];
+  static char           blocks[RING_DEPTH][RING_BLOCK_SIZE];
+
+  int      ret   = KC_FILE_INVALID;
+  unsigned count = 0;
+  bool     same  = true;
+
+  ok(ring != NULL);
+  ok(ring->backend == backend);
+  ok(ring->pending == 0);
+
+  file->open(file, "test_file_ring", KC_FILE_CREATE_ALWAYS);
+
+  note("Submit Write")
+  for (int i = 0; i < RING_DEPTH; ++i)
+  {
+    memset(blocks[i], 'a' + i % 26, RING_BLOCK_SIZE);
+
+    ret = ring->submit_write(ring, file, (uint64_t)i * RING_BLOCK_SIZE,
+      blocks[i], RING_BLOCK_SIZE, blocks[i]);
+
+    same = same && ret == KC_FILE_SUCCESS;
+  }
+
+  ok(same == true);
+  ok(ring->pending == RING_DEPTH);
+
+  // the ring is full until some completions are reaped
+  ret = ring->submit_fsync(ring, file, NULL);
+
+  ok(ret == KC_RESOURCE_UNAVAILABLE);
+
+  ret = ring->poll_completions(ring, completions, RING_DEPTH, RING_DEPTH,
+    &count);
+
+  for (unsigned i = 0; i < count; ++i)
+  {
+    same = same && completions[i].result == RING_BLOCK_SIZE;
+  }
+
+  ok(ret == KC_FILE_SUCCESS);
+  ok(count == RING_DEPTH);
+  ok(same == true);
+  ok(ring->pending == 0);
+
+  note("Submit Fsync")
+  ret = ring->submit_fsync(ring, file, file);
+
+  ok(ret == KC_FILE_SUCCESS);
+
+  ring->poll_completions(ring, completions, RING_DEPTH, 1, &count);
+
+  ok(count == 1);
+  ok(completions[0].context == file);
+  ok(completions[0].result == 0);
+
+  note("Submit Read")
+  memset(blocks, 0, sizeof(blocks));
+  file->open(file, "test_file_ring", KC_FILE_READ);
+
+  // read the blocks back in reverse order, each one lands in its own buffer
+  for (int i = 0; i < RING_DEPTH; ++i)
+  {
+    ring->submit_read(ring, file,
+      (uint64_t)(RING_DEPTH - 1 - i) * RING_BLOCK_SIZE, blocks[i],
+      RING_BLOCK_SIZE, blocks[i]);
+  }
+
+  unsigned total = 0;
+
+  while (ring->pending > 0)
+  {
+    ring->poll_completions(ring, completions, RING_DEPTH, 1, &count);
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+      char* block = (char*)completions[i].context;
+      int   index = RING_DEPTH - 1 - (int)((block - blocks[0]) / RING_BLOCK_SIZE);
+
+      same = same && completions[i].result == RING_BLOCK_SIZE &&
+        block[0] == 'a' + index % 26 &&
+        block[RING_BLOCK_SIZE - 1] == 'a' + index % 26;
+    }
+
+    total += count;
+  }
+
+  ok(total == RING_DEPTH);
+  ok(same == true);
+
+  note("Buffered Write")
+  file->open(file, "test_file_ring", KC_FILE_CREATE_ALWAYS);
+  file->write(file, "buffered");
+  memset(blocks[0], 0, RING_BLOCK_SIZE);
+
+  // the bytes still sitting in the stream are flushed before the request
+  ret = ring->submit_fsync(ring, file, NULL);
+
+  ok(ret == KC_FILE_SUCCESS);
+
+  ring->poll_completions(ring, completions, RING_DEPTH, 1, &count);
+
+  FILE* copy = fopen("test_file_ring", "r");
+
+  ok(count == 1);
+  ok(fread(blocks[0], 1, RING_BLOCK_SIZE, copy) == 8);
+  ok(memcmp(blocks[0], "buffered", 8) == 0);
+
+  fclose(copy);
+
+  note("Errors")
+  ret = ring->submit_read(ring, file, 0, NULL, RING_BLOCK_SIZE, NULL);
+
+  ok(ret == KC_NULL_REFERENCE);
+
+  file->close(file);
+  ret = ring->submit_fsync(ring, file, NULL);
+
+  ok(ret == KC_FILE_CLOSED);
+
+  // nothing is in flight, polling returns right away
+  ret = ring->poll_completions(ring, completions, RING_DEPTH, 1, &count);
+
+  ok(ret == KC_FILE_SUCCESS);
+  ok(count == 0);
+
+  file->delete(file);
+  destroy_file(file);
+  destroy_file_ring(ring);
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("FileRing")
+  {
+    subtest("Creation and Destruction")
+    {
+      struct FileRing* ring = new_file_ring(8, KC_FILE_RING_AUTO);
+
+      ok(ring != NULL);
+      ok(ring->log != NULL);
+      ok(ring->engine != NULL);
+      ok(ring->depth == 8);
+      ok(ring->pending == 0);
+      ok(ring->backend == KC_FILE_RING_IO_URING ||
+         ring->backend == KC_FILE_RING_THREADS);
+
+      destroy_file_ring(ring);
+
+      ring = new_file_ring(0, KC_FILE_RING_AUTO);
+
+      ok(ring == NULL);
+    }
+
+    subtest("IO Uring")
+    {
+      struct FileRing* ring = new_file_ring(1, KC_FILE_RING_IO_URING);
+
+      // the kernel may not support io_uring at all
+      skip(ring == NULL);
+      ok(ring != NULL);
+
+      if (ring != NULL)
+      {
+        destroy_file_ring(ring);
+        run_ring(KC_FILE_RING_IO_URING);
+      }
+    }
+
+    subtest("Thread Pool")
+    {
+      run_ring(KC_FILE_RING_THREADS);
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}
@@ -0,0 +1,376 @@
+// This file is part of libkc_system
+// ==================================
+//
+// file_watch.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/file.h"
+#include "../include/file_watch.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WATCH_DELAY                                                          50
+#define WATCH_TIMEOUT                                                      2000
+#define WATCH_MAX_CHANGES                                                    16
+
+struct WatchCheck
+{
+  size_t   batches;
+  size_t   count;
+  char     paths[WATCH_MAX_CHANGES][256];
+  uint32_t events[WATCH_MAX_CHANGES];
+};
+
+//---------------------------------------------------------------------------//
+
+static int collect_changes(const struct FileChange* changes, size_t count,
+  void* context)
+{
+  struct WatchCheck* check = (struct WatchCheck*)context;
+
+  check->batches += 1;
+
+  for (size_t i = 0; i < count && check->count < WATCH_MAX_CHANGES; ++i)
+  {
+    snprintf(check->paths[check->count], sizeof(check->paths[0]), "%s",
+      changes[i].path != NULL ? changes[i].path : "");
+
+    check->events[check->count++] = changes[i].events;
+  }
+
+  return KC_FILE_SUCCESS;
+}
+
+//---------------------------------------------------------------------------//
+
+static uint32_t find_change(struct WatchCheck* check, const char* path)
+{
+  for (size_t i = 0; i < check->count; ++i)
+  {
+    if (strcmp(check->paths[i], path) == 0)
+    {
+      return check->events[i];
+    }
+  }
+
+  return 0;
+}
+
+//---------------------------------------------------------------------------//
+
+static void append_file(const char* path, const char* data)
+{
+  int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+  if (fd >= 0)
+  {
+    write(fd, data, strlen(data));
+    close(fd);
+  }
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("FileWatch")
+  {
+    subtest("Creation and Destruction")
+    {
+      struct FileWatch* watch = new_file_watch(WATCH_DELAY);
+
+      ok(watch != NULL);
+      ok(watch->log != NULL);
+      ok(watch->fd >= 0);
+      ok(watch->delay == WATCH_DELAY);
+      ok(watch->watches == 0);
+      ok(watch->pending == 0);
+      ok(watch->engine != NULL);
+
+      destroy_file_watch(watch);
+    }
+
+    subtest("Add and Remove")
+    {
+      struct FileWatch* watch = new_file_watch(WATCH_DELAY);
+
+      mkdir("test_file_watch", 0777);
+      mkdir("test_file_watch/a", 0777);
+      mkdir("test_file_watch/a/b", 0777);
+
+      ok(watch->add(watch, "test_file_watch_missing", 0) == KC_FILE_INVALID);
+      ok(watch->add(watch, "test_file_watch", 0x80) == KC_FILE_INVALID);
+      ok(watch->add(watch, NULL, 0) == KC_NULL_REFERENCE);
+
+      // a tree is watched directory by directory
+      ok(watch->add(watch, "test_file_watch/", KC_FILE_WATCH_RECURSIVE) ==
+        KC_FILE_SUCCESS);
+      ok(watch->watches == 3);
+
+      // adding the same path again reuses its watch
+      ok(watch->add(watch, "test_file_watch", 0) == KC_FILE_SUCCESS);
+      ok(watch->watches == 3);
+
+      ok(watch->remove(watch, "test_file_watch/a") == KC_FILE_SUCCESS);
+      ok(watch->watches == 1);
+      ok(watch->remove(watch, "test_file_watch/a") == KC_FILE_INVALID);
+      ok(watch->remove(watch, "test_file_watch") == KC_FILE_SUCCESS);
+      ok(watch->watches == 0);
+
+      rmdir("test_file_watch/a/b");
+      rmdir("test_file_watch/a");
+      rmdir("test_file_watch");
+
+      destroy_file_watch(watch);
+    }
+
+    subtest("Coalesce")
+    {
+      struct FileWatch* watch = new_file_watch(WATCH_DELAY);
+      struct WatchCheck check = {0};
+
+      int timeout = 0;
+
+      mkdir("test_file_watch", 0777);
+      watch->add(watch, "test_file_watch", 0);
+
+      ok(watch->get_timeout(watch, &timeout) == KC_FILE_SUCCESS);
+      ok(timeout == -1);
+
+      // a burst of writes to one file is a single change
+      for (int i = 0; i < 100; ++i)
+      {
+        append_file("test_file_watch/config", "key = value\n");
+      }
+
+      // the descriptor wakes up an epoll or poll loop
+      struct pollfd pfd = { watch->fd, POLLIN, 0 };
+
+      ok(poll(&pfd, 1, WATCH_TIMEOUT) == 1);
+
+      // nothing has settled yet, the events are only collected
+      ok(watch->dispatch(watch, 0, collect_changes, &check) ==
+        KC_FILE_SUCCESS);
+      ok(check.batches == 0);
+      ok(watch->pending == 1);
+
+      watch->get_timeout(watch, &timeout);
+      ok(timeout >= 0 && timeout <= WATCH_DELAY);
+
+      ok(watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check) ==
+        KC_FILE_SUCCESS);
+      ok(check.batches == 1);
+      ok(check.count == 1);
+      ok(find_change(&check, "test_file_watch/config") ==
+        (KC_FILE_WATCH_CREATED | KC_FILE_WATCH_MODIFIED));
+      ok(watch->pending == 0);
+
+      // deletions are reported too
+      unlink("test_file_watch/config");
+
+      check = (struct WatchCheck){0};
+
+      ok(watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check) ==
+        KC_FILE_SUCCESS);
+      ok(find_change(&check, "test_file_watch/config") &
+        KC_FILE_WATCH_DELETED);
+
+      // a removed path reports nothing more
+      watch->remove(watch, "test_file_watch");
+      append_file("test_file_watch/config", "key = value\n");
+
+      check = (struct WatchCheck){0};
+
+      ok(watch->dispatch(watch, 2 * WATCH_DELAY, collect_changes, &check) ==
+        KC_FILE_SUCCESS);
+      ok(check.count == 0);
+
+      ok(watch->dispatch(watch, 0, NULL, NULL) == KC_NULL_REFERENCE);
+      ok(watch->get_timeout(watch, NULL) == KC_NULL_REFERENCE);
+
+      unlink("test_file_watch/config");
+      rmdir("test_file_watch");
+
+      destroy_file_watch(watch);
+    }
+
+    subtest("Replace")
+    {
+      struct FileWatch* watch = new_file_watch(WATCH_DELAY);
+      struct File*      file  = new_file();
+      struct WatchCheck check = {0};
+
+      append_file("test_file_watch_config", "first");
+
+      watch->add(watch, "test_file_watch_config", 0);
+
+      // a config file replaced atomically is still watched afterwards
+      file->atomic_write(file, "test_file_watch_config", "second", 6);
+
+      for (int i = 0; i < 4 && check.count < 1; ++i)
+      {
+        watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check);
+      }
+
+      ok(find_change(&check, "test_file_watch_config") &
+        KC_FILE_WATCH_CREATED);
+      ok(watch->watches == 1);
+
+      check = (struct WatchCheck){0};
+      append_file("test_file_watch_config", "third");
+
+      for (int i = 0; i < 4 && check.count < 1; ++i)
+      {
+        watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check);
+      }
+
+      ok(find_change(&check, "test_file_watch_config") &
+        KC_FILE_WATCH_MODIFIED);
+
+      // once it is deleted, there is nothing left to watch
+      unlink("test_file_watch_config");
+
+      check = (struct WatchCheck){0};
+
+      watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check);
+
+      ok(find_change(&check, "test_file_watch_config") &
+        KC_FILE_WATCH_DELETED);
+      ok(watch->watches == 0);
+
+      destroy_file(file);
+      destroy_file_watch(watch);
+    }
+
+    subtest("Recursive")
+    {
+      struct FileWatch* watch = new_file_watch(WATCH_DELAY);
+      struct WatchCheck check = {0};
+
+      mkdir("test_file_watch", 0777);
+      mkdir("test_file_watch/spool", 0777);
+
+      watch->add(watch, "test_file_watch", KC_FILE_WATCH_RECURSIVE);
+
+      // changes deep in the tree are reported with their full path
+      append_file("test_file_watch/spool/job", "1");
+
+      // directories created later are watched as well, with what they
+      // already hold when the watch is placed
+      mkdir("test_file_watch/spool/new", 0777);
+      append_file("test_file_watch/spool/new/job", "2");
+
+      while (check.count < 3 &&
+             watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check) ==
+               KC_FILE_SUCCESS && check.batches < 4)
+      {
+      }
+
+      ok(find_change(&check, "test_file_watch/spool/job") &
+        KC_FILE_WATCH_CREATED);
+      ok(find_change(&check, "test_file_watch/spool/new") &
+        KC_FILE_WATCH_CREATED);
+      ok(find_change(&check, "test_file_watch/spool/new/job") &
+        KC_FILE_WATCH_CREATED);
+      ok(watch->watches == 3);
+
+      // once the directory is there, its files are watched like any other
+      check = (struct WatchCheck){0};
+      append_file("test_file_watch/spool/new/job", "3");
+
+      ok(watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check) ==
+        KC_FILE_SUCCESS);
+      ok(check.count == 1);
+      ok(find_change(&check, "test_file_watch/spool/new/job") ==
+        KC_FILE_WATCH_MODIFIED);
+
+      unlink("test_file_watch/spool/new/job");
+      unlink("test_file_watch/spool/job");
+      rmdir("test_file_watch/spool/new");
+      rmdir("test_file_watch/spool");
+      rmdir("test_file_watch");
+
+      // every watch goes away with its directory
+      check = (struct WatchCheck){0};
+
+      watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check);
+
+      ok(watch->watches == 0);
+
+      destroy_file_watch(watch);
+    }
+
+    subtest("Rename")
+    {
+      struct FileWatch* watch = new_file_watch(WATCH_DELAY);
+      struct WatchCheck check = {0};
+
+      mkdir("test_file_watch", 0777);
+      mkdir("test_file_watch/x", 0777);
+      mkdir("test_file_watch/x/deep", 0777);
+
+      watch->add(watch, "test_file_watch", KC_FILE_WATCH_RECURSIVE);
+
+      ok(watch->watches == 3);
+
+      // a directory renamed in the tree is still watched under its new name
+      rename("test_file_watch/x", "test_file_watch/y");
+
+      // a lost watch reports nothing, the wait is bounded either way
+      for (int i = 0; i < 4 && check.count < 2; ++i)
+      {
+        watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check);
+      }
+
+      ok(find_change(&check, "test_file_watch/x") & KC_FILE_WATCH_DELETED);
+      ok(find_change(&check, "test_file_watch/y") & KC_FILE_WATCH_CREATED);
+      ok(watch->watches == 3);
+
+      check = (struct WatchCheck){0};
+      append_file("test_file_watch/y/f", "1");
+      append_file("test_file_watch/y/deep/f", "2");
+
+      for (int i = 0; i < 4 && check.count < 2; ++i)
+      {
+        watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check);
+      }
+
+      ok(find_change(&check, "test_file_watch/y/f") & KC_FILE_WATCH_CREATED);
+      ok(find_change(&check, "test_file_watch/y/deep/f") &
+        KC_FILE_WATCH_CREATED);
+
+      // moved out of the tree, its watches go away
+      rename("test_file_watch/y", "test_file_watch_moved");
+
+      check = (struct WatchCheck){0};
+
+      watch->dispatch(watch, WATCH_TIMEOUT, collect_changes, &check);
+
+      ok(find_change(&check, "test_file_watch/y") & KC_FILE_WATCH_DELETED);
+      ok(watch->watches == 1);
+
+      unlink("test_file_watch_moved/deep/f");
+      unlink("test_file_watch_moved/f");
+      rmdir("test_file_watch_moved/deep");
+      rmdir("test_file_watch_moved");
+      rmdir("test_file_watch");
+
+      destroy_file_watch(watch);
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}
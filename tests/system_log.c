@@ -0,0 +1,91 @@
+// This file is part of libkc_system
+// ==================================
+//
+// system_log.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/dir.h"
+#include "../include/file.h"
+#include "../include/system_log.h"
+
+#include <stdio.h>
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("SystemLog")
+  {
+    subtest("Shared Logger")
+    {
+      struct File* first  = new_file();
+      struct File* second = new_file();
+      struct Dir*  dir    = new_dir(0);
+
+      ok(first->log != NULL);
+      ok(first->log == second->log);
+      ok(first->log == get_system_log(KC_SYSTEM_LOG_FILE, __FILE__));
+      ok(dir->log != first->log);
+
+      // the logger outlives the files that use it
+      destroy_file(first);
+
+      struct File* third = new_file();
+
+      ok(third->log == second->log);
+
+      ok(get_system_log(KC_SYSTEM_LOG_MODULES, __FILE__) == NULL);
+
+      destroy_file(third);
+      destroy_file(second);
+      destroy_dir(dir);
+    }
+
+    subtest("Enable and Disable")
+    {
+      struct File* file = new_file();
+
+#ifdef KC_SYSTEM_LOG_DISABLED
+      ok(is_system_log_enabled() == false);
+#else
+      ok(is_system_log_enabled() == true);
+#endif
+
+      // the methods of an enabled logger are compared against
+      set_system_log(true);
+
+      void (*error)(struct ConsoleLog*, const int, const int, const char*) =
+        file->log->error;
+      void (*fatal)(struct ConsoleLog*, const int, const int, const char*) =
+        file->log->fatal;
+
+      set_system_log(false);
+
+      ok(is_system_log_enabled() == false);
+      ok(file->log->error != error);
+
+      // a fatal error still aborts, even when the logger is muted
+      ok(file->log->fatal == fatal);
+
+      // nothing is printed, the failure is still reported
+      int ret = file->open(file, "test_system_log_missing", KC_FILE_READ);
+
+      ok(ret == KC_FILE_INVALID);
+
+      set_system_log(true);
+
+      ok(is_system_log_enabled() == true);
+      ok(file->log->error == error);
+
+      destroy_file(file);
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}
@@ -0,0 +1,241 @@
+// This file is part of libkc_system
+// ==================================
+//
+// system_stats.c
+//
+// Copyright (c) 2024 Daniel Tanase
+// SPDX-License-Identifier: MIT License
+
+#define _GNU_SOURCE
+
+#include "../deps/libkc/logger/logger.h"
+#include "../deps/libkc/testing/testing.h"
+#include "../include/file.h"
+#include "../include/system_stats.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATS_THREADS                                                       4
+#define STATS_WRITES                                                      100
+
+//---------------------------------------------------------------------------//
+
+static void* write_records(void* context)
+{
+  struct File* file = new_file();
+  char         name[64];
+
+  snprintf(name, sizeof(name), "test_system_stats_%d", *(int*)context);
+
+  file->open(file, name, KC_FILE_CREATE_ALWAYS);
+
+  for (int i = 0; i < STATS_WRITES; ++i)
+  {
+    file->write_bytes(file, "0123456789", 10);
+  }
+
+  file->delete(file);
+  destroy_file(file);
+
+  return NULL;
+}
+
+//---------------------------------------------------------------------------//
+
+static bool is_empty(const struct SystemStats* stats)
+{
+  const uint64_t* counters = (const uint64_t*)stats;
+
+  for (size_t i = 0; i < sizeof(struct SystemStats) / sizeof(uint64_t); ++i)
+  {
+    if (counters[i] != 0)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+//---------------------------------------------------------------------------//
+
+int main()
+{
+  testgroup("SystemStats")
+  {
+    subtest("Percentiles")
+    {
+      struct SystemStatsCounter counter;
+
+      memset(&counter, 0, sizeof(counter));
+
+      ok(get_system_stats_percentile(&counter, 0.5) == 0);
+
+      // 90 calls between 2048 and 2559 ns, 10 between 65536 and 81919 ns
+      counter.histogram[40] = 90;
+      counter.histogram[60] = 10;
+
+      ok(get_system_stats_percentile(&counter, 0) == 2559);
+      ok(get_system_stats_percentile(&counter, 0.5) == 2559);
+      ok(get_system_stats_percentile(&counter, 0.9) == 2559);
+      ok(get_system_stats_percentile(&counter, 0.91) == 81919);
+      ok(get_system_stats_percentile(&counter, 1) == 81919);
+
+      // the first buckets hold a single value each
+      memset(&counter, 0, sizeof(counter));
+      counter.histogram[3] = 1;
+
+      ok(get_system_stats_percentile(&counter, 0.99) == 3);
+      ok(get_system_stats_percentile(NULL, 0.5) == 0);
+    }
+
+#ifdef KC_SYSTEM_STATS
+    subtest("Counters")
+    {
+      struct File*       file = new_file();
+      struct SystemStats before;
+      struct SystemStats after;
+      struct SystemStats local;
+      char*              content = NULL;
+
+      ok(is_system_stats_enabled() == true);
+      ok(file->stats != NULL);
+
+      // nothing was read or written before
+      get_system_stats(&before);
+      ok(is_empty(&before) == true);
+
+      file->open(file, "test_system_stats", KC_FILE_CREATE_ALWAYS);
+      file->write_bytes(file, "0123456789", 10);
+      file->write(file, "abcde");
+      file->flush(file);
+      file->sync(file);
+      file->close(file);
+
+      file->open(file, "test_system_stats", KC_FILE_READ);
+      file->read(file, &content);
+      file->close(file);
+
+      free(content);
+
+      // a file that is not there is counted as a failed open
+      ok(file->open(file, "test_system_stats_missing", KC_FILE_READ) !=
+        KC_FILE_SUCCESS);
+
+      get_system_stats(&after);
+
+      struct SystemStatsCounter* open  =
+        &after.operations[KC_SYSTEM_STATS_OPEN];
+      struct SystemStatsCounter* write =
+        &after.operations[KC_SYSTEM_STATS_WRITE];
+      struct SystemStatsCounter* read  =
+        &after.operations[KC_SYSTEM_STATS_READ];
+
+      ok(open->calls - before.operations[KC_SYSTEM_STATS_OPEN].calls == 3);
+      ok(open->errors - before.operations[KC_SYSTEM_STATS_OPEN].errors == 1);
+      ok(write->calls - before.operations[KC_SYSTEM_STATS_WRITE].calls == 2);
+      ok(write->bytes - before.operations[KC_SYSTEM_STATS_WRITE].bytes == 15);
+      ok(read->bytes - before.operations[KC_SYSTEM_STATS_READ].bytes == 15);
+      ok(after.operations[KC_SYSTEM_STATS_CLOSE].calls -
+        before.operations[KC_SYSTEM_STATS_CLOSE].calls == 2);
+      ok(after.operations[KC_SYSTEM_STATS_SYNC].calls -
+        before.operations[KC_SYSTEM_STATS_SYNC].calls == 1);
+
+      // flushes and syncs land in histograms of their own
+      ok(after.operations[KC_SYSTEM_STATS_FLUSH].calls -
+        before.operations[KC_SYSTEM_STATS_FLUSH].calls == 1);
+
+      // every call lands in one bucket of the histogram
+      uint64_t counted = 0;
+
+      for (int i = 0; i < KC_SYSTEM_STATS_BUCKETS; ++i)
+      {
+        counted += write->histogram[i];
+      }
+
+      ok(counted == write->calls);
+      ok(write->nanoseconds > 0);
+      ok(get_system_stats_percentile(write, 0.5) > 0);
+
+      // the File keeps the same counts on its own
+      ok(file->get_stats(file, &local) == KC_FILE_SUCCESS);
+      ok(local.operations[KC_SYSTEM_STATS_OPEN].calls == 3);
+      ok(local.operations[KC_SYSTEM_STATS_WRITE].bytes == 15);
+      ok(local.operations[KC_SYSTEM_STATS_READ].calls == 1);
+
+      ok(file->get_stats(file, NULL) == KC_NULL_REFERENCE);
+
+      remove("test_system_stats");
+      destroy_file(file);
+    }
+#else
+    subtest("Disabled")
+    {
+      struct File*       file = new_file();
+      struct SystemStats stats;
+
+      ok(is_system_stats_enabled() == false);
+      ok(file->stats == NULL);
+
+      file->open(file, "test_system_stats", KC_FILE_CREATE_ALWAYS);
+      file->write(file, "nothing is counted");
+      file->close(file);
+
+      // nothing was counted, neither globally nor for the File
+      get_system_stats(&stats);
+      ok(is_empty(&stats) == true);
+
+      ok(file->get_stats(file, &stats) == KC_FILE_SUCCESS);
+      ok(is_empty(&stats) == true);
+
+      ok(file->get_stats(file, NULL) == KC_NULL_REFERENCE);
+
+      remove("test_system_stats");
+      destroy_file(file);
+    }
+#endif
+
+    subtest("Threads")
+    {
+      pthread_t          threads[STATS_THREADS];
+      int                indexes[STATS_THREADS];
+      struct SystemStats before;
+      struct SystemStats after;
+
+      get_system_stats(&before);
+
+      for (int i = 0; i < STATS_THREADS; ++i)
+      {
+        indexes[i] = i;
+        pthread_create(&threads[i], NULL, write_records, &indexes[i]);
+      }
+
+      for (int i = 0; i < STATS_THREADS; ++i)
+      {
+        pthread_join(threads[i], NULL);
+      }
+
+      // the slots of the threads that exited are still added up
+      get_system_stats(&after);
+
+      uint64_t counted = is_system_stats_enabled() == true ? 1 : 0;
+
+      ok(after.operations[KC_SYSTEM_STATS_WRITE].calls -
+        before.operations[KC_SYSTEM_STATS_WRITE].calls ==
+        counted * STATS_THREADS * STATS_WRITES);
+      ok(after.operations[KC_SYSTEM_STATS_WRITE].bytes -
+        before.operations[KC_SYSTEM_STATS_WRITE].bytes ==
+        counted * STATS_THREADS * STATS_WRITES * 10);
+      ok(after.operations[KC_SYSTEM_STATS_OPEN].calls -
+        before.operations[KC_SYSTEM_STATS_OPEN].calls ==
+        counted * STATS_THREADS);
+    }
+
+    done_testing();
+  }
+
+  return 0;
+}